@@ -0,0 +1,247 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/**
+ * @file wzprofile.cpp
+ *
+ * Recording of scoped timers and counters, and writing them as Chrome trace events.
+ */
+
+#include "frame.h"
+#include "wzprofile.h"
+
+#ifdef WZ_PROFILING
+
+#include "wzapp.h"
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <string.h>
+#include <vector>
+
+#define PROFILE_MAX_EVENTS (1 << 21)  ///< Timers kept for the trace file, about 64MiB. Histograms are still collected afterwards.
+#define PROFILE_BUCKETS 32            ///< Bucket 0 counts zeros, bucket i counts values in [2^(i-1), 2^i).
+
+std::atomic<bool> wzProfileEnabled(false);
+
+namespace
+{
+
+struct ScopeEvent
+{
+	const char *name;
+	uint64_t start, end;
+	int thread;
+};
+
+struct CounterSample
+{
+	const char *name;
+	uint64_t time;
+	int64_t value;
+};
+
+struct Histogram
+{
+	unsigned ticks = 0;     ///< Ticks in which the timer or counter was used.
+	uint64_t total = 0;
+	uint64_t max = 0;
+	unsigned buckets[PROFILE_BUCKETS] = {};
+};
+
+struct NameLess
+{
+	bool operator ()(const char *a, const char *b) const
+	{
+		return strcmp(a, b) < 0;  // Equal string literals might not have the same address in different files.
+	}
+};
+
+}
+
+static wz::mutex profileMutex;
+static std::string profileFilename;
+static std::chrono::steady_clock::time_point profileStartTime;
+static std::vector<ScopeEvent> profileEvents;
+static std::vector<CounterSample> profileCounterSamples;
+static std::map<const char *, uint64_t, NameLess> tickTimes;   ///< Nanoseconds per timer in the current tick.
+static std::map<const char *, int64_t, NameLess> tickCounts;   ///< Counts in the current tick.
+static std::map<const char *, Histogram, NameLess> timeHistograms;   ///< Of microseconds per tick.
+static std::map<const char *, Histogram, NameLess> countHistograms;
+static unsigned profileTicks = 0;
+static std::atomic<int> nextThreadIndex(1);
+static thread_local int threadIndex = -1;
+
+uint64_t wzProfileNow()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profileStartTime).count() + 1;
+}
+
+static void addToHistogram(Histogram &histogram, uint64_t value)
+{
+	unsigned bucket = 0;
+	for (uint64_t v = value; v != 0 && bucket < PROFILE_BUCKETS - 1; v >>= 1)
+	{
+		++bucket;
+	}
+	++histogram.ticks;
+	histogram.total += value;
+	histogram.max = std::max(histogram.max, value);
+	++histogram.buckets[bucket];
+}
+
+void wzProfileAddScope(const char *name, uint64_t start, uint64_t end)
+{
+	if (threadIndex < 0)
+	{
+		threadIndex = nextThreadIndex++;
+	}
+
+	std::lock_guard<wz::mutex> lock(profileMutex);
+	if (!wzProfileEnabled)
+	{
+		return;  // Stopped while timing.
+	}
+	tickTimes[name] += end - start;
+	if (profileEvents.size() < PROFILE_MAX_EVENTS)
+	{
+		profileEvents.push_back({name, start, end, threadIndex});
+		if (profileEvents.size() == PROFILE_MAX_EVENTS)
+		{
+			debug(LOG_WARNING, "Recorded %d profiling timers, only collecting histograms from now on", PROFILE_MAX_EVENTS);
+		}
+	}
+}
+
+void wzProfileAddCount(const char *name, int64_t count)
+{
+	std::lock_guard<wz::mutex> lock(profileMutex);
+	if (!wzProfileEnabled)
+	{
+		return;
+	}
+	tickCounts[name] += count;
+}
+
+void wzProfileEndTick()
+{
+	uint64_t now = wzProfileNow();
+
+	std::lock_guard<wz::mutex> lock(profileMutex);
+	for (auto const &time : tickTimes)
+	{
+		addToHistogram(timeHistograms[time.first], time.second / 1000);
+	}
+	for (auto const &count : tickCounts)
+	{
+		addToHistogram(countHistograms[count.first], std::max<int64_t>(count.second, 0));
+		profileCounterSamples.push_back({count.first, now, count.second});
+	}
+	tickTimes.clear();
+	tickCounts.clear();
+	++profileTicks;
+}
+
+void wzProfileStart(const char *filename)
+{
+	std::lock_guard<wz::mutex> lock(profileMutex);
+	profileFilename = filename;
+	profileStartTime = std::chrono::steady_clock::now();
+	threadIndex = 0;
+	wzProfileEnabled = true;
+	debug(LOG_INFO, "Profiling, writing to \"%s\" on exit", filename);
+}
+
+static void writeHistograms(FILE *file, const char *key, std::map<const char *, Histogram, NameLess> const &histograms)
+{
+	fprintf(file, "\t\"%s\": {", key);
+	const char *separator = "\n";
+	for (auto const &entry : histograms)
+	{
+		Histogram const &histogram = entry.second;
+		unsigned numBuckets = PROFILE_BUCKETS;
+		while (numBuckets > 1 && histogram.buckets[numBuckets - 1] == 0)
+		{
+			--numBuckets;
+		}
+		fprintf(file, "%s\t\t\"%s\": {\"ticks\": %u, \"total\": %llu, \"max\": %llu, \"buckets\": [", separator, entry.first, histogram.ticks,
+		        (unsigned long long)histogram.total, (unsigned long long)histogram.max);
+		for (unsigned i = 0; i < numBuckets; ++i)
+		{
+			fprintf(file, "%s%u", i != 0 ? ", " : "", histogram.buckets[i]);
+		}
+		fprintf(file, "]}");
+		separator = ",\n";
+	}
+	fprintf(file, "\n\t}");
+}
+
+void wzProfileShutdown()
+{
+	if (!wzProfileEnabled)
+	{
+		return;
+	}
+
+	std::lock_guard<wz::mutex> lock(profileMutex);
+	wzProfileEnabled = false;
+
+	FILE *file = fopen(profileFilename.c_str(), "w");
+	ASSERT_OR_RETURN(, file != nullptr, "Could not open \"%s\" for writing the profile", profileFilename.c_str());
+
+	// Names are string literals in the code, so they need no escaping.
+	fprintf(file, "{\n\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [\n");
+	fprintf(file, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 0, \"args\": {\"name\": \"main\"}}");
+	for (ScopeEvent const &event : profileEvents)
+	{
+		fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f}",
+		        event.name, event.thread, event.start / 1000., (event.end - event.start) / 1000.);
+	}
+	for (CounterSample const &sample : profileCounterSamples)
+	{
+		fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"tid\": 0, \"ts\": %.3f, \"args\": {\"value\": %lld}}",
+		        sample.name, sample.time / 1000., (long long)sample.value);
+	}
+	fprintf(file, "\n],\n");
+
+	// Bucket 0 counts ticks with a total of 0, bucket i counts ticks with a total in [2^(i-1), 2^i).
+	fprintf(file, "\"tickHistograms\": {\n\t\"ticks\": %u,\n", profileTicks);
+	writeHistograms(file, "timersUs", timeHistograms);
+	fprintf(file, ",\n");
+	writeHistograms(file, "counters", countHistograms);
+	fprintf(file, "\n}\n}\n");
+	fclose(file);
+
+	debug(LOG_INFO, "Wrote %zu timers over %u ticks to \"%s\"", profileEvents.size(), profileTicks, profileFilename.c_str());
+	profileEvents.clear();
+	profileCounterSamples.clear();
+}
+
+#else
+
+void wzProfileStart(const char *filename)
+{
+	debug(LOG_WARNING, "Not profiling to \"%s\", since built without WZ_PROFILING (cmake -DWZ_ENABLE_PROFILING=ON)", filename);
+}
+
+void wzProfileShutdown()
+{
+}
+
+#endif // WZ_PROFILING
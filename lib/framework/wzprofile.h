@@ -0,0 +1,87 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/** @file
+ *  Scoped timers and counters for profiling the game loop.
+ *
+ *  Only compiled in when WZ_PROFILING is defined (cmake -DWZ_ENABLE_PROFILING=ON), otherwise the macros expand to
+ *  nothing. When compiled in, nothing is recorded until wzProfileStart() is called (--profile=<file>).
+ *
+ *  WZ_PROFILE_SCOPE(name) times the rest of the enclosing scope, WZ_PROFILE_COUNT(name, n) adds n to a counter, and
+ *  WZ_PROFILE_TICK() ends a game tick. The name must be a string literal. Timers and counters may be used from any
+ *  thread. For each name, the total time or count per tick is collected in a histogram, and on wzProfileShutdown()
+ *  all timers, per-tick counters and histograms are written as a Chrome trace event file, which can be opened in
+ *  chrome://tracing or https://ui.perfetto.dev.
+ */
+
+#ifndef __INCLUDED_LIB_FRAMEWORK_WZPROFILE_H__
+#define __INCLUDED_LIB_FRAMEWORK_WZPROFILE_H__
+
+#include <stdint.h>
+
+/// Start recording, to write to filename on wzProfileShutdown(). Call from main thread.
+void wzProfileStart(const char *filename);
+/// Stop recording and write the trace file, if wzProfileStart() was called. Call from main thread.
+void wzProfileShutdown();
+
+#ifdef WZ_PROFILING
+
+#include <atomic>
+
+extern std::atomic<bool> wzProfileEnabled;
+
+uint64_t wzProfileNow();
+void wzProfileAddScope(const char *name, uint64_t start, uint64_t end);
+void wzProfileAddCount(const char *name, int64_t count);
+void wzProfileEndTick();
+
+class WzProfileScope
+{
+public:
+	explicit WzProfileScope(const char *name_) : name(name_), start(wzProfileEnabled.load(std::memory_order_relaxed) ? wzProfileNow() : 0) {}
+	~WzProfileScope()
+	{
+		if (start != 0)
+		{
+			wzProfileAddScope(name, start, wzProfileNow());
+		}
+	}
+
+	WzProfileScope(WzProfileScope const &) = delete;
+	WzProfileScope &operator =(WzProfileScope const &) = delete;
+
+private:
+	const char *name;
+	uint64_t start;  ///< Nanoseconds since wzProfileStart(), plus one. 0 if not recording.
+};
+
+#define WZ_PROFILE_CONCAT_(a, b) a##b
+#define WZ_PROFILE_CONCAT(a, b) WZ_PROFILE_CONCAT_(a, b)
+#define WZ_PROFILE_SCOPE(name) WzProfileScope WZ_PROFILE_CONCAT(wzProfileScope, __LINE__)(name)
+#define WZ_PROFILE_COUNT(name, n) do { if (wzProfileEnabled.load(std::memory_order_relaxed)) { wzProfileAddCount(name, n); } } while (0)
+#define WZ_PROFILE_TICK() do { if (wzProfileEnabled.load(std::memory_order_relaxed)) { wzProfileEndTick(); } } while (0)
+
+#else
+
+#define WZ_PROFILE_SCOPE(name) do {} while (0)
+#define WZ_PROFILE_COUNT(name, n) do {} while (0)
+#define WZ_PROFILE_TICK() do {} while (0)
+
+#endif // WZ_PROFILING
+
+#endif // __INCLUDED_LIB_FRAMEWORK_WZPROFILE_H__
@@ -42,6 +42,9 @@ float graphicsTimeFraction = 0.0, realTimeFraction = 0.0;
 /** The current clock modifier. Set to speed up the game. */
 static Rational modifier;
 
+/** Whether to tick as soon as possible, see gameTimeSetFastForward. */
+static bool fastForward = false;
+
 /// The real time, the last time graphicsTime updated.
 static uint32_t prevRealTime;
 
@@ -169,7 +172,16 @@ void gameTimeUpdate(bool mayUpdate)
 	}
 
 	// Calculate the new game time
-	int newDeltaGraphicsTime = quantiseFraction(modifier.n, modifier.d, currTime, prevRealTime);
+	int newDeltaGraphicsTime;
+	if (fastForward)
+	{
+		// Tick if allowed to, otherwise show the latest game state.
+		newDeltaGraphicsTime = gameTime + (mayUpdate ? 1 : 0) - graphicsTime;
+	}
+	else
+	{
+		newDeltaGraphicsTime = quantiseFraction(modifier.n, modifier.d, currTime, prevRealTime);
+	}
 	ASSERT(newDeltaGraphicsTime >= 0, "Something very wrong.");
 
 	uint32_t newGraphicsTime = graphicsTime + newDeltaGraphicsTime;
@@ -275,6 +287,17 @@ Rational gameTimeGetMod()
 	return modifier;
 }
 
+void gameTimeSetFastForward(bool enable)
+{
+	fastForward = enable;
+	prevRealTime = wzGetTicks();
+}
+
+bool gameTimeFastForward()
+{
+	return fastForward;
+}
+
 bool gameTimeIsStopped(void)
 {
 	return stopCount != 0;
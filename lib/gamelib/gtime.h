@@ -99,6 +99,13 @@ void gameTimeSetMod(Rational mod);
 /** Get the current time modifier. */
 Rational gameTimeGetMod();
 
+/** Tick the game time whenever gameTimeUpdate may update, instead of following the wall clock, and keep graphicsTime
+ *  at gameTime otherwise. The time modifier is ignored while enabled. Used to run games as fast as possible. */
+void gameTimeSetFastForward(bool enable);
+
+/** Returns true if gameTimeSetFastForward is enabled. */
+bool gameTimeFastForward();
+
 /**
  * Returns the game time, modulo the time period, scaled to 0..requiredRange.
  * For instance getModularScaledGameTime(4096,256) will return a number that cycles through the values
@@ -0,0 +1,471 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/**
+ * @file netcompress.cpp
+ *
+ * Streaming compression of the data sent over game sockets.
+ */
+#include "lib/framework/frame.h"
+#include "netcompress.h"
+
+#include "lib/framework/math_ext.h"
+
+#include <algorithm>
+
+#if !defined(ZLIB_CONST)
+#  define ZLIB_CONST
+#endif
+#include <zlib.h>
+#if defined(WZ_HAVE_LZ4)
+# include <lz4frame.h>
+#endif
+#if defined(WZ_HAVE_ZSTD)
+# include <zstd.h>
+# if ZSTD_VERSION_NUMBER < 10400  // Too old for ZSTD_compressStream2, so just use the other codecs.
+#  undef WZ_HAVE_ZSTD
+# endif
+#endif
+
+// zlib, exactly as sent by older versions.
+
+static void zlibInput(z_stream &stream, const uint8_t *data, size_t size)
+{
+#if ZLIB_VERNUM < 0x1252
+	// zlib < 1.2.5.2 does not support `#define ZLIB_CONST`
+	// Unfortunately, some OSes (ex. OpenBSD) ship with zlib < 1.2.5.2
+	// Workaround: cast away the const of the input, and disable the resulting -Wcast-qual warning
+	#if defined(__clang__)
+	#  pragma clang diagnostic push
+	#  pragma clang diagnostic ignored "-Wcast-qual"
+	#elif defined(__GNUC__)
+	#  pragma GCC diagnostic push
+	#  pragma GCC diagnostic ignored "-Wcast-qual"
+	#endif
+
+	// cast away the const for earlier zlib versions
+	stream.next_in = (Bytef *)data; // -Wcast-qual
+
+	#if defined(__clang__)
+	#  pragma clang diagnostic pop
+	#elif defined(__GNUC__)
+	#  pragma GCC diagnostic pop
+	#endif
+#else
+	// zlib >= 1.2.5.2 supports ZLIB_CONST
+	stream.next_in = (const Bytef *)data;
+#endif
+	stream.avail_in = size;
+}
+
+class ZlibCompressor : public WireCompressor
+{
+public:
+	ZlibCompressor(int level)
+	{
+		memset(&stream, 0, sizeof(stream));
+		int ret = deflateInit(&stream, level);
+		ASSERT(ret == Z_OK, "deflateInit failed! Sockets won't work.");
+	}
+
+	~ZlibCompressor() override
+	{
+		deflateEnd(&stream);
+	}
+
+	void compress(const uint8_t *data, size_t size, std::vector<uint8_t> &out) override
+	{
+		zlibInput(stream, data, size);
+		do
+		{
+			size_t alreadyHave = out.size();
+			out.resize(alreadyHave + size + 20);  // A bit more than size should be enough to always do everything in one go.
+			stream.next_out = (Bytef *)&out[alreadyHave];
+			stream.avail_out = out.size() - alreadyHave;
+
+			int ret = deflate(&stream, Z_NO_FLUSH);
+			ASSERT(ret != Z_STREAM_ERROR, "zlib compression failed!");
+
+			// Remove unused part of buffer.
+			out.resize(out.size() - stream.avail_out);
+		}
+		while (stream.avail_out == 0);
+
+		ASSERT(stream.avail_in == 0, "zlib didn't compress everything!");
+	}
+
+	void flush(std::vector<uint8_t> &out) override
+	{
+		do
+		{
+			zlibInput(stream, nullptr, 0);
+			size_t alreadyHave = out.size();
+			out.resize(alreadyHave + 1000);  // 100 bytes would probably be enough to flush the rest in one go.
+			stream.next_out = (Bytef *)&out[alreadyHave];
+			stream.avail_out = out.size() - alreadyHave;
+
+			int ret = deflate(&stream, Z_PARTIAL_FLUSH);
+			ASSERT(ret != Z_STREAM_ERROR, "zlib compression failed!");
+
+			// Remove unused part of buffer.
+			out.resize(out.size() - stream.avail_out);
+		}
+		while (stream.avail_out == 0);
+	}
+
+private:
+	z_stream stream;
+};
+
+class ZlibDecompressor : public WireDecompressor
+{
+public:
+	ZlibDecompressor() : needMore(true)
+	{
+		memset(&stream, 0, sizeof(stream));
+		int ret = inflateInit(&stream);
+		ASSERT(ret == Z_OK, "inflateInit failed! Sockets won't work.");
+	}
+
+	~ZlibDecompressor() override
+	{
+		inflateEnd(&stream);
+	}
+
+	void input(const uint8_t *data, size_t size) override
+	{
+		zlibInput(stream, data, size);
+		needMore = size == 0;
+	}
+
+	ssize_t decompress(uint8_t *buf, size_t maxSize) override
+	{
+		stream.next_out = (Bytef *)buf;
+		stream.avail_out = maxSize;
+		int ret = inflate(&stream, Z_NO_FLUSH);
+		ASSERT(ret != Z_STREAM_ERROR, "zlib inflate not working!");
+		char const *err = nullptr;
+		switch (ret)
+		{
+		case Z_NEED_DICT:  err = "Z_NEED_DICT";  break;
+		case Z_DATA_ERROR: err = "Z_DATA_ERROR"; break;
+		case Z_MEM_ERROR:  err = "Z_MEM_ERROR";  break;
+		}
+		if (err != nullptr)
+		{
+			debug(LOG_ERROR, "Couldn't decompress data from socket. zlib error %s", err);
+			return -1;  // Bad data!
+		}
+
+		if (stream.avail_out != 0)
+		{
+			needMore = true;
+			ASSERT(stream.avail_in == 0, "zlib not consuming all input!");
+		}
+
+		return maxSize - stream.avail_out;  // Got some data, return how much.
+	}
+
+	bool needInput() const override
+	{
+		return needMore;
+	}
+
+private:
+	z_stream stream;
+	bool needMore;
+};
+
+#if defined(WZ_HAVE_LZ4)
+// LZ4 frames, with linked blocks so that each flushed block can refer back to the previous ones.
+
+class Lz4Compressor : public WireCompressor
+{
+public:
+	Lz4Compressor(int level) : started(false)
+	{
+		LZ4F_errorCode_t ret = LZ4F_createCompressionContext(&context, LZ4F_VERSION);
+		ASSERT(!LZ4F_isError(ret), "LZ4F_createCompressionContext failed: %s", LZ4F_getErrorName(ret));
+		memset(&prefs, 0, sizeof(prefs));
+		prefs.frameInfo.blockMode = LZ4F_blockLinked;
+		prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+		prefs.compressionLevel = level;
+	}
+
+	~Lz4Compressor() override
+	{
+		LZ4F_freeCompressionContext(context);
+	}
+
+	void compress(const uint8_t *data, size_t size, std::vector<uint8_t> &out) override
+	{
+		begin(out);
+		scratch.resize(std::max(scratch.size(), LZ4F_compressBound(size, &prefs)));  // Only grows, so isn't cleared each time.
+		size_t ret = LZ4F_compressUpdate(context, scratch.data(), scratch.size(), data, size, nullptr);
+		append(ret, out);
+	}
+
+	void flush(std::vector<uint8_t> &out) override
+	{
+		begin(out);
+		scratch.resize(std::max(scratch.size(), LZ4F_compressBound(0, &prefs)));
+		size_t ret = LZ4F_flush(context, scratch.data(), scratch.size(), nullptr);
+		append(ret, out);
+	}
+
+private:
+	void begin(std::vector<uint8_t> &out)
+	{
+		if (started)
+		{
+			return;
+		}
+		started = true;
+		scratch.resize(std::max<size_t>(scratch.size(), LZ4F_HEADER_SIZE_MAX));
+		size_t ret = LZ4F_compressBegin(context, scratch.data(), scratch.size(), &prefs);
+		append(ret, out);
+	}
+
+	void append(size_t ret, std::vector<uint8_t> &out)
+	{
+		ASSERT_OR_RETURN(, !LZ4F_isError(ret), "lz4 compression failed: %s", LZ4F_getErrorName(ret));
+		out.insert(out.end(), scratch.begin(), scratch.begin() + ret);
+	}
+
+	LZ4F_compressionContext_t context;
+	LZ4F_preferences_t prefs;
+	bool started;                  ///< True once the frame header has been written.
+	std::vector<uint8_t> scratch;  ///< LZ4F needs room for a whole block, which is more than what it usually writes.
+};
+
+class Lz4Decompressor : public WireDecompressor
+{
+public:
+	Lz4Decompressor() : in(nullptr), inSize(0), needMore(true)
+	{
+		LZ4F_errorCode_t ret = LZ4F_createDecompressionContext(&context, LZ4F_VERSION);
+		ASSERT(!LZ4F_isError(ret), "LZ4F_createDecompressionContext failed: %s", LZ4F_getErrorName(ret));
+	}
+
+	~Lz4Decompressor() override
+	{
+		LZ4F_freeDecompressionContext(context);
+	}
+
+	void input(const uint8_t *data, size_t size) override
+	{
+		in = data;
+		inSize = size;
+		needMore = size == 0;
+	}
+
+	ssize_t decompress(uint8_t *buf, size_t maxSize) override
+	{
+		size_t outSize = maxSize;
+		size_t inUsed = inSize;
+		size_t ret = LZ4F_decompress(context, buf, &outSize, in, &inUsed, nullptr);
+		if (LZ4F_isError(ret))
+		{
+			debug(LOG_ERROR, "Couldn't decompress data from socket. lz4 error %s", LZ4F_getErrorName(ret));
+			return -1;  // Bad data!
+		}
+		in += inUsed;
+		inSize -= inUsed;
+		needMore = inSize == 0 && outSize < maxSize;
+		return outSize;
+	}
+
+	bool needInput() const override
+	{
+		return needMore;
+	}
+
+private:
+	LZ4F_decompressionContext_t context;
+	const uint8_t *in;
+	size_t inSize;
+	bool needMore;
+};
+#endif
+
+#if defined(WZ_HAVE_ZSTD)
+// A single endless zstd frame, flushed after each batch of messages.
+
+class ZstdCompressor : public WireCompressor
+{
+public:
+	ZstdCompressor(int level) : context(ZSTD_createCCtx()), scratch(ZSTD_CStreamOutSize())
+	{
+		ZSTD_CCtx_setParameter(context, ZSTD_c_compressionLevel, level);
+	}
+
+	~ZstdCompressor() override
+	{
+		ZSTD_freeCCtx(context);
+	}
+
+	void compress(const uint8_t *data, size_t size, std::vector<uint8_t> &out) override
+	{
+		run(data, size, ZSTD_e_continue, out);
+	}
+
+	void flush(std::vector<uint8_t> &out) override
+	{
+		run(nullptr, 0, ZSTD_e_flush, out);
+	}
+
+private:
+	void run(const uint8_t *data, size_t size, ZSTD_EndDirective mode, std::vector<uint8_t> &out)
+	{
+		ZSTD_inBuffer in = {data, size, 0};
+		size_t remaining;
+		do
+		{
+			ZSTD_outBuffer buffer = {scratch.data(), scratch.size(), 0};
+			remaining = ZSTD_compressStream2(context, &buffer, &in, mode);
+			ASSERT_OR_RETURN(, !ZSTD_isError(remaining), "zstd compression failed: %s", ZSTD_getErrorName(remaining));
+			out.insert(out.end(), scratch.begin(), scratch.begin() + buffer.pos);
+		}
+		while (mode == ZSTD_e_flush ? remaining != 0 : in.pos != in.size);
+	}
+
+	ZSTD_CCtx *context;
+	std::vector<uint8_t> scratch;
+};
+
+class ZstdDecompressor : public WireDecompressor
+{
+public:
+	ZstdDecompressor() : context(ZSTD_createDCtx()), needMore(true)
+	{
+		in = {nullptr, 0, 0};
+	}
+
+	~ZstdDecompressor() override
+	{
+		ZSTD_freeDCtx(context);
+	}
+
+	void input(const uint8_t *data, size_t size) override
+	{
+		in = {data, size, 0};
+		needMore = size == 0;
+	}
+
+	ssize_t decompress(uint8_t *buf, size_t maxSize) override
+	{
+		ZSTD_outBuffer out = {buf, maxSize, 0};
+		size_t ret = ZSTD_decompressStream(context, &out, &in);
+		if (ZSTD_isError(ret))
+		{
+			debug(LOG_ERROR, "Couldn't decompress data from socket. zstd error %s", ZSTD_getErrorName(ret));
+			return -1;  // Bad data!
+		}
+		needMore = in.pos == in.size && out.pos < out.size;
+		return out.pos;
+	}
+
+	bool needInput() const override
+	{
+		return needMore;
+	}
+
+private:
+	ZSTD_DCtx *context;
+	ZSTD_inBuffer in;
+	bool needMore;
+};
+#endif
+
+static const char *const wireCompressionNames[WIRE_COMPRESSION_COUNT] = {"zlib", "lz4", "zstd"};
+
+const char *wireCompressionName(WireCompression codec)
+{
+	return codec < WIRE_COMPRESSION_COUNT ? wireCompressionNames[codec] : "unknown";
+}
+
+bool wireCompressionFromName(const char *name, WireCompression &codec)
+{
+	for (int i = 0; i < WIRE_COMPRESSION_COUNT; ++i)
+	{
+		if (strcmp(name, wireCompressionNames[i]) == 0)
+		{
+			codec = (WireCompression)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t wireCompressionSupported()
+{
+	uint32_t supported = 1 << WIRE_COMPRESSION_ZLIB;
+#if defined(WZ_HAVE_LZ4)
+	supported |= 1 << WIRE_COMPRESSION_LZ4;
+#endif
+#if defined(WZ_HAVE_ZSTD)
+	supported |= 1 << WIRE_COMPRESSION_ZSTD;
+#endif
+	return supported;
+}
+
+int wireCompressionDefaultLevel(WireCompression codec)
+{
+	switch (codec)
+	{
+	case WIRE_COMPRESSION_LZ4:  return 0;  // Plain LZ4. Levels above 2 use LZ4HC.
+	case WIRE_COMPRESSION_ZSTD: return 3;
+	default:                    return 6;
+	}
+}
+
+std::unique_ptr<WireCompressor> makeWireCompressor(WireCompression codec, int level)
+{
+	switch (codec)
+	{
+#if defined(WZ_HAVE_LZ4)
+	case WIRE_COMPRESSION_LZ4:
+		return std::unique_ptr<WireCompressor>(new Lz4Compressor(clip(level, 0, 12)));
+#endif
+#if defined(WZ_HAVE_ZSTD)
+	case WIRE_COMPRESSION_ZSTD:
+		return std::unique_ptr<WireCompressor>(new ZstdCompressor(clip(level, 1, 19)));
+#endif
+	default:
+		ASSERT(codec == WIRE_COMPRESSION_ZLIB, "Compression %s not supported, using zlib.", wireCompressionName(codec));
+		return std::unique_ptr<WireCompressor>(new ZlibCompressor(clip(level, 1, 9)));
+	}
+}
+
+std::unique_ptr<WireDecompressor> makeWireDecompressor(WireCompression codec)
+{
+	switch (codec)
+	{
+#if defined(WZ_HAVE_LZ4)
+	case WIRE_COMPRESSION_LZ4:
+		return std::unique_ptr<WireDecompressor>(new Lz4Decompressor);
+#endif
+#if defined(WZ_HAVE_ZSTD)
+	case WIRE_COMPRESSION_ZSTD:
+		return std::unique_ptr<WireDecompressor>(new ZstdDecompressor);
+#endif
+	default:
+		ASSERT(codec == WIRE_COMPRESSION_ZLIB, "Compression %s not supported, using zlib.", wireCompressionName(codec));
+		return std::unique_ptr<WireDecompressor>(new ZlibDecompressor);
+	}
+}
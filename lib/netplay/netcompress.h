@@ -0,0 +1,66 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/**
+ * @file netcompress.h
+ *
+ * Streaming compression of the data sent over game sockets.
+ */
+#ifndef _NET_COMPRESS_H_
+#define _NET_COMPRESS_H_
+
+#include "lib/framework/types.h"
+#include <memory>
+#include <vector>
+
+/// Compression codecs for game sockets. The values are sent in the join handshake, so don't renumber them.
+enum WireCompression
+{
+	WIRE_COMPRESSION_ZLIB = 0,  ///< Always available, and the only codec of older versions.
+	WIRE_COMPRESSION_LZ4  = 1,  ///< Much less CPU than zlib, for somewhat more bandwidth.
+	WIRE_COMPRESSION_ZSTD = 2,  ///< Usually both smaller and faster than zlib.
+	WIRE_COMPRESSION_COUNT
+};
+
+/// Compresses the data sent over a socket, as one continuous stream.
+class WireCompressor
+{
+public:
+	virtual ~WireCompressor() = default;
+	virtual void compress(const uint8_t *data, size_t size, std::vector<uint8_t> &out) = 0;  ///< Appends compressed data to out. Some of it may only appear after flush().
+	virtual void flush(std::vector<uint8_t> &out) = 0;                                       ///< Appends the rest of the compressed data to out, so the other end can decompress everything so far.
+};
+
+/// Decompresses the data received from a socket.
+class WireDecompressor
+{
+public:
+	virtual ~WireDecompressor() = default;
+	virtual void input(const uint8_t *data, size_t size) = 0;  ///< Gives compressed data from the socket. Only call when needInput() is true.
+	virtual ssize_t decompress(uint8_t *buf, size_t maxSize) = 0;  ///< Decompresses up to maxSize bytes into buf. Returns the number of bytes, or -1 if the data is bad.
+	virtual bool needInput() const = 0;                       ///< Returns true if all the input has been decompressed.
+};
+
+const char *wireCompressionName(WireCompression codec);
+bool wireCompressionFromName(const char *name, WireCompression &codec);  ///< Returns false if name isn't a codec.
+uint32_t wireCompressionSupported();                         ///< Returns a bitmask of the codecs this build supports, 1 << WireCompression.
+int wireCompressionDefaultLevel(WireCompression codec);
+std::unique_ptr<WireCompressor> makeWireCompressor(WireCompression codec, int level);  ///< level is clamped to what the codec supports.
+std::unique_ptr<WireDecompressor> makeWireDecompressor(WireCompression codec);
+
+#endif //_NET_COMPRESS_H_
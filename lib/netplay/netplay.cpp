@@ -28,6 +28,7 @@
 #include "lib/framework/string_ext.h"
 #include "lib/framework/crc.h"
 #include "lib/framework/file.h"
+#include "lib/framework/wzprofile.h"
 #include "lib/gamelib/gtime.h"
 #include "lib/exceptionhandler/dumpinfo.h"
 #include "src/console.h"
@@ -45,6 +46,7 @@
 
 #include "netplay.h"
 #include "netlog.h"
+#include "netreplay.h"
 #include "netsocket.h"
 
 #include <miniupnpc/miniwget.h>
@@ -84,6 +86,8 @@
 char masterserver_name[255] = {'\0'};
 static unsigned int masterserver_port = 0, gameserver_port = 0;
 static bool bJoinPrefTryIPv6First = true;
+static WireCompression wireCompression = WIRE_COMPRESSION_ZLIB;
+static int wireCompressionLevel = wireCompressionDefaultLevel(WIRE_COMPRESSION_ZLIB);
 
 // This is for command line argument override
 // Disables port saving and reading from/to config
@@ -134,6 +138,9 @@ struct NETSTATS  // data regarding the last one second or so.
 	Statistic       rawBytes;               // Number of actual bytes, in about 1 sec.
 	Statistic       uncompressedBytes;      // Number of bytes sent, before compression, in about 1 sec.
 	Statistic       packets;                // Number of calls to writeAll, in about 1 sec.
+	Statistic       codecRawBytes[WIRE_COMPRESSION_COUNT];           // Compressed bytes, per codec.
+	Statistic       codecUncompressedBytes[WIRE_COMPRESSION_COUNT];  // Bytes before compression, per codec.
+	Statistic       codecMicroseconds[WIRE_COMPRESSION_COUNT];       // CPU time spent compressing and decompressing, per codec.
 };
 
 struct NET_PLAYER_DATA
@@ -226,10 +233,10 @@ static SocketSet *tmp_socket_set = nullptr;
 static int32_t          NetGameFlags[4] = { 0, 0, 0, 0 };
 char iptoconnect[PATH_MAX] = "\0"; // holds IP/hostname from command line
 
-static NETSTATS nStats              = {{0, 0}, {0, 0}, {0, 0}};
-static NETSTATS nStatsLastSec       = {{0, 0}, {0, 0}, {0, 0}};
-static NETSTATS nStatsSecondLastSec = {{0, 0}, {0, 0}, {0, 0}};
-static const NETSTATS nZeroStats    = {{0, 0}, {0, 0}, {0, 0}};
+static NETSTATS nStats              = {};
+static NETSTATS nStatsLastSec       = {};
+static NETSTATS nStatsSecondLastSec = {};
+static const NETSTATS nZeroStats    = {};
 static int nStatsLastUpdateTime = 0;
 
 unsigned NET_PlayerConnectionStatus[CONNECTIONSTATUS_NORMAL][MAX_PLAYERS];
@@ -1341,6 +1348,7 @@ int NETshutdown()
 	nStats = nZeroStats;
 	nStatsLastSec = nZeroStats;
 	nStatsSecondLastSec = nZeroStats;
+	socketResetCompressionStatistics();
 
 	return 0;
 }
@@ -1428,18 +1436,32 @@ int NETclose()
 
 // ////////////////////////////////////////////////////////////////////////
 // return bytes of data sent recently.
-size_t NETgetStatistic(NetStatisticType type, bool sent, bool isTotal)
+size_t NETgetStatistic(NetStatisticType type, bool sent, bool isTotal, WireCompression codec)
 {
+	ASSERT_OR_RETURN(0, codec < WIRE_COMPRESSION_COUNT, "Bad codec %d", (int)codec);
 	size_t Statistic::*statisticType = sent ? &Statistic::sent : &Statistic::received;
-	Statistic NETSTATS::*statsType;
+	Statistic NETSTATS::*statsType = nullptr;
+	Statistic (NETSTATS::*codecStatsType)[WIRE_COMPRESSION_COUNT] = nullptr;
 	switch (type)
 	{
-	case NetStatisticRawBytes:          statsType = &NETSTATS::rawBytes;          break;
-	case NetStatisticUncompressedBytes: statsType = &NETSTATS::uncompressedBytes; break;
-	case NetStatisticPackets:           statsType = &NETSTATS::packets;           break;
+	case NetStatisticRawBytes:               statsType = &NETSTATS::rawBytes;                    break;
+	case NetStatisticUncompressedBytes:      statsType = &NETSTATS::uncompressedBytes;           break;
+	case NetStatisticPackets:                statsType = &NETSTATS::packets;                     break;
+	case NetStatisticCodecRawBytes:          codecStatsType = &NETSTATS::codecRawBytes;          break;
+	case NetStatisticCodecUncompressedBytes: codecStatsType = &NETSTATS::codecUncompressedBytes; break;
+	case NetStatisticCodecMicroseconds:      codecStatsType = &NETSTATS::codecMicroseconds;      break;
 	default: ASSERT(false, " "); return 0;
 	}
 
+	// The sockets count these themselves, since they do the compressing.
+	for (int i = 0; i < WIRE_COMPRESSION_COUNT; ++i)
+	{
+		SocketCompressionStatistics socketStats = socketCompressionStatistics((WireCompression)i);
+		nStats.codecRawBytes[i]          = {socketStats.compressedSent, socketStats.compressedReceived};
+		nStats.codecUncompressedBytes[i] = {socketStats.uncompressedSent, socketStats.uncompressedReceived};
+		nStats.codecMicroseconds[i]      = {socketStats.microsecondsSent, socketStats.microsecondsReceived};
+	}
+
 	int time = wzGetTicks();
 	if ((unsigned)(time - nStatsLastUpdateTime) >= (unsigned)GAME_TICKS_PER_SEC)
 	{
@@ -1448,11 +1470,15 @@ size_t NETgetStatistic(NetStatisticType type, bool sent, bool isTotal)
 		nStatsLastSec = nStats;
 	}
 
+	auto get = [&](NETSTATS const &stats) {
+		Statistic const &statistic = statsType != nullptr ? stats.*statsType : (stats.*codecStatsType)[codec];
+		return statistic.*statisticType;
+	};
 	if (isTotal)
 	{
-		return nStats.*statsType.*statisticType;
+		return get(nStats);
 	}
-	return nStatsLastSec.*statsType.*statisticType - nStatsSecondLastSec.*statsType.*statisticType;
+	return get(nStatsLastSec) - get(nStatsSecondLastSec);
 }
 
 
@@ -1497,11 +1523,9 @@ bool NETsend(NETQUEUE queue, NetMessage const *message)
 			// We are the host, send directly to player.
 			if (sockets[player] != nullptr && player != queue.exclude)
 			{
-				uint8_t *rawData = message->rawDataDup();
 				ssize_t rawLen   = message->rawLen();
 				size_t compressedRawLen;
-				result = writeAll(sockets[player], rawData, rawLen, &compressedRawLen);
-				delete[] rawData;  // Done with the data.
+				result = writeAll(sockets[player], message->rawData(), rawLen, &compressedRawLen);
 
 				if (result == rawLen)
 				{
@@ -1528,11 +1552,9 @@ bool NETsend(NETQUEUE queue, NetMessage const *message)
 		// We are a client, send directly to player, who happens to be the host.
 		if (bsocket)
 		{
-			uint8_t *rawData = message->rawDataDup();
 			ssize_t rawLen   = message->rawLen();
 			size_t compressedRawLen;
-			result = writeAll(bsocket, rawData, rawLen, &compressedRawLen);
-			delete[] rawData;  // Done with the data.
+			result = writeAll(bsocket, message->rawData(), rawLen, &compressedRawLen);
 
 			if (result == rawLen)
 			{
@@ -1561,10 +1583,11 @@ bool NETsend(NETQUEUE queue, NetMessage const *message)
 	{
 		// We are a client and can't send the data directly, ask the host to send the data to the player.
 		uint8_t sender = selectedPlayer;
+		NetMessage wrapped = *message;
 		NETbeginEncode(NETnetQueue(NET_HOST_ONLY), NET_SEND_TO_PLAYER);
 		NETuint8_t(&sender);
 		NETuint8_t(&player);
-		NETnetMessage(&message);
+		NETnetMessage(&wrapped);
 		NETend();
 	}
 
@@ -1622,12 +1645,11 @@ static bool NETprocessSystemMessage(NETQUEUE playerQueue, uint8_t type)
 		{
 			uint8_t sender;
 			uint8_t receiver;
-			NetMessage const *message = nullptr;
+			NetMessage message;
 			NETbeginDecode(playerQueue, NET_SEND_TO_PLAYER);
 			NETuint8_t(&sender);
 			NETuint8_t(&receiver);
-			NETnetMessage(&message);  // Must delete message later.
-			std::unique_ptr<NetMessage const> deleteLater(message);
+			NETnetMessage(&message);  // Refers to the data in playerQueue, which is only valid until the queue changes.
 			if (!NETend())
 			{
 				debug(LOG_ERROR, "Incomplete NET_SEND_TO_PLAYER.");
@@ -1643,33 +1665,33 @@ static bool NETprocessSystemMessage(NETQUEUE playerQueue, uint8_t type)
 				// Message was sent to us via the host.
 				if (sender != selectedPlayer)  // Make sure host didn't send us our own broadcast messages, which shouldn't happen anyway.
 				{
-					NETinsertMessageFromNet(NETnetQueue(sender), message);
-					NETlogPacket(message->type, static_cast<uint32_t>(message->rawLen()), true);
+					NETlogPacket(message.type, static_cast<uint32_t>(message.rawLen()), true);
+					NETinsertMessageFromNet(NETnetQueue(sender), &message);
 				}
 			}
 			else if (NetPlay.isHost && sender == playerQueue.index)
 			{
-				if (((message->type == NET_FIREUP
-				      || message->type == NET_KICK
-				      || message->type == NET_PLAYER_LEAVING
-				      || message->type == NET_PLAYER_DROPPED
-				      || message->type == NET_REJECTED
-				      || message->type == NET_PLAYER_JOINED) && sender != NET_HOST_ONLY)
+				if (((message.type == NET_FIREUP
+				      || message.type == NET_KICK
+				      || message.type == NET_PLAYER_LEAVING
+				      || message.type == NET_PLAYER_DROPPED
+				      || message.type == NET_REJECTED
+				      || message.type == NET_PLAYER_JOINED) && sender != NET_HOST_ONLY)
 				    ||
-				    ((message->type == NET_HOST_DROPPED
-				      || message->type == NET_OPTIONS
-				      || message->type == NET_FILE_REQUESTED
-				      || message->type == NET_READY_REQUEST
-				      || message->type == NET_TEAMREQUEST
-				      || message->type == NET_COLOURREQUEST
-				      || message->type == NET_POSITIONREQUEST
-				      || message->type == NET_FILE_CANCELLED
-				      || message->type == NET_JOIN
-				      || message->type == NET_PLAYER_INFO) && receiver != NET_HOST_ONLY))
+				    ((message.type == NET_HOST_DROPPED
+				      || message.type == NET_OPTIONS
+				      || message.type == NET_FILE_REQUESTED
+				      || message.type == NET_READY_REQUEST
+				      || message.type == NET_TEAMREQUEST
+				      || message.type == NET_COLOURREQUEST
+				      || message.type == NET_POSITIONREQUEST
+				      || message.type == NET_FILE_CANCELLED
+				      || message.type == NET_JOIN
+				      || message.type == NET_PLAYER_INFO) && receiver != NET_HOST_ONLY))
 				{
 					char msg[256] = {'\0'};
 
-					ssprintf(msg, "Auto-kicking player %u, lacked the required access level for command(%d).", (unsigned int)sender, (int)message->type);
+					ssprintf(msg, "Auto-kicking player %u, lacked the required access level for command(%d).", (unsigned int)sender, (int)message.type);
 					sendRoomSystemMessage(msg);
 					NETlogEntry(msg, SYNC_FLAG, sender);
 					addToBanList(NetPlay.players[sender].IPtextAddress, NetPlay.players[sender].name);
@@ -1688,15 +1710,15 @@ static bool NETprocessSystemMessage(NETQUEUE playerQueue, uint8_t type)
 
 				if (receiver == NET_ALL_PLAYERS)
 				{
-					NETinsertMessageFromNet(NETnetQueue(sender), message);  // Message is also for the host.
-					NETlogPacket(message->type, static_cast<uint32_t>(message->rawLen()), true);
+					NETlogPacket(message.type, static_cast<uint32_t>(message.rawLen()), true);
+					NETinsertMessageFromNet(NETnetQueue(sender), &message);  // Message is also for the host. May be inserted into playerQueue itself, so don't use message after this.
 					// Not sure if flushing here can make a difference, maybe it can:
 					//NETflush();  // Send the message to everyone as fast as possible.
 				}
 			}
 			else
 			{
-				debug(LOG_INFO, "Report this: Player %d sent us message type (%d) addressed to %d from %d. We are %d.", (int)playerQueue.index, (int)message->type, (int)receiver, (int)sender, selectedPlayer);
+				debug(LOG_INFO, "Report this: Player %d sent us message type (%d) addressed to %d from %d. We are %d.", (int)playerQueue.index, (int)message.type, (int)receiver, (int)sender, selectedPlayer);
 			}
 
 			break;
@@ -1705,7 +1727,7 @@ static bool NETprocessSystemMessage(NETQUEUE playerQueue, uint8_t type)
 		{
 			uint8_t player = 0;
 			uint32_t num = 0, n;
-			NetMessage const *message = nullptr;
+			NetMessage message;
 
 			// Encoded in NETprocessSystemMessage in nettypes.cpp.
 			NETbeginDecode(playerQueue, NET_SHARE_GAME_QUEUE);
@@ -1721,11 +1743,8 @@ static bool NETprocessSystemMessage(NETQUEUE playerQueue, uint8_t type)
 			{
 				NETnetMessage(&message);
 
-				NETinsertMessageFromNet(NETgameQueue(player), message);
-				NETlogPacket(message->type, static_cast<uint32_t>(message->rawLen()), true);
-
-				delete message;
-				message = nullptr;
+				NETinsertMessageFromNet(NETgameQueue(player), &message);
+				NETlogPacket(message.type, static_cast<uint32_t>(message.rawLen()), true);
 			}
 			if (!NETend())
 			{
@@ -2081,7 +2100,7 @@ checkMessages:
 		*queue = NETnetQueue(current);
 		while (NETisMessageReady(*queue))
 		{
-			*type = NETgetMessage(*queue)->type;
+			*type = NETgetMessage(*queue).type;
 			if (!NETprocessSystemMessage(*queue, *type))
 			{
 				return true;  // We couldn't process the message, let the caller deal with it..
@@ -2094,17 +2113,22 @@ checkMessages:
 
 bool NETrecvGame(NETQUEUE *queue, uint8_t *type)
 {
+	WZ_PROFILE_SCOPE("NETrecvGame");
+
 	for (unsigned current = 0; current < MAX_PLAYERS; ++current)
 	{
 		*queue = NETgameQueue(current);
 		while (!checkPlayerGameTime(current))  // Check for any messages that are scheduled to be read now.
 		{
+			while (NETisReplay() && !NETisMessageReady(*queue) && NETreplayLoadNetMessage())
+			{}  // Read ahead in the replay until this player has a message, queueing the other players' messages on the way.
+
 			if (!NETisMessageReady(*queue))
 			{
 				return false;  // Still waiting for messages from this player, and all players should process messages in the same order. Will have to freeze the game while waiting.
 			}
 
-			*type = NETgetMessage(*queue)->type;
+			*type = NETgetMessage(*queue).type;
 
 			if (*type == GAME_GAME_TIME)
 			{
@@ -2113,6 +2137,7 @@ bool NETrecvGame(NETQUEUE *queue, uint8_t *type)
 				continue;
 			}
 
+			WZ_PROFILE_COUNT("game messages", 1);
 			return true;  // Have a message ready to read now.
 		}
 	}
@@ -2843,6 +2868,34 @@ void NETfixPlayerCount()
 	}
 
 }
+/// Returns the codecs we support, and (in the top byte) the one we prefer, as sent in the join handshake.
+static uint32_t wireCompressionOffer()
+{
+	return (uint32_t)wireCompression << 24 | wireCompressionSupported();
+}
+
+/// Picks the codec for a connection, given the other end's wireCompressionOffer(). Our preference wins, then theirs.
+static WireCompression chooseWireCompression(uint32_t offer)
+{
+	uint32_t common = offer & wireCompressionSupported() & 0xFFFFFF;
+	unsigned theirs = offer >> 24;
+	if ((common & 1 << wireCompression) != 0)
+	{
+		return wireCompression;
+	}
+	if (theirs < WIRE_COMPRESSION_COUNT && (common & 1 << theirs) != 0)
+	{
+		return (WireCompression)theirs;
+	}
+	return WIRE_COMPRESSION_ZLIB;
+}
+
+/// Each end compresses at its own level. The configured level only applies to the configured codec.
+static int wireCompressionLevelFor(WireCompression codec)
+{
+	return codec == wireCompression ? wireCompressionLevel : wireCompressionDefaultLevel(codec);
+}
+
 // ////////////////////////////////////////////////////////////////////////
 // Host a game with a given name and player name. & 4 user game flags
 static void NETallowJoining()
@@ -2986,13 +3039,25 @@ static void NETallowJoining()
 				}
 				else if (NETisCorrectVersion(major, minor))
 				{
-					result = htonl(ERROR_NOERROR);
-					memcpy(&buffer, &result, sizeof(result));
-					writeAll(tmp_socket[i], &buffer, sizeof(result));
-					socketBeginCompression(tmp_socket[i]);
-
-					// Connection is successful.
-					connectFailed = false;
+					// The version is followed by the compression codecs the client supports.
+					uint32_t offer;
+					if (readAll(tmp_socket[i], &offer, sizeof(offer), NET_TIMEOUT_DELAY) != sizeof(offer))
+					{
+						debug(LOG_ERROR, "Didn't receive the compression codecs from the client.");
+						NETlogEntry("No compression codecs", SYNC_FLAG, i);
+						connectFailed = true;
+					}
+					else
+					{
+						WireCompression codec = chooseWireCompression(ntohl(offer));
+						uint32_t reply[2] = {htonl(ERROR_NOERROR), htonl(codec)};
+						writeAll(tmp_socket[i], reply, sizeof(reply));
+						socketBeginCompression(tmp_socket[i], codec, wireCompressionLevelFor(codec));
+						debug(LOG_NET, "Using %s compression with %s", wireCompressionName(codec), getSocketTextAddress(tmp_socket[i]));
+
+						// Connection is successful.
+						connectFailed = false;
+					}
 				}
 				else
 				{
@@ -3064,7 +3129,7 @@ static void NETallowJoining()
 
 				NETinsertRawData(NETnetTmpQueue(i), buffer, size);
 
-				if (NETisMessageReady(NETnetTmpQueue(i)) && NETgetMessage(NETnetTmpQueue(i))->type == NET_JOIN)
+				if (NETisMessageReady(NETnetTmpQueue(i)) && NETgetMessage(NETnetTmpQueue(i)).type == NET_JOIN)
 				{
 					uint8_t j;
 					uint8_t index;
@@ -3607,9 +3672,10 @@ bool NETjoinGame(const char *host, uint32_t port, const char *playername)
 {
 	SocketAddress *hosts = nullptr;
 	unsigned int i;
-	char buffer[sizeof(int32_t) * 2] = { 0 };
+	char buffer[sizeof(int32_t) * 3] = { 0 };
 	char *p_buffer;
 	uint32_t result;
+	uint32_t codec;
 
 	if (port == 0)
 	{
@@ -3665,6 +3731,7 @@ bool NETjoinGame(const char *host, uint32_t port, const char *playername)
 	};
 	pushu32(NETCODE_VERSION_MAJOR);
 	pushu32(NETCODE_VERSION_MINOR);
+	pushu32(wireCompressionOffer());
 
 	if (writeAll(tcp_socket, buffer, sizeof(buffer)) == SOCKET_ERROR
 	    || readAll(tcp_socket, &result, sizeof(result), 1500) != sizeof(result))
@@ -3674,6 +3741,17 @@ bool NETjoinGame(const char *host, uint32_t port, const char *playername)
 	}
 
 	result = ntohl(result);
+	if (result == ERROR_NOERROR)
+	{
+		// The host replies with the compression codec to use.
+		if (readAll(tcp_socket, &codec, sizeof(codec), 1500) != sizeof(codec)
+		    || (codec = ntohl(codec)) >= WIRE_COMPRESSION_COUNT
+		    || (wireCompressionSupported() & 1 << codec) == 0)
+		{
+			debug(LOG_ERROR, "Couldn't agree on a compression codec with the host.");
+			result = ERROR_CONNECTION;
+		}
+	}
 	if (result != ERROR_NOERROR)
 	{
 		debug(LOG_ERROR, "Received error %d", result);
@@ -3693,7 +3771,8 @@ bool NETjoinGame(const char *host, uint32_t port, const char *playername)
 	// NOTE: tcp_socket = bsocket now!
 	bsocket = tcp_socket;
 	tcp_socket = nullptr;
-	socketBeginCompression(bsocket);
+	socketBeginCompression(bsocket, (WireCompression)codec, wireCompressionLevelFor((WireCompression)codec));
+	debug(LOG_NET, "Using %s compression with the host", wireCompressionName((WireCompression)codec));
 
 	// Send a join message to the host
 	NETbeginEncode(NETnetQueue(NET_HOST_ONLY), NET_JOIN);
@@ -3857,6 +3936,39 @@ bool NETgetJoinPreferenceIPv6()
 	return bJoinPrefTryIPv6First;
 }
 
+/*!
+ * Set the preferred compression codec for game connections
+ * \param codec Used if the other end supports it, otherwise their preference or zlib is used.
+ * \param level Compression level for the codec, or -1 for its default.
+ */
+void NETsetWireCompression(WireCompression codec, int level)
+{
+	if (codec >= WIRE_COMPRESSION_COUNT || (wireCompressionSupported() & 1 << codec) == 0)
+	{
+		debug(LOG_WARNING, "Compression %s not supported by this build, using zlib.", wireCompressionName(codec));
+		codec = WIRE_COMPRESSION_ZLIB;
+		level = -1;
+	}
+	wireCompression = codec;
+	wireCompressionLevel = level == -1 ? wireCompressionDefaultLevel(codec) : level;
+}
+
+/**
+ * @return The preferred compression codec for game connections.
+ */
+WireCompression NETgetWireCompression()
+{
+	return wireCompression;
+}
+
+/**
+ * @return The compression level used with NETgetWireCompression().
+ */
+int NETgetWireCompressionLevel()
+{
+	return wireCompressionLevel;
+}
+
 
 void NETsetPlayerConnectionStatus(CONNECTION_STATUS status, unsigned player)
 {
@@ -3914,208 +4026,231 @@ bool NETcheckPlayerConnectionStatus(CONNECTION_STATUS status, unsigned player)
 	return realTime < NET_PlayerConnectionStatus[status][player];
 }
 
-struct SyncDebugEntry
+/// Length modifier of a printf conversion, which gives the type of its argument.
+enum SyncDebugLength
 {
-	char const *function;
+	SYNC_DEBUG_LENGTH_INT,        ///< None, "h" or "hh".
+	SYNC_DEBUG_LENGTH_LONG,       ///< "l".
+	SYNC_DEBUG_LENGTH_LONG_LONG,  ///< "ll", or "I64" with MSVC.
+	SYNC_DEBUG_LENGTH_INTMAX,     ///< "j".
+	SYNC_DEBUG_LENGTH_SIZE,       ///< "z", or "I" with MSVC.
+	SYNC_DEBUG_LENGTH_PTRDIFF,    ///< "t".
+	SYNC_DEBUG_LENGTH_DOUBLE,     ///< "L".
 };
 
-struct SyncDebugString : public SyncDebugEntry
+/// A printf conversion specification, such as "%-8.2lld".
+struct SyncDebugConversion
 {
-	void set(uint32_t &crc, char const *f, char const *string)
-	{
-		function = f;
-		crc = crcSum(crc, function, strlen(function) + 1);
-		crc = crcSum(crc, string,   strlen(string) + 1);
-	}
-	int snprint(char *buf, size_t bufSize, char const *&string) const
-	{
-		int ret = snprintf(buf, bufSize, "[%s] %s\n", function, string);
-		string += strlen(string) + 1;
-		return ret;
-	}
+	char const *begin;       ///< The '%'.
+	char const *end;         ///< Just after the conversion character.
+	unsigned numStars;       ///< Number of extra int arguments, for '*' width or precision.
+	SyncDebugLength length;
+	char type;               ///< The conversion character.
 };
 
-struct SyncDebugValueChange : public SyncDebugEntry
+/// Parses the conversion specification at format, which must point to a '%'.
+static void parseSyncDebugConversion(char const *format, SyncDebugConversion &conv)
 {
-	void set(uint32_t &crc, char const *f, char const *vn, int nv, int i)
+	conv.begin = format++;
+	conv.numStars = 0;
+	conv.length = SYNC_DEBUG_LENGTH_INT;
+	while (*format != '\0' && strchr("-+ #0123456789.*", *format) != nullptr)
 	{
-		function = f;
-		variableName = vn;
-		newValue = nv;
-		id = i;
-		uint32_t valueBytes = htonl(newValue);
-		crc = crcSum(crc, function,     strlen(function) + 1);
-		crc = crcSum(crc, variableName, strlen(variableName) + 1);
-		crc = crcSum(crc, &valueBytes,  4);
+		conv.numStars += *format++ == '*';
 	}
-	int snprint(char *buf, size_t bufSize) const
+	while (*format != '\0' && strchr("hlLjztI", *format) != nullptr)
 	{
-		if (id != -1)
+		switch (*format)
 		{
-			return snprintf(buf, bufSize, "[%s] %d %s = %d\n", function, id, variableName, newValue);
+		case 'l': conv.length = conv.length == SYNC_DEBUG_LENGTH_LONG ? SYNC_DEBUG_LENGTH_LONG_LONG : SYNC_DEBUG_LENGTH_LONG; break;
+		case 'L': conv.length = SYNC_DEBUG_LENGTH_DOUBLE; break;
+		case 'j': conv.length = SYNC_DEBUG_LENGTH_INTMAX; break;
+		case 'z': conv.length = SYNC_DEBUG_LENGTH_SIZE; break;
+		case 't': conv.length = SYNC_DEBUG_LENGTH_PTRDIFF; break;
+		case 'I':
+			if (format[1] == '6' && format[2] == '4')
+			{
+				conv.length = SYNC_DEBUG_LENGTH_LONG_LONG;
+				format += 2;
+			}
+			else if (format[1] == '3' && format[2] == '2')
+			{
+				format += 2;
+			}
+			else
+			{
+				conv.length = SYNC_DEBUG_LENGTH_SIZE;
+			}
+			break;
+		default: break;  // 'h' arguments are passed as int anyway.
 		}
-		return snprintf(buf, bufSize, "[%s] %s = %d\n", function, variableName, newValue);
+		++format;
 	}
+	conv.type = *format;
+	conv.end = *format != '\0' ? format + 1 : format;
+}
 
-	int         newValue;
-	int         id;
-	char const *variableName;
-};
+/// Reads an integer argument of a conversion, sign extended if signed, so it can be stored as an int64_t.
+static int64_t readSyncDebugInt(SyncDebugConversion const &conv, va_list &ap)
+{
+	bool isSigned = conv.type == 'd' || conv.type == 'i' || conv.type == 'c';
+	switch (conv.length)
+	{
+	case SYNC_DEBUG_LENGTH_LONG:      return isSigned ? (int64_t)va_arg(ap, long) : (int64_t)va_arg(ap, unsigned long);
+	case SYNC_DEBUG_LENGTH_LONG_LONG: return isSigned ? (int64_t)va_arg(ap, long long) : (int64_t)va_arg(ap, unsigned long long);
+	case SYNC_DEBUG_LENGTH_INTMAX:    return isSigned ? (int64_t)va_arg(ap, intmax_t) : (int64_t)va_arg(ap, uintmax_t);
+	case SYNC_DEBUG_LENGTH_SIZE:      return isSigned ? (int64_t)va_arg(ap, ssize_t) : (int64_t)va_arg(ap, size_t);
+	case SYNC_DEBUG_LENGTH_PTRDIFF:   return (int64_t)va_arg(ap, ptrdiff_t);
+	default:                          return isSigned ? (int64_t)va_arg(ap, int) : (int64_t)va_arg(ap, unsigned);
+	}
+}
+
+/// Prints a single integer conversion, passing the value as the type the length modifier asks for.
+static int printSyncDebugInt(char *buf, size_t bufSize, char const *spec, SyncDebugConversion const &conv, int const *stars, int64_t value)
+{
+	bool isSigned = conv.type == 'd' || conv.type == 'i' || conv.type == 'c';
+#define SYNC_DEBUG_PRINT(signedType, unsignedType) \
+	(conv.numStars == 0 ? (isSigned ? snprintf(buf, bufSize, spec, (signedType)value) : snprintf(buf, bufSize, spec, (unsignedType)value)) : \
+	 conv.numStars == 1 ? (isSigned ? snprintf(buf, bufSize, spec, stars[0], (signedType)value) : snprintf(buf, bufSize, spec, stars[0], (unsignedType)value)) : \
+	                      (isSigned ? snprintf(buf, bufSize, spec, stars[0], stars[1], (signedType)value) : snprintf(buf, bufSize, spec, stars[0], stars[1], (unsignedType)value)))
+	switch (conv.length)
+	{
+	case SYNC_DEBUG_LENGTH_LONG:      return SYNC_DEBUG_PRINT(long, unsigned long);
+	case SYNC_DEBUG_LENGTH_LONG_LONG: return SYNC_DEBUG_PRINT(long long, unsigned long long);
+	case SYNC_DEBUG_LENGTH_INTMAX:    return SYNC_DEBUG_PRINT(intmax_t, uintmax_t);
+	case SYNC_DEBUG_LENGTH_SIZE:      return SYNC_DEBUG_PRINT(ssize_t, size_t);
+	case SYNC_DEBUG_LENGTH_PTRDIFF:   return SYNC_DEBUG_PRINT(ptrdiff_t, ptrdiff_t);
+	default:                          return SYNC_DEBUG_PRINT(int, unsigned);
+	}
+#undef SYNC_DEBUG_PRINT
+}
 
-struct SyncDebugIntList : public SyncDebugEntry
+template <typename T>
+static int printSyncDebugValue(char *buf, size_t bufSize, char const *spec, SyncDebugConversion const &conv, int const *stars, T value)
 {
-	void set(uint32_t &crc, char const *f, char const *s, int const *ints, size_t num)
+	switch (conv.numStars)
 	{
-		function = f;
-		string = s;
-		uint32_t valueBytes[40];
-		numInts = std::min(num, ARRAY_SIZE(valueBytes));
-		for (unsigned n = 0; n < numInts; ++n)
-		{
-			valueBytes[n] = htonl(ints[n]);
-		}
-		crc = crcSum(crc, valueBytes, 4 * numInts);
+	case 0:  return snprintf(buf, bufSize, spec, value);
+	case 1:  return snprintf(buf, bufSize, spec, stars[0], value);
+	default: return snprintf(buf, bufSize, spec, stars[0], stars[1], value);
 	}
-	int snprint(char *buf, size_t bufSize, int const *&ints) const
+}
+
+static uint32_t crcSumInt64(uint32_t crc, int64_t value)
+{
+	uint8_t valueBytes[8];
+	for (unsigned n = 0; n < 8; ++n)
 	{
-		size_t index = 0;
-		if (index < bufSize)
-		{
-			index += snprintf(buf + index, bufSize - index, "[%s] ", function);
-		}
-		if (index < bufSize)
-		{
-			switch (numInts)
-			{
-			case  0: index += snprintf(buf + index, bufSize - index, "%s", string); break;
-			case  1: index += snprintf(buf + index, bufSize - index, string, ints[0]); break;
-			case  2: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1]); break;
-			case  3: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2]); break;
-			case  4: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3]); break;
-			case  5: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4]); break;
-			case  6: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5]); break;
-			case  7: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6]); break;
-			case  8: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7]); break;
-			case  9: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8]); break;
-			case 10: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9]); break;
-			case 11: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10]); break;
-			case 12: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11]); break;
-			case 13: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12]); break;
-			case 14: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13]); break;
-			case 15: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14]); break;
-			case 16: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15]); break;
-			case 17: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16]); break;
-			case 18: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17]); break;
-			case 19: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18]); break;
-			case 20: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19]); break;
-			case 21: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20]); break;
-			case 22: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21]); break;
-			case 23: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22]); break;
-			case 24: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23]); break;
-			case 25: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24]); break;
-			case 26: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25]); break;
-			case 27: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26]); break;
-			case 28: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27]); break;
-			case 29: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27], ints[28]); break;
-			case 30: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27], ints[28], ints[29]); break;
-			case 31: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27], ints[28], ints[29], ints[30]); break;
-			case 32: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27], ints[28], ints[29], ints[30], ints[31]); break;
-			case 33: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27], ints[28], ints[29], ints[30], ints[31], ints[32]); break;
-			case 34: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27], ints[28], ints[29], ints[30], ints[31], ints[32], ints[33]); break;
-			case 35: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27], ints[28], ints[29], ints[30], ints[31], ints[32], ints[33], ints[34]); break;
-			case 36: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27], ints[28], ints[29], ints[30], ints[31], ints[32], ints[33], ints[34], ints[35]); break;
-			case 37: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27], ints[28], ints[29], ints[30], ints[31], ints[32], ints[33], ints[34], ints[35], ints[36]); break;
-			case 38: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27], ints[28], ints[29], ints[30], ints[31], ints[32], ints[33], ints[34], ints[35], ints[36], ints[37]); break;
-			case 39: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27], ints[28], ints[29], ints[30], ints[31], ints[32], ints[33], ints[34], ints[35], ints[36], ints[37], ints[38]); break;
-			case 40: index += snprintf(buf + index, bufSize - index, string, ints[0], ints[1], ints[2], ints[3], ints[4], ints[5], ints[6], ints[7], ints[8], ints[9], ints[10], ints[11], ints[12], ints[13], ints[14], ints[15], ints[16], ints[17], ints[18], ints[19], ints[20], ints[21], ints[22], ints[23], ints[24], ints[25], ints[26], ints[27], ints[28], ints[29], ints[30], ints[31], ints[32], ints[33], ints[34], ints[35], ints[36], ints[37], ints[38], ints[39]); break;
-			default: index += snprintf(buf + index, bufSize - index, "Too many ints in intlist."); break;
-			}
-		}
-		if (index < bufSize)
-		{
-			index += snprintf(buf + index, bufSize - index, "\n");
-		}
-		ints += numInts;
-		return index;
+		valueBytes[n] = (uint8_t)((uint64_t)value >> (56 - 8 * n));
 	}
+	return crcSum(crc, valueBytes, 8);
+}
 
-	char const *string;
-	unsigned numInts;
+/// A syncDebug() call. The format string is only applied to the arguments if the log has to be dumped.
+struct SyncDebugEntry
+{
+	char const *function;
+	char const *format;
+	uint32_t firstArg;  ///< Index of the first argument in SyncDebugLog::args.
+	uint32_t numArgs;
 };
 
+/**
+ * The syncDebug() calls of a single tick.
+ *
+ * The arguments are stored in binary, as int64_t for integers (and the bits of doubles), or as offsets into chars for
+ * strings, and the CRC is taken of the literal parts of the format strings and of the argument values. Since nothing is
+ * formatted until snprint() is called on a desynch, and the buffers keep their capacity when cleared, logging costs
+ * little more than copying the arguments, and doesn't allocate once the buffers have grown to the size of a tick.
+ */
 struct SyncDebugLog
 {
 	SyncDebugLog() : time(0), crc(0x00000000) {}
 	void clear()
 	{
-		log.clear();
 		time = 0;
 		crc = 0x00000000;
-		//printf("Freeing %d strings, %d valueChanges, %d intLists, %d chars, %d ints\n", (int)strings.size(), (int)valueChanges.size(), (int)intLists.size(), (int)chars.size(), (int)ints.size());
-		strings.clear();
-		valueChanges.clear();
-		intLists.clear();
+		entries.clear();
+		args.clear();
 		chars.clear();
-		ints.clear();
-	}
-	void string(char const *f, char const *s)
-	{
-		size_t offset = chars.size();
-		chars.resize(chars.size() + strlen(s) + 1);
-		char *buf = &chars[offset];
-		strcpy(buf, s);
-
-		strings.resize(strings.size() + 1);
-		strings.back().set(crc, f, buf);
-
-		log.push_back('s');
-	}
-	void valueChange(char const *f, char const *vn, int nv, int i)
-	{
-		valueChanges.resize(valueChanges.size() + 1);
-		valueChanges.back().set(crc, f, vn, nv, i);
-		log.push_back('v');
-	}
-	void intList(char const *f, char const *s, int *begin, size_t num)
-	{
-		size_t offset = ints.size();
-		ints.resize(ints.size() + num);
-		int *buf = &ints[offset];
-		std::copy(begin, begin + num, buf);
-
-		intLists.resize(intLists.size() + 1);
-		intLists.back().set(crc, f, s, buf, num);
-		log.push_back('i');
 	}
-	int snprint(char *buf, size_t bufSize)
+	void format(char const *f, char const *fmt, va_list &ap)
 	{
-		SyncDebugString const *stringPtr = strings.empty() ? nullptr : &strings[0]; // .empty() check, since &strings[0] is undefined if strings is empty(), even if it's likely to work, anyway.
-		SyncDebugValueChange const *valueChangePtr = valueChanges.empty() ? nullptr : &valueChanges[0];
-		SyncDebugIntList const *intListPtr = intLists.empty() ? nullptr : &intLists[0];
-		char const *charPtr = chars.empty() ? nullptr : &chars[0];
-		int const *intPtr = ints.empty() ? nullptr : &ints[0];
-
-		int index = 0;
-		for (size_t n = 0; n < log.size() && (size_t)index < bufSize; ++n)
+		size_t firstArg = args.size();
+		char const *literal = fmt;
+		char const *c = fmt;
+		while (*c != '\0')
 		{
-			char type = log[n];
-			switch (type)
+			if (*c != '%')
 			{
-			case 's':
-				index += stringPtr++->snprint(buf + index, bufSize - index, charPtr);
+				++c;
+				continue;
+			}
+			crc = crcSum(crc, literal, c - literal);
+			SyncDebugConversion conv;
+			parseSyncDebugConversion(c, conv);
+			c = literal = conv.end;
+			crc = crcSum(crc, &conv.type, 1);  // Not the length modifiers, which can depend on the platform, such as PRId64.
+			for (unsigned n = 0; n < conv.numStars; ++n)
+			{
+				args.push_back(va_arg(ap, int));
+				crc = crcSumInt64(crc, args.back());
+			}
+			switch (conv.type)
+			{
+			case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c':
+				args.push_back(readSyncDebugInt(conv, ap));
+				crc = crcSumInt64(crc, args.back());
 				break;
-			case 'v':
-				index += valueChangePtr++->snprint(buf + index, bufSize - index);
+			case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			{
+				double value = conv.length == SYNC_DEBUG_LENGTH_DOUBLE ? (double)va_arg(ap, long double) : va_arg(ap, double);
+				int64_t bits;
+				memcpy(&bits, &value, sizeof(bits));
+				args.push_back(bits);
+				crc = crcSumInt64(crc, bits);
+				break;
+			}
+			case 's':
+			{
+				char const *string = va_arg(ap, char const *);
+				string = string != nullptr ? string : "(null)";
+				size_t stringLen = strlen(string) + 1;
+				args.push_back((int64_t)chars.size());
+				chars.insert(chars.end(), string, string + stringLen);
+				crc = crcSum(crc, string, stringLen);
 				break;
-			case 'i':
-				index += intListPtr++->snprint(buf + index, bufSize - index, intPtr);
+			}
+			case 'p':
+				args.push_back((int64_t)(uintptr_t)va_arg(ap, void *));
+				crc = crcSumInt64(crc, args.back());
 				break;
 			default:
-				abort();
-				break;
+				break;  // "%%", or something which doesn't take an argument.
 			}
 		}
-		return index;
+		crc = crcSum(crc, literal, c - literal);
+		entries.push_back({f, fmt, (uint32_t)firstArg, (uint32_t)(args.size() - firstArg)});
+	}
+	void intList(char const *f, char const *s, int const *ints, size_t num)
+	{
+		size_t firstArg = args.size();
+		for (size_t n = 0; n < num; ++n)
+		{
+			uint32_t valueBytes = htonl(ints[n]);
+			crc = crcSum(crc, &valueBytes, 4);
+			args.push_back(ints[n]);
+		}
+		entries.push_back({f, s, (uint32_t)firstArg, (uint32_t)num});
+	}
+	int snprint(char *buf, size_t bufSize) const
+	{
+		size_t index = 0;
+		for (size_t n = 0; n < entries.size() && index < bufSize; ++n)
+		{
+			index += snprintEntry(buf + index, bufSize - index, entries[n]);
+		}
+		return (int)std::min(index, bufSize);
 	}
 	uint32_t getGameTime() const
 	{
@@ -4127,7 +4262,7 @@ struct SyncDebugLog
 	}
 	size_t getNumEntries() const
 	{
-		return log.size();
+		return entries.size();
 	}
 	void setGameTime(uint32_t newTime)
 	{
@@ -4139,23 +4274,90 @@ struct SyncDebugLog
 	}
 
 private:
-	std::vector<char> log;
+	size_t snprintEntry(char *buf, size_t bufSize, SyncDebugEntry const &entry) const
+	{
+		size_t index = 0;
+		auto print = [&](int ret) { index = std::min(index + std::max(ret, 0), bufSize); };
+
+		print(snprintf(buf + index, bufSize - index, "[%s] ", entry.function));
+		int64_t const *arg = args.data() + entry.firstArg;
+		int64_t const *argEnd = arg + entry.numArgs;
+		char const *literal = entry.format;
+		char const *c = entry.format;
+		while (*c != '\0' && index < bufSize)
+		{
+			if (*c != '%')
+			{
+				++c;
+				continue;
+			}
+			print(snprintf(buf + index, bufSize - index, "%.*s", (int)(c - literal), literal));
+			SyncDebugConversion conv;
+			parseSyncDebugConversion(c, conv);
+			c = literal = conv.end;
+			bool takesArg = conv.type != '\0' && strchr("diouxXcfFeEgGaAsp", conv.type) != nullptr;
+			if ((size_t)(argEnd - arg) < conv.numStars + (takesArg ? 1 : 0) || conv.numStars > 2)
+			{
+				print(snprintf(buf + index, bufSize - index, "<missing argument>"));
+				literal = c = "";
+				break;
+			}
+			if (!takesArg)
+			{
+				print(snprintf(buf + index, bufSize - index, "%.*s", (int)(conv.end - conv.begin) - 1, conv.begin + 1));  // "%%" is printed as "%".
+				continue;
+			}
+			int stars[2];
+			for (unsigned n = 0; n < conv.numStars; ++n)
+			{
+				stars[n] = (int)*arg++;
+			}
+			char spec[32];
+			ssprintf(spec, "%.*s", (int)(conv.end - conv.begin), conv.begin);
+			int64_t value = *arg++;
+			switch (conv.type)
+			{
+			case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			{
+				double d;
+				memcpy(&d, &value, sizeof(d));
+				if (conv.length == SYNC_DEBUG_LENGTH_DOUBLE)
+				{
+					print(printSyncDebugValue(buf + index, bufSize - index, spec, conv, stars, (long double)d));
+				}
+				else
+				{
+					print(printSyncDebugValue(buf + index, bufSize - index, spec, conv, stars, d));
+				}
+				break;
+			}
+			case 's':
+				print(printSyncDebugValue(buf + index, bufSize - index, spec, conv, stars, &chars[value]));
+				break;
+			case 'p':
+				print(printSyncDebugValue(buf + index, bufSize - index, spec, conv, stars, (void *)(uintptr_t)value));
+				break;
+			default:
+				print(printSyncDebugInt(buf + index, bufSize - index, spec, conv, stars, value));
+				break;
+			}
+		}
+		print(snprintf(buf + index, bufSize - index, "%s\n", literal));
+		return index;
+	}
+
 	uint32_t time;
 	uint32_t crc;
 
-	std::vector<SyncDebugString> strings;
-	std::vector<SyncDebugValueChange> valueChanges;
-	std::vector<SyncDebugIntList> intLists;
-
+	std::vector<SyncDebugEntry> entries;
+	std::vector<int64_t> args;
 	std::vector<char> chars;
-	std::vector<int> ints;
 
 private:
 	SyncDebugLog(SyncDebugLog const &)/* = delete*/;
 	SyncDebugLog &operator =(SyncDebugLog const &)/* = delete*/;
 };
 
-#define MAX_LEN_LOG_LINE 512  // From debug.c - no use printing something longer.
 #define MAX_SYNC_HISTORY 12
 
 static unsigned syncDebugNext = 0;
@@ -4175,13 +4377,9 @@ void _syncDebug(const char *function, const char *str, ...)
 #endif
 
 	va_list ap;
-	char outputBuffer[MAX_LEN_LOG_LINE];
-
 	va_start(ap, str);
-	vssprintf(outputBuffer, str, ap);
+	syncDebugLog[syncDebugNext].format(function, str, ap);
 	va_end(ap);
-
-	syncDebugLog[syncDebugNext].string(function, outputBuffer);
 }
 
 void _syncDebugIntList(const char *function, const char *str, int *ints, size_t numInts)
@@ -29,6 +29,7 @@
 #include "lib/framework/crc.h"
 #include "src/factionid.h"
 #include "nettypes.h"
+#include "netcompress.h"
 #include <physfs.h>
 #include <vector>
 #include <functional>
@@ -353,8 +354,8 @@ void NETaddRedirects();
 void NETremRedirects();
 void NETdiscoverUPnPDevices();
 
-enum NetStatisticType {NetStatisticRawBytes, NetStatisticUncompressedBytes, NetStatisticPackets};
-size_t NETgetStatistic(NetStatisticType type, bool sent, bool isTotal = false);     // Return some statistic. Call regularly for good results.
+enum NetStatisticType {NetStatisticRawBytes, NetStatisticUncompressedBytes, NetStatisticPackets, NetStatisticCodecRawBytes, NetStatisticCodecUncompressedBytes, NetStatisticCodecMicroseconds};
+size_t NETgetStatistic(NetStatisticType type, bool sent, bool isTotal = false, WireCompression codec = WIRE_COMPRESSION_ZLIB);     // Return some statistic. Call regularly for good results. The NetStatisticCodec* statistics are for the given codec.
 
 void NETplayerKicked(UDWORD index);			// Cleanup after player has been kicked
 
@@ -382,6 +383,9 @@ void NETsetGameserverPort(unsigned int port);
 unsigned int NETgetGameserverPort();
 void NETsetJoinPreferenceIPv6(bool bTryIPv6First);
 bool NETgetJoinPreferenceIPv6();
+void NETsetWireCompression(WireCompression codec, int level = -1);
+WireCompression NETgetWireCompression();
+int NETgetWireCompressionLevel();
 
 bool NETsetupTCPIP(const char *machine);
 void NETsetGamePassword(const char *password);
@@ -408,6 +412,7 @@ bool NETcheckPlayerConnectionStatus(CONNECTION_STATUS status, unsigned player);
 const char *messageTypeToString(unsigned messageType);
 
 /// Sync debugging. Only prints anything, if different players would print different things.
+/// The arguments are stored as they are, and only formatted if the log is dumped, so this is cheap enough to call every tick.
 #define syncDebug(...) do { _syncDebug(__FUNCTION__, __VA_ARGS__); } while(0)
 #ifdef WZ_CC_MINGW
 void _syncDebug(const char *function, const char *str, ...) WZ_DECL_FORMAT(__MINGW_PRINTF_FORMAT, 2, 3);
@@ -415,7 +420,7 @@ void _syncDebug(const char *function, const char *str, ...) WZ_DECL_FORMAT(__MIN
 void _syncDebug(const char *function, const char *str, ...) WZ_DECL_FORMAT(printf, 2, 3);
 #endif
 
-/// Faster than syncDebug. Make sure that str is a format string that takes ints only.
+/// Faster than syncDebug, since str isn't parsed until the log is dumped. Make sure that str is a format string that takes ints only.
 void _syncDebugIntList(const char *function, const char *str, int *ints, size_t numInts);
 #define syncDebugBacktrace() do { _syncDebugBacktrace(__FUNCTION__); } while(0)
 void _syncDebugBacktrace(const char *function);                  ///< Adds a backtrace to syncDebug, if the platform supports it. Can be a bit slow, don't call way too often, unless desperate.
@@ -24,6 +24,9 @@
 #include "lib/framework/frame.h"
 #include "netqueue.h"
 
+#include <algorithm>
+#include <functional>
+
 // See comments in netqueue.h.
 
 
@@ -100,72 +103,79 @@ bool decode_uint32_t(uint8_t b, uint32_t &v, unsigned n)
 	return !isLastByte;
 }
 
-uint8_t *NetMessage::rawDataDup() const
-{
-	unsigned encodedLengthOfSize = encodedlength_uint32_t(data.size());
-
-	uint8_t *ret = new uint8_t[1 + encodedLengthOfSize + data.size()];
+static const unsigned maxEncodedLength_uint32_t = 5;  ///< Maximum return value of encodedlength_uint32_t.
 
-	ret[0] = type;
+/// Decodes the type and length at the start of rawData. Returns false if they aren't all there yet.
+static bool decodeHeader(const uint8_t *rawData, size_t available, size_t &headerLen, uint32_t &len)
+{
+	len = 0;
+	bool moreBytes = true;
+	unsigned n;
+	for (n = 0; moreBytes && available > 1 + n; ++n)
+	{
+		moreBytes = decode_uint32_t(rawData[1 + n], len, n);
+	}
+	headerLen = 1 + n;
+	return !moreBytes;
+}
 
-	uint32_t len = data.size();
-	for (unsigned n = 0; n < encodedLengthOfSize; ++n)
+size_t netMessageRawLen(const uint8_t *rawData, size_t available)
+{
+	size_t headerLen;
+	uint32_t len;
+	if (!decodeHeader(rawData, available, headerLen, len))
 	{
-		encode_uint32_t(ret[n + 1], len, n);
+		return 0;  // Don't have the whole length yet.
 	}
 
-	std::copy(data.begin(), data.end(), ret + 1 + encodedLengthOfSize);
-	return ret;
+	ASSERT(len < 40000000, "Trying to write a very large packet (%u bytes) to the queue.", len);
+	if (available - headerLen < len)
+	{
+		return 0;  // Don't have a whole message ready yet.
+	}
+	return headerLen + len;
 }
 
-size_t NetMessage::rawLen() const
+NetMessage::NetMessage(const uint8_t *rawData, size_t rawLen)
+	: type(rawData[0])
+	, raw(rawData)
+	, rawLength(rawLen)
 {
-	return 1 + static_cast<size_t>(encodedlength_uint32_t(data.size())) + data.size();
+	size_t headerLen;
+	uint32_t len;
+	decodeHeader(rawData, rawLen, headerLen, len);
+	ASSERT(headerLen + len == rawLen, "Bad message length.");
+	data = rawData + headerLen;
+	dataLen = rawLen - headerLen;
 }
 
 NetQueue::NetQueue()
 	: canGetMessagesForNet(true)
 	, canGetMessages(true)
+	, dataPos(0)
+	, messagePos(0)
+	, completeEnd(0)
+	, numDataMessages(0)
+	, numMessages(0)
+{}
+
+NetMessage NetQueue::messageAt(size_t pos) const
 {
-	dataPos = messages.end();
-	messagePos = messages.end();
+	return NetMessage(buffer.data() + pos, netMessageRawLen(buffer.data() + pos, completeEnd - pos));
 }
 
 void NetQueue::writeRawData(const uint8_t *netData, size_t netLen)
 {
-	size_t used = 0;
-	std::vector<uint8_t> &buffer = incompleteReceivedMessageData;  // Short alias.
-
-	// Insert the data.
+	// Insert the data, after any incomplete message it may complete.
 	buffer.insert(buffer.end(), netData, netData + netLen);
 
-	// Extract the messages.
-	while (buffer.size() - used > 1)
+	// Find the whole messages. They are already in the right format, so just need counting.
+	while (size_t rawLen = netMessageRawLen(buffer.data() + completeEnd, buffer.size() - completeEnd))
 	{
-		uint8_t type = buffer[used];
-
-		uint32_t len = 0;
-		bool moreBytes = true;
-		unsigned n;
-		for (n = 0; moreBytes && buffer.size() - used > 1 + n; ++n)
-		{
-			moreBytes = decode_uint32_t(buffer[used + 1 + n], len, n);
-		}
-		unsigned headerLen = 1 + n;
-
-		ASSERT(len < 40000000, "Trying to write a very large packet (%u bytes) to the queue.", len);
-		if (buffer.size() - used - headerLen < len)
-		{
-			break;  // Don't have a whole message ready yet.
-		}
-
-		messages.push_front(NetMessage(type));
-		messages.front().data.assign(buffer.begin() + used + headerLen, buffer.begin() + used + headerLen + len);
-		used += headerLen + len;
+		completeEnd += rawLen;
+		++numDataMessages;
+		++numMessages;
 	}
-
-	// Recycle old data.
-	buffer.erase(buffer.begin(), buffer.begin() + used);
 }
 
 void NetQueue::setWillNeverGetMessagesForNet()
@@ -175,36 +185,26 @@ void NetQueue::setWillNeverGetMessagesForNet()
 
 unsigned NetQueue::numMessagesForNet() const
 {
-	unsigned count = 0;
-	if (canGetMessagesForNet)
-	{
-		for (List::iterator i = dataPos; i != messages.begin(); --i)
-		{
-			++count;
-		}
-	}
-
-	return count;
+	return canGetMessagesForNet ? numDataMessages : 0;
 }
 
-const NetMessage &NetQueue::getMessageForNet() const
+NetMessage NetQueue::getMessageForNet() const
 {
 	ASSERT(canGetMessagesForNet, "Wrong NetQueue type for getMessageForNet.");
-	ASSERT(dataPos != messages.begin(), "No message to get!");
+	ASSERT(numDataMessages != 0, "No message to get!");
 
 	// Return the message.
-	List::iterator i = dataPos;
-	--i;
-	return *i;
+	return messageAt(dataPos);
 }
 
 void NetQueue::popMessageForNet()
 {
 	ASSERT(canGetMessagesForNet, "Wrong NetQueue type for popMessageForNet.");
-	ASSERT(dataPos != messages.begin(), "No message to pop!");
+	ASSERT_OR_RETURN(, numDataMessages != 0, "No message to pop!");
 
 	// Pop the message.
-	--dataPos;
+	dataPos += messageAt(dataPos).rawLen();
+	--numDataMessages;
 
 	// Recycle old data.
 	popOldMessages();
@@ -212,7 +212,60 @@ void NetQueue::popMessageForNet()
 
 void NetQueue::pushMessage(const NetMessage &message)
 {
-	messages.push_front(message);
+	size_t rawLen = message.rawLen();
+	if (rawLen == 0)
+	{
+		return;  // Not a valid message, such as from a truncated NET_SHARE_GAME_QUEUE.
+	}
+
+	// The message may be in our own buffer, which may move when making room, so copy it by position in that case.
+	const uint8_t *rawData = message.rawData();
+	std::less<const uint8_t *> before;
+	bool inBuffer = !buffer.empty() && !before(rawData, buffer.data()) && before(rawData, buffer.data() + buffer.size());
+	size_t inBufferPos = inBuffer ? rawData - buffer.data() : 0;
+	ASSERT_OR_RETURN(, !inBuffer || inBufferPos + rawLen <= completeEnd, "Message overlaps incomplete data.");
+
+	// Insert before any incomplete message from the network.
+	buffer.insert(buffer.begin() + completeEnd, rawLen, 0);
+	const uint8_t *src = inBuffer ? buffer.data() + inBufferPos : rawData;
+	std::copy(src, src + rawLen, buffer.begin() + completeEnd);
+	completeEnd += rawLen;
+	++numDataMessages;
+	++numMessages;
+}
+
+std::vector<uint8_t> *NetQueue::beginMessage(uint8_t type)
+{
+	ASSERT(completeEnd == buffer.size(), "Can't serialise a message after an incomplete message.");
+	buffer.resize(completeEnd);
+
+	buffer.push_back(type);
+	buffer.resize(buffer.size() + maxEncodedLength_uint32_t);  // Room for the length, which endMessage fills in.
+	return &buffer;
+}
+
+NetMessage NetQueue::endMessage()
+{
+	size_t dataStart = completeEnd + 1 + maxEncodedLength_uint32_t;
+	ASSERT_OR_RETURN(NetMessage(), buffer.size() >= dataStart, "No message to end.");
+
+	uint32_t len = buffer.size() - dataStart;
+	unsigned encodedLength = encodedlength_uint32_t(len);
+	uint32_t v = len;
+	for (unsigned n = 0; n < encodedLength; ++n)
+	{
+		encode_uint32_t(buffer[completeEnd + 1 + n], v, n);
+	}
+
+	// Move the data back to just after the length. Usually a few bytes, since most messages are short.
+	std::copy(buffer.begin() + dataStart, buffer.end(), buffer.begin() + completeEnd + 1 + encodedLength);
+	buffer.resize(completeEnd + 1 + encodedLength + len);
+
+	size_t messageStart = completeEnd;
+	completeEnd = buffer.size();
+	++numDataMessages;
+	++numMessages;
+	return messageAt(messageStart);
 }
 
 void NetQueue::setWillNeverGetMessages()
@@ -223,27 +276,26 @@ void NetQueue::setWillNeverGetMessages()
 bool NetQueue::haveMessage() const
 {
 	ASSERT(canGetMessages, "Wrong NetQueue type for haveMessage.");
-	return messagePos != messages.begin();
+	return numMessages != 0;
 }
 
-const NetMessage &NetQueue::getMessage() const
+NetMessage NetQueue::getMessage() const
 {
 	ASSERT(canGetMessages, "Wrong NetQueue type for getMessage.");
-	ASSERT(messagePos != messages.begin(), "No message to get!");
+	ASSERT(numMessages != 0, "No message to get!");
 
 	// Return the message.
-	List::iterator i = messagePos;
-	--i;
-	return *i;
+	return messageAt(messagePos);
 }
 
 void NetQueue::popMessage()
 {
 	ASSERT(canGetMessages, "Wrong NetQueue type for popMessage.");
-	ASSERT(messagePos != messages.begin(), "No message to pop!");
+	ASSERT_OR_RETURN(, numMessages != 0, "No message to pop!");
 
 	// Pop the message.
-	--messagePos;
+	messagePos += messageAt(messagePos).rawLen();
+	--numMessages;
 
 	// Recycle old data.
 	popOldMessages();
@@ -253,27 +305,30 @@ void NetQueue::popOldMessages()
 {
 	if (!canGetMessagesForNet)
 	{
-		dataPos = messages.begin();
+		dataPos = completeEnd;
+		numDataMessages = 0;
 	}
 	if (!canGetMessages)
 	{
-		messagePos = messages.begin();
+		messagePos = completeEnd;
+		numMessages = 0;
 	}
 
-	List::iterator i = messages.end();
-	while (i != dataPos && i != messagePos)
+	size_t used = std::min(dataPos, messagePos);
+	if (used == buffer.size())
 	{
-		--i;
+		// Everything used, so start again at the beginning of the buffer, keeping the memory.
+		buffer.clear();
+		dataPos = 0;
+		messagePos = 0;
+		completeEnd = 0;
 	}
-
-	if (i == dataPos)
+	else if (used > buffer.size() / 2)
 	{
-		dataPos = messages.end();  // Old iterator will become invalid.
+		// Some messages are still waiting, move them to the beginning of the buffer, so it doesn't keep growing.
+		buffer.erase(buffer.begin(), buffer.begin() + used);
+		dataPos -= used;
+		messagePos -= used;
+		completeEnd -= used;
 	}
-	if (i == messagePos)
-	{
-		messagePos = messages.end();  // Old iterator will become invalid.
-	}
-
-	messages.erase(i, messages.end());
 }
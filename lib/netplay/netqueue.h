@@ -32,7 +32,7 @@
 // At game level:
 // There should be a NetQueue representing each client.
 // Clients should serialise messages to their own queue.
-// Clients should call readRawData on their own queue, and send it over the network. (And popRawData when done.)
+// Clients should call getMessageForNet on their own queue, and send its rawData over the network. (And popMessageForNet when done.)
 // Clients should receive data from remote clients, and call writeRawData on the corresponding queues.
 // Clients should deserialise messages from all queues (including their own), such that all clients are processing the same data in the same way.
 
@@ -41,33 +41,52 @@
 
 
 /// A NetMessage consists of a type (uint8_t) and some data, the meaning of which depends on the type.
+/// A NetMessage doesn't own its data. It refers to the message in the same format as sent over the network (the type,
+/// the encoded length of the data, then the data), usually inside the buffer of a NetQueue. It is only valid until that
+/// NetQueue is next changed.
 class NetMessage
 {
 public:
-	NetMessage(uint8_t type_ = 0xFF) : type(type_) {}
-	uint8_t *rawDataDup() const;  ///< Returns data compatible with NetQueue::writeRawData(). Must be delete[]d.
-	size_t rawLen() const;        ///< Returns the length of the return value of rawDataDup().
+	NetMessage() : type(0xFF), data(nullptr), dataLen(0), raw(nullptr), rawLength(0) {}
+	NetMessage(const uint8_t *rawData, size_t rawLen);  ///< rawData must contain exactly one whole message.
+	const uint8_t *rawData() const  ///< Returns data compatible with NetQueue::writeRawData().
+	{
+		return raw;
+	}
+	size_t rawLen() const           ///< Returns the length of rawData().
+	{
+		return rawLength;
+	}
 	uint8_t type;
-	std::vector<uint8_t> data;
+	const uint8_t *data;            ///< The data, after the type and encoded length.
+	size_t dataLen;
+
+private:
+	const uint8_t *raw;
+	size_t rawLength;
 };
 
 /// MessageWriter is used for serialising, using the same interface as MessageReader.
+/// Writes directly to the end of the buffer, which is usually the buffer of a NetQueue, see NetQueue::beginMessage.
 class MessageWriter
 {
 public:
 	enum { Read, Write, Direction = Write };
 
-	MessageWriter(NetMessage *m = nullptr) : message(m) {}
-	MessageWriter(NetMessage &m) : message(&m) {}
+	MessageWriter(std::vector<uint8_t> *b = nullptr) : buffer(b) {}
 	void byte(uint8_t v) const
 	{
-		message->data.push_back(v);
+		buffer->push_back(v);
+	}
+	void bytes(const uint8_t *v, size_t size) const  ///< v must not point into the buffer.
+	{
+		buffer->insert(buffer->end(), v, v + size);
 	}
 	bool valid() const
 	{
 		return true;
 	}
-	NetMessage *message;
+	std::vector<uint8_t> *buffer;
 };
 /// MessageReader is used for deserialising, using the same interface as MessageWriter.
 class MessageReader
@@ -79,18 +98,19 @@ public:
 	MessageReader(const NetMessage &m) : message(&m), index(0) {}
 	void byte(uint8_t &v) const
 	{
-		v = index >= message->data.size() ? 0x00 : message->data[index];
+		v = index >= message->dataLen ? 0x00 : message->data[index];
 		++index;
 	}
 	bool valid() const
 	{
-		return index <= message->data.size();
+		return index <= message->dataLen;
 	}
 	const NetMessage *message;
 	mutable size_t index;
 };
 
 /// A NetQueue is a queue of NetMessages. A NetQueue can convert the messages into a stream of bytes, which can be sent over the network, and converted back into a queue of NetMessages by the NetQueue at the other end.
+/// The messages are stored one after another in a single buffer, in the same format as sent over the network, so adding, sending and reading messages doesn't allocate memory once the buffer is big enough.
 class NetQueue
 {
 public:
@@ -101,19 +121,22 @@ public:
 	// Network related, sending
 	void setWillNeverGetMessagesForNet();                              ///< Marks that we will not be sending this data over the network.
 	unsigned numMessagesForNet() const;                                ///< Checks that we didn't mark that we will not be sending this data over the network (returns 0), and returns the number of messages to be sent.
-	const NetMessage &getMessageForNet() const;                        ///< Extracts data from the NetQueue to send over the network.
+	NetMessage getMessageForNet() const;                               ///< Extracts data from the NetQueue to send over the network.
 	void popMessageForNet();                                           ///< Pops the extracted data, so that future getMessageForNet calls do not return that data.
 
 	// All game clients should check game messages from all queues, including their own, and only the net messages sent to them.
 	// Message related, storing.
-	void pushMessage(const NetMessage &message);                       ///< Adds a message to the queue.
+	void pushMessage(const NetMessage &message);                       ///< Adds a copy of a message to the queue. The message may be from this queue.
+	std::vector<uint8_t> *beginMessage(uint8_t type);                  ///< Starts adding a message to the queue. Returns the buffer to serialise the data into, with a MessageWriter.
+	NetMessage endMessage();                                           ///< Finishes the message started with beginMessage, and returns it.
 	// Message related, extracting.
 	void setWillNeverGetMessages();                                    ///< Marks that we will not be reading any of the messages (only sending over the network).
 	bool haveMessage() const;                                          ///< Return true if we have a message ready to return.
-	const NetMessage &getMessage() const;                              ///< Returns a message.
+	NetMessage getMessage() const;                                     ///< Returns a message.
 	void popMessage();                                                 ///< Pops the last returned message.
 
 private:
+	NetMessage messageAt(size_t pos) const;                            ///< Returns the message starting at buffer[pos].
 	void popOldMessages();                                             ///< Pops any messages that are no longer needed.
 
 	// Disable copy constructor and assignment operator.
@@ -123,11 +146,12 @@ private:
 	bool canGetMessagesForNet;                                         ///< True if we will send the messages over the network, false if we don't.
 	bool canGetMessages;                                               ///< True if we will get the messages, false if we don't use them ourselves.
 
-	typedef std::list<NetMessage> List;
-	List::iterator                dataPos;                             ///< Last message which was sent over the network.
-	List::iterator                messagePos;                          ///< Last message which was popped.
-	List                          messages;                            ///< List of messages. Messages are added to the front and read from the back.
-	std::vector<uint8_t>          incompleteReceivedMessageData;       ///< Data from network which has not yet formed an entire message.
+	std::vector<uint8_t>          buffer;                              ///< Messages, oldest first. Rewinds to the start whenever all messages have been used.
+	size_t                        dataPos;                             ///< Start of the next message to send over the network.
+	size_t                        messagePos;                          ///< Start of the next message to return from getMessage.
+	size_t                        completeEnd;                         ///< End of the last whole message. After this is data from the network which has not yet formed an entire message, or the message being serialised.
+	unsigned                      numDataMessages;                     ///< Number of messages from dataPos to completeEnd.
+	unsigned                      numMessages;                         ///< Number of messages from messagePos to completeEnd.
 };
 
 /// A NetQueuePair is used for talking to a socket. We insert NetMessages in the send NetQueue, which converts the messages into a stream of bytes for the
@@ -155,5 +179,7 @@ bool encode_uint32_t(uint8_t &b, uint32_t &v, unsigned n);
 /// Must init v to 0, does not modify b.
 /// Input is b, output is v.
 bool decode_uint32_t(uint8_t b, uint32_t &v, unsigned n);
+/// Returns the length of the message at the start of rawData, in the format sent over the network, or 0 if the whole message isn't there yet.
+size_t netMessageRawLen(const uint8_t *rawData, size_t available);
 
 #endif //_NET_QUEUE_H_
@@ -0,0 +1,283 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/**
+ * @file netreplay.cpp
+ *
+ * Recording and playback of the game queue messages of a game.
+ *
+ * File format, integers are big endian:
+ *   "WZrp", uint32_t format version, uint32_t netcode major and minor version, uint32_t settings length, settings.
+ *   Then a zlib stream of records, each a uint8_t player followed by a game queue message in the format sent over the network.
+ * The stream is only flushed at the end, but everything written before a crash can still be played back.
+ */
+#include "lib/framework/frame.h"
+#include "netreplay.h"
+
+#include <physfs.h>
+#include "lib/framework/physfs_ext.h"
+#include "lib/framework/wztime.h"
+
+#include "netcompress.h"
+#include "netplay.h"
+#include "netqueue.h"
+
+#include <algorithm>
+
+static const char replayMagic[4] = {'W', 'Z', 'r', 'p'};
+static const uint32_t replayFormatVersion = 1;
+static const uint32_t replayMaxSettingsSize = 1 << 24;  ///< Anything bigger isn't a replay.
+static const size_t replayChunkSize = 1 << 16;          ///< How much to write or read from the file at once.
+
+static PHYSFS_file *saveHandle = nullptr;
+static std::unique_ptr<WireCompressor> saveCompressor;
+static std::vector<uint8_t> saveBuffer;              ///< Compressed records which haven't been written yet.
+
+static PHYSFS_file *loadHandle = nullptr;
+static std::unique_ptr<WireDecompressor> loadDecompressor;
+static std::vector<uint8_t> loadCompressed;          ///< Compressed data read from the file, given to loadDecompressor.
+static std::vector<uint8_t> loadBuffer;              ///< Decompressed records.
+static size_t loadBufferUsed = 0;                    ///< How much of loadBuffer has been inserted into the game queues.
+static bool loadFinished = false;
+
+static uint32_t messageCount = 0;
+
+static bool writeSaveBuffer()
+{
+	PHYSFS_sint64 size = saveBuffer.size();
+	bool ok = size == 0 || WZ_PHYSFS_writeBytes(saveHandle, saveBuffer.data(), static_cast<PHYSFS_uint32>(size)) == size;
+	if (!ok)
+	{
+		debug(LOG_ERROR, "Could not write replay: %s", WZ_PHYSFS_getLastError());
+	}
+	saveBuffer.clear();
+	return ok;
+}
+
+bool NETreplaySaveStart(const std::string &subdir, const std::string &settings)
+{
+	ASSERT_OR_RETURN(false, saveHandle == nullptr, "Already recording a replay.");
+	if (NETisReplay())
+	{
+		return false;  // The replay being played back already has everything.
+	}
+
+	std::string filename = "replay/" + subdir + "/" + formatLocalDateTime("%Y%m%d_%H%M%S") + ".wzrp";
+	saveHandle = PHYSFS_openWrite(filename.c_str());
+	if (saveHandle == nullptr)
+	{
+		debug(LOG_ERROR, "Could not create replay %s: %s", filename.c_str(), WZ_PHYSFS_getLastError());
+		return false;
+	}
+
+	bool ok = WZ_PHYSFS_writeBytes(saveHandle, replayMagic, sizeof(replayMagic)) == sizeof(replayMagic)
+	          && PHYSFS_writeUBE32(saveHandle, replayFormatVersion)
+	          && PHYSFS_writeUBE32(saveHandle, NETGetMajorVersion())
+	          && PHYSFS_writeUBE32(saveHandle, NETGetMinorVersion())
+	          && PHYSFS_writeUBE32(saveHandle, static_cast<PHYSFS_uint32>(settings.size()))
+	          && WZ_PHYSFS_writeBytes(saveHandle, settings.data(), static_cast<PHYSFS_uint32>(settings.size())) == static_cast<PHYSFS_sint64>(settings.size());
+	if (!ok)
+	{
+		debug(LOG_ERROR, "Could not write replay %s: %s", filename.c_str(), WZ_PHYSFS_getLastError());
+		PHYSFS_close(saveHandle);
+		saveHandle = nullptr;
+		return false;
+	}
+
+	saveCompressor = makeWireCompressor(WIRE_COMPRESSION_ZLIB, wireCompressionDefaultLevel(WIRE_COMPRESSION_ZLIB));
+	saveBuffer.clear();
+	messageCount = 0;
+	debug(LOG_INFO, "Recording replay %s", filename.c_str());
+	return true;
+}
+
+bool NETreplaySaveStop()
+{
+	if (saveHandle == nullptr)
+	{
+		return false;
+	}
+
+	saveCompressor->flush(saveBuffer);
+	bool ok = writeSaveBuffer();
+	ok = PHYSFS_close(saveHandle) != 0 && ok;
+	saveHandle = nullptr;
+	saveCompressor.reset();
+	debug(LOG_INFO, "Recorded %u messages to replay.", messageCount);
+	return ok;
+}
+
+void NETreplaySaveNetMessage(NetMessage const &message, uint8_t player)
+{
+	if (saveHandle == nullptr)
+	{
+		return;
+	}
+
+	saveCompressor->compress(&player, 1, saveBuffer);
+	saveCompressor->compress(message.rawData(), message.rawLen(), saveBuffer);
+	++messageCount;
+
+	if (saveBuffer.size() >= replayChunkSize && !writeSaveBuffer())
+	{
+		NETreplaySaveStop();  // Don't keep trying to write a broken file every tick.
+	}
+}
+
+bool NETreplayLoadStart(const std::string &filename, std::string &settings)
+{
+	NETreplayLoadStop();
+
+	loadHandle = PHYSFS_openRead(filename.c_str());
+	if (loadHandle == nullptr)
+	{
+		debug(LOG_ERROR, "Could not open replay %s: %s", filename.c_str(), WZ_PHYSFS_getLastError());
+		return false;
+	}
+
+	char magic[sizeof(replayMagic)];
+	uint32_t version = 0, major = 0, minor = 0, settingsSize = 0;
+	bool ok = WZ_PHYSFS_readBytes(loadHandle, magic, sizeof(magic)) == sizeof(magic) && memcmp(magic, replayMagic, sizeof(magic)) == 0
+	          && PHYSFS_readUBE32(loadHandle, &version) && version == replayFormatVersion
+	          && PHYSFS_readUBE32(loadHandle, &major)
+	          && PHYSFS_readUBE32(loadHandle, &minor)
+	          && PHYSFS_readUBE32(loadHandle, &settingsSize) && settingsSize <= replayMaxSettingsSize;
+	if (ok)
+	{
+		settings.resize(settingsSize);
+		ok = WZ_PHYSFS_readBytes(loadHandle, &settings[0], settingsSize) == settingsSize;
+	}
+	if (!ok)
+	{
+		debug(LOG_ERROR, "%s is not a replay, or is from an incompatible version.", filename.c_str());
+		PHYSFS_close(loadHandle);
+		loadHandle = nullptr;
+		return false;
+	}
+	if (major != (uint32_t)NETGetMajorVersion() || minor != (uint32_t)NETGetMinorVersion())
+	{
+		debug(LOG_WARNING, "Replay %s was recorded with netcode version %u.%u, not %d.%d, so it will probably desync.", filename.c_str(), major, minor, NETGetMajorVersion(), NETGetMinorVersion());
+	}
+
+	loadDecompressor = makeWireDecompressor(WIRE_COMPRESSION_ZLIB);
+	loadBuffer.clear();
+	loadBufferUsed = 0;
+	loadFinished = false;
+	messageCount = 0;
+	debug(LOG_INFO, "Playing back replay %s", filename.c_str());
+	return true;
+}
+
+bool NETreplayLoadStop()
+{
+	if (loadHandle == nullptr)
+	{
+		return false;
+	}
+
+	PHYSFS_close(loadHandle);
+	loadHandle = nullptr;
+	loadDecompressor.reset();
+	loadCompressed.clear();
+	loadBuffer.clear();
+	loadBufferUsed = 0;
+	return true;
+}
+
+/// Decompresses more of the file into loadBuffer. Returns false at the end of the file.
+static bool readLoadBuffer()
+{
+	loadBuffer.erase(loadBuffer.begin(), loadBuffer.begin() + loadBufferUsed);
+	loadBufferUsed = 0;
+
+	while (true)
+	{
+		if (loadDecompressor->needInput())
+		{
+			loadCompressed.resize(replayChunkSize);
+			PHYSFS_sint64 size = WZ_PHYSFS_readBytes(loadHandle, loadCompressed.data(), static_cast<PHYSFS_uint32>(loadCompressed.size()));
+			if (size <= 0)
+			{
+				return false;
+			}
+			loadDecompressor->input(loadCompressed.data(), size);
+		}
+
+		size_t alreadyHave = loadBuffer.size();
+		loadBuffer.resize(alreadyHave + replayChunkSize);
+		ssize_t size = loadDecompressor->decompress(&loadBuffer[alreadyHave], replayChunkSize);
+		loadBuffer.resize(alreadyHave + std::max<ssize_t>(size, 0));
+		if (size < 0)
+		{
+			debug(LOG_ERROR, "Replay is corrupt after %u messages.", messageCount);
+			return false;
+		}
+		if (size > 0)
+		{
+			return true;
+		}
+	}
+}
+
+bool NETreplayLoadNetMessage()
+{
+	if (loadHandle == nullptr || loadFinished)
+	{
+		return false;
+	}
+
+	size_t rawLen = 0;
+	while (loadBuffer.size() - loadBufferUsed < 2 || (rawLen = netMessageRawLen(&loadBuffer[loadBufferUsed + 1], loadBuffer.size() - loadBufferUsed - 1)) == 0)
+	{
+		if (!readLoadBuffer())
+		{
+			loadFinished = true;
+			debug(LOG_INFO, "End of replay, after %u messages.", messageCount);
+			return false;
+		}
+	}
+
+	uint8_t player = loadBuffer[loadBufferUsed];
+	uint8_t *rawData = &loadBuffer[loadBufferUsed + 1];
+	loadBufferUsed += 1 + rawLen;
+	if (player >= MAX_PLAYERS)
+	{
+		loadFinished = true;
+		debug(LOG_ERROR, "Replay has a message from player %u, after %u messages.", player, messageCount);
+		return false;
+	}
+
+	NETinsertRawData(NETgameQueue(player), rawData, rawLen);
+	++messageCount;
+	return true;
+}
+
+bool NETisReplay()
+{
+	return loadHandle != nullptr;
+}
+
+bool NETreplayLoadFinished()
+{
+	return loadFinished;
+}
+
+uint32_t NETreplayMessageCount()
+{
+	return messageCount;
+}
@@ -0,0 +1,48 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/**
+ * @file netreplay.h
+ *
+ * Recording and playback of the game queue messages of a game.
+ *
+ * A replay is the settings the game was started with, followed by every game queue message in the order it was processed.
+ * Since the game is deterministic given those, feeding the messages back into the game queues re-runs the same game.
+ */
+#ifndef _NET_REPLAY_H_
+#define _NET_REPLAY_H_
+
+#include "lib/framework/types.h"
+#include <string>
+
+class NetMessage;
+
+/// Starts recording to a new file in replay/<subdir>/. settings is stored as is, and given back by NETreplayLoadStart.
+bool NETreplaySaveStart(const std::string &subdir, const std::string &settings);
+bool NETreplaySaveStop();
+void NETreplaySaveNetMessage(NetMessage const &message, uint8_t player);  ///< Records a game queue message as it is processed. Does nothing if not recording.
+
+/// Starts playing back a replay, and returns the settings it was recorded with.
+bool NETreplayLoadStart(const std::string &filename, std::string &settings);
+bool NETreplayLoadStop();
+bool NETreplayLoadNetMessage();  ///< Inserts the next message of the replay into its game queue. Returns false at the end of the replay.
+bool NETisReplay();              ///< Returns true while playing back. Messages sent to the game queues are then discarded, since the replay has all of them.
+bool NETreplayLoadFinished();    ///< Returns true once all the messages of the replay have been inserted.
+uint32_t NETreplayMessageCount();  ///< Returns the number of messages saved or loaded so far.
+
+#endif //_NET_REPLAY_H_
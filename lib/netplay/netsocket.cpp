@@ -29,12 +29,19 @@
 
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <map>
+#include <memory>
 
-#if !defined(ZLIB_CONST)
-#  define ZLIB_CONST
+#if defined(WZ_OS_UNIX)
+# include <poll.h>
 #endif
-#include <zlib.h>
+#if defined(WZ_OS_LINUX)
+# include <sys/epoll.h>
+# include <sys/eventfd.h>
+#endif
+
 
 enum
 {
@@ -52,12 +59,8 @@ struct Socket
 	 *
 	 * All non-listening sockets will only use the first socket handle.
 	 */
-	Socket() : ready(false), writeError(false), deleteLater(false), isCompressed(false), readDisconnected(false), zDeflateInSize(0)
-	{
-		memset(&zDeflate, 0, sizeof(zDeflate));
-		memset(&zInflate, 0, sizeof(zInflate));
-	}
-	~Socket();
+	Socket() : ready(false), writeError(false), deleteLater(false), isCompressed(false), readDisconnected(false), compression(WIRE_COMPRESSION_ZLIB), compressorInSize(0), writeQueueSent(0), writeRegistered(false)
+	{}
 
 	SOCKET fd[SOCK_COUNT];
 	bool ready;
@@ -67,19 +70,51 @@ struct Socket
 
 	bool isCompressed;
 	bool readDisconnected;  ///< True iff a call to recv() returned 0.
-	z_stream zDeflate;
-	z_stream zInflate;
-	unsigned zDeflateInSize;
-	bool zInflateNeedInput;
-	std::vector<uint8_t> zDeflateOutBuf;
-	std::vector<uint8_t> zInflateInBuf;
+	WireCompression compression;        ///< Codec of compressor and decompressor, once isCompressed.
+	std::unique_ptr<WireCompressor> compressor;
+	std::unique_ptr<WireDecompressor> decompressor;
+	unsigned compressorInSize;
+	std::vector<uint8_t> compressorOutBuf;
+	std::vector<uint8_t> decompressorInBuf;
+
+	// Only used by EpollWriteBackend, which has a queue per socket.
+	wz::mutex writeMutex;               ///< Protects writeQueue, writeQueueSent, writeError and deleteLater.
+	std::vector<uint8_t> writeQueue;
+	size_t writeQueueSent;              ///< Bytes at the start of writeQueue which have already been sent.
+	bool writeRegistered;               ///< True once added to the epoll set of the write thread.
 };
 
 struct SocketSet
 {
 	std::vector<Socket *> fds;
+#if defined(WZ_OS_LINUX)
+	int epollFd = -1;                   ///< Watches fds for reading, if made by allocSocketSet. Otherwise checkSockets uses poll().
+	mutable std::vector<struct epoll_event> events;
+#endif
 };
 
+/// Sends the data given to writeAll and socketFlush in the background, and closes sockets once their data is sent.
+class SocketWriteBackend
+{
+public:
+	virtual ~SocketWriteBackend() = default;
+	virtual void write(Socket *sock, uint8_t const *data, size_t size) = 0;  ///< Queues data to send. May send some of it straight away.
+	virtual void close(Socket *sock) = 0;                                     ///< Closes and deletes the socket, once its queued data is sent.
+};
+
+static std::unique_ptr<SocketWriteBackend> socketWriteBackend;
+
+/// Totals over all sockets using a codec. Atomic, since sockets aren't all used from the same thread.
+struct CompressionCounters
+{
+	std::atomic<size_t> compressedSent{0};
+	std::atomic<size_t> uncompressedSent{0};
+	std::atomic<uint64_t> nanosecondsSent{0};
+	std::atomic<size_t> compressedReceived{0};
+	std::atomic<size_t> uncompressedReceived{0};
+	std::atomic<uint64_t> nanosecondsReceived{0};
+};
+static CompressionCounters compressionCounters[WIRE_COMPRESSION_COUNT];
 
 static WZ_MUTEX *socketThreadMutex;
 static WZ_SEMAPHORE *socketThreadSemaphore;
@@ -346,7 +381,8 @@ const char *strSockError(int error)
  */
 static bool connectionIsOpen(Socket *sock)
 {
-	const SocketSet set = {std::vector<Socket *>(1, sock)};
+	SocketSet set;
+	set.fds.push_back(sock);
 
 	ASSERT_OR_RETURN((setSockErr(EBADF), false),
 	                 sock && sock->fd[SOCK_CONNECTION] != INVALID_SOCKET, "Invalid socket");
@@ -500,6 +536,299 @@ static int socketThreadFunction(void *)
 	return 42;  // Return value arbitrary and unused.
 }
 
+/// Portable backend. One thread calls select() on all sockets with queued data, and one lock protects all the queues.
+class SelectWriteBackend : public SocketWriteBackend
+{
+public:
+	SelectWriteBackend()
+	{
+		socketThreadQuit = false;
+		socketThreadMutex = wzMutexCreate();
+		socketThreadSemaphore = wzSemaphoreCreate(0);
+		socketThread = wzThreadCreate(socketThreadFunction, nullptr);
+		wzThreadStart(socketThread);
+	}
+
+	~SelectWriteBackend() override
+	{
+		wzMutexLock(socketThreadMutex);
+		socketThreadQuit = true;
+		socketThreadWrites.clear();
+		wzMutexUnlock(socketThreadMutex);
+		wzSemaphorePost(socketThreadSemaphore);  // Wake up the thread, so it can quit.
+		wzThreadJoin(socketThread);
+		wzMutexDestroy(socketThreadMutex);
+		wzSemaphoreDestroy(socketThreadSemaphore);
+		socketThread = nullptr;
+	}
+
+	void write(Socket *sock, uint8_t const *data, size_t size) override
+	{
+		wzMutexLock(socketThreadMutex);
+		if (socketThreadWrites.empty())
+		{
+			wzSemaphorePost(socketThreadSemaphore);
+		}
+		std::vector<uint8_t> &writeQueue = socketThreadWrites[sock];
+		writeQueue.insert(writeQueue.end(), data, data + size);
+		wzMutexUnlock(socketThreadMutex);
+	}
+
+	void close(Socket *sock) override
+	{
+		wzMutexLock(socketThreadMutex);
+		//Instead of socketThreadWrites.erase(sock);, try sending the data before actually deleting.
+		if (socketThreadWrites.find(sock) != socketThreadWrites.end())
+		{
+			// Wait until the data is written, then delete the socket.
+			sock->deleteLater = true;
+		}
+		else
+		{
+			// Delete the socket.
+			socketCloseNow(sock);
+		}
+		wzMutexUnlock(socketThreadMutex);
+	}
+};
+
+#if defined(WZ_OS_LINUX)
+/// Sends as much of the data as the socket will take, without blocking. Returns the number of bytes sent. Call with sock->writeMutex locked.
+static size_t epollSend(Socket *sock, uint8_t const *data, size_t size)
+{
+	size_t sent = 0;
+	while (sent < size && !sock->writeError)
+	{
+		ssize_t ret = send(sock->fd[SOCK_CONNECTION], reinterpret_cast<char const *>(data + sent), size - sent, MSG_NOSIGNAL | MSG_DONTWAIT);
+		if (ret != SOCKET_ERROR)
+		{
+			sent += ret;
+			continue;
+		}
+		switch (getSockErr())
+		{
+		case EINTR:
+			continue;
+		case EAGAIN:
+#if defined(EWOULDBLOCK) && EAGAIN != EWOULDBLOCK
+		case EWOULDBLOCK:
+#endif
+			return sent;  // Socket buffer full, epoll says when there is room again.
+		default:
+			debug(LOG_NET, "Socket error: %s", strSockError(getSockErr()));
+			sock->writeError = true;  // Socket broken, don't try writing to it again.
+			break;
+		}
+	}
+	return sent;
+}
+
+/// Sends as much of the socket's write queue as it will take, without blocking. Call with sock->writeMutex locked.
+static void epollSendQueued(Socket *sock)
+{
+	sock->writeQueueSent += epollSend(sock, sock->writeQueue.data() + sock->writeQueueSent, sock->writeQueue.size() - sock->writeQueueSent);
+	if (sock->writeQueueSent == sock->writeQueue.size() || sock->writeError)
+	{
+		sock->writeQueue.clear();
+		sock->writeQueueSent = 0;
+	}
+}
+
+/// Linux backend. Each socket has its own queue and lock, and data is sent straight away if nothing is queued before it.
+/// The thread only sends what the socket couldn't take, when edge-triggered epoll says there is room, so it never polls
+/// idle sockets and doesn't wake up on a timer.
+class EpollWriteBackend : public SocketWriteBackend
+{
+public:
+	/// Returns nullptr if epoll isn't available, in which case SelectWriteBackend should be used instead.
+	static std::unique_ptr<SocketWriteBackend> create()
+	{
+		int epollFd = epoll_create1(EPOLL_CLOEXEC);
+		if (epollFd == -1)
+		{
+			debug(LOG_WARNING, "epoll_create1 failed: %s", strSockError(getSockErr()));
+			return nullptr;
+		}
+		int wakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.ptr = nullptr;  // Not a socket.
+		if (wakeFd == -1 || epoll_ctl(epollFd, EPOLL_CTL_ADD, wakeFd, &event) == -1)
+		{
+			debug(LOG_WARNING, "eventfd failed: %s", strSockError(getSockErr()));
+			if (wakeFd != -1)
+			{
+				::close(wakeFd);
+			}
+			::close(epollFd);
+			return nullptr;
+		}
+		return std::unique_ptr<SocketWriteBackend>(new EpollWriteBackend(epollFd, wakeFd));
+	}
+
+	~EpollWriteBackend() override
+	{
+		quit = true;
+		wake();
+		wzThreadJoin(thread);
+		for (Socket *sock : closing)
+		{
+			socketCloseNow(sock);
+		}
+		::close(wakeFd);
+		::close(epollFd);
+	}
+
+	void write(Socket *sock, uint8_t const *data, size_t size) override
+	{
+		std::lock_guard<wz::mutex> lock(sock->writeMutex);
+		if (sock->writeError)
+		{
+			return;
+		}
+		if (!sock->writeRegistered)
+		{
+			struct epoll_event event;
+			event.events = EPOLLOUT | EPOLLET;
+			event.data.ptr = sock;
+			if (epoll_ctl(epollFd, EPOLL_CTL_ADD, sock->fd[SOCK_CONNECTION], &event) == -1)
+			{
+				debug(LOG_ERROR, "epoll_ctl failed: %s", strSockError(getSockErr()));
+				sock->writeError = true;
+				return;
+			}
+			sock->writeRegistered = true;
+		}
+
+		if (sock->writeQueue.empty())
+		{
+			// Nothing waiting, so send straight from the caller's buffer, and only queue what the socket won't take.
+			size_t sent = epollSend(sock, data, size);
+			data += sent;
+			size -= sent;
+			if (size == 0 || sock->writeError)
+			{
+				return;
+			}
+		}
+
+		// The socket is full, the thread sends the rest when epoll says there is room.
+		if (sock->writeQueueSent > sock->writeQueue.size() / 2)
+		{
+			// Drop what has been sent, so the queue doesn't keep growing while the socket is busy.
+			sock->writeQueue.erase(sock->writeQueue.begin(), sock->writeQueue.begin() + sock->writeQueueSent);
+			sock->writeQueueSent = 0;
+		}
+		sock->writeQueue.insert(sock->writeQueue.end(), data, data + size);
+	}
+
+	void close(Socket *sock) override
+	{
+		bool registered;
+		{
+			std::lock_guard<wz::mutex> lock(sock->writeMutex);
+			if (!sock->writeQueue.empty())
+			{
+				sock->deleteLater = true;  // The thread deletes the socket after sending the rest.
+				return;
+			}
+			registered = sock->writeRegistered;
+		}
+		if (!registered)
+		{
+			socketCloseNow(sock);  // The thread has never seen this socket.
+			return;
+		}
+		// The thread may be handling an event for this socket right now, so let it delete the socket.
+		std::lock_guard<wz::mutex> lock(closeMutex);
+		closing.push_back(sock);
+		wake();
+	}
+
+private:
+	EpollWriteBackend(int epollFd, int wakeFd) : epollFd(epollFd), wakeFd(wakeFd), quit(false)
+	{
+		thread = wzThreadCreate(threadFunction, this);
+		wzThreadStart(thread);
+	}
+
+	void wake()
+	{
+		uint64_t one = 1;
+		if (::write(wakeFd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+		{
+			debug(LOG_ERROR, "Failed to wake socket thread: %s", strSockError(getSockErr()));
+		}
+	}
+
+	static int threadFunction(void *backend)
+	{
+		static_cast<EpollWriteBackend *>(backend)->run();
+		return 42;  // Return value arbitrary and unused.
+	}
+
+	void run()
+	{
+		struct epoll_event events[64];
+		std::vector<Socket *> toClose;
+		while (!quit)
+		{
+			int ret = epoll_wait(epollFd, events, ARRAY_SIZE(events), -1);
+			if (ret == -1)
+			{
+				if (errno != EINTR)
+				{
+					debug(LOG_ERROR, "epoll_wait failed: %s", strSockError(getSockErr()));
+				}
+				continue;
+			}
+
+			for (int i = 0; i < ret; ++i)
+			{
+				Socket *sock = static_cast<Socket *>(events[i].data.ptr);
+				if (sock == nullptr)
+				{
+					uint64_t count;
+					if (::read(wakeFd, &count, sizeof(count)) == -1 && errno != EAGAIN)
+					{
+						debug(LOG_ERROR, "Failed to reset socket thread wakeup: %s", strSockError(getSockErr()));
+					}
+					continue;
+				}
+
+				bool done;
+				{
+					std::lock_guard<wz::mutex> lock(sock->writeMutex);
+					epollSendQueued(sock);
+					done = sock->deleteLater && sock->writeQueue.empty();
+				}
+				if (done)
+				{
+					socketCloseNow(sock);
+				}
+			}
+
+			{
+				std::lock_guard<wz::mutex> lock(closeMutex);
+				toClose.swap(closing);
+			}
+			for (Socket *sock : toClose)
+			{
+				socketCloseNow(sock);
+			}
+			toClose.clear();
+		}
+	}
+
+	int epollFd;
+	int wakeFd;                       ///< eventfd for waking the thread up, to delete closed sockets or quit.
+	WZ_THREAD *thread;
+	std::atomic<bool> quit;
+	wz::mutex closeMutex;             ///< Protects closing.
+	std::vector<Socket *> closing;    ///< Closed sockets, which the thread deletes after handling its current events.
+};
+#endif
+
 /**
  * Similar to read(2) with the exception that this function won't be
  * interrupted by signals (EINTR).
@@ -519,17 +848,17 @@ ssize_t readNoInt(Socket *sock, void *buf, size_t max_size, size_t *rawByteCount
 
 	if (sock->isCompressed)
 	{
-		if (sock->zInflateNeedInput)
+		if (sock->decompressor->needInput())
 		{
 			// No input data, read some.
 
-			sock->zInflateInBuf.resize(max_size + 1000);
+			sock->decompressorInBuf.resize(max_size + 1000);
 
 			ssize_t received;
 			do
 			{
 				//                                                  v----- This weird cast is because recv() takes a char * on windows instead of a void *...
-				received = recv(sock->fd[SOCK_CONNECTION], (char *)&sock->zInflateInBuf[0], sock->zInflateInBuf.size(), 0);
+				received = recv(sock->fd[SOCK_CONNECTION], (char *)&sock->decompressorInBuf[0], sock->decompressorInBuf.size(), 0);
 			}
 			while (received == SOCKET_ERROR && getSockErr() == EINTR);
 			if (received < 0)
@@ -537,44 +866,22 @@ ssize_t readNoInt(Socket *sock, void *buf, size_t max_size, size_t *rawByteCount
 				return received;
 			}
 
-			sock->zInflate.next_in = &sock->zInflateInBuf[0];
-			sock->zInflate.avail_in = received;
+			sock->decompressor->input(&sock->decompressorInBuf[0], received);
 			rawBytes = received;
 
 			if (received == 0)
 			{
 				sock->readDisconnected = true;
 			}
-			else
-			{
-				sock->zInflateNeedInput = false;
-			}
 		}
 
-		sock->zInflate.next_out = (Bytef *)buf;
-		sock->zInflate.avail_out = max_size;
-		int ret = inflate(&sock->zInflate, Z_NO_FLUSH);
-		ASSERT(ret != Z_STREAM_ERROR, "zlib inflate not working!");
-		char const *err = nullptr;
-		switch (ret)
-		{
-		case Z_NEED_DICT:  err = "Z_NEED_DICT";  break;
-		case Z_DATA_ERROR: err = "Z_DATA_ERROR"; break;
-		case Z_MEM_ERROR:  err = "Z_MEM_ERROR";  break;
-		}
-		if (err != nullptr)
-		{
-			debug(LOG_ERROR, "Couldn't decompress data from socket. zlib error %s", err);
-			return -1;  // Bad data!
-		}
-
-		if (sock->zInflate.avail_out != 0)
-		{
-			sock->zInflateNeedInput = true;
-			ASSERT(sock->zInflate.avail_in == 0, "zlib not consuming all input!");
-		}
-
-		return max_size - sock->zInflate.avail_out;  // Got some data, return how much.
+		CompressionCounters &counters = compressionCounters[sock->compression];
+		auto start = std::chrono::steady_clock::now();
+		ssize_t decompressed = sock->decompressor->decompress(static_cast<uint8_t *>(buf), max_size);
+		counters.nanosecondsReceived += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		counters.compressedReceived += rawBytes;
+		counters.uncompressedReceived += std::max<ssize_t>(decompressed, 0);
+		return decompressed;
 	}
 
 	ssize_t received;
@@ -627,61 +934,19 @@ ssize_t writeAll(Socket *sock, const void *buf, size_t size, size_t *rawByteCoun
 	{
 		if (!sock->isCompressed)
 		{
-			wzMutexLock(socketThreadMutex);
-			if (socketThreadWrites.empty())
-			{
-				wzSemaphorePost(socketThreadSemaphore);
-			}
-			std::vector<uint8_t> &writeQueue = socketThreadWrites[sock];
-			writeQueue.insert(writeQueue.end(), static_cast<char const *>(buf), static_cast<char const *>(buf) + size);
-			wzMutexUnlock(socketThreadMutex);
+			socketWriteBackend->write(sock, static_cast<uint8_t const *>(buf), size);
 			rawBytes = size;
 		}
 		else
 		{
-		#if ZLIB_VERNUM < 0x1252
-			// zlib < 1.2.5.2 does not support `#define ZLIB_CONST`
-			// Unfortunately, some OSes (ex. OpenBSD) ship with zlib < 1.2.5.2
-			// Workaround: cast away the const of the input, and disable the resulting -Wcast-qual warning
-			#if defined(__clang__)
-			#  pragma clang diagnostic push
-			#  pragma clang diagnostic ignored "-Wcast-qual"
-			#elif defined(__GNUC__)
-			#  pragma GCC diagnostic push
-			#  pragma GCC diagnostic ignored "-Wcast-qual"
-			#endif
-
-			// cast away the const for earlier zlib versions
-			sock->zDeflate.next_in = (Bytef *)buf; // -Wcast-qual
-
-			#if defined(__clang__)
-			#  pragma clang diagnostic pop
-			#elif defined(__GNUC__)
-			#  pragma GCC diagnostic pop
-			#endif
-		#else
-			// zlib >= 1.2.5.2 supports ZLIB_CONST
-			sock->zDeflate.next_in = (const Bytef *)buf;
-		#endif
-
-			sock->zDeflate.avail_in = size;
-			sock->zDeflateInSize += sock->zDeflate.avail_in;
-			do
-			{
-				size_t alreadyHave = sock->zDeflateOutBuf.size();
-				sock->zDeflateOutBuf.resize(alreadyHave + size + 20);  // A bit more than size should be enough to always do everything in one go.
-				sock->zDeflate.next_out = (Bytef *)&sock->zDeflateOutBuf[alreadyHave];
-				sock->zDeflate.avail_out = sock->zDeflateOutBuf.size() - alreadyHave;
-
-				int ret = deflate(&sock->zDeflate, Z_NO_FLUSH);
-				ASSERT(ret != Z_STREAM_ERROR, "zlib compression failed!");
-
-				// Remove unused part of buffer.
-				sock->zDeflateOutBuf.resize(sock->zDeflateOutBuf.size() - sock->zDeflate.avail_out);
-			}
-			while (sock->zDeflate.avail_out == 0);
-
-			ASSERT(sock->zDeflate.avail_in == 0, "zlib didn't compress everything!");
+			CompressionCounters &counters = compressionCounters[sock->compression];
+			size_t alreadyHave = sock->compressorOutBuf.size();
+			auto start = std::chrono::steady_clock::now();
+			sock->compressor->compress(static_cast<uint8_t const *>(buf), size, sock->compressorOutBuf);
+			counters.nanosecondsSent += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+			counters.uncompressedSent += size;
+			counters.compressedSent += sock->compressorOutBuf.size() - alreadyHave;
+			sock->compressorInSize += size;
 		}
 	}
 
@@ -696,98 +961,96 @@ void socketFlush(Socket *sock, size_t *rawByteCount)
 
 	if (!sock->isCompressed)
 	{
-		return;  // Not compressed, so don't mess with zlib.
+		return;  // Not compressed, so nothing to flush.
 	}
 
-	// Flush data out of zlib compression state.
-	do
-	{
-		sock->zDeflate.next_in = (Bytef *)nullptr;
-		sock->zDeflate.avail_in = 0;
-		size_t alreadyHave = sock->zDeflateOutBuf.size();
-		sock->zDeflateOutBuf.resize(alreadyHave + 1000);  // 100 bytes would probably be enough to flush the rest in one go.
-		sock->zDeflate.next_out = (Bytef *)&sock->zDeflateOutBuf[alreadyHave];
-		sock->zDeflate.avail_out = sock->zDeflateOutBuf.size() - alreadyHave;
-
-		int ret = deflate(&sock->zDeflate, Z_PARTIAL_FLUSH);
-		ASSERT(ret != Z_STREAM_ERROR, "zlib compression failed!");
-
-		// Remove unused part of buffer.
-		sock->zDeflateOutBuf.resize(sock->zDeflateOutBuf.size() - sock->zDeflate.avail_out);
-	}
-	while (sock->zDeflate.avail_out == 0);
+	// Flush data out of the compression state.
+	CompressionCounters &counters = compressionCounters[sock->compression];
+	size_t alreadyHave = sock->compressorOutBuf.size();
+	auto start = std::chrono::steady_clock::now();
+	sock->compressor->flush(sock->compressorOutBuf);
+	counters.nanosecondsSent += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	counters.compressedSent += sock->compressorOutBuf.size() - alreadyHave;
 
-	if (sock->zDeflateOutBuf.empty())
+	if (sock->compressorOutBuf.empty())
 	{
 		return;  // No data to flush out.
 	}
 
-	wzMutexLock(socketThreadMutex);
-	if (socketThreadWrites.empty())
-	{
-		wzSemaphorePost(socketThreadSemaphore);
-	}
-	std::vector<uint8_t> &writeQueue = socketThreadWrites[sock];
-	writeQueue.insert(writeQueue.end(), sock->zDeflateOutBuf.begin(), sock->zDeflateOutBuf.end());
-	wzMutexUnlock(socketThreadMutex);
+	socketWriteBackend->write(sock, sock->compressorOutBuf.data(), sock->compressorOutBuf.size());
 
 	// Primitive network logging, uncomment to use.
-	//printf("Size %3u ->%3zu, buf =", sock->zDeflateInSize, sock->zDeflateOutBuf.size());
-	//for (unsigned n = 0; n < std::min<unsigned>(sock->zDeflateOutBuf.size(), 40); ++n) printf(" %02X", sock->zDeflateOutBuf[n]);
+	//printf("Size %3u ->%3zu, buf =", sock->compressorInSize, sock->compressorOutBuf.size());
+	//for (unsigned n = 0; n < std::min<unsigned>(sock->compressorOutBuf.size(), 40); ++n) printf(" %02X", sock->compressorOutBuf[n]);
 	//printf("\n");
 
 	// Data sent, don't send again.
-	rawBytes = sock->zDeflateOutBuf.size();
-	sock->zDeflateInSize = 0;
-	sock->zDeflateOutBuf.clear();
+	rawBytes = sock->compressorOutBuf.size();
+	sock->compressorInSize = 0;
+	sock->compressorOutBuf.clear();
 }
 
-void socketBeginCompression(Socket *sock)
+void socketBeginCompression(Socket *sock, WireCompression codec, int level)
 {
 	if (sock->isCompressed)
 	{
 		return;  // Nothing to do.
 	}
 
-	wzMutexLock(socketThreadMutex);
-
-	// Init deflate.
-	sock->zDeflate.zalloc = Z_NULL;
-	sock->zDeflate.zfree = Z_NULL;
-	sock->zDeflate.opaque = Z_NULL;
-	int ret = deflateInit(&sock->zDeflate, 6);
-	ASSERT(ret == Z_OK, "deflateInit failed! Sockets won't work.");
-
-	sock->zInflate.zalloc = Z_NULL;
-	sock->zInflate.zfree = Z_NULL;
-	sock->zInflate.opaque = Z_NULL;
-	sock->zInflate.avail_in = 0;
-	sock->zInflate.next_in = Z_NULL;
-	ret = inflateInit(&sock->zInflate);
-	ASSERT(ret == Z_OK, "deflateInit failed! Sockets won't work.");
-
-	sock->zInflateNeedInput = true;
+	sock->compression = codec;
+	sock->compressor = makeWireCompressor(codec, level);
+	sock->decompressor = makeWireDecompressor(codec);
 
 	sock->isCompressed = true;
-	wzMutexUnlock(socketThreadMutex);
 }
 
-Socket::~Socket()
+SocketCompressionStatistics socketCompressionStatistics(WireCompression codec)
 {
-	if (isCompressed)
+	CompressionCounters const &counters = compressionCounters[codec];
+	SocketCompressionStatistics stats;
+	stats.compressedSent = counters.compressedSent;
+	stats.uncompressedSent = counters.uncompressedSent;
+	stats.microsecondsSent = counters.nanosecondsSent / 1000;
+	stats.compressedReceived = counters.compressedReceived;
+	stats.uncompressedReceived = counters.uncompressedReceived;
+	stats.microsecondsReceived = counters.nanosecondsReceived / 1000;
+	return stats;
+}
+
+void socketResetCompressionStatistics()
+{
+	for (CompressionCounters &counters : compressionCounters)
 	{
-		deflateEnd(&zDeflate);
-		deflateEnd(&zInflate);
+		counters.compressedSent = 0;
+		counters.uncompressedSent = 0;
+		counters.nanosecondsSent = 0;
+		counters.compressedReceived = 0;
+		counters.uncompressedReceived = 0;
+		counters.nanosecondsReceived = 0;
 	}
 }
 
 SocketSet *allocSocketSet()
 {
-	return new SocketSet;
+	SocketSet *set = new SocketSet;
+#if defined(WZ_OS_LINUX)
+	set->epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if (set->epollFd == -1)
+	{
+		debug(LOG_WARNING, "epoll_create1 failed, using poll: %s", strSockError(getSockErr()));
+	}
+#endif
+	return set;
 }
 
 void deleteSocketSet(SocketSet *set)
 {
+#if defined(WZ_OS_LINUX)
+	if (set->epollFd != -1)
+	{
+		close(set->epollFd);
+	}
+#endif
 	delete set;
 }
 
@@ -810,6 +1073,20 @@ void SocketSet_AddSocket(SocketSet *set, Socket *socket)
 
 	set->fds.push_back(socket);
 	debug(LOG_NET, "Socket added: set->fds[%lu] = %p", (unsigned long)i, static_cast<void *>(socket));
+
+#if defined(WZ_OS_LINUX)
+	if (set->epollFd != -1)
+	{
+		// Level-triggered, since readNoInt only reads once each time checkSockets says the socket is ready.
+		struct epoll_event event;
+		event.events = EPOLLIN;
+		event.data.ptr = socket;
+		if (epoll_ctl(set->epollFd, EPOLL_CTL_ADD, socket->fd[SOCK_CONNECTION], &event) == -1)
+		{
+			debug(LOG_ERROR, "epoll_ctl failed: %s", strSockError(getSockErr()));
+		}
+	}
+#endif
 }
 
 /**
@@ -822,6 +1099,13 @@ void SocketSet_DelSocket(SocketSet *set, Socket *socket)
 	{
 		debug(LOG_NET, "Socket %p erased (set->fds[%lu])", static_cast<void *>(socket), (unsigned long)i);
 		set->fds.erase(set->fds.begin() + i);
+#if defined(WZ_OS_LINUX)
+		if (set->epollFd != -1 && socket->fd[SOCK_CONNECTION] != INVALID_SOCKET)
+		{
+			struct epoll_event event = {};  // Ignored, but must not be null before Linux 2.6.9.
+			epoll_ctl(set->epollFd, EPOLL_CTL_DEL, socket->fd[SOCK_CONNECTION], &event);
+		}
+#endif
 	}
 }
 
@@ -925,24 +1209,16 @@ int checkSockets(const SocketSet *set, unsigned int timeout)
 		return 0;
 	}
 
-#if   defined(WZ_OS_UNIX)
-	SOCKET maxfd = INT_MIN;
-#elif defined(WZ_OS_WIN)
-	SOCKET maxfd = 0;
-#endif
-
 	bool compressedReady = false;
 	for (size_t i = 0; i < set->fds.size(); ++i)
 	{
 		ASSERT(set->fds[i]->fd[SOCK_CONNECTION] != INVALID_SOCKET, "Invalid file descriptor!");
 
-		if (set->fds[i]->isCompressed && !set->fds[i]->zInflateNeedInput)
+		if (set->fds[i]->isCompressed && !set->fds[i]->decompressor->needInput())
 		{
 			compressedReady = true;
 			break;
 		}
-
-		maxfd = std::max(maxfd, set->fds[i]->fd[SOCK_CONNECTION]);
 	}
 
 	if (compressedReady)
@@ -952,13 +1228,71 @@ int checkSockets(const SocketSet *set, unsigned int timeout)
 		int ret = 0;
 		for (size_t i = 0; i < set->fds.size(); ++i)
 		{
-			set->fds[i]->ready = set->fds[i]->isCompressed && !set->fds[i]->zInflateNeedInput;
+			set->fds[i]->ready = set->fds[i]->isCompressed && !set->fds[i]->decompressor->needInput();
 			++ret;
 		}
 		return ret;
 	}
 
 	int ret;
+#if defined(WZ_OS_LINUX)
+	if (set->epollFd != -1)
+	{
+		// The kernel keeps track of the sockets, so this doesn't depend on how many there are, or on FD_SETSIZE.
+		set->events.resize(set->fds.size());
+		do
+		{
+			ret = epoll_wait(set->epollFd, set->events.data(), set->events.size(), timeout);
+		}
+		while (ret == SOCKET_ERROR && getSockErr() == EINTR);
+
+		if (ret == SOCKET_ERROR)
+		{
+			debug(LOG_ERROR, "epoll_wait failed: %s", strSockError(getSockErr()));
+			return SOCKET_ERROR;
+		}
+
+		for (size_t i = 0; i < set->fds.size(); ++i)
+		{
+			set->fds[i]->ready = false;
+		}
+		for (int i = 0; i < ret; ++i)
+		{
+			static_cast<Socket *>(set->events[i].data.ptr)->ready = true;
+		}
+
+		return ret;
+	}
+#endif
+
+#if   defined(WZ_OS_UNIX)
+	std::vector<struct pollfd> fds(set->fds.size());
+	for (size_t i = 0; i < set->fds.size(); ++i)
+	{
+		fds[i].fd = set->fds[i]->fd[SOCK_CONNECTION];
+		fds[i].events = POLLIN;
+		fds[i].revents = 0;
+	}
+
+	do
+	{
+		ret = poll(fds.data(), fds.size(), timeout);
+	}
+	while (ret == SOCKET_ERROR && getSockErr() == EINTR);
+
+	if (ret == SOCKET_ERROR)
+	{
+		debug(LOG_ERROR, "poll failed: %s", strSockError(getSockErr()));
+		return SOCKET_ERROR;
+	}
+
+	for (size_t i = 0; i < set->fds.size(); ++i)
+	{
+		// Like select, report hangups and errors as readable, so that the next read finds out about them.
+		set->fds[i]->ready = (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) != 0;
+	}
+#elif defined(WZ_OS_WIN)
+	SOCKET maxfd = 0;
 	fd_set fds;
 	do
 	{
@@ -970,6 +1304,7 @@ int checkSockets(const SocketSet *set, unsigned int timeout)
 			const SOCKET fd = set->fds[i]->fd[SOCK_CONNECTION];
 
 			FD_SET(fd, &fds);
+			maxfd = std::max(maxfd, fd);
 		}
 
 		ret = select(maxfd + 1, &fds, nullptr, nullptr, &tv);
@@ -986,6 +1321,7 @@ int checkSockets(const SocketSet *set, unsigned int timeout)
 	{
 		set->fds[i]->ready = FD_ISSET(set->fds[i]->fd[SOCK_CONNECTION], &fds);
 	}
+#endif
 
 	return ret;
 }
@@ -1008,7 +1344,8 @@ ssize_t readAll(Socket *sock, void *buf, size_t size, unsigned int timeout)
 {
 	ASSERT(!sock->isCompressed, "readAll on compressed sockets not implemented.");
 
-	const SocketSet set = {std::vector<Socket *>(1, sock)};
+	SocketSet set;
+	set.fds.push_back(sock);
 
 	size_t received = 0;
 
@@ -1100,19 +1437,7 @@ static void socketCloseNow(Socket *sock)
 
 void socketClose(Socket *sock)
 {
-	wzMutexLock(socketThreadMutex);
-	//Instead of socketThreadWrites.erase(sock);, try sending the data before actually deleting.
-	if (socketThreadWrites.find(sock) != socketThreadWrites.end())
-	{
-		// Wait until the data is written, then delete the socket.
-		sock->deleteLater = true;
-	}
-	else
-	{
-		// Delete the socket.
-		socketCloseNow(sock);
-	}
-	wzMutexUnlock(socketThreadMutex);
+	socketWriteBackend->close(sock);
 }
 
 Socket *socketAccept(Socket *sock)
@@ -1688,30 +2013,21 @@ void SOCKETinit()
 	}
 #endif
 
-	if (socketThread == nullptr)
+	if (socketWriteBackend == nullptr)
 	{
-		socketThreadQuit = false;
-		socketThreadMutex = wzMutexCreate();
-		socketThreadSemaphore = wzSemaphoreCreate(0);
-		socketThread = wzThreadCreate(socketThreadFunction, nullptr);
-		wzThreadStart(socketThread);
+#if defined(WZ_OS_LINUX)
+		socketWriteBackend = EpollWriteBackend::create();
+#endif
+		if (socketWriteBackend == nullptr)
+		{
+			socketWriteBackend.reset(new SelectWriteBackend);
+		}
 	}
 }
 
 void SOCKETshutdown()
 {
-	if (socketThread != nullptr)
-	{
-		wzMutexLock(socketThreadMutex);
-		socketThreadQuit = true;
-		socketThreadWrites.clear();
-		wzMutexUnlock(socketThreadMutex);
-		wzSemaphorePost(socketThreadSemaphore);  // Wake up the thread, so it can quit.
-		wzThreadJoin(socketThread);
-		wzMutexDestroy(socketThreadMutex);
-		wzSemaphoreDestroy(socketThreadSemaphore);
-		socketThread = nullptr;
-	}
+	socketWriteBackend.reset();
 
 #if defined(WZ_OS_WIN)
 	WSACleanup();
@@ -22,6 +22,7 @@
 #define _net_socket_h
 
 #include "lib/framework/types.h"
+#include "netcompress.h"
 #include <string>
 #include <vector>
 
@@ -116,13 +117,22 @@ ssize_t readNoInt(Socket *sock, void *buf, size_t max_size, size_t *rawByteCount
 WZ_DECL_NONNULL(1, 2)
 ssize_t readAll(Socket *sock, void *buf, size_t size, unsigned timeout);///< Reads exactly size bytes from the Socket, or blocks until the timeout expires.
 WZ_DECL_NONNULL(1, 2)
-ssize_t writeAll(Socket *sock, const void *buf, size_t size, size_t *rawByteCount = nullptr);  ///< Nonblocking write of size bytes to the Socket. All bytes will be written asynchronously, by a separate thread. Raw count of bytes (after compression) returned in rawByteCount, which will often be 0 until the socket is flushed.
+ssize_t writeAll(Socket *sock, const void *buf, size_t size, size_t *rawByteCount = nullptr);  ///< Nonblocking write of size bytes to the Socket. Bytes the socket can't take straight away will be written asynchronously, by a separate thread. Raw count of bytes (after compression) returned in rawByteCount, which will often be 0 until the socket is flushed.
 
 // Sockets, compressed.
-WZ_DECL_NONNULL(1) void socketBeginCompression(Socket *sock); ///< Makes future data sent compressed, and future data received expected to be compressed.
+WZ_DECL_NONNULL(1) void socketBeginCompression(Socket *sock, WireCompression codec, int level); ///< Makes future data sent compressed, and future data received expected to be compressed, with the codec.
 WZ_DECL_NONNULL(1) bool socketReadDisconnected(Socket *sock);  ///< If readNoInt returned 0, returns true if this is the result of a disconnect, or false if the input compressed data just hasn't produced any output bytes.
 WZ_DECL_NONNULL(1) void socketFlush(Socket *sock, size_t *rawByteCount = nullptr); ///< Actually sends the data written with writeAll. Only useful on compressed sockets. Note that flushing too often makes compression less effective. Raw count of bytes (after compression) returned in rawByteCount.
 
+/// Totals over all sockets using one codec.
+struct SocketCompressionStatistics
+{
+	size_t compressedSent, uncompressedSent, microsecondsSent;              ///< Output, input and CPU time of the compressors.
+	size_t compressedReceived, uncompressedReceived, microsecondsReceived;  ///< Input, output and CPU time of the decompressors.
+};
+SocketCompressionStatistics socketCompressionStatistics(WireCompression codec);
+void socketResetCompressionStatistics();
+
 // Socket sets.
 WZ_DECL_ALLOCATION SocketSet *allocSocketSet();                         ///< Constructs a SocketSet.
 WZ_DECL_NONNULL(1) void deleteSocketSet(SocketSet *set);                ///< Destroys the SocketSet.
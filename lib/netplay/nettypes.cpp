@@ -38,6 +38,7 @@
 #include "nettypes.h"
 #include "netqueue.h"
 #include "netlog.h"
+#include "netreplay.h"
 #include "src/order.h"
 #include <cstring>
 
@@ -57,9 +58,11 @@ static NetQueuePair *tmpQueues[MAX_TMP_SOCKETS] = {nullptr, nullptr, nullptr, nu
 static NetQueue *broadcastQueue = nullptr;
 
 // Only used between NETbegin{Encode,Decode} and NETend calls.
-static MessageWriter writer;  ///< Used when serialising a message.
+static MessageWriter writer;  ///< Used when serialising a message. Writes directly to the send queue.
 static MessageReader reader;  ///< Used when deserialising a message.
-static NetMessage message;    ///< A message which is being serialised or deserialised.
+static NetMessage message;    ///< A message which is being deserialised. Refers to the data in the receive queue.
+static uint8_t encodeType;    ///< Type of the message which is being serialised.
+static std::vector<uint8_t> discardedMessage;  ///< Used instead of the send queue, when serialising a message to a null queue.
 static NETQUEUE queueInfo;    ///< Indicates which queue is currently being (de)serialised.
 static PACKETDIR NetDir;      ///< Indicates whether a message is being serialised (PACKET_ENCODE) or deserialised (PACKET_DECODE), or not doing anything (PACKET_INVALID).
 
@@ -265,11 +268,25 @@ static void queue(const Q &q, std::vector<T> &v)
 	}
 }
 
-template<class Q>
-static void queue(const Q &q, NetMessage &v)
+// A NetMessage is serialised as its type, data length and data, which is exactly its raw data.
+static void queue(const MessageWriter &q, NetMessage &v)
+{
+	q.bytes(v.rawData(), v.rawLen());
+}
+
+// The deserialised NetMessage refers to the data of the message it's in.
+static void queue(const MessageReader &q, NetMessage &v)
 {
-	queue(q, v.type);
-	queue(q, v.data);
+	size_t available = q.index < q.message->dataLen ? q.message->dataLen - q.index : 0;
+	size_t rawLen = netMessageRawLen(q.message->data + q.index, available);
+	if (rawLen == 0)
+	{
+		v = NetMessage();
+		q.index = q.message->dataLen + 1;  // Truncated, so mark the reader invalid.
+		return;
+	}
+	v = NetMessage(q.message->data + q.index, rawLen);
+	q.index += rawLen;
 }
 
 template<class T>
@@ -299,6 +316,16 @@ static NetQueue *receiveQueue(NETQUEUE queue)
 	return queue.isPair ? &(*static_cast<NetQueuePair **>(queue.queue))->receive : static_cast<NetQueue *>(queue.queue);
 }
 
+/// Gets the queue to serialise a message into, or nullptr if the message should be discarded.
+static NetQueue *encodeQueue(NETQUEUE queue)
+{
+	if (queue.queueType == QUEUE_GAME && NETisReplay())
+	{
+		return nullptr;  // The game queue messages of all players come from the replay.
+	}
+	return sendQueue(queue);
+}
+
 /// Gets the &NetQueuePair, corresponding to queue.
 static NetQueuePair *&pairQueue(NETQUEUE queue)
 {
@@ -391,9 +418,9 @@ bool NETisMessageReady(NETQUEUE queue)
 	return receiveQueue(queue)->haveMessage();
 }
 
-NetMessage const *NETgetMessage(NETQUEUE queue)
+NetMessage NETgetMessage(NETQUEUE queue)
 {
-	return &receiveQueue(queue)->getMessage();
+	return receiveQueue(queue)->getMessage();
 }
 
 /*
@@ -455,8 +482,15 @@ void NETbeginEncode(NETQUEUE queue, uint8_t type)
 	NETsetPacketDir(PACKET_ENCODE);
 
 	queueInfo = queue;
-	message = type;
-	writer = MessageWriter(message);
+	encodeType = type;
+	NetQueue *netQueue = encodeQueue(queueInfo);
+	if (netQueue == nullptr)
+	{
+		discardedMessage.clear();
+		writer = MessageWriter(&discardedMessage);
+		return;
+	}
+	writer = MessageWriter(netQueue->beginMessage(type));
 }
 
 void NETbeginDecode(NETQUEUE queue, uint8_t type)
@@ -475,29 +509,34 @@ bool NETend()
 	// If we are encoding just return true
 	if (NETgetPacketDir() == PACKET_ENCODE)
 	{
-		// Push the message onto the list.
-		NetQueue *queue = sendQueue(queueInfo);
-		if (queue == nullptr) {
-			debug(LOG_WARNING, "Sending %s to null queue, type %d.", messageTypeToString(message.type), queueInfo.queueType);
+		// The message was serialised directly into the queue, so just finish it.
+		NetQueue *netQueue = encodeQueue(queueInfo);
+		if (netQueue == nullptr) {
+			if (!NETisReplay())
+			{
+				debug(LOG_WARNING, "Sending %s to null queue, type %d.", messageTypeToString(encodeType), queueInfo.queueType);
+			}
+			NETsetPacketDir(PACKET_INVALID);
 			return true;
 		}
-		queue->pushMessage(message);
-		NETlogPacket(message.type, static_cast<uint32_t>(message.data.size()), false);
+		NetMessage encoded = netQueue->endMessage();
+		NETlogPacket(encoded.type, static_cast<uint32_t>(encoded.dataLen), false);
 
 		if (queueInfo.queueType == QUEUE_GAME || queueInfo.queueType == QUEUE_GAME_FORCED)
 		{
-			ASSERT(message.type > GAME_MIN_TYPE && message.type < GAME_MAX_TYPE, "Inserting %s into game queue.", messageTypeToString(message.type));
+			ASSERT(encoded.type > GAME_MIN_TYPE && encoded.type < GAME_MAX_TYPE, "Inserting %s into game queue.", messageTypeToString(encoded.type));
 		}
 		else
 		{
-			ASSERT(message.type > NET_MIN_TYPE && message.type < NET_MAX_TYPE, "Inserting %s into net queue.", messageTypeToString(message.type));
+			ASSERT(encoded.type > NET_MIN_TYPE && encoded.type < NET_MAX_TYPE, "Inserting %s into net queue.", messageTypeToString(encoded.type));
 		}
 
 		if (queueInfo.queueType == QUEUE_NET || queueInfo.queueType == QUEUE_BROADCAST || queueInfo.queueType == QUEUE_TMP)
 		{
-			NETsend(queueInfo, &queue->getMessageForNet());
-			queue->popMessageForNet();
-			ASSERT(queue->numMessagesForNet() == 0, "Queue not empty.");
+			NetMessage toSend = netQueue->getMessageForNet();
+			NETsend(queueInfo, &toSend);  // Sends directly from the queue.
+			netQueue->popMessageForNet();
+			ASSERT(netQueue->numMessagesForNet() == 0, "Queue not empty.");
 		}
 
 		// We have ended the serialisation, so mark the direction invalid
@@ -518,21 +557,21 @@ bool NETend()
 			// Decoded in NETprocessSystemMessage in netplay.cpp.
 			uint8_t player = queueInfo.index;
 			uint32_t num = 1;
-			NetMessage backupMessage = message;  // 'message' will be overwritten, so we need a copy (to avoid trying to insert a message into itself).
-			NETbeginEncode(NETbroadcastQueue(), NET_SHARE_GAME_QUEUE);
-			NETuint8_t(&player);
-			NETuint32_t(&num);
+			NetQueue shareQueue;  // The NET_SHARE_GAME_QUEUE message isn't sent by itself, so serialise it somewhere else than the broadcast queue.
+			shareQueue.setWillNeverGetMessages();
+			MessageWriter shareWriter(shareQueue.beginMessage(NET_SHARE_GAME_QUEUE));
+			queue(shareWriter, player);
+			queue(shareWriter, num);
 			for (uint32_t n = 0; n < num; ++n)
 			{
-				queueAuto(backupMessage);
+				queue(shareWriter, encoded);
 			}
-			NETsetPacketDir(PACKET_INVALID);  // Instead of NETend();
-			backupMessage = message;  // 'message' will be overwritten again, so we need a copy of this NET_SHARE_GAME_QUEUE message.
+			NetMessage shareMessage = shareQueue.endMessage();
 			uint8_t allPlayers = NET_ALL_PLAYERS;
 			NETbeginEncode(NETbroadcastQueue(), NET_SEND_TO_PLAYER);
 			NETuint8_t(&player);
 			NETuint8_t(&allPlayers);
-			queueAuto(backupMessage);
+			queueAuto(shareMessage);
 			NETend();  // This time we actually send it.
 		}
 
@@ -577,7 +616,8 @@ void NETflushGameQueues()
 		NETuint32_t(&num);
 		for (uint32_t n = 0; n < num; ++n)
 		{
-			queueAuto(const_cast<NetMessage &>(queue->getMessageForNet()));  // const_cast is safe since we are encoding, not decoding.
+			NetMessage gameMessage = queue->getMessageForNet();
+			queueAuto(gameMessage);
 			queue->popMessageForNet();
 		}
 		NETend();
@@ -586,6 +626,10 @@ void NETflushGameQueues()
 
 void NETpop(NETQUEUE queue)
 {
+	if (queue.queueType == QUEUE_GAME)
+	{
+		NETreplaySaveNetMessage(receiveQueue(queue)->getMessage(), queue.index);
+	}
 	receiveQueue(queue)->popMessage();
 }
 
@@ -778,18 +822,7 @@ void NETVector2i(Vector2i *vp)
 	queueAuto(*vp);
 }
 
-void NETnetMessage(NetMessage const **message)
+void NETnetMessage(NetMessage *message)
 {
-	if (NETgetPacketDir() == PACKET_ENCODE)
-	{
-		queueAuto(*const_cast<NetMessage *>(*message));  // Const cast safe when encoding.
-	}
-
-	if (NETgetPacketDir() == PACKET_DECODE)
-	{
-		NetMessage *m = new NetMessage;
-		queueAuto(*m);
-		*message = m;
-		return;
-	}
+	queueAuto(*message);
 }
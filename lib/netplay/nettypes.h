@@ -67,7 +67,7 @@ NETQUEUE NETbroadcastQueue(unsigned excludePlayer = NET_NO_EXCLUDE);  ///< The q
 void NETinsertRawData(NETQUEUE queue, uint8_t *data, size_t dataLen);  ///< Dump raw data from sockets and raw data sent via host here.
 void NETinsertMessageFromNet(NETQUEUE queue, NetMessage const *message);     ///< Dump whole NetMessages into the queue.
 bool NETisMessageReady(NETQUEUE queue);       ///< Returns true if there is a complete message ready to deserialise in this queue.
-NetMessage const *NETgetMessage(NETQUEUE queue);///< Returns the current message in the queue which is ready to be deserialised. Do not delete the message.
+NetMessage NETgetMessage(NETQUEUE queue);///< Returns the current message in the queue which is ready to be deserialised. Only valid until the queue changes.
 
 void NETinitQueue(NETQUEUE queue);             ///< Allocates the queue. Deletes the old queue, if there was one. Avoids a crash on NULL pointer deference when trying to use the queue.
 void NETsetNoSendOverNetwork(NETQUEUE queue);  ///< Used to mark that a game queue should not be sent over the network (for example, if it is being sent to us, instead).
@@ -193,6 +193,6 @@ static inline void NETauto(T (&ar)[N])
 	}
 }
 
-void NETnetMessage(NetMessage const **message);  ///< If decoding, must delete the NETMESSAGE.
+void NETnetMessage(NetMessage *message);  ///< If decoding, the message refers to the data of the message being decoded, so is only valid until its queue changes.
 
 #endif
@@ -556,8 +556,8 @@ static bool actionRemoveDroidsFromBuildPos(unsigned player, Vector2i pos, uint16
 	Vector2i structureCentre = world_coord(b.map) + world_coord(b.size) / 2;
 	unsigned structureMaxRadius = iHypot(world_coord(b.size) / 2) + 1; // +1 since iHypot rounds down.
 
-	static GridList gridList;  // static to avoid allocations.
-	gridList = gridStartIterate(structureCentre.x, structureCentre.y, structureMaxRadius);
+	GridList gridList;  // Only when starting to build, so not worth keeping around.
+	gridQuery(gridList, structureCentre.x, structureCentre.y, structureMaxRadius);
 	for (GridIterator gi = gridList.begin(); gi != gridList.end(); ++gi)
 	{
 		DROID *droid = castDroid(*gi);
@@ -25,6 +25,8 @@
  */
 
 #include "lib/framework/frame.h"
+#include "lib/framework/math_ext.h"
+#include "lib/netplay/netplay.h"
 
 #include "action.h"
 #include "cmddroid.h"
@@ -36,6 +38,9 @@
 #include "projectile.h"
 #include "objmem.h"
 #include "order.h"
+#include "simjobs.h"
+
+#include <unordered_map>
 
 /* Weights used for target selection code,
  * target distance is used as 'common currency'
@@ -101,8 +106,8 @@ static int aiDroidRange(DROID *psDroid, int weapon_slot)
 	return longRange;
 }
 
-// see if a structure has the range to fire on a target
-static bool aiStructHasRange(STRUCTURE *psStruct, BASE_OBJECT *psTarget, int weapon_slot)
+// see if a target is in range of a structure, without checking whether anything is in the way
+static bool aiStructInRange(STRUCTURE *psStruct, BASE_OBJECT *psTarget, int weapon_slot)
 {
 	if (psStruct->numWeaps == 0 || psStruct->asWeaps[0].nStat == 0)
 	{
@@ -113,7 +118,13 @@ static bool aiStructHasRange(STRUCTURE *psStruct, BASE_OBJECT *psTarget, int wea
 	WEAPON_STATS *psWStats = psStruct->asWeaps[weapon_slot].nStat + asWeaponStats;
 
 	int longRange = proj_GetLongRange(psWStats, psStruct->player);
-	return objPosDiffSq(psStruct, psTarget) < longRange * longRange && lineOfFire(psStruct, psTarget, weapon_slot, true);
+	return objPosDiffSq(psStruct, psTarget) < longRange * longRange;
+}
+
+// see if a structure has the range to fire on a target
+static bool aiStructHasRange(STRUCTURE *psStruct, BASE_OBJECT *psTarget, int weapon_slot)
+{
+	return aiStructInRange(psStruct, psTarget, weapon_slot) && lineOfFire(psStruct, psTarget, weapon_slot, true);
 }
 
 static bool aiDroidHasRange(DROID *psDroid, BASE_OBJECT *psTarget, int weapon_slot)
@@ -136,6 +147,143 @@ static bool aiObjHasRange(BASE_OBJECT *psObj, BASE_OBJECT *psTarget, int weapon_
 	return false;
 }
 
+/// Objects near which a player may look for targets, bucketed by map area, so that droids don't each have to query the grid.
+/// Built the first time the player looks for a target in a tick, from the objects the grid held at the start of the tick.
+struct TargetCandidateCache
+{
+	struct Entry
+	{
+		BASE_OBJECT *psObj;
+		bool         ally;  ///< Visible allied object whose target may be shared, otherwise a visible enemy droid, structure or feature.
+	};
+
+	uint32_t           time = UINT32_MAX;  ///< Game time when built.
+	int                cellsX = 0, cellsY = 0;
+	std::vector<Entry> entries;            ///< Sorted by cell, and in grid order within each cell.
+	std::vector<unsigned> cellStart;       ///< entries[cellStart[cell]] to entries[cellStart[cell + 1] - 1] are in cell.
+};
+
+#define TARGET_CACHE_CELL (TILE_UNITS * 8)
+
+static TargetCandidateCache targetCandidateCache[MAX_PLAYERS];
+
+static TargetCandidateCache const &aiTargetCandidates(unsigned player)
+{
+	static GridList gridList;  // static to avoid allocations.
+	static std::vector<unsigned> entryCells;
+
+	TargetCandidateCache &cache = targetCandidateCache[player];
+	if (cache.time == gameTime)
+	{
+		return cache;
+	}
+	cache.time = gameTime;
+	cache.cellsX = (world_coord(mapWidth) + TARGET_CACHE_CELL - 1) / TARGET_CACHE_CELL;
+	cache.cellsY = (world_coord(mapHeight) + TARGET_CACHE_CELL - 1) / TARGET_CACHE_CELL;
+	cache.cellStart.assign(cache.cellsX * cache.cellsY + 1, 0);
+
+	// Keep only what aiBestNearestTarget and aiChooseTarget would look at for this player anyway.
+	static std::vector<TargetCandidateCache::Entry> found;
+	found.clear();
+	entryCells.clear();
+	gridQueryArea(gridList, 0, 0, world_coord(mapWidth), world_coord(mapHeight));
+	for (BASE_OBJECT *psObj : gridList)
+	{
+		if (psObj->visible[player] != UBYTE_MAX)
+		{
+			continue;
+		}
+		bool ally = aiCheckAlliances(psObj->player, player);
+		if (ally ? !(psObj->type == OBJ_STRUCTURE || (psObj->type == OBJ_DROID && psObj->numWeaps > 0))
+		    : !(psObj->type == OBJ_DROID || psObj->type == OBJ_STRUCTURE || psObj->type == OBJ_FEATURE))
+		{
+			continue;
+		}
+		int cellX = clip(psObj->pos.x / TARGET_CACHE_CELL, 0, cache.cellsX - 1);
+		int cellY = clip(psObj->pos.y / TARGET_CACHE_CELL, 0, cache.cellsY - 1);
+		unsigned cell = cellX + cellY * cache.cellsX;
+		found.push_back({psObj, ally});
+		entryCells.push_back(cell);
+		++cache.cellStart[cell + 1];
+	}
+
+	// Counting sort, which keeps the grid order within each cell.
+	for (unsigned cell = 0; cell + 1 < cache.cellStart.size(); ++cell)
+	{
+		cache.cellStart[cell + 1] += cache.cellStart[cell];
+	}
+	cache.entries.resize(found.size());
+	static std::vector<unsigned> next;
+	next.assign(cache.cellStart.begin(), cache.cellStart.end() - 1);
+	for (size_t i = 0; i < found.size(); ++i)
+	{
+		cache.entries[next[entryCells[i]]++] = found[i];
+	}
+	return cache;
+}
+
+/// Finds the objects within radius from the cache, which a player may want to shoot at or share the targets of.
+static void aiQueryTargetCandidates(std::vector<TargetCandidateCache::Entry> &results, unsigned player, int32_t x, int32_t y, uint32_t radius)
+{
+	TargetCandidateCache const &cache = aiTargetCandidates(player);
+	results.clear();
+	// Objects may have moved a bit since the cache was built, so look a tile further.
+	int margin = radius + TILE_UNITS;
+	int x0 = clip((x - margin) / TARGET_CACHE_CELL, 0, cache.cellsX - 1), x1 = clip((x + margin) / TARGET_CACHE_CELL, 0, cache.cellsX - 1);
+	int y0 = clip((y - margin) / TARGET_CACHE_CELL, 0, cache.cellsY - 1), y1 = clip((y + margin) / TARGET_CACHE_CELL, 0, cache.cellsY - 1);
+	for (int cellY = y0; cellY <= y1; ++cellY)
+	{
+		for (int cellX = x0; cellX <= x1; ++cellX)
+		{
+			unsigned cell = cellX + cellY * cache.cellsX;
+			for (unsigned i = cache.cellStart[cell]; i < cache.cellStart[cell + 1]; ++i)
+			{
+				BASE_OBJECT *psObj = cache.entries[i].psObj;
+				int64_t dx = psObj->pos.x - x, dy = psObj->pos.y - y;
+				if (dx * dx + dy * dy <= (int64_t)radius * radius)
+				{
+					results.push_back(cache.entries[i]);
+				}
+			}
+		}
+	}
+}
+
+/// Scratch space for aiBestNearestTargetFrom and aiChooseStructureTarget, one per simulation thread.
+struct BestNearestTargetBuffers
+{
+	std::vector<TargetCandidateCache::Entry> nearby;
+	std::vector<BASE_OBJECT *> candidates;  ///< Targets worth evaluating, in the order found.
+	std::vector<bool> candidateLineOfFire;
+	std::vector<int> candidateVisibility;
+	GridList gridList;                      ///< For aiChooseSensorTarget.
+};
+static std::vector<BestNearestTargetBuffers> bestNearestTargetBuffers(1);
+
+/// Results of aiBestNearestTarget for the droids expected to look for targets this tick, see aiPrepareDroidTargets.
+struct PreparedDroidTargets
+{
+	DROID       *psDroid;
+	unsigned     slots;                   ///< Bit mask of the weapon slots looked up.
+	BASE_OBJECT *psTarget[MAX_WEAPONS];
+	int          weight[MAX_WEAPONS];
+};
+static std::vector<PreparedDroidTargets> preparedDroidTargets;
+static std::unordered_map<DROID const *, unsigned> preparedDroidTargetIndex;  // Only used for lookups, so the order doesn't matter.
+static uint32_t preparedDroidTargetTime = UINT32_MAX;
+
+/// Results of aiChooseTarget for the defensive structures which will look for targets this tick, see aiPrepareStructureTargets.
+struct PreparedStructureTargets
+{
+	STRUCTURE    *psStruct;
+	unsigned      slots;                  ///< Bit mask of the weapon slots looked up.
+	BASE_OBJECT  *psTarget[MAX_WEAPONS];  ///< nullptr if no target was found.
+	TARGET_ORIGIN origin[MAX_WEAPONS];
+};
+static std::vector<PreparedStructureTargets> preparedStructureTargets;
+static std::unordered_map<STRUCTURE const *, unsigned> preparedStructureTargetIndex;  // Only used for lookups, so the order doesn't matter.
+static uint32_t preparedStructureTargetTime = UINT32_MAX;
+
 /* Initialise the AI system */
 bool aiInitialise()
 {
@@ -154,6 +302,17 @@ bool aiInitialise()
 	}
 	satuplinkbits = 0;
 
+	for (TargetCandidateCache &cache : targetCandidateCache)
+	{
+		cache = TargetCandidateCache();
+	}
+	preparedDroidTargets.clear();
+	preparedDroidTargetIndex.clear();
+	preparedDroidTargetTime = UINT32_MAX;
+	preparedStructureTargets.clear();
+	preparedStructureTargetIndex.clear();
+	preparedStructureTargetTime = UINT32_MAX;
+
 	return true;
 }
 
@@ -269,7 +428,8 @@ static BASE_OBJECT *aiSearchSensorTargets(BASE_OBJECT *psObj, int weapon_slot, W
 }
 
 /* Calculates attack priority for a certain target */
-static SDWORD targetAttackWeight(BASE_OBJECT *psTarget, BASE_OBJECT *psAttacker, SDWORD weapon_slot)
+// visibility is visibleObject(psAttacker, psTarget, true), if already known, or -1 to look it up when needed.
+static SDWORD targetAttackWeight(BASE_OBJECT *psTarget, BASE_OBJECT *psAttacker, SDWORD weapon_slot, int visibility = -1)
 {
 	SDWORD			targetTypeBonus = 0, damageRatio = 0, attackWeight = 0, noTarget = -1;
 	UDWORD			weaponSlot;
@@ -486,7 +646,11 @@ static SDWORD targetAttackWeight(BASE_OBJECT *psTarget, BASE_OBJECT *psAttacker,
 	}
 
 	/* We prefer objects we can see and can attack immediately */
-	if (!visibleObject((BASE_OBJECT *)psAttacker, psTarget, true))
+	if (visibility < 0)
+	{
+		visibility = visibleObject((BASE_OBJECT *)psAttacker, psTarget, true);
+	}
+	if (!visibility)
 	{
 		attackWeight /= WEIGHT_NOT_VISIBLE_F;
 	}
@@ -543,7 +707,8 @@ static SDWORD targetAttackWeight(BASE_OBJECT *psTarget, BASE_OBJECT *psAttacker,
 // Find the best nearest target for a droid.
 // If extraRange is higher than zero, then this is the range it accepts for movement to target.
 // Returns integer representing target priority, -1 if failed
-int aiBestNearestTarget(DROID *psDroid, BASE_OBJECT **ppsObj, int weapon_slot, int extraRange)
+// Only reads the game state, so it can run on any thread, given a buffer of its own.
+static int aiBestNearestTargetFrom(DROID *psDroid, BASE_OBJECT **ppsObj, int weapon_slot, int extraRange, BestNearestTargetBuffers &buffers)
 {
 	int failure = -1;
 	int bestMod = 0;
@@ -581,15 +746,18 @@ int aiBestNearestTarget(DROID *psDroid, BASE_OBJECT **ppsObj, int weapon_slot, i
 	// Range was previously 9*TILE_UNITS. Increasing this doesn't seem to help much, though. Not sure why.
 	int droidRange = std::min(aiDroidRange(psDroid, weapon_slot) + extraRange, objSensorRange(psDroid) + 6 * TILE_UNITS);
 
-	static GridList gridList;  // static to avoid allocations.
-	gridList = gridStartIterate(psDroid->pos.x, psDroid->pos.y, droidRange);
-	for (GridIterator gi = gridList.begin(); gi != gridList.end(); ++gi)
+	std::vector<TargetCandidateCache::Entry> &nearby = buffers.nearby;
+	std::vector<BASE_OBJECT *> &candidates = buffers.candidates;
+	std::vector<int> &candidateVisibility = buffers.candidateVisibility;
+	candidates.clear();
+	aiQueryTargetCandidates(nearby, psDroid->player, psDroid->pos.x, psDroid->pos.y, droidRange);
+	for (TargetCandidateCache::Entry const &entry : nearby)
 	{
 		BASE_OBJECT *friendlyObj = nullptr;
-		BASE_OBJECT *targetInQuestion = *gi;
+		BASE_OBJECT *targetInQuestion = entry.psObj;
 
 		/* This is a friendly unit, check if we can reuse its target */
-		if (aiCheckAlliances(targetInQuestion->player, psDroid->player))
+		if (entry.ally)
 		{
 			friendlyObj = targetInQuestion;
 			targetInQuestion = nullptr;
@@ -687,22 +855,30 @@ int aiBestNearestTarget(DROID *psDroid, BASE_OBJECT **ppsObj, int weapon_slot, i
 				objTrace(psDroid->id, "considering shooting at %s in frustration", objInfo(targetInQuestion));
 			}
 
-			/* Check if our weapon is most effective against this object */
 			if (psTarget != nullptr && psTarget == targetInQuestion)		//was assigned?
 			{
-				int newMod = targetAttackWeight(psTarget, (BASE_OBJECT *)psDroid, weapon_slot);
-
-				/* Remember this one if it's our best target so far */
-				if (newMod >= 0 && (newMod > bestMod || bestTarget == nullptr))
-				{
-					bestMod = newMod;
-					tmpOrigin = ORIGIN_ALLY;
-					bestTarget = psTarget;
-				}
+				candidates.push_back(psTarget);
 			}
 		}
 	}
 
+	// Check which candidates we can see all at once, since only the viewer changes.
+	candidateVisibility.resize(candidates.size());
+	visibleObjectBatch(psDroid, candidates.data(), candidates.size(), true, candidateVisibility.data());
+	for (size_t i = 0; i < candidates.size(); ++i)
+	{
+		/* Check if our weapon is most effective against this object */
+		int newMod = targetAttackWeight(candidates[i], (BASE_OBJECT *)psDroid, weapon_slot, candidateVisibility[i]);
+
+		/* Remember this one if it's our best target so far */
+		if (newMod >= 0 && (newMod > bestMod || bestTarget == nullptr))
+		{
+			bestMod = newMod;
+			tmpOrigin = ORIGIN_ALLY;
+			bestTarget = candidates[i];
+		}
+	}
+
 	if (bestTarget)
 	{
 		ASSERT(!bestTarget->died, "AI gave us a target that is already dead.");
@@ -728,6 +904,39 @@ int aiBestNearestTarget(DROID *psDroid, BASE_OBJECT **ppsObj, int weapon_slot, i
 	return failure;
 }
 
+/// Whether a target prepared at the start of the tick is still what a search now would pick.
+/// Projectiles fired since only add expected damage, which can only lower the weight of the other candidates, so the prepared
+/// target stays the best one, unless it was destroyed, changed sides, or is now probably doomed itself.
+static bool aiPreparedTargetStillBest(BASE_OBJECT *psTarget, unsigned player, bool isDirect)
+{
+	return !psTarget->died && !aiCheckAlliances(psTarget->player, player) && !aiObjectIsProbablyDoomed(psTarget, isDirect);
+}
+
+int aiBestNearestTarget(DROID *psDroid, BASE_OBJECT **ppsObj, int weapon_slot, int extraRange)
+{
+	if (extraRange == 0 && preparedDroidTargetTime == gameTime)
+	{
+		auto it = preparedDroidTargetIndex.find(psDroid);
+		if (it != preparedDroidTargetIndex.end() && (preparedDroidTargets[it->second].slots & (1 << weapon_slot)) != 0)
+		{
+			PreparedDroidTargets const &prepared = preparedDroidTargets[it->second];
+			BASE_OBJECT *psTarget = prepared.psTarget[weapon_slot];
+			if (prepared.weight[weapon_slot] < 0)
+			{
+				return prepared.weight[weapon_slot];
+			}
+			// Same as in targetAttackWeight, sensors count as indirect.
+			bool isDirect = psDroid->droidType != DROID_SENSOR && proj_Direct(&asWeaponStats[psDroid->asWeaps[weapon_slot].nStat]);
+			if (aiPreparedTargetStillBest(psTarget, psDroid->player, isDirect))
+			{
+				*ppsObj = psTarget;
+				return prepared.weight[weapon_slot];
+			}
+		}
+	}
+	return aiBestNearestTargetFrom(psDroid, ppsObj, weapon_slot, extraRange, bestNearestTargetBuffers[0]);
+}
+
 // Are there a lot of bullets heading towards the droid?
 static bool aiDroidIsProbablyDoomed(DROID *psDroid, bool isDirect)
 {
@@ -818,13 +1027,140 @@ static bool aiObjIsWall(BASE_OBJECT *psObj)
 }
 
 
+/// The structure part of aiChooseTarget. Only reads the game state, so it can run on any thread, given a buffer of its own.
+static bool aiChooseStructureTarget(STRUCTURE *psStruct, BASE_OBJECT **ppsTarget, int weapon_slot, TARGET_ORIGIN *targetOrigin, BestNearestTargetBuffers &buffers)
+{
+	BASE_OBJECT		*psTarget = nullptr;
+	DROID			*psCommander;
+	TARGET_ORIGIN		tmpOrigin = ORIGIN_UNKNOWN;
+	bool			bCommanderBlock = false;
+
+	ASSERT_OR_RETURN(false, psStruct->asWeaps[weapon_slot].nStat > 0, "Invalid weapon turret");
+
+	WEAPON_STATS *psWStats = psStruct->asWeaps[weapon_slot].nStat + asWeaponStats;
+	int longRange = proj_GetLongRange(psWStats, psStruct->player);
+
+	// see if there is a target from the command droids
+	psCommander = cmdDroidGetDesignator(psStruct->player);
+	if (!proj_Direct(psWStats) && (psCommander != nullptr) &&
+	    aiStructHasRange(psStruct, psCommander, weapon_slot))
+	{
+		// there is a commander that can fire designate for this structure
+		// set bCommanderBlock so that the structure does not fire until the commander
+		// has a target - (slow firing weapons will not be ready to fire otherwise).
+		bCommanderBlock = true;
+
+		// I do believe this will never happen, check for yourself :-)
+		debug(LOG_NEVER, "Commander %d is good enough for fire designation", psCommander->id);
+
+		if (psCommander->action == DACTION_ATTACK
+		    && psCommander->psActionTarget[0] != nullptr
+		    && !psCommander->psActionTarget[0]->died)
+		{
+			// the commander has a target to fire on
+			if (aiStructHasRange(psStruct, psCommander->psActionTarget[0], weapon_slot))
+			{
+				// target in range - fire on it
+				tmpOrigin = ORIGIN_COMMANDER;
+				psTarget = psCommander->psActionTarget[0];
+			}
+			else
+			{
+				// target out of range - release the commander block
+				bCommanderBlock = false;
+			}
+		}
+	}
+
+	// indirect fire structures use sensor towers first
+	if (psTarget == nullptr && !bCommanderBlock && !proj_Direct(psWStats))
+	{
+		psTarget = aiSearchSensorTargets(psStruct, weapon_slot, psWStats, &tmpOrigin);
+	}
+
+	if (psTarget == nullptr && !bCommanderBlock)
+	{
+		int targetValue = -1;
+		int tarDist = INT32_MAX;
+		int srange = longRange;
+
+		if (!proj_Direct(psWStats) && srange > objSensorRange(psStruct))
+		{
+			// search radius of indirect weapons limited by their sight, unless they use
+			// external sensors to provide fire designation
+			srange = objSensorRange(psStruct);
+		}
+
+		std::vector<TargetCandidateCache::Entry> &nearby = buffers.nearby;
+		std::vector<BASE_OBJECT *> &candidates = buffers.candidates;  // Valid targets in range, in the order found.
+		std::vector<bool> &candidateLineOfFire = buffers.candidateLineOfFire;
+		std::vector<int> &candidateVisibility = buffers.candidateVisibility;
+		candidates.clear();
+		aiQueryTargetCandidates(nearby, psStruct->player, psStruct->pos.x, psStruct->pos.y, srange);
+		for (TargetCandidateCache::Entry const &entry : nearby)
+		{
+			BASE_OBJECT *psCurr = entry.psObj;
+			/* Check that it is a valid target */
+			if (!entry.ally && psCurr->type != OBJ_FEATURE && !psCurr->died
+			    && !aiCheckAlliances(psCurr->player, psStruct->player)
+			    && validTarget(psStruct, psCurr, weapon_slot) && psCurr->visible[psStruct->player] == UBYTE_MAX
+			    && aiStructInRange(psStruct, psCurr, weapon_slot))
+			{
+				candidates.push_back(psCurr);
+			}
+		}
+
+		// Throw away all the targets we can't hit at once, and then check which of the rest we can see.
+		lineOfFireBatch(psStruct, candidates.data(), candidates.size(), weapon_slot, true, candidateLineOfFire);
+		size_t numHittable = 0;
+		for (size_t i = 0; i < candidates.size(); ++i)
+		{
+			if (candidateLineOfFire[i])
+			{
+				candidates[numHittable++] = candidates[i];
+			}
+		}
+		candidates.resize(numHittable);
+		candidateVisibility.resize(candidates.size());
+		visibleObjectBatch(psStruct, candidates.data(), candidates.size(), true, candidateVisibility.data());
+
+		for (size_t i = 0; i < candidates.size(); ++i)
+		{
+			BASE_OBJECT *psCurr = candidates[i];
+			int newTargetValue = targetAttackWeight(psCurr, psStruct, weapon_slot, candidateVisibility[i]);
+			// See if in sensor range and visible
+			int distSq = objPosDiffSq(psCurr->pos, psStruct->pos);
+			if (newTargetValue < targetValue || (newTargetValue == targetValue && distSq >= tarDist))
+			{
+				continue;
+			}
+
+			tmpOrigin = ORIGIN_VISUAL;
+			psTarget = psCurr;
+			tarDist = distSq;
+			targetValue = newTargetValue;
+		}
+	}
+
+	if (psTarget)
+	{
+		ASSERT(!psTarget->died, "Structure found a dead target!");
+		if (targetOrigin)
+		{
+			*targetOrigin = tmpOrigin;
+		}
+		*ppsTarget = psTarget;
+		return true;
+	}
+
+	return false;
+}
+
 /* See if there is a target in range */
 bool aiChooseTarget(BASE_OBJECT *psObj, BASE_OBJECT **ppsTarget, int weapon_slot, bool bUpdateTarget, TARGET_ORIGIN *targetOrigin)
 {
 	BASE_OBJECT		*psTarget = nullptr;
-	DROID			*psCommander;
 	SDWORD			curTargetWeight = -1;
-	TARGET_ORIGIN		tmpOrigin = ORIGIN_UNKNOWN;
 
 	if (targetOrigin)
 	{
@@ -867,102 +1203,30 @@ bool aiChooseTarget(BASE_OBJECT *psObj, BASE_OBJECT **ppsTarget, int weapon_slot
 	}
 	else if (psObj->type == OBJ_STRUCTURE)
 	{
-		bool	bCommanderBlock = false;
-
-		ASSERT_OR_RETURN(false, psObj->asWeaps[weapon_slot].nStat > 0, "Invalid weapon turret");
-
-		WEAPON_STATS *psWStats = psObj->asWeaps[weapon_slot].nStat + asWeaponStats;
-		int longRange = proj_GetLongRange(psWStats, psObj->player);
-
-		// see if there is a target from the command droids
-		psTarget = nullptr;
-		psCommander = cmdDroidGetDesignator(psObj->player);
-		if (!proj_Direct(psWStats) && (psCommander != nullptr) &&
-		    aiStructHasRange((STRUCTURE *)psObj, (BASE_OBJECT *)psCommander, weapon_slot))
+		STRUCTURE *psStruct = (STRUCTURE *)psObj;
+		if (preparedStructureTargetTime == gameTime)
 		{
-			// there is a commander that can fire designate for this structure
-			// set bCommanderBlock so that the structure does not fire until the commander
-			// has a target - (slow firing weapons will not be ready to fire otherwise).
-			bCommanderBlock = true;
-
-			// I do believe this will never happen, check for yourself :-)
-			debug(LOG_NEVER, "Commander %d is good enough for fire designation", psCommander->id);
-
-			if (psCommander->action == DACTION_ATTACK
-			    && psCommander->psActionTarget[0] != nullptr
-			    && !psCommander->psActionTarget[0]->died)
+			auto it = preparedStructureTargetIndex.find(psStruct);
+			if (it != preparedStructureTargetIndex.end() && (preparedStructureTargets[it->second].slots & (1 << weapon_slot)) != 0)
 			{
-				// the commander has a target to fire on
-				if (aiStructHasRange((STRUCTURE *)psObj, psCommander->psActionTarget[0], weapon_slot))
+				PreparedStructureTargets const &prepared = preparedStructureTargets[it->second];
+				psTarget = prepared.psTarget[weapon_slot];
+				if (psTarget == nullptr)
 				{
-					// target in range - fire on it
-					tmpOrigin = ORIGIN_COMMANDER;
-					psTarget = psCommander->psActionTarget[0];
+					return false;
 				}
-				else
+				if (aiPreparedTargetStillBest(psTarget, psObj->player, proj_Direct(&asWeaponStats[psStruct->asWeaps[weapon_slot].nStat])))
 				{
-					// target out of range - release the commander block
-					bCommanderBlock = false;
-				}
-			}
-		}
-
-		// indirect fire structures use sensor towers first
-		if (psTarget == nullptr && !bCommanderBlock && !proj_Direct(psWStats))
-		{
-			psTarget = aiSearchSensorTargets(psObj, weapon_slot, psWStats, &tmpOrigin);
-		}
-
-		if (psTarget == nullptr && !bCommanderBlock)
-		{
-			int targetValue = -1;
-			int tarDist = INT32_MAX;
-			int srange = longRange;
-
-			if (!proj_Direct(psWStats) && srange > objSensorRange(psObj))
-			{
-				// search radius of indirect weapons limited by their sight, unless they use
-				// external sensors to provide fire designation
-				srange = objSensorRange(psObj);
-			}
-
-			static GridList gridList;  // static to avoid allocations.
-			gridList = gridStartIterate(psObj->pos.x, psObj->pos.y, srange);
-			for (GridIterator gi = gridList.begin(); gi != gridList.end(); ++gi)
-			{
-				BASE_OBJECT *psCurr = *gi;
-				/* Check that it is a valid target */
-				if (psCurr->type != OBJ_FEATURE && !psCurr->died
-				    && !aiCheckAlliances(psCurr->player, psObj->player)
-				    && validTarget(psObj, psCurr, weapon_slot) && psCurr->visible[psObj->player] == UBYTE_MAX
-				    && aiStructHasRange((STRUCTURE *)psObj, psCurr, weapon_slot))
-				{
-					int newTargetValue = targetAttackWeight(psCurr, psObj, weapon_slot);
-					// See if in sensor range and visible
-					int distSq = objPosDiffSq(psCurr->pos, psObj->pos);
-					if (newTargetValue < targetValue || (newTargetValue == targetValue && distSq >= tarDist))
+					if (targetOrigin)
 					{
-						continue;
+						*targetOrigin = prepared.origin[weapon_slot];
 					}
-
-					tmpOrigin = ORIGIN_VISUAL;
-					psTarget = psCurr;
-					tarDist = distSq;
-					targetValue = newTargetValue;
+					*ppsTarget = psTarget;
+					return true;
 				}
 			}
 		}
-
-		if (psTarget)
-		{
-			ASSERT(!psTarget->died, "Structure found a dead target!");
-			if (targetOrigin)
-			{
-				*targetOrigin = tmpOrigin;
-			}
-			*ppsTarget = psTarget;
-			return true;
-		}
+		return aiChooseStructureTarget(psStruct, ppsTarget, weapon_slot, targetOrigin, bestNearestTargetBuffers[0]);
 	}
 
 	return false;
@@ -1009,8 +1273,8 @@ bool aiChooseSensorTarget(BASE_OBJECT *psObj, BASE_OBJECT **ppsTarget)
 		BASE_OBJECT    *psTemp = nullptr;
 		unsigned tarDist = UINT32_MAX;
 
-		static GridList gridList;  // static to avoid allocations.
-		gridList = gridStartIterate(psObj->pos.x, psObj->pos.y, objSensorRange(psObj));
+		GridList &gridList = bestNearestTargetBuffers[0].gridList;  // Only called from the main thread.
+		gridQuery(gridList, psObj->pos.x, psObj->pos.y, objSensorRange(psObj));
 		for (GridIterator gi = gridList.begin(); gi != gridList.end(); ++gi)
 		{
 			BASE_OBJECT *psCurr = *gi;
@@ -1082,21 +1346,9 @@ static bool updateAttackTarget(BASE_OBJECT *psAttacker, SDWORD weapon_slot)
 }
 
 /* Do the AI for a droid */
-void aiUpdateDroid(DROID *psDroid)
+/// Works out whether aiUpdateDroid should look for a target, or look for a better target than the current one.
+static void aiDroidTargetNeeds(DROID *psDroid, bool &lookForTarget, bool &updateTarget)
 {
-	bool		lookForTarget, updateTarget;
-
-	ASSERT(psDroid != nullptr, "Invalid droid pointer");
-	if (!psDroid || isDead((BASE_OBJECT *)psDroid))
-	{
-		return;
-	}
-
-	if (psDroid->droidType != DROID_SENSOR && psDroid->numWeaps == 0)
-	{
-		return;
-	}
-
 	lookForTarget = false;
 	updateTarget = false;
 
@@ -1172,10 +1424,35 @@ void aiUpdateDroid(DROID *psDroid)
 	{
 		lookForTarget = false;
 	}
+}
+
+/// True if the droid should look for a better target than its current one this tick.
+static bool aiDroidWantsBetterTarget(DROID *psDroid, bool lookForTarget, bool updateTarget)
+{
+	/* For commanders and non-assigned non-commanders: look for a better target once in a while */
+	return !lookForTarget && updateTarget && psDroid->numWeaps > 0 && !hasCommander(psDroid)
+	    && (psDroid->id + gameTime) / TARGET_UPD_SKIP_FRAMES != (psDroid->id + gameTime - deltaGameTime) / TARGET_UPD_SKIP_FRAMES;
+}
+
+void aiUpdateDroid(DROID *psDroid)
+{
+	bool		lookForTarget, updateTarget;
+
+	ASSERT(psDroid != nullptr, "Invalid droid pointer");
+	if (!psDroid || isDead((BASE_OBJECT *)psDroid))
+	{
+		return;
+	}
+
+	if (psDroid->droidType != DROID_SENSOR && psDroid->numWeaps == 0)
+	{
+		return;
+	}
+
+	aiDroidTargetNeeds(psDroid, lookForTarget, updateTarget);
 
 	/* For commanders and non-assigned non-commanders: look for a better target once in a while */
-	if (!lookForTarget && updateTarget && psDroid->numWeaps > 0 && !hasCommander(psDroid)
-	    && (psDroid->id + gameTime) / TARGET_UPD_SKIP_FRAMES != (psDroid->id + gameTime - deltaGameTime) / TARGET_UPD_SKIP_FRAMES)
+	if (aiDroidWantsBetterTarget(psDroid, lookForTarget, updateTarget))
 	{
 		for (unsigned i = 0; i < psDroid->numWeaps; ++i)
 		{
@@ -1215,6 +1492,149 @@ void aiUpdateDroid(DROID *psDroid)
 	}
 }
 
+void aiPrepareDroidTargets()
+{
+	preparedDroidTargets.clear();
+	preparedDroidTargetIndex.clear();
+	preparedDroidTargetTime = gameTime;
+
+	// Pick the droids which aiUpdateDroid will most likely ask for a target, and their weapon slots.
+	for (unsigned player = 0; player < MAX_PLAYERS; ++player)
+	{
+		for (DROID *psDroid = apsDroidLists[player]; psDroid != nullptr; psDroid = psDroid->psNext)
+		{
+			if (isDead(psDroid) || psDroid->droidType == DROID_SENSOR || psDroid->numWeaps == 0)
+			{
+				continue;
+			}
+			bool lookForTarget, updateTarget;
+			aiDroidTargetNeeds(psDroid, lookForTarget, updateTarget);
+			unsigned slots = 0;
+			if (lookForTarget && !updateTarget)
+			{
+				slots = 1;
+			}
+			else if (aiDroidWantsBetterTarget(psDroid, lookForTarget, updateTarget))
+			{
+				slots = (1 << psDroid->numWeaps) - 1;
+			}
+			if (slots != 0)
+			{
+				PreparedDroidTargets prepared;
+				prepared.psDroid = psDroid;
+				prepared.slots = slots;
+				preparedDroidTargets.push_back(prepared);
+			}
+		}
+	}
+	if (preparedDroidTargets.empty())
+	{
+		return;
+	}
+
+	// The target candidate caches are built lazily, so build them now, before the other threads read them.
+	for (PreparedDroidTargets const &prepared : preparedDroidTargets)
+	{
+		aiTargetCandidates(prepared.psDroid->player);
+	}
+
+	bestNearestTargetBuffers.resize(simJobsNumWorkers());
+	simJobsParallelFor(preparedDroidTargets.size(), [](size_t item, unsigned worker) {
+		PreparedDroidTargets &prepared = preparedDroidTargets[item];
+		for (unsigned slot = 0; slot < MAX_WEAPONS; ++slot)
+		{
+			prepared.psTarget[slot] = nullptr;
+			prepared.weight[slot] = -1;
+			if ((prepared.slots & (1 << slot)) != 0)
+			{
+				prepared.weight[slot] = aiBestNearestTargetFrom(prepared.psDroid, &prepared.psTarget[slot], slot, 0, bestNearestTargetBuffers[worker]);
+			}
+		}
+	});
+
+	for (unsigned i = 0; i < preparedDroidTargets.size(); ++i)
+	{
+		PreparedDroidTargets const &prepared = preparedDroidTargets[i];
+		preparedDroidTargetIndex.emplace(prepared.psDroid, i);
+		// Goes into the sync debug checksums, so that any difference between clients shows up here, rather than much later.
+		static_assert(MAX_WEAPONS == 3, "Update the syncDebug call below.");
+		syncDebug("%u targets %u:%d %u:%d %u:%d", prepared.psDroid->id,
+		          prepared.psTarget[0] != nullptr ? prepared.psTarget[0]->id : 0, prepared.weight[0],
+		          prepared.psTarget[1] != nullptr ? prepared.psTarget[1]->id : 0, prepared.weight[1],
+		          prepared.psTarget[2] != nullptr ? prepared.psTarget[2]->id : 0, prepared.weight[2]);
+	}
+}
+
+void aiPrepareStructureTargets()
+{
+	preparedStructureTargets.clear();
+	preparedStructureTargetIndex.clear();
+	preparedStructureTargetTime = gameTime;
+
+	// Pick the built structures with weapons, since aiUpdateStructure looks for targets for all of them every tick.
+	for (unsigned player = 0; player < MAX_PLAYERS; ++player)
+	{
+		for (STRUCTURE *psStruct = apsStructLists[player]; psStruct != nullptr; psStruct = psStruct->psNext)
+		{
+			if (isDead(psStruct) || psStruct->status != SS_BUILT || psStruct->numWeaps == 0)
+			{
+				continue;
+			}
+			unsigned slots = 0;
+			for (unsigned slot = 0; slot < psStruct->numWeaps; ++slot)
+			{
+				if (psStruct->asWeaps[slot].nStat > 0 && asWeaponStats[psStruct->asWeaps[slot].nStat].weaponSubClass != WSC_LAS_SAT)
+				{
+					slots |= 1 << slot;
+				}
+			}
+			if (slots != 0)
+			{
+				PreparedStructureTargets prepared;
+				prepared.psStruct = psStruct;
+				prepared.slots = slots;
+				preparedStructureTargets.push_back(prepared);
+			}
+		}
+	}
+	if (preparedStructureTargets.empty())
+	{
+		return;
+	}
+
+	// The target candidate caches are built lazily, so build them now, before the other threads read them.
+	for (PreparedStructureTargets const &prepared : preparedStructureTargets)
+	{
+		aiTargetCandidates(prepared.psStruct->player);
+	}
+
+	bestNearestTargetBuffers.resize(simJobsNumWorkers());
+	simJobsParallelFor(preparedStructureTargets.size(), [](size_t item, unsigned worker) {
+		PreparedStructureTargets &prepared = preparedStructureTargets[item];
+		for (unsigned slot = 0; slot < MAX_WEAPONS; ++slot)
+		{
+			prepared.psTarget[slot] = nullptr;
+			prepared.origin[slot] = ORIGIN_UNKNOWN;
+			if ((prepared.slots & (1 << slot)) != 0)
+			{
+				aiChooseStructureTarget(prepared.psStruct, &prepared.psTarget[slot], slot, &prepared.origin[slot], bestNearestTargetBuffers[worker]);
+			}
+		}
+	});
+
+	for (unsigned i = 0; i < preparedStructureTargets.size(); ++i)
+	{
+		PreparedStructureTargets const &prepared = preparedStructureTargets[i];
+		preparedStructureTargetIndex.emplace(prepared.psStruct, i);
+		// Goes into the sync debug checksums, so that any difference between clients shows up here, rather than much later.
+		static_assert(MAX_WEAPONS == 3, "Update the syncDebug call below.");
+		syncDebug("%u targets %u:%d %u:%d %u:%d", prepared.psStruct->id,
+		          prepared.psTarget[0] != nullptr ? prepared.psTarget[0]->id : 0, prepared.origin[0],
+		          prepared.psTarget[1] != nullptr ? prepared.psTarget[1]->id : 0, prepared.origin[1],
+		          prepared.psTarget[2] != nullptr ? prepared.psTarget[2]->id : 0, prepared.origin[2]);
+	}
+}
+
 /* Check if any of our weapons can hit the target... */
 bool checkAnyWeaponsTarget(BASE_OBJECT *psObject, BASE_OBJECT *psTarget)
 {
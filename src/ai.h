@@ -63,6 +63,18 @@ bool aiShutdown();
 /* Do the AI for a droid */
 void aiUpdateDroid(DROID *psDroid);
 
+/** Look for targets for all the droids which will probably need one this tick, using the simulation threads.
+ *  Call once per tick, before updating the droids. aiBestNearestTarget then returns the prepared results,
+ *  unless the target has been destroyed since, so all the searches see the game state from before any droid moved.
+ */
+void aiPrepareDroidTargets();
+
+/** Look for targets for all the built structures with weapons, using the simulation threads.
+ *  Call once per tick, before updating the structures. aiChooseTarget then returns the prepared results for
+ *  structures, unless the target has been destroyed since.
+ */
+void aiPrepareStructureTargets();
+
 // Find the nearest best target for a droid
 // returns integer representing quality of choice, -1 if failed
 int aiBestNearestTarget(DROID *psDroid, BASE_OBJECT **ppsObj, int weapon_slot, int extraRange = 0);
@@ -35,13 +35,18 @@
  *    is continued until the new source is reached.  If the new source is  not reached,
  *    the droid is  on a  different island than the previous droid,  and pathfinding is
  *    restarted from the first step.
- *  Up to 30 pathfinding maps from A* are cached, in a LRU list. The PathNode heap con-
+ *  Up to 30 pathfinding maps from A* are cached,  in LRU lists owned by the caller (see
+ *  the job lanes in fpath.cpp, each lane has its own share of them). The PathNode heap con-
  *  tains the  priority-heap-sorted  nodes which are to be explored.  The path back  is
  *  stored in the PathExploredTile 2D array of tiles.
+ *  When no context can be reused and the route is long, the route is first planned on the
+ *  cluster graph (see pathcluster.h),  and the context only explores the clusters on that
+ *  route. Such a context can only be reused by droids starting inside those clusters.
  */
 
 #ifndef WZ_TESTING
 #include "lib/framework/frame.h"
+#include "lib/framework/wzprofile.h"
 
 #include "astar.h"
 #include "map.h"
@@ -54,169 +59,19 @@
 
 #include "lib/netplay/netplay.h"
 
-/// A coordinate.
-struct PathCoord
-{
-	PathCoord() {}
-	PathCoord(int16_t x_, int16_t y_) : x(x_), y(y_) {}
-	bool operator ==(PathCoord const &z) const
-	{
-		return x == z.x && y == z.y;
-	}
-	bool operator !=(PathCoord const &z) const
-	{
-		return !(*this == z);
-	}
-
-	int16_t x, y;
-};
-
-/** The structure to store a node of the route in node table
- *
- *  @ingroup pathfinding
- */
-struct PathNode
-{
-	bool operator <(PathNode const &z) const
-	{
-		// Sort descending est, fallback to ascending dist, fallback to sorting by position.
-		if (est  != z.est)
-		{
-			return est  > z.est;
-		}
-		if (dist != z.dist)
-		{
-			return dist < z.dist;
-		}
-		if (p.x  != z.p.x)
-		{
-			return p.x  < z.p.x;
-		}
-		return p.y  < z.p.y;
-	}
-
-	PathCoord p;                    // Map coords.
-	unsigned  dist, est;            // Distance so far and estimate to end.
-};
-struct PathExploredTile
-{
-	PathExploredTile() : iteration(0xFFFF), dx(0), dy(0), dist(0), visited(false) {}
-
-	uint16_t iteration;
-	int8_t   dx, dy;                // Offset from previous point in the route.
-	unsigned dist;                  // Shortest known distance to tile.
-	bool     visited;
-};
-
-struct PathBlockingType
-{
-	uint32_t gameTime;
-
-	PROPULSION_TYPE propulsion;
-	int owner;
-	FPATH_MOVETYPE moveType;
-};
-/// Pathfinding blocking map
-struct PathBlockingMap
-{
-	bool operator ==(PathBlockingType const &z) const
-	{
-		return type.gameTime == z.gameTime &&
-		       fpathIsEquivalentBlocking(type.propulsion, type.owner, type.moveType,
-		                                 z.propulsion,    z.owner,    z.moveType);
-	}
-
-	PathBlockingType type;
-	std::vector<bool> map;
-	std::vector<bool> dangerMap;	// using threatBits
-};
-
-struct PathNonblockingArea
-{
-	PathNonblockingArea() {}
-	PathNonblockingArea(StructureBounds const &st) : x1(st.map.x), x2(st.map.x + st.size.x), y1(st.map.y), y2(st.map.y + st.size.y) {}
-	bool operator ==(PathNonblockingArea const &z) const
-	{
-		return x1 == z.x1 && x2 == z.x2 && y1 == z.y1 && y2 == z.y2;
-	}
-	bool operator !=(PathNonblockingArea const &z) const
-	{
-		return !(*this == z);
-	}
-	bool isNonblocking(int x, int y) const
-	{
-		return x >= x1 && x < x2 && y >= y1 && y < y2;
-	}
-
-	int16_t x1 = 0;
-	int16_t x2 = 0;
-	int16_t y1 = 0;
-	int16_t y2 = 0;
-};
-
-// Data structures used for pathfinding, can contain cached results.
-struct PathfindContext
-{
-	PathfindContext() : myGameTime(0), iteration(0), blockingMap(nullptr) {}
-	bool isBlocked(int x, int y) const
-	{
-		if (dstIgnore.isNonblocking(x, y))
-		{
-			return false;  // The path is actually blocked here by a structure, but ignore it since it's where we want to go (or where we came from).
-		}
-		// Not sure whether the out-of-bounds check is needed, can only happen if pathfinding is started on a blocking tile (or off the map).
-		return x < 0 || y < 0 || x >= mapWidth || y >= mapHeight || blockingMap->map[x + y * mapWidth];
-	}
-	bool isDangerous(int x, int y) const
-	{
-		return !blockingMap->dangerMap.empty() && blockingMap->dangerMap[x + y * mapWidth];
-	}
-	bool matches(std::shared_ptr<PathBlockingMap> &blockingMap_, PathCoord tileS_, PathNonblockingArea dstIgnore_) const
-	{
-		// Must check myGameTime == blockingMap_->type.gameTime, otherwise blockingMap could be a deleted pointer which coincidentally compares equal to the valid pointer blockingMap_.
-		return myGameTime == blockingMap_->type.gameTime && blockingMap == blockingMap_ && tileS == tileS_ && dstIgnore == dstIgnore_;
-	}
-	void assign(std::shared_ptr<PathBlockingMap> &blockingMap_, PathCoord tileS_, PathNonblockingArea dstIgnore_)
-	{
-		blockingMap = blockingMap_;
-		tileS = tileS_;
-		dstIgnore = dstIgnore_;
-		myGameTime = blockingMap->type.gameTime;
-		nodes.clear();
-
-		// Make the iteration not match any value of iteration in map.
-		if (++iteration == 0xFFFF)
-		{
-			map.clear();  // There are no values of iteration guaranteed not to exist in map, so clear the map.
-			iteration = 0;
-		}
-		map.resize(static_cast<size_t>(mapWidth) * static_cast<size_t>(mapHeight));  // Allocate space for map, if needed.
-	}
-
-	PathCoord       tileS;                // Start tile for pathfinding. (May be either source or target tile.)
-	uint32_t        myGameTime;
-
-	PathCoord       nearestCoord;         // Nearest reachable tile to destination.
-
-	/** Counter to implement lazy deletion from map.
-	 *
-	 *  @see fpathTableReset
-	 */
-	uint16_t        iteration;
-
-	std::vector<PathNode> nodes;        ///< Edge of explored region of the map.
-	std::vector<PathExploredTile> map;  ///< Map, with paths leading back to tileS.
-	std::shared_ptr<PathBlockingMap> blockingMap; ///< Map of blocking tiles for the type of object which needs a path.
-	PathNonblockingArea dstIgnore;      ///< Area of structure at destination which should be considered nonblocking.
-};
-
-/// Last recently used list of contexts.
-static std::list<PathfindContext> fpathContexts;
-
 /// Lists of blocking maps from current tick.
 static std::vector<std::shared_ptr<PathBlockingMap>> fpathBlockingMaps;
 /// Game time for all blocking maps in fpathBlockingMaps.
 static uint32_t fpathCurrentGameTime;
+/// Most recent cluster graph for each kind of blocking map, to be updated incrementally when the blocking map changes.
+static std::vector<std::pair<PathBlockingType, std::shared_ptr<PathClusterGraph>>> fpathClusterGraphs;
+/// Most recent blocking map of each kind, to tell whether the next one changed.
+static std::vector<std::shared_ptr<PathBlockingMap>> fpathLastBlockingMaps;
+/// Last generation given to a blocking map.
+static uint32_t fpathBlockingGeneration = 0;
+
+/// Routes estimated to be longer than this (about 3 clusters) are planned on the cluster graph first.
+#define PATH_CLUSTER_MIN_ROUTE (3 * PATH_CLUSTER_SIZE * 140)
 
 // Convert a direction into an offset
 // dir 0 => x = 0, y = -1
@@ -234,8 +89,9 @@ static const Vector2i aDirOffset[] =
 
 void fpathHardTableReset()
 {
-	fpathContexts.clear();
 	fpathBlockingMaps.clear();
+	fpathClusterGraphs.clear();
+	fpathLastBlockingMaps.clear();
 }
 
 /** Get the nearest entry in the open list
@@ -353,7 +209,7 @@ static void fpathAStarReestimate(PathfindContext &context, PathCoord tileF)
 }
 
 /// Returns nearest explored tile to tileF.
-static PathCoord fpathAStarExplore(PathfindContext &context, PathCoord tileF)
+static PathCoord fpathAStarExplore(PathfindContext &context, PathCoord tileF, PathfindStats *stats)
 {
 	PathCoord       nearestCoord(0, 0);
 	unsigned        nearestDist = 0xFFFFFFFF;
@@ -368,6 +224,10 @@ static PathCoord fpathAStarExplore(PathfindContext &context, PathCoord tileF)
 			continue;  // Already been here.
 		}
 		context.map[node.p.x + node.p.y * mapWidth].visited = true;
+		if (stats != nullptr)
+		{
+			++stats->nodesExpanded;
+		}
 
 		// note the nearest node to the target so far
 		if (node.est - node.dist < nearestDist)
@@ -432,17 +292,20 @@ static PathCoord fpathAStarExplore(PathfindContext &context, PathCoord tileF)
 	return nearestCoord;
 }
 
-static void fpathInitContext(PathfindContext &context, std::shared_ptr<PathBlockingMap> &blockingMap, PathCoord tileS, PathCoord tileRealS, PathCoord tileF, PathNonblockingArea dstIgnore)
+static void fpathInitContext(PathfindContext &context, std::shared_ptr<PathBlockingMap> &blockingMap, PathCoord tileS, PathCoord tileRealS, PathCoord tileF, PathNonblockingArea dstIgnore, std::vector<bool> const &corridor)
 {
-	context.assign(blockingMap, tileS, dstIgnore);
+	context.assign(blockingMap, tileS, dstIgnore, corridor);
 
 	// Add the start point to the open list
 	fpathNewNode(context, tileF, tileRealS, 0, tileRealS);
 	ASSERT(!context.nodes.empty(), "fpathNewNode failed to add node.");
 }
 
-ASR_RETVAL fpathAStarRoute(MOVE_CONTROL *psMove, PATHJOB *psJob)
+ASR_RETVAL fpathAStarRoute(PathfindContextList &fpathContexts, MOVE_CONTROL *psMove, PATHJOB *psJob, PathfindStats *stats, size_t maxContexts)
 {
+	WZ_PROFILE_SCOPE("fpathAStarRoute");
+	WZ_PROFILE_COUNT("routes", 1);
+
 	ASR_RETVAL      retval = ASR_OK;
 
 	bool            mustReverse = true;
@@ -464,6 +327,12 @@ ASR_RETVAL fpathAStarRoute(MOVE_CONTROL *psMove, PATHJOB *psJob)
 
 		// We have tried going to tileDest before.
 
+		if (!contextIterator->isInCorridor(tileOrig.x, tileOrig.y))
+		{
+			// The previous search was restricted to a corridor of clusters, which orig is not in, so this context can't find orig.
+			continue;
+		}
+
 		if (contextIterator->map[tileOrig.x + tileOrig.y * mapWidth].iteration == contextIterator->iteration
 		    && contextIterator->map[tileOrig.x + tileOrig.y * mapWidth].visited)
 		{
@@ -474,7 +343,7 @@ ASR_RETVAL fpathAStarRoute(MOVE_CONTROL *psMove, PATHJOB *psJob)
 		{
 			// Need to find the path from orig to dest, continue previous exploration.
 			fpathAStarReestimate(*contextIterator, tileOrig);
-			endCoord = fpathAStarExplore(*contextIterator, tileOrig);
+			endCoord = fpathAStarExplore(*contextIterator, tileOrig, stats);
 		}
 
 		if (endCoord != tileOrig)
@@ -491,21 +360,36 @@ ASR_RETVAL fpathAStarRoute(MOVE_CONTROL *psMove, PATHJOB *psJob)
 	{
 		// We did not find an appropriate context. Make one.
 
-		if (fpathContexts.size() < 30)
+		if (fpathContexts.size() < maxContexts)
 		{
 			fpathContexts.push_back(PathfindContext());
 		}
 		--contextIterator;
 
+		// For long routes, plan the route on the cluster graph first, and only search the clusters it passes through.
+		std::vector<bool> corridor;
+		if (fpathEstimate(tileOrig, tileDest) > PATH_CLUSTER_MIN_ROUTE && dstIgnore == PathNonblockingArea() && psJob->blockingMap->clusters != nullptr)
+		{
+			if (!psJob->blockingMap->clusters->findCorridor(tileOrig.x, tileOrig.y, tileDest.x, tileDest.y, corridor))
+			{
+				corridor.clear();  // No abstract route, maybe the destination is unreachable, so search everywhere for the nearest reachable tile.
+			}
+		}
+
 		// Init a new context, overwriting the oldest one if we are caching too many.
 		// We will be searching from orig to dest, since we don't know where the nearest reachable tile to dest is.
-		fpathInitContext(*contextIterator, psJob->blockingMap, tileOrig, tileOrig, tileDest, dstIgnore);
-		endCoord = fpathAStarExplore(*contextIterator, tileDest);
+		fpathInitContext(*contextIterator, psJob->blockingMap, tileOrig, tileOrig, tileDest, dstIgnore, corridor);
+		endCoord = fpathAStarExplore(*contextIterator, tileDest, stats);
 		contextIterator->nearestCoord = endCoord;
 	}
 
 	PathfindContext &context = *contextIterator;
 
+	if (stats != nullptr)
+	{
+		++(mustReverse ? stats->contextMisses : stats->contextHits);
+	}
+
 	// return the nearest route if no actual route was found
 	if (context.nearestCoord != tileDest)
 	{
@@ -513,8 +397,7 @@ ASR_RETVAL fpathAStarRoute(MOVE_CONTROL *psMove, PATHJOB *psJob)
 	}
 
 	// Get route, in reverse order.
-	static std::vector<Vector2i> path;  // Declared static to save allocations.
-	path.clear();
+	std::vector<Vector2i> path;  // Not static, since several pathfinding threads may be running at once.
 
 	Vector2i newP(0, 0);
 	for (Vector2i p(world_coord(endCoord.x) + TILE_UNITS / 2, world_coord(endCoord.y) + TILE_UNITS / 2); true; p = newP)
@@ -578,7 +461,8 @@ ASR_RETVAL fpathAStarRoute(MOVE_CONTROL *psMove, PATHJOB *psJob)
 		if (!context.isBlocked(tileOrig.x, tileOrig.y))  // If blocked, searching from tileDest to tileOrig wouldn't find the tileOrig tile.
 		{
 			// Next time, search starting from nearest reachable tile to the destination.
-			fpathInitContext(context, psJob->blockingMap, tileDest, context.nearestCoord, tileOrig, dstIgnore);
+			// Keep the corridor, if any. Droids starting outside it will get a new context.
+			fpathInitContext(context, psJob->blockingMap, tileDest, context.nearestCoord, tileOrig, dstIgnore, context.corridor);
 		}
 	}
 	else
@@ -637,17 +521,44 @@ void fpathSetBlockingMap(PATHJOB *psJob)
 			}
 		if (!isHumanPlayer(type.owner) && type.moveType == FMT_MOVE)
 		{
-			std::vector<bool> &dangerMap = blockMap->dangerMap;
-			dangerMap.resize(static_cast<size_t>(mapWidth) * static_cast<size_t>(mapHeight));
-			for (int y = 0; y < mapHeight; ++y)
-				for (int x = 0; x < mapWidth; ++x)
-				{
-					dangerMap[x + y * mapWidth] = auxTile(x, y, type.owner) & AUXBITS_THREAT;
-					checksumDangerMap ^= dangerMap[x + y * mapWidth] * (factor = 3 * factor + 1);
-				}
+			blockMap->dangerMap = threatMapSnapshot(type.owner);
+			checksumDangerMap = blockMap->dangerMap ? blockMap->dangerMap->checksum : 0;
 		}
 		syncDebug("blockingMap(%d,%d,%d,%d) = %08X %08X", gameTime, psJob->propulsion, psJob->owner, psJob->moveType, checksumMap, checksumDangerMap);
 
+		// Keep the generation of the previous map of this kind if nothing changed, so that cached paths stay valid.
+		auto last = std::find_if(fpathLastBlockingMaps.begin(), fpathLastBlockingMaps.end(), [&](std::shared_ptr<PathBlockingMap> const &ptr) {
+			return fpathIsEquivalentBlocking(ptr->type.propulsion, ptr->type.owner, ptr->type.moveType,
+			                                 type.propulsion,      type.owner,      type.moveType);
+		});
+		if (last == fpathLastBlockingMaps.end())
+		{
+			fpathLastBlockingMaps.emplace_back(nullptr);
+			last = fpathLastBlockingMaps.end() - 1;
+		}
+		if (*last != nullptr && (*last)->map == map && (*last)->dangerMap == blockMap->dangerMap)
+		{
+			blockMap->generation = (*last)->generation;
+		}
+		else
+		{
+			blockMap->generation = ++fpathBlockingGeneration;
+		}
+		*last = fpathBlockingMaps.back();
+
+		// Make the cluster graph for the new map, reusing whatever didn't change since the last map of this kind.
+		auto graph = std::find_if(fpathClusterGraphs.begin(), fpathClusterGraphs.end(), [&](std::pair<PathBlockingType, std::shared_ptr<PathClusterGraph>> const &entry) {
+			return fpathIsEquivalentBlocking(entry.first.propulsion, entry.first.owner, entry.first.moveType,
+			                                 type.propulsion,       type.owner,       type.moveType);
+		});
+		if (graph == fpathClusterGraphs.end())
+		{
+			fpathClusterGraphs.emplace_back(type, nullptr);
+			graph = fpathClusterGraphs.end() - 1;
+		}
+		graph->second = pathClusterGraphCreate(map, mapWidth, mapHeight, graph->second);
+		blockMap->clusters = graph->second;
+
 		psJob->blockingMap = fpathBlockingMaps.back();
 	}
 	else
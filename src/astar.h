@@ -22,6 +22,13 @@
 #define __INCLUDED_SRC_ASTART_H__
 
 #include "fpath.h"
+#include "map.h"
+#include "pathcluster.h"
+#include "threatmap.h"
+
+#include <list>
+#include <vector>
+#include <memory>
 
 /** return codes for astar
  *
@@ -34,11 +41,193 @@ enum ASR_RETVAL
 	ASR_NEAREST,    ///< found a partial route to a nearby position
 };
 
+/// A coordinate.
+struct PathCoord
+{
+	PathCoord() {}
+	PathCoord(int16_t x_, int16_t y_) : x(x_), y(y_) {}
+	bool operator ==(PathCoord const &z) const
+	{
+		return x == z.x && y == z.y;
+	}
+	bool operator !=(PathCoord const &z) const
+	{
+		return !(*this == z);
+	}
+
+	int16_t x, y;
+};
+
+/** The structure to store a node of the route in node table
+ *
+ *  @ingroup pathfinding
+ */
+struct PathNode
+{
+	bool operator <(PathNode const &z) const
+	{
+		// Sort descending est, fallback to ascending dist, fallback to sorting by position.
+		if (est  != z.est)
+		{
+			return est  > z.est;
+		}
+		if (dist != z.dist)
+		{
+			return dist < z.dist;
+		}
+		if (p.x  != z.p.x)
+		{
+			return p.x  < z.p.x;
+		}
+		return p.y  < z.p.y;
+	}
+
+	PathCoord p;                    // Map coords.
+	unsigned  dist, est;            // Distance so far and estimate to end.
+};
+struct PathExploredTile
+{
+	PathExploredTile() : iteration(0xFFFF), dx(0), dy(0), dist(0), visited(false) {}
+
+	uint16_t iteration;
+	int8_t   dx, dy;                // Offset from previous point in the route.
+	unsigned dist;                  // Shortest known distance to tile.
+	bool     visited;
+};
+
+struct PathBlockingType
+{
+	uint32_t gameTime;
+
+	PROPULSION_TYPE propulsion;
+	int owner;
+	FPATH_MOVETYPE moveType;
+};
+/// Pathfinding blocking map
+struct PathBlockingMap
+{
+	bool operator ==(PathBlockingType const &z) const
+	{
+		return type.gameTime == z.gameTime &&
+		       fpathIsEquivalentBlocking(type.propulsion, type.owner, type.moveType,
+		                                 z.propulsion,    z.owner,    z.moveType);
+	}
+
+	PathBlockingType type;
+	std::vector<bool> map;
+	std::shared_ptr<ThreatSnapshot const> dangerMap;  ///< Ground threat of the owner, if the owner avoids danger.
+	std::shared_ptr<PathClusterGraph> clusters;  ///< Hierarchical abstraction of map, for planning long routes.
+	uint32_t generation = 0;  ///< Same as for the previous map of an equivalent type, if map and dangerMap didn't change since then. Unique otherwise.
+};
+
+struct PathNonblockingArea
+{
+	PathNonblockingArea() {}
+	PathNonblockingArea(StructureBounds const &st) : x1(st.map.x), x2(st.map.x + st.size.x), y1(st.map.y), y2(st.map.y + st.size.y) {}
+	bool operator ==(PathNonblockingArea const &z) const
+	{
+		return x1 == z.x1 && x2 == z.x2 && y1 == z.y1 && y2 == z.y2;
+	}
+	bool operator !=(PathNonblockingArea const &z) const
+	{
+		return !(*this == z);
+	}
+	bool isNonblocking(int x, int y) const
+	{
+		return x >= x1 && x < x2 && y >= y1 && y < y2;
+	}
+
+	int16_t x1 = 0;
+	int16_t x2 = 0;
+	int16_t y1 = 0;
+	int16_t y2 = 0;
+};
+
+// Data structures used for pathfinding, can contain cached results.
+struct PathfindContext
+{
+	PathfindContext() : myGameTime(0), iteration(0), blockingMap(nullptr) {}
+	bool isBlocked(int x, int y) const
+	{
+		if (dstIgnore.isNonblocking(x, y))
+		{
+			return false;  // The path is actually blocked here by a structure, but ignore it since it's where we want to go (or where we came from).
+		}
+		// Not sure whether the out-of-bounds check is needed, can only happen if pathfinding is started on a blocking tile (or off the map).
+		return x < 0 || y < 0 || x >= mapWidth || y >= mapHeight || !isInCorridor(x, y) || blockingMap->map[x + y * mapWidth];
+	}
+	bool isInCorridor(int x, int y) const
+	{
+		return corridor.empty() || corridor[x / PATH_CLUSTER_SIZE + y / PATH_CLUSTER_SIZE * corridorWidth];
+	}
+	bool isDangerous(int x, int y) const
+	{
+		return blockingMap->dangerMap && blockingMap->dangerMap->ground[x + y * mapWidth];
+	}
+	bool matches(std::shared_ptr<PathBlockingMap> &blockingMap_, PathCoord tileS_, PathNonblockingArea dstIgnore_) const
+	{
+		// Must check myGameTime == blockingMap_->type.gameTime, otherwise blockingMap could be a deleted pointer which coincidentally compares equal to the valid pointer blockingMap_.
+		return myGameTime == blockingMap_->type.gameTime && blockingMap == blockingMap_ && tileS == tileS_ && dstIgnore == dstIgnore_;
+	}
+	void assign(std::shared_ptr<PathBlockingMap> &blockingMap_, PathCoord tileS_, PathNonblockingArea dstIgnore_, std::vector<bool> const &corridor_)
+	{
+		blockingMap = blockingMap_;
+		tileS = tileS_;
+		dstIgnore = dstIgnore_;
+		corridor = corridor_;
+		corridorWidth = (mapWidth + PATH_CLUSTER_SIZE - 1) / PATH_CLUSTER_SIZE;
+		myGameTime = blockingMap->type.gameTime;
+		nodes.clear();
+
+		// Make the iteration not match any value of iteration in map.
+		if (++iteration == 0xFFFF)
+		{
+			map.clear();  // There are no values of iteration guaranteed not to exist in map, so clear the map.
+			iteration = 0;
+		}
+		map.resize(static_cast<size_t>(mapWidth) * static_cast<size_t>(mapHeight));  // Allocate space for map, if needed.
+	}
+
+	PathCoord       tileS;                // Start tile for pathfinding. (May be either source or target tile.)
+	uint32_t        myGameTime;
+
+	PathCoord       nearestCoord;         // Nearest reachable tile to destination.
+
+	/** Counter to implement lazy deletion from map.
+	 *
+	 *  @see fpathTableReset
+	 */
+	uint16_t        iteration;
+
+	std::vector<PathNode> nodes;        ///< Edge of explored region of the map.
+	std::vector<PathExploredTile> map;  ///< Map, with paths leading back to tileS.
+	std::shared_ptr<PathBlockingMap> blockingMap; ///< Map of blocking tiles for the type of object which needs a path.
+	PathNonblockingArea dstIgnore;      ///< Area of structure at destination which should be considered nonblocking.
+	std::vector<bool> corridor;         ///< Clusters the search is restricted to, or empty to search the whole map.
+	int corridorWidth = 0;              ///< Width of the map in clusters.
+};
+
+/// Last recently used list of contexts. Must only be used by one thread at a time.
+typedef std::list<PathfindContext> PathfindContextList;
+
+/// Number of contexts cached in total, over all context lists, since each of them holds a map-sized array.
+#define FPATH_MAX_CONTEXTS 30
+
+/// Counters for measuring pathfinding, see pathbench.h.
+struct PathfindStats
+{
+	uint64_t nodesExpanded = 0;  ///< Nodes taken from the open list.
+	uint64_t contextHits = 0;    ///< Routes found by continuing the search of a cached context.
+	uint64_t contextMisses = 0;  ///< Routes which needed a new context.
+};
+
 /** Use the A* algorithm to find a path
+ *
+ *  If stats is not nullptr, the work done is added to it. At most maxContexts contexts are kept in fpathContexts.
  *
  *  @ingroup pathfinding
  */
-ASR_RETVAL fpathAStarRoute(MOVE_CONTROL *psMove, PATHJOB *psJob);
+ASR_RETVAL fpathAStarRoute(PathfindContextList &fpathContexts, MOVE_CONTROL *psMove, PATHJOB *psJob, PathfindStats *stats = nullptr, size_t maxContexts = FPATH_MAX_CONTEXTS);
 
 /// Call from main thread.
 /// Sets psJob->blockingMap for later use by pathfinding thread, generating the required map if not already generated.
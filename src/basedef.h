@@ -123,6 +123,7 @@ struct BASE_OBJECT : public SIMPLE_OBJECT
 	UDWORD              periodicalDamageStart;                  ///< When the object entered the fire
 	UDWORD              periodicalDamage;                 ///< How much damage has been done since the object entered the fire
 	std::vector<TILEPOS> watchedTiles;              ///< Variable size array of watched tiles, empty for features
+	PlayerMask          threatPlayers = 0;          ///< Players the object was last found to be a threat to, if armed, see threatmap.h
 
 	UDWORD              timeAnimationStarted;       ///< Animation start time, zero for do not animate
 	UBYTE               animationEvent;             ///< If animation start time > 0, this points to which animation to run
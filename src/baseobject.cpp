@@ -29,6 +29,8 @@
 #include "feature.h"
 #include "intdisplay.h"
 #include "map.h"
+#include "objmem.h"
+#include "threatmap.h"
 
 
 static inline uint16_t interpolateAngle(uint16_t v1, uint16_t v2, uint32_t t1, uint32_t t2, uint32_t t)
@@ -115,6 +117,8 @@ BASE_OBJECT::BASE_OBJECT(OBJECT_TYPE type, uint32_t id, unsigned player)
 BASE_OBJECT::~BASE_OBJECT()
 {
 	visRemoveVisibility(this);
+	objIdIndexRemove(this);
+	threatMapObjectRemoved(this);
 
 #ifdef DEBUG
 	psNext = this;                                                       // Hopefully this will trigger an infinite loop       if someone uses the freed object.
@@ -25,6 +25,7 @@
  */
 
 #include "lib/framework/frame.h"
+#include "lib/framework/wzprofile.h"
 #include "lib/ivis_opengl/screen.h"
 #include "lib/netplay/netplay.h"
 #include "lib/ivis_opengl/pieclip.h"
@@ -35,13 +36,16 @@
 #include "frontend.h"
 #include "keybind.h"
 #include "loadsave.h"
+#include "loop.h"
 #include "main.h"
 #include "modding.h"
 #include "multiplay.h"
 #include "version.h"
+#include "visibility.h"
 #include "warzoneconfig.h"
 #include "wrappers.h"
 
+#include <algorithm>
 #include <cwchar>
 
 //////
@@ -79,6 +83,10 @@ typedef struct _poptContext
 /// Enable automatic test games
 static bool wz_autogame = false;
 static std::string wz_saveandquit;
+static std::string wz_pathbench;
+static std::string wz_simbench;
+static std::string wz_replay;
+static std::string wz_recordpathjobs;
 static std::string wz_test;
 static std::string wz_autoratingUrl;
 static bool wz_cli_headless = false;
@@ -327,6 +335,13 @@ typedef enum
 	CLI_WIN_ENABLE_CONSOLE,
 #endif
 	CLI_GAMEPORT,
+	CLI_PATHBENCH,
+	CLI_SIMBENCH,
+	CLI_RECORDPATHJOBS,
+	CLI_PROFILE,
+	CLI_FASTFORWARD,
+	CLI_REPLAY,
+	CLI_VISCHECK,
 } CLI_OPTIONS;
 
 static const struct poptOption *getOptionsTable()
@@ -386,6 +401,13 @@ static const struct poptOption *getOptionsTable()
 		{ "enableconsole", POPT_ARG_NONE, CLI_WIN_ENABLE_CONSOLE,   N_("Attach or create a console window and display console output (Windows only)"), nullptr },
 #endif
 		{ "gameport", POPT_ARG_STRING, CLI_GAMEPORT,   N_("Set game server port"), N_("port") },
+		{ "pathbench", POPT_ARG_STRING, CLI_PATHBENCH,   N_("Run path jobs on the loaded map, print timings and quit"), N_("file or random:count[:seed]") },
+		{ "recordpathjobs", POPT_ARG_STRING, CLI_RECORDPATHJOBS,   N_("Record path jobs to file, for --pathbench"), N_("file") },
+		{ "simbench", POPT_ARG_STRING, CLI_SIMBENCH,   N_("Run game ticks as fast as possible, print timings as JSON and quit"), N_("ticks[:seed]") },
+		{ "profile", POPT_ARG_STRING, CLI_PROFILE,   N_("Record game loop timers and counters, write them as Chrome trace events on exit"), N_("file") },
+		{ "fastforward", POPT_ARG_STRING, CLI_FASTFORWARD,   N_("Run the game as fast as possible, drawing a frame every N ticks (0: every 100ms)"), N_("N") },
+		{ "replay", POPT_ARG_STRING, CLI_REPLAY,   N_("Play back a recorded game (as fast as possible with --headless, printing timings as JSON)"), N_("file") },
+		{ "vischeck", POPT_ARG_NONE, CLI_VISCHECK,   N_("Compare the parallel vision pass to a serial one each tick, and fail --simbench or --replay on any difference"), nullptr },
 		// Terminating entry
 		{ nullptr, 0, 0,              nullptr,                                    nullptr },
 	};
@@ -849,6 +871,65 @@ bool ParseCommandLine(int argc, const char * const *argv)
 			netGameserverPortOverride = true;
 			debug(LOG_INFO, "Games will be hosted on port [%d]", NETgetGameserverPort());
 			break;
+
+		case CLI_PATHBENCH:
+			token = poptGetOptArg(poptCon);
+			if (token == nullptr)
+			{
+				qFatal("Bad path jobs");
+			}
+			wz_pathbench = token;
+			break;
+
+		case CLI_SIMBENCH:
+			token = poptGetOptArg(poptCon);
+			if (token == nullptr)
+			{
+				qFatal("Bad simulation benchmark");
+			}
+			wz_simbench = token;
+			break;
+
+		case CLI_VISCHECK:
+			visSetCheckParallel(true);
+			break;
+
+		case CLI_RECORDPATHJOBS:
+			token = poptGetOptArg(poptCon);
+			if (token == nullptr)
+			{
+				qFatal("Bad path jobs file name");
+			}
+			wz_recordpathjobs = token;
+			break;
+
+		case CLI_PROFILE:
+			token = poptGetOptArg(poptCon);
+			if (token == nullptr)
+			{
+				qFatal("Bad profile file name");
+			}
+			wzProfileStart(token);
+			break;
+
+		case CLI_FASTFORWARD:
+			token = poptGetOptArg(poptCon);
+			if (token == nullptr)
+			{
+				qFatal("Bad fast forward render interval");
+			}
+			loopSetFastForward(true, std::max(atoi(token), 0));
+			break;
+
+		case CLI_REPLAY:
+			setHostLaunch(HostLaunch::Replay);
+			token = poptGetOptArg(poptCon);
+			if (token == nullptr)
+			{
+				qFatal("Bad replay file name");
+			}
+			wz_replay = token;
+			break;
 		};
 	}
 
@@ -865,6 +946,26 @@ const std::string &saveandquit_enabled()
 	return wz_saveandquit;
 }
 
+const std::string &pathbench_enabled()
+{
+	return wz_pathbench;
+}
+
+const std::string &recordpathjobs_enabled()
+{
+	return wz_recordpathjobs;
+}
+
+const std::string &simbench_enabled()
+{
+	return wz_simbench;
+}
+
+const std::string &replay_enabled()
+{
+	return wz_replay;
+}
+
 const std::string &wz_skirmish_test()
 {
 	return wz_test;
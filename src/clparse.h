@@ -30,6 +30,10 @@ bool ParseCommandLineEarly(int argc, const char * const *argv);
 
 bool autogame_enabled();
 const std::string &saveandquit_enabled();
+const std::string &pathbench_enabled();
+const std::string &recordpathjobs_enabled();
+const std::string &simbench_enabled();
+const std::string &replay_enabled();
 const std::string &wz_skirmish_test();
 std::string autoratingUrl(std::string const &hash);
 
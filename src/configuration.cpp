@@ -357,6 +357,13 @@ bool loadConfig()
 		NETsetGameserverPort(iniGetInteger("gameserver_port", GAMESERVERPORT).value());
 	}
 	NETsetJoinPreferenceIPv6(iniGetBool("prefer_ipv6", true).value());
+	WireCompression netCompression = WIRE_COMPRESSION_ZLIB;
+	std::string netCompressionName = iniGetString("net_compression", "zlib").value();
+	if (!wireCompressionFromName(netCompressionName.c_str(), netCompression))
+	{
+		debug(LOG_WARNING, "Unknown net_compression \"%s\", using zlib.", netCompressionName.c_str());
+	}
+	NETsetWireCompression(netCompression, iniGetInteger("net_compression_level", -1).value());
 	setPublicIPv4LookupService(iniGetString("publicIPv4LookupService_Url", WZ_DEFAULT_PUBLIC_IPv4_LOOKUP_SERVICE_URL).value(), iniGetString("publicIPv4LookupService_JSONKey", WZ_DEFAULT_PUBLIC_IPv4_LOOKUP_SERVICE_JSONKEY).value());
 	setPublicIPv6LookupService(iniGetString("publicIPv6LookupService_Url", WZ_DEFAULT_PUBLIC_IPv6_LOOKUP_SERVICE_URL).value(), iniGetString("publicIPv6LookupService_JSONKey", WZ_DEFAULT_PUBLIC_IPv6_LOOKUP_SERVICE_JSONKEY).value());
 	war_SetFMVmode((FMV_MODE)iniGetInteger("FMVmode", FMV_FULLSCREEN).value());
@@ -415,6 +422,9 @@ bool loadConfig()
 	}
 	war_SetDisplayScale(static_cast<unsigned int>(displayScale));
 	war_setAutoAdjustDisplayScale(iniGetBool("autoAdjustDisplayScale", true).value());
+	war_SetPathfindingThreads(iniGetInteger("pathfindingThreads", 0).value());
+	war_SetSimulationThreads(iniGetInteger("simulationThreads", 0).value());
+	war_SetRecordReplays(iniGetBool("recordReplays", false).value());
 	// 640x480 is minimum that we will support, but default to something more sensible
 	int width = iniGetInteger("width", war_GetWidth()).value();
 	int height = iniGetInteger("height", war_GetHeight()).value();
@@ -551,6 +561,9 @@ bool saveConfig()
 	iniSetInteger("vsync", war_GetVsync());
 	iniSetInteger("displayScale", war_GetDisplayScale());
 	iniSetBool("autoAdjustDisplayScale", war_getAutoAdjustDisplayScale());
+	iniSetInteger("pathfindingThreads", war_GetPathfindingThreads());
+	iniSetInteger("simulationThreads", war_GetSimulationThreads());
+	iniSetBool("recordReplays", war_GetRecordReplays());
 	iniSetInteger("textureSize", getTextureSize());
 	iniSetInteger("antialiasing", war_getAntialiasing());
 	iniSetInteger("UPnP", (int)NetPlay.isUPNP);
@@ -566,6 +579,8 @@ bool saveConfig()
 		iniSetInteger("gameserver_port", (int)NETgetGameserverPort());
 	}
 	iniSetBool("prefer_ipv6", NETgetJoinPreferenceIPv6());
+	iniSetString("net_compression", wireCompressionName(NETgetWireCompression()));
+	iniSetInteger("net_compression_level", NETgetWireCompressionLevel());
 	iniSetString("publicIPv4LookupService_Url", getPublicIPv4LookupServiceUrl());
 	iniSetString("publicIPv4LookupService_JSONKey", getPublicIPv4LookupServiceJSONKey());
 	iniSetString("publicIPv6LookupService_Url", getPublicIPv6LookupServiceUrl());
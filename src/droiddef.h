@@ -94,6 +94,9 @@ struct DROID : public BASE_OBJECT
 	DROID(uint32_t id, unsigned player);
 	~DROID();
 
+	static void *operator new(size_t size);  ///< Allocated from a slab pool, see objmemPoolStats().
+	static void operator delete(void *ptr);
+
 	/// UTF-8 name of the droid. This is generated from the droid template
 	///  WARNING: This *can* be changed by the game player after creation & can be translated, do NOT rely on this being the same for everyone!
 	char            aName[MAX_STR_LENGTH];
@@ -74,6 +74,9 @@
 #endif
 #include <glm/gtx/transform.hpp>
 
+#include <memory>
+#include <vector>
+
 #define	GRAVITON_GRAVITY	((float)-800)
 #define	EFFECT_X_FLIP		0x1
 #define	EFFECT_Y_FLIP		0x2
@@ -154,7 +157,30 @@
 #define SHOCKWAVE_SPEED	(GAME_TICKS_PER_SEC)
 #define	MAX_SHOCKWAVE_SIZE				500
 
-static std::list<EFFECT *> activeList;
+/* Number of effects of each group which can exist at once. Effects added to a full group are dropped. */
+static const unsigned effectGroupCapacity[EFFECT_FREED] =
+{
+	4096,	// EFFECT_EXPLOSION
+	1024,	// EFFECT_CONSTRUCTION
+	4096,	// EFFECT_SMOKE
+	2048,	// EFFECT_GRAVITON
+	256,	// EFFECT_WAYPOINT
+	1024,	// EFFECT_BLOOD
+	512,	// EFFECT_DESTRUCTION
+	64,		// EFFECT_SAT_LASER
+	1024,	// EFFECT_FIRE
+	1024,	// EFFECT_FIREWORK
+};
+
+/* The effects of one group. Freed slots have group EFFECT_FREED, and are reused before the pool grows. */
+struct EffectPool
+{
+	std::unique_ptr<EFFECT[]> effects;	// Fixed size, so that effects don't move when others are added during an update.
+	std::vector<unsigned> freeSlots;	// Freed slots below end.
+	unsigned end = 0;					// Slots from here on have never been used.
+};
+
+static EffectPool effectPools[EFFECT_FREED];
 
 /* Tick counts for updates on a particular interval */
 static	UDWORD	lastUpdateStructures[EFFECT_STRUCTURE_DIVISION];
@@ -179,7 +205,25 @@ static bool updateDestruction(EFFECT *psEffect);
 static bool updateFire(EFFECT *psEffect);
 static bool updateSatLaser(EFFECT *psEffect);
 static bool updateFirework(EFFECT *psEffect);
-static bool updateEffect(EFFECT *psEffect);	// MASTER function
+
+/* The update function of each group, and whether it runs while the game is paused. */
+static const struct
+{
+	bool (*update)(EFFECT *psEffect);
+	bool whilePaused;
+} effectGroupUpdate[EFFECT_FREED] =
+{
+	{updateExplosion, true},	// EFFECT_EXPLOSION
+	{updateConstruction, false},	// EFFECT_CONSTRUCTION
+	{updatePolySmoke, false},	// EFFECT_SMOKE
+	{updateGraviton, false},	// EFFECT_GRAVITON
+	{updateWaypoint, false},	// EFFECT_WAYPOINT
+	{updateBlood, false},	// EFFECT_BLOOD
+	{updateDestruction, false},	// EFFECT_DESTRUCTION
+	{updateSatLaser, false},	// EFFECT_SAT_LASER
+	{updateFire, false},	// EFFECT_FIRE
+	{updateFirework, false},	// EFFECT_FIREWORK
+};
 
 // ----------------------------------------------------------------------------------------
 // ---- The render functions - every group type of effect has a distinct one
@@ -214,11 +258,46 @@ static UDWORD effectGetNumFrames(EFFECT *psEffect);
 
 void shutdownEffectsSystem()
 {
-	for (auto eff : activeList)
+	for (EffectPool &pool : effectPools)
 	{
-		delete eff;
+		pool = EffectPool();
 	}
-	activeList.clear();
+}
+
+/* Takes an unused effect from the pool of the group, or returns nullptr if the pool is full */
+static EFFECT *effectAlloc(EFFECT_GROUP group)
+{
+	ASSERT_OR_RETURN(nullptr, group < EFFECT_FREED, "Bad effect group %d", (int)group);
+
+	EffectPool &pool = effectPools[group];
+	if (!pool.effects)
+	{
+		pool.effects.reset(new EFFECT[effectGroupCapacity[group]]);
+		pool.freeSlots.reserve(effectGroupCapacity[group]);
+	}
+
+	EFFECT *psEffect;
+	if (!pool.freeSlots.empty())
+	{
+		psEffect = &pool.effects[pool.freeSlots.back()];
+		pool.freeSlots.pop_back();
+	}
+	else if (pool.end < effectGroupCapacity[group])
+	{
+		psEffect = &pool.effects[pool.end++];
+	}
+	else
+	{
+		return nullptr;
+	}
+	*psEffect = EFFECT();
+	return psEffect;
+}
+
+static void effectFree(EffectPool &pool, EFFECT *psEffect)
+{
+	psEffect->group = EFFECT_FREED;
+	pool.freeSlots.push_back(static_cast<unsigned>(psEffect - pool.effects.get()));
 }
 
 /*!
@@ -306,7 +385,12 @@ void addEffect(const Vector3i *pos, EFFECT_GROUP group, EFFECT_TYPE type, bool s
 	{
 		return;
 	}
-	EFFECT *psEffect = new EFFECT();
+	EFFECT *psEffect = effectAlloc(group);
+	if (psEffect == nullptr)
+	{
+		SetEffectForPlayer(0);	// reset it
+		return;  // Too much going on already, nobody will notice one effect less.
+	}
 	/* Reset control bits */
 	psEffect->control = 0;
 
@@ -398,107 +482,44 @@ void addEffect(const Vector3i *pos, EFFECT_GROUP group, EFFECT_TYPE type, bool s
 	}
 
 	ASSERT(psEffect->imd != nullptr || group == EFFECT_DESTRUCTION || group == EFFECT_FIRE || group == EFFECT_SAT_LASER, "null effect imd");
-
-	activeList.push_back(psEffect);
 }
 
 
-/* Calls all the update functions for each different currently active effect */
+/* Calls all the update functions for each different currently active effect, one group at a time */
 void processEffects(const glm::mat4 &viewMatrix)
 {
-	for (auto it = activeList.begin(); it != activeList.end(); )
+	const bool paused = gamePaused();
+
+	for (int group = 0; group < EFFECT_FREED; ++group)
 	{
-		EFFECT *psEffect = *it;
+		EffectPool &pool = effectPools[group];
+		bool (*const update)(EFFECT *) = effectGroupUpdate[group].update;
+		const bool doUpdate = !paused || effectGroupUpdate[group].whilePaused;
 
-		if (psEffect->birthTime <= graphicsTime)  // Don't process, if it doesn't exist yet
+		// Effects added by the update functions are appended, so pool.end must be reread every time.
+		for (unsigned i = 0; i < pool.end; ++i)
 		{
-			if (!updateEffect(psEffect))
+			EFFECT *psEffect = &pool.effects[i];
+			if (psEffect->group == EFFECT_FREED || psEffect->birthTime > graphicsTime)  // Don't process, if it doesn't exist (yet)
+			{
+				continue;
+			}
+			if (doUpdate && !update(psEffect))
 			{
-				delete psEffect;
-				it = activeList.erase(it);
+				effectFree(pool, psEffect);
 				continue;
 			}
-			if (psEffect->group != EFFECT_FREED && clipXY(psEffect->position.x, psEffect->position.z))
+			if (clipXY(psEffect->position.x, psEffect->position.z))
 			{
 				bucketAddTypeToList(RENDER_EFFECT, psEffect, viewMatrix);
 			}
 		}
-		++it;
 	}
 
 	/* Add any structure effects */
 	effectStructureUpdates();
 }
 
-/* The general update function for all effects - calls a specific one for each. Returns false if effect should be deleted. */
-static bool updateEffect(EFFECT *psEffect)
-{
-	/* What type of effect are we dealing with? */
-	switch (psEffect->group)
-	{
-	case EFFECT_EXPLOSION:
-		return updateExplosion(psEffect);
-	case EFFECT_WAYPOINT:
-		if (!gamePaused())
-		{
-			return updateWaypoint(psEffect);
-		}
-		return true;
-	case EFFECT_CONSTRUCTION:
-		if (!gamePaused())
-		{
-			return updateConstruction(psEffect);
-		}
-		return true;
-	case EFFECT_SMOKE:
-		if (!gamePaused())
-		{
-			return updatePolySmoke(psEffect);
-		}
-		return true;
-	case EFFECT_GRAVITON:
-		if (!gamePaused())
-		{
-			return updateGraviton(psEffect);
-		}
-		return true;
-	case EFFECT_BLOOD:
-		if (!gamePaused())
-		{
-			return updateBlood(psEffect);
-		}
-		return true;
-	case EFFECT_DESTRUCTION:
-		if (!gamePaused())
-		{
-			return updateDestruction(psEffect);
-		}
-		return true;
-	case EFFECT_FIRE:
-		if (!gamePaused())
-		{
-			return updateFire(psEffect);
-		}
-		return true;
-	case EFFECT_SAT_LASER:
-		if (!gamePaused())
-		{
-			return updateSatLaser(psEffect);
-		}
-		return true;
-	case EFFECT_FIREWORK:
-		if (!gamePaused())
-		{
-			return updateFirework(psEffect);
-		}
-		return true;
-	case EFFECT_FREED:
-		break;
-	}
-	debug(LOG_ERROR, "Weirdy class of effect passed to updateEffect");
-	abort();
-}
-
 // ----------------------------------------------------------------------------------------
 // ALL THE UPDATE FUNCTIONS
 // ----------------------------------------------------------------------------------------
@@ -2222,34 +2243,42 @@ bool writeFXData(const char *fileName)
 {
 	int i = 0;
 	WzConfig ini(WzString::fromUtf8(fileName), WzConfig::ReadAndWrite);
-	for (auto iter = activeList.cbegin(); iter != activeList.end(); ++iter, i++)
-	{
-		EFFECT *it = *iter;
-		ini.beginGroup("effect_" + WzString::number(i));
-		ini.setValue("control", it->control);
-		ini.setValue("group", it->group);
-		ini.setValue("type", it->type);
-		ini.setValue("frameNumber", it->frameNumber);
-		ini.setValue("size", it->size);
-		ini.setValue("baseScale", it->baseScale);
-		ini.setValue("specific", it->specific);
-		ini.setVector3f("position", it->position);
-		ini.setVector3f("velocity", it->velocity);
-		ini.setVector3i("rotation", it->rotation);
-		ini.setVector3i("spin", it->spin);
-		ini.setValue("birthTime", it->birthTime);
-		ini.setValue("lastFrame", it->lastFrame);
-		ini.setValue("frameDelay", it->frameDelay);
-		ini.setValue("lifeSpan", it->lifeSpan);
-		ini.setValue("radius", it->radius);
-
-		if (it->imd)
+	for (EffectPool const &pool : effectPools)
+	{
+		for (unsigned slot = 0; slot < pool.end; ++slot)
 		{
-			ini.setValue("imd_name", modelName(it->imd));
-		}
+			EFFECT *it = &pool.effects[slot];
+			if (it->group == EFFECT_FREED)
+			{
+				continue;
+			}
+			ini.beginGroup("effect_" + WzString::number(i));
+			ini.setValue("control", it->control);
+			ini.setValue("group", it->group);
+			ini.setValue("type", it->type);
+			ini.setValue("frameNumber", it->frameNumber);
+			ini.setValue("size", it->size);
+			ini.setValue("baseScale", it->baseScale);
+			ini.setValue("specific", it->specific);
+			ini.setVector3f("position", it->position);
+			ini.setVector3f("velocity", it->velocity);
+			ini.setVector3i("rotation", it->rotation);
+			ini.setVector3i("spin", it->spin);
+			ini.setValue("birthTime", it->birthTime);
+			ini.setValue("lastFrame", it->lastFrame);
+			ini.setValue("frameDelay", it->frameDelay);
+			ini.setValue("lifeSpan", it->lifeSpan);
+			ini.setValue("radius", it->radius);
+
+			if (it->imd)
+			{
+				ini.setValue("imd_name", modelName(it->imd));
+			}
 
-		// Move on to reading the next effect
-		ini.endGroup();
+			// Move on to reading the next effect
+			ini.endGroup();
+			++i;
+		}
 	}
 
 	// Everything is just fine!
@@ -2268,10 +2297,16 @@ bool readFXData(const char *fileName)
 	for (int i = 0; i < list.size(); ++i)
 	{
 		ini.beginGroup(list[i]);
-		EFFECT *curEffect = new EFFECT();
+		EFFECT_GROUP group = (EFFECT_GROUP)ini.value("group").toInt();
+		EFFECT *curEffect = effectAlloc(group);
+		if (curEffect == nullptr)
+		{
+			ini.endGroup();
+			continue;
+		}
 
 		curEffect->control      = ini.value("control").toInt();
-		curEffect->group        = (EFFECT_GROUP)ini.value("group").toInt();
+		curEffect->group        = group;
 		curEffect->type         = (EFFECT_TYPE)ini.value("type").toInt();
 		curEffect->frameNumber  = ini.value("frameNumber").toInt();
 		curEffect->size         = ini.value("size").toInt();
@@ -2315,8 +2350,6 @@ bool readFXData(const char *fileName)
 
 		// Move on to reading the next effect
 		ini.endGroup();
-
-		activeList.push_back(curEffect);
 	}
 
 	/* Hopefully everything's just fine by now */
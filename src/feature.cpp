@@ -292,6 +292,7 @@ FEATURE *buildFeature(FEATURE_STATS *psStats, UDWORD x, UDWORD y, bool FromSave)
 			if ((!psStats->tileDraw) && (FromSave == false))
 			{
 				psTile->height = height;
+				visTerrainHeightChanged(b.map.x + width, b.map.y + breadth);
 			}
 		}
 	}
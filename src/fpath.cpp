@@ -32,11 +32,15 @@
 #include "lib/netplay/netplay.h"
 
 #include "lib/framework/wzapp.h"
+#include "lib/framework/math_ext.h"
 
 #include "objects.h"
 #include "map.h"
 #include "multiplay.h"
 #include "astar.h"
+#include "pathbench.h"
+#include "pathcache.h"
+#include "warzoneconfig.h"
 
 #include "fpath.h"
 
@@ -56,30 +60,74 @@ struct PATHRESULT
 
 
 // threading stuff
-static WZ_THREAD        *fpathThread = nullptr;
+static std::vector<WZ_THREAD *> fpathThreads;
 static WZ_MUTEX         *fpathMutex = nullptr;
 static WZ_SEMAPHORE     *fpathSemaphore = nullptr;
-using packagedPathJob = wz::packaged_task<PATHRESULT()>;
-static std::list<packagedPathJob>    pathJobs;
+using packagedPathJob = wz::packaged_task<PATHRESULT(PathfindContextList &)>;
 static std::unordered_map<uint32_t, wz::future<PATHRESULT>> pathResults;
+static std::unordered_map<uint32_t, PathCacheKey> pathCacheKeys;  ///< Route cache keys of the queued jobs, for caching their results.
+
+/** Number of independent queues of path jobs.
+ *
+ *  Jobs are put into a lane according to their destination tile, so all jobs which could possibly share a
+ *  PathfindContext end up in the same lane, and are processed in the order they were queued, by one worker at
+ *  a time. Since the resulting paths can depend on the contents of the context cache, this must never depend
+ *  on the number of pathfinding threads, or clients with different numbers of threads would desynch.
+ */
+#define FPATH_LANES 16
+/// Contexts cached per lane, so that all lanes together cache about as many as a single list used to.
+#define FPATH_LANE_CONTEXTS ((FPATH_MAX_CONTEXTS + FPATH_LANES - 1) / FPATH_LANES)
+
+struct PathJobLane
+{
+	std::list<packagedPathJob> jobs;     ///< Jobs waiting to be processed, in order.
+	PathfindContextList        contexts; ///< Cached A* contexts, only used by the worker currently owning the lane.
+	bool                       busy = false;  ///< A worker is currently processing a job from this lane.
+};
+static PathJobLane      pathLanes[FPATH_LANES];
 
 static bool             waitingForResult = false;
 static uint32_t         waitingForResultId;
 static WZ_SEMAPHORE     *waitingForResultSemaphore = nullptr;
 
-static PATHRESULT fpathExecute(PATHJOB psJob);
+static PATHRESULT fpathExecute(PATHJOB psJob, PathfindContextList &contexts);
 
+static unsigned fpathLaneIndex(PATHJOB const &job)
+{
+	// Must only depend on the fields compared by PathfindContext::matches, which includes the destination tile.
+	unsigned x = map_coord(job.destX), y = map_coord(job.destY);
+	return (x * 7919 + y * 104729) % FPATH_LANES;
+}
 
-/** This runs in a separate thread */
-static int fpathThreadFunc(void *)
+/// Returns a lane with pending jobs, which no other worker is processing. Must be called with fpathMutex held.
+static PathJobLane *fpathTakeLane(unsigned &firstLane)
 {
+	for (unsigned n = 0; n < FPATH_LANES; ++n)
+	{
+		PathJobLane &lane = pathLanes[(firstLane + n) % FPATH_LANES];
+		if (!lane.busy && !lane.jobs.empty())
+		{
+			firstLane = (firstLane + n) % FPATH_LANES;
+			lane.busy = true;
+			return &lane;
+		}
+	}
+	return nullptr;
+}
+
+/** This runs in one or more separate threads */
+static int fpathThreadFunc(void *data)
+{
+	unsigned firstLane = (unsigned)(uintptr_t)data % FPATH_LANES;  // Spread workers out over the lanes.
+
 	wzMutexLock(fpathMutex);
 
 	while (!fpathQuit)
 	{
-		if (pathJobs.empty())
+		PathJobLane *lane = fpathTakeLane(firstLane);
+		if (lane == nullptr)
 		{
-			ASSERT(!waitingForResult, "Waiting for a result (id %u) that doesn't exist.", waitingForResultId);
+			// Either there are no jobs, or the remaining jobs are in lanes owned by other workers, which will process them.
 			wzMutexUnlock(fpathMutex);
 			wzSemaphoreWait(fpathSemaphore);  // Go to sleep until needed.
 			wzMutexLock(fpathMutex);
@@ -87,13 +135,14 @@ static int fpathThreadFunc(void *)
 		}
 
 		// Copy the first job from the queue.
-		packagedPathJob job = std::move(pathJobs.front());
-		pathJobs.pop_front();
+		packagedPathJob job = std::move(lane->jobs.front());
+		lane->jobs.pop_front();
 
 		wzMutexUnlock(fpathMutex);
-		job();
+		job(lane->contexts);
 		wzMutexLock(fpathMutex);
 
+		lane->busy = false;
 		waitingForResult = false;
 		objTrace(waitingForResultId, "These are the droids you are looking for.");
 		wzSemaphorePost(waitingForResultSemaphore);
@@ -102,6 +151,17 @@ static int fpathThreadFunc(void *)
 	return 0;
 }
 
+static unsigned fpathNumThreads()
+{
+	int numThreads = war_GetPathfindingThreads();
+	if (numThreads <= 0)
+	{
+		// Leave one core for the main thread, and don't go overboard.
+		numThreads = clip<int>((int)wzGetLogicalCPUCount() - 1, 1, 4);
+	}
+	return std::min<unsigned>(numThreads, FPATH_LANES);
+}
+
 
 // initialise the findpath module
 bool fpathInitialise()
@@ -109,13 +169,19 @@ bool fpathInitialise()
 	// The path system is up
 	fpathQuit = false;
 
-	if (!fpathThread)
+	if (fpathThreads.empty())
 	{
 		fpathMutex = wzMutexCreate();
 		fpathSemaphore = wzSemaphoreCreate(0);
 		waitingForResultSemaphore = wzSemaphoreCreate(0);
-		fpathThread = wzThreadCreate(fpathThreadFunc, nullptr);
-		wzThreadStart(fpathThread);
+		unsigned numThreads = fpathNumThreads();
+		for (unsigned n = 0; n < numThreads; ++n)
+		{
+			WZ_THREAD *thread = wzThreadCreate(fpathThreadFunc, (void *)(uintptr_t)(n * FPATH_LANES / numThreads));
+			wzThreadStart(thread);
+			fpathThreads.push_back(thread);
+		}
+		debug(LOG_INFO, "Started %u pathfinding thread(s)", numThreads);
 	}
 
 	return true;
@@ -124,14 +190,20 @@ bool fpathInitialise()
 
 void fpathShutdown()
 {
-	if (fpathThread)
+	if (!fpathThreads.empty())
 	{
-		// Signal the path finding thread to quit
+		// Signal the path finding threads to quit
 		fpathQuit = true;
-		wzSemaphorePost(fpathSemaphore);  // Wake up thread.
+		for (size_t n = 0; n < fpathThreads.size(); ++n)
+		{
+			wzSemaphorePost(fpathSemaphore);  // Wake up threads.
+		}
 
-		wzThreadJoin(fpathThread);
-		fpathThread = nullptr;
+		for (WZ_THREAD *thread : fpathThreads)
+		{
+			wzThreadJoin(thread);
+		}
+		fpathThreads.clear();
 		wzMutexDestroy(fpathMutex);
 		fpathMutex = nullptr;
 		wzSemaphoreDestroy(fpathSemaphore);
@@ -139,7 +211,15 @@ void fpathShutdown()
 		wzSemaphoreDestroy(waitingForResultSemaphore);
 		waitingForResultSemaphore = nullptr;
 	}
+	for (PathJobLane &lane : pathLanes)
+	{
+		lane.jobs.clear();
+		lane.contexts.clear();
+	}
 	fpathHardTableReset();
+	pathCacheKeys.clear();
+	pathCacheClear();
+	pathBenchRecordShutdown();
 }
 
 
@@ -309,6 +389,7 @@ void fpathSetDirectRoute(DROID *psDroid, SDWORD targetX, SDWORD targetY)
 void fpathRemoveDroidData(int id)
 {
 	pathResults.erase(id);
+	pathCacheKeys.erase(id);
 }
 
 static FPATH_RETVAL fpathRoute(MOVE_CONTROL *psMove, unsigned id, int startX, int startY, int tX, int tY, PROPULSION_TYPE propulsionType,
@@ -352,8 +433,17 @@ static FPATH_RETVAL fpathRoute(MOVE_CONTROL *psMove, unsigned id, int startX, in
 		FPATH_RETVAL retval = result.retval;
 		ASSERT(retval != FPR_OK || psMove->asPath.size() > 0, "Ok result but no path after copy");
 
-		// Remove it from the result list
+		// Remove it from the result list, and share the route with other droids going the same way
 		pathResults.erase(id);
+		auto key = pathCacheKeys.find(id);
+		if (key != pathCacheKeys.end())
+		{
+			if (retval == FPR_OK && correctDestination)
+			{
+				pathCacheInsert(key->second, psMove->asPath);
+			}
+			pathCacheKeys.erase(key);
+		}
 
 		objTrace(id, "Got a path to (%d, %d)! Length=%d Retval=%d", psMove->destination.x, psMove->destination.y, (int)psMove->asPath.size(), (int)retval);
 		syncDebug("fpathRoute(..., %d, %d, %d, %d, %d, %d, %d, %d, %d) = %d, path[%d] = %08X->(%d, %d)", id, startX, startY, tX, tY, propulsionType, droidType, moveType, owner, retval, (int)psMove->asPath.size(), ~crcSumVector2i(0, psMove->asPath.data(), psMove->asPath.size()), psMove->destination.x, psMove->destination.y);
@@ -382,25 +472,41 @@ queuePathfinding:
 	job.acceptNearest = acceptNearest;
 	job.deleted = false;
 	fpathSetBlockingMap(&job);
+	pathBenchRecordJob(job);
 
-	debug(LOG_NEVER, "starting new job for droid %d 0x%x", id, id);
 	// Clear any results or jobs waiting already. It is a vital assumption that there is only one
 	// job or result for each droid in the system at any time.
 	fpathRemoveDroidData(id);
 
-	packagedPathJob task([job]() { return fpathExecute(job); });
+	// Reuse the route of a droid which recently went from nearby to the same place, if possible.
+	// The fallback for failed VTOL routes is not a real route, so VTOLs are not cached.
+	if (propulsionType != PROPULSION_TYPE_LIFT)
+	{
+		PathCacheKey key = pathCacheKey(job);
+		if (pathCacheLookup(key, job, psMove))
+		{
+			psMove->pathIndex = 0;
+			psMove->Status = MOVENAVIGATE;
+			objTrace(id, "Got a cached path to (%d, %d)! Length=%d", psMove->destination.x, psMove->destination.y, (int)psMove->asPath.size());
+			syncDebug("fpathRoute(..., %d, %d, %d, %d, %d, %d, %d, %d, %d) = cached, path[%d] = %08X->(%d, %d)", id, startX, startY, tX, tY, propulsionType, droidType, moveType, owner, (int)psMove->asPath.size(), ~crcSumVector2i(0, psMove->asPath.data(), psMove->asPath.size()), psMove->destination.x, psMove->destination.y);
+			return FPR_OK;
+		}
+		pathCacheKeys[id] = key;
+	}
+
+	debug(LOG_NEVER, "starting new job for droid %d 0x%x", id, id);
+
+	PathJobLane &lane = pathLanes[fpathLaneIndex(job)];
+	packagedPathJob task([job](PathfindContextList &contexts) { return fpathExecute(job, contexts); });
 	pathResults[id] = task.get_future();
 
 	// Add to end of list
 	wzMutexLock(fpathMutex);
-	bool isFirstJob = pathJobs.empty();
-	pathJobs.push_back(std::move(task));
+	bool isFirstJob = lane.jobs.empty();
+	lane.jobs.push_back(std::move(task));
 	wzMutexUnlock(fpathMutex);
 
-	if (isFirstJob)
-	{
-		wzSemaphorePost(fpathSemaphore);  // Wake up processing thread.
-	}
+	wzSemaphorePost(fpathSemaphore);  // Wake up a processing thread.
 
 	objTrace(id, "Queued up a path-finding request to (%d, %d), at least %d items earlier in queue", tX, tY, isFirstJob);
 	syncDebug("fpathRoute(..., %d, %d, %d, %d, %d, %d, %d, %d, %d) = FPR_WAIT", id, startX, startY, tX, tY, propulsionType, droidType, moveType, owner);
@@ -452,15 +558,15 @@ FPATH_RETVAL fpathDroidRoute(DROID *psDroid, SDWORD tX, SDWORD tY, FPATH_MOVETYP
 	                  psDroid->droidType, moveType, psDroid->player, acceptNearest, dstStructure);
 }
 
-// Run only from path thread
-PATHRESULT fpathExecute(PATHJOB job)
+// Run only from path threads
+PATHRESULT fpathExecute(PATHJOB job, PathfindContextList &contexts)
 {
 	PATHRESULT result;
 	result.droidID = job.droidID;
 	result.retval = FPR_FAILED;
 	result.originalDest = Vector2i(job.destX, job.destY);
 
-	ASR_RETVAL retval = fpathAStarRoute(&result.sMove, &job);
+	ASR_RETVAL retval = fpathAStarRoute(contexts, &result.sMove, &job, nullptr, FPATH_LANE_CONTEXTS);
 
 	ASSERT(retval != ASR_OK || result.sMove.asPath.size() > 0, "Ok result but no path in result");
 	switch (retval)
@@ -505,7 +611,10 @@ static size_t fpathJobQueueLength()
 	size_t count = 0;
 
 	wzMutexLock(fpathMutex);
-	count = pathJobs.size();  // O(N) function call for std::list. .empty() is faster, but this function isn't used except in tests.
+	for (PathJobLane const &lane : pathLanes)
+	{
+		count += lane.jobs.size() + lane.busy;  // O(N) function call for std::list. .empty() is faster, but this function isn't used except in tests.
+	}
 	wzMutexUnlock(fpathMutex);
 	return count;
 }
@@ -539,10 +648,10 @@ void fpathTest(int x, int y, int x2, int y2)
 	(void)fpathJobQueueLength();
 
 	/* Check initial state */
-	assert(fpathThread != nullptr);
+	assert(!fpathThreads.empty());
 	assert(fpathMutex != nullptr);
 	assert(fpathSemaphore != nullptr);
-	assert(pathJobs.empty());
+	assert(fpathJobQueueLength() == 0);
 	assert(pathResults.empty());
 	fpathRemoveDroidData(0);	// should not crash
 
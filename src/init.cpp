@@ -31,6 +31,7 @@
 #include "lib/framework/file.h"
 #include "lib/framework/physfs_ext.h"
 #include "lib/framework/wzapp.h"
+#include "lib/framework/wzprofile.h"
 #include "lib/ivis_opengl/piemode.h"
 #include "lib/ivis_opengl/piestate.h"
 #include "lib/ivis_opengl/screen.h"
@@ -92,6 +93,7 @@
 #include "qtscript.h"
 #include "template.h"
 #include "activity.h"
+#include "simjobs.h"
 
 #include <algorithm>
 
@@ -777,6 +779,7 @@ void systemShutdown()
 
 	shutdownEffectsSystem();
 	wzSceneEnd(nullptr);  // Might want to end the "Main menu loop" or "Main game loop".
+	wzProfileShutdown();
 	keyMappings.clear();
 
 	// free up all the load functions (all the data should already have been freed)
@@ -991,6 +994,11 @@ bool stageOneInitialise()
 		return false;
 	}
 
+	if (!simJobsInitialise())
+	{
+		return false;
+	}
+
 	initMission();
 	initTransporters();
 	scriptInit();
@@ -1049,6 +1057,7 @@ bool stageOneShutDown()
 	}
 
 	gridShutDown();
+	simJobsShutdown();
 
 	debug(LOG_TEXTURE, "== stageOneShutDown ==");
 	modelShutdown();
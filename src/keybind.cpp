@@ -303,6 +303,7 @@ void	kf_HalveHeights()
 			psTile->height /= 2;
 		}
 	}
+	visClearTerrainCache();
 }
 
 // --------------------------------------------------------------------------
@@ -645,6 +646,21 @@ void	kf_FrameRate()
 		                          NETgetStatistic(NetStatisticUncompressedBytes, false),
 		                          NETgetStatistic(NetStatisticPackets, true),
 		                          NETgetStatistic(NetStatisticPackets, false));
+		for (int codec = 0; codec < WIRE_COMPRESSION_COUNT; ++codec)
+		{
+			WireCompression wireCodec = (WireCompression)codec;
+			if (NETgetStatistic(NetStatisticCodecUncompressedBytes, true, true, wireCodec) + NETgetStatistic(NetStatisticCodecUncompressedBytes, false, true, wireCodec) == 0)
+			{
+				continue;  // Not used by any connection.
+			}
+			CONPRINTF("NETWORK %s:  Bytes: s-%zu/%zu r-%zu/%zu  CPU us: s-%zu r-%zu", wireCompressionName(wireCodec),
+			                          NETgetStatistic(NetStatisticCodecRawBytes, true, false, wireCodec),
+			                          NETgetStatistic(NetStatisticCodecUncompressedBytes, true, false, wireCodec),
+			                          NETgetStatistic(NetStatisticCodecRawBytes, false, false, wireCodec),
+			                          NETgetStatistic(NetStatisticCodecUncompressedBytes, false, false, wireCodec),
+			                          NETgetStatistic(NetStatisticCodecMicroseconds, true, false, wireCodec),
+			                          NETgetStatistic(NetStatisticCodecMicroseconds, false, false, wireCodec));
+		}
 	}
 	gameStats = !gameStats;
 	CONPRINTF("Built: %s %s", getCompileDate(), __TIME__);
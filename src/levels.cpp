@@ -1052,7 +1052,7 @@ bool levLoadData(char const *name, Sha256 const *hash, char *pSaveName, GAME_TYP
 	if (autogame_enabled())
 	{
 		gameTimeSetMod(Rational(500));
-		if (getHostLaunch() != HostLaunch::Skirmish) // tests will specify the AI manually
+		if (getHostLaunch() != HostLaunch::Skirmish && getHostLaunch() != HostLaunch::Replay) // tests will specify the AI manually, and replays have its orders
 		{
 			jsAutogameSpecific("multiplay/skirmish/semperfi.js", selectedPlayer);
 		}
@@ -27,6 +27,7 @@
 #include "lib/framework/input.h"
 #include "lib/framework/strres.h"
 #include "lib/framework/wzapp.h"
+#include "lib/framework/wzprofile.h"
 
 #include "lib/ivis_opengl/pieblitfunc.h"
 #include "lib/ivis_opengl/piestate.h" //ivis render code
@@ -76,6 +77,7 @@
 #include "edit3d.h"
 #include "fpath.h"
 #include "cmddroid.h"
+#include "ai.h"
 #include "keybind.h"
 #include "wrappers.h"
 #include "random.h"
@@ -84,6 +86,8 @@
 #include "notifications.h"
 #include "scores.h"
 #include "clparse.h"
+#include "replay.h"
+#include "simbench.h"
 
 #include "warzoneconfig.h"
 
@@ -91,6 +95,8 @@
 #include "objmem.h"
 #endif
 
+#include <algorithm>
+#include <chrono>
 #include <numeric>
 
 
@@ -125,6 +131,43 @@ static unsigned numConstructorDroids[MAX_PLAYERS];
 
 static SDWORD videoMode = 0;
 
+static bool phaseTiming = false;
+static uint64_t phaseTimes[SIM_PHASE_COUNT];
+
+#define FAST_FORWARD_RENDER_INTERVAL 100    ///< Milliseconds between frames when fast forwarding without a tick count.
+#define FAST_FORWARD_REPORT_INTERVAL 10000  ///< Milliseconds between ticks per second reports when fast forwarding.
+
+static unsigned fastForwardRenderEvery = 0;
+static unsigned fastForwardTicksSinceRender = 0;
+static uint32_t fastForwardRenderTime = 0;    ///< wzGetTicks() of the last frame.
+static unsigned fastForwardReportTicks = 0;   ///< Ticks since fastForwardReportTime.
+static uint32_t fastForwardReportTime = 0;
+static double fastForwardTicksPerSecond = 0;
+
+/// Adds the time until the end of the scope to a part of gameStateUpdate, if loopSetPhaseTiming is enabled.
+class SimPhaseTimer
+{
+public:
+	SimPhaseTimer(SIM_PHASE phase_) : phase(phase_)
+	{
+		if (phaseTiming)
+		{
+			start = std::chrono::steady_clock::now();
+		}
+	}
+	~SimPhaseTimer()
+	{
+		if (phaseTiming)
+		{
+			phaseTimes[phase] += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		}
+	}
+
+private:
+	SIM_PHASE phase;
+	std::chrono::steady_clock::time_point start;
+};
+
 LOOP_MISSION_STATE		loopMissionState = LMS_NORMAL;
 
 // this is set by scrStartMission to say what type of new level is to be started
@@ -508,6 +551,8 @@ void countUpdate(bool synch)
 
 static void gameStateUpdate()
 {
+	WZ_PROFILE_SCOPE("gameStateUpdate");
+
 	syncDebug("map = \"%s\", pseudorandom 32-bit integer = 0x%08X, allocated = %d %d %d %d %d %d %d %d %d %d, position = %d %d %d %d %d %d %d %d %d %d", game.map, gameRandU32(),
 	          NetPlay.players[0].allocated, NetPlay.players[1].allocated, NetPlay.players[2].allocated, NetPlay.players[3].allocated, NetPlay.players[4].allocated, NetPlay.players[5].allocated, NetPlay.players[6].allocated, NetPlay.players[7].allocated, NetPlay.players[8].allocated, NetPlay.players[9].allocated,
 	          NetPlay.players[0].position, NetPlay.players[1].position, NetPlay.players[2].position, NetPlay.players[3].position, NetPlay.players[4].position, NetPlay.players[5].position, NetPlay.players[6].position, NetPlay.players[7].position, NetPlay.players[8].position, NetPlay.players[9].position
@@ -530,6 +575,7 @@ static void gameStateUpdate()
 
 	if (!paused && !scriptPaused())
 	{
+		SimPhaseTimer timer(SIM_PHASE_SCRIPTS);
 		updateScripts();
 	}
 
@@ -540,70 +586,111 @@ static void gameStateUpdate()
 	visUpdateLevel();
 
 	// Put all droids/structures/features into the grid.
-	gridReset();
+	{
+		SimPhaseTimer timer(SIM_PHASE_GRID);
+		gridReset();
+	}
 
 	// Check which objects are visible.
-	processVisibility();
+	{
+		SimPhaseTimer timer(SIM_PHASE_VISIBILITY);
+		processVisibility();
+	}
 
 	// Update the map.
-	mapUpdate();
+	{
+		SimPhaseTimer timer(SIM_PHASE_MAP);
+		mapUpdate();
+	}
 
 	//update the findpath system
-	fpathUpdate();
+	{
+		SimPhaseTimer timer(SIM_PHASE_FPATH);
+		fpathUpdate();
+	}
 
 	// update the command droids
 	cmdDroidUpdate();
 
+	// Look for droid targets in parallel, before the droids are updated one by one.
+	{
+		SimPhaseTimer timer(SIM_PHASE_DROIDS);
+		aiPrepareDroidTargets();
+	}
+
+	// Same for the structures, before any of them are updated.
+	{
+		SimPhaseTimer timer(SIM_PHASE_STRUCTURES);
+		aiPrepareStructureTargets();
+	}
+
 	for (unsigned i = 0; i < MAX_PLAYERS; i++)
 	{
 		//update the current power available for a player
 		updatePlayerPower(i);
 
-		DROID *psNext;
-		for (DROID *psCurr = apsDroidLists[i]; psCurr != nullptr; psCurr = psNext)
 		{
-			// Copy the next pointer - not 100% sure if the droid could get destroyed but this covers us anyway
-			psNext = psCurr->psNext;
-			droidUpdate(psCurr);
-		}
+			SimPhaseTimer timer(SIM_PHASE_DROIDS);
 
-		for (DROID *psCurr = mission.apsDroidLists[i]; psCurr != nullptr; psCurr = psNext)
-		{
-			/* Copy the next pointer - not 100% sure if the droid could
-			get destroyed but this covers us anyway */
-			psNext = psCurr->psNext;
-			missionDroidUpdate(psCurr);
-		}
+			DROID *psNext;
+			for (DROID *psCurr = apsDroidLists[i]; psCurr != nullptr; psCurr = psNext)
+			{
+				// Copy the next pointer - not 100% sure if the droid could get destroyed but this covers us anyway
+				psNext = psCurr->psNext;
+				droidUpdate(psCurr);
+			}
 
-		// FIXME: These for-loops are code duplicationo
-		STRUCTURE *psNBuilding;
-		for (STRUCTURE *psCBuilding = apsStructLists[i]; psCBuilding != nullptr; psCBuilding = psNBuilding)
-		{
-			/* Copy the next pointer - not 100% sure if the structure could get destroyed but this covers us anyway */
-			psNBuilding = psCBuilding->psNext;
-			structureUpdate(psCBuilding, false);
+			for (DROID *psCurr = mission.apsDroidLists[i]; psCurr != nullptr; psCurr = psNext)
+			{
+				/* Copy the next pointer - not 100% sure if the droid could
+				get destroyed but this covers us anyway */
+				psNext = psCurr->psNext;
+				missionDroidUpdate(psCurr);
+			}
 		}
-		for (STRUCTURE *psCBuilding = mission.apsStructLists[i]; psCBuilding != nullptr; psCBuilding = psNBuilding)
+
 		{
-			/* Copy the next pointer - not 100% sure if the structure could get destroyed but this covers us anyway. It shouldn't do since its not even on the map!*/
-			psNBuilding = psCBuilding->psNext;
-			structureUpdate(psCBuilding, true); // update for mission
+			SimPhaseTimer timer(SIM_PHASE_STRUCTURES);
+
+			// FIXME: These for-loops are code duplicationo
+			STRUCTURE *psNBuilding;
+			for (STRUCTURE *psCBuilding = apsStructLists[i]; psCBuilding != nullptr; psCBuilding = psNBuilding)
+			{
+				/* Copy the next pointer - not 100% sure if the structure could get destroyed but this covers us anyway */
+				psNBuilding = psCBuilding->psNext;
+				structureUpdate(psCBuilding, false);
+			}
+			for (STRUCTURE *psCBuilding = mission.apsStructLists[i]; psCBuilding != nullptr; psCBuilding = psNBuilding)
+			{
+				/* Copy the next pointer - not 100% sure if the structure could get destroyed but this covers us anyway. It shouldn't do since its not even on the map!*/
+				psNBuilding = psCBuilding->psNext;
+				structureUpdate(psCBuilding, true); // update for mission
+			}
 		}
 	}
 
 	missionTimerUpdate();
 
-	proj_UpdateAll();
+	{
+		SimPhaseTimer timer(SIM_PHASE_PROJECTILES);
+		proj_UpdateAll();
+	}
 
-	FEATURE *psNFeat;
-	for (FEATURE *psCFeat = apsFeatureLists[0]; psCFeat; psCFeat = psNFeat)
 	{
-		psNFeat = psCFeat->psNext;
-		featureUpdate(psCFeat);
+		SimPhaseTimer timer(SIM_PHASE_FEATURES);
+		FEATURE *psNFeat;
+		for (FEATURE *psCFeat = apsFeatureLists[0]; psCFeat; psCFeat = psNFeat)
+		{
+			psNFeat = psCFeat->psNext;
+			featureUpdate(psCFeat);
+		}
 	}
 
 	// Free dead droid memory.
-	objmemUpdate();
+	{
+		SimPhaseTimer timer(SIM_PHASE_OBJMEM);
+		objmemUpdate();
+	}
 
 	// Must end update, since we may or may not have ticked, and some message queue processing code may vary depending on whether it's in an update.
 	gameTimeUpdateEnd();
@@ -612,6 +699,71 @@ static void gameStateUpdate()
 	countUpdate(true);
 }
 
+void loopSetPhaseTiming(bool enable)
+{
+	phaseTiming = enable;
+	if (enable)
+	{
+		std::fill(phaseTimes, phaseTimes + SIM_PHASE_COUNT, 0);
+	}
+}
+
+uint64_t loopPhaseTime(SIM_PHASE phase)
+{
+	return phaseTimes[phase];
+}
+
+const char *loopPhaseName(SIM_PHASE phase)
+{
+	static const char *const names[SIM_PHASE_COUNT] = {"scripts", "visibility", "grid", "map", "fpath", "droids", "structures", "projectiles", "features", "objmem"};
+	return names[phase];
+}
+
+void loopSetFastForward(bool enable, unsigned renderEvery)
+{
+	gameTimeSetFastForward(enable);
+	fastForwardRenderEvery = renderEvery;
+	fastForwardTicksSinceRender = 0;
+	fastForwardRenderTime = wzGetTicks();
+	fastForwardReportTicks = 0;
+	fastForwardReportTime = fastForwardRenderTime;
+	fastForwardTicksPerSecond = 0;
+	if (enable)
+	{
+		debug(LOG_INFO, "Fast forwarding, drawing a frame every %u %s", renderEvery != 0 ? renderEvery : FAST_FORWARD_RENDER_INTERVAL, renderEvery != 0 ? "ticks" : "ms");
+	}
+}
+
+double loopFastForwardTicksPerSecond()
+{
+	return fastForwardTicksPerSecond;
+}
+
+/// True if it's time to stop ticking and render a frame while fast forwarding.
+static bool fastForwardWantsRender()
+{
+	if (fastForwardRenderEvery != 0)
+	{
+		return fastForwardTicksSinceRender >= fastForwardRenderEvery;
+	}
+	return wzGetTicks() - fastForwardRenderTime >= FAST_FORWARD_RENDER_INTERVAL;
+}
+
+static void fastForwardTick()
+{
+	++fastForwardTicksSinceRender;
+	++fastForwardReportTicks;
+	uint32_t now = wzGetTicks();
+	if (now - fastForwardReportTime >= FAST_FORWARD_REPORT_INTERVAL)
+	{
+		fastForwardTicksPerSecond = fastForwardReportTicks * 1000. / (now - fastForwardReportTime);
+		debug(LOG_INFO, "Fast forwarding at %.1f ticks per second, %.1f times real time, gameTime = %u", fastForwardTicksPerSecond,
+		      fastForwardTicksPerSecond * GAME_TICKS_PER_UPDATE / GAME_TICKS_PER_SEC, gameTime);
+		fastForwardReportTicks = 0;
+		fastForwardReportTime = now;
+	}
+}
+
 /* The main game loop */
 GAMECODE gameLoop()
 {
@@ -632,7 +784,14 @@ GAMECODE gameLoop()
 		recvMessage();
 
 		// Update gameTime and graphicsTime, and corresponding deltas. Note that gameTime and graphicsTime pause, if we aren't getting our GAME_GAME_TIME messages.
-		gameTimeUpdate(renderBudget > 0 || previousUpdateWasRender);
+		if (gameTimeFastForward())
+		{
+			gameTimeUpdate(!fastForwardWantsRender());
+		}
+		else
+		{
+			gameTimeUpdate(renderBudget > 0 || previousUpdateWasRender);
+		}
 
 		if (deltaGameTime == 0)
 		{
@@ -646,6 +805,17 @@ GAMECODE gameLoop()
 		gameStateUpdate();
 		syncDebug("End game state update, gameTime = %d", gameTime);
 		unsigned after = wzGetTicks();
+		WZ_PROFILE_TICK();
+
+		if (gameTimeFastForward())
+		{
+			fastForwardTick();
+		}
+
+		if (!simbench_enabled().empty())
+		{
+			simBenchTick();
+		}
 
 		renderBudget -= (after - before) * renderFraction.n;
 		renderBudget = std::max(renderBudget, (-updateFraction * 500).floor());
@@ -654,6 +824,11 @@ GAMECODE gameLoop()
 		ASSERT(deltaGraphicsTime == 0, "Shouldn't update graphics and game state at once.");
 	}
 
+	if (getHostLaunch() == HostLaunch::Replay)
+	{
+		replayPlaybackUpdate();
+	}
+
 	if (realTime - lastFlushTime >= 400u)
 	{
 		lastFlushTime = realTime;
@@ -667,6 +842,8 @@ GAMECODE gameLoop()
 	renderBudget += (after - before) * updateFraction.n;
 	renderBudget = std::min(renderBudget, (renderFraction * 500).floor());
 	previousUpdateWasRender = true;
+	fastForwardTicksSinceRender = 0;
+	fastForwardRenderTime = after;
 
 	if (headlessGameMode() && autogame_enabled())
 	{
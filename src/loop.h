@@ -56,6 +56,35 @@ extern LEVEL_TYPE nextMissionType;
 extern size_t loopPieCount;
 extern size_t loopPolyCount;
 
+/// Parts of gameStateUpdate which are timed separately, see loopSetPhaseTiming.
+enum SIM_PHASE
+{
+	SIM_PHASE_SCRIPTS,
+	SIM_PHASE_VISIBILITY,
+	SIM_PHASE_GRID,
+	SIM_PHASE_MAP,
+	SIM_PHASE_FPATH,
+	SIM_PHASE_DROIDS,
+	SIM_PHASE_STRUCTURES,
+	SIM_PHASE_PROJECTILES,
+	SIM_PHASE_FEATURES,
+	SIM_PHASE_OBJMEM,
+	SIM_PHASE_COUNT
+};
+
+/// Start or stop timing the parts of gameStateUpdate. Starting also resets the totals.
+void loopSetPhaseTiming(bool enable);
+/// Total time spent in a part of gameStateUpdate while timing was enabled, in nanoseconds.
+uint64_t loopPhaseTime(SIM_PHASE phase);
+/// Short name of a part of gameStateUpdate, such as "droids".
+const char *loopPhaseName(SIM_PHASE phase);
+
+/// Run game ticks back to back as fast as possible, and only call renderLoop after every renderEvery ticks, or
+/// every 100ms of wall clock time if renderEvery is 0. Use with --headless to not draw anything.
+void loopSetFastForward(bool enable, unsigned renderEvery);
+/// Game ticks per second of wall clock time while fast forwarding, measured over the last few seconds.
+double loopFastForwardTicksPerSecond();
+
 GAMECODE gameLoop();
 void videoLoop();
 void loop_SetVideoPlaybackMode();
@@ -1378,6 +1378,9 @@ int realmain(int argc, char *argv[])
 
 	PHYSFS_mkdir("music");	// custom music overriding default music and music mods
 
+	PHYSFS_mkdir("replay/multiplay");	// multiplayer game replays
+	PHYSFS_mkdir("replay/skirmish");	// skirmish game replays
+
 	make_dir(SaveGamePath, "savegames", nullptr); 	// save games
 	PHYSFS_mkdir("savegames/campaign");		// campaign save games
 	PHYSFS_mkdir("savegames/campaign/auto");	// campaign autosave games
@@ -49,6 +49,7 @@
 #include "astar.h"
 #include "fpath.h"
 #include "levels.h"
+#include "threatmap.h"
 #include "lib/framework/wzapp.h"
 
 #define GAME_TICKS_FOR_DANGER (GAME_TICKS_PER_SEC * 2)
@@ -108,6 +109,7 @@ struct GATEWAY_SAVE
 /* The size and contents of the map */
 SDWORD	mapWidth = 0, mapHeight = 0;
 MAPTILE	*psMapTiles = nullptr;
+uint32_t mapTilesGeneration = 0;
 uint8_t *psBlockMap[AUX_MAX];
 uint8_t *psAuxMap[MAX_PLAYERS + AUX_MAX];        // yes, we waste one element... eyes wide open... makes API nicer
 
@@ -800,6 +802,7 @@ bool mapLoad(char const *filename, bool preview)
 
 	/* Allocate the memory for the map */
 	psMapTiles = (MAPTILE *)calloc((size_t)width * height, sizeof(MAPTILE));
+	++mapTilesGeneration;
 	ASSERT(psMapTiles != nullptr, "Out of memory");
 
 	mapWidth = width;
@@ -904,6 +907,7 @@ bool mapLoadFromScriptData(ScriptMapData const &data, bool preview)
 
 	/* Allocate the memory for the map */
 	psMapTiles = (MAPTILE *)calloc((size_t)data.mapWidth * data.mapHeight, sizeof(MAPTILE));
+	++mapTilesGeneration;
 	ASSERT(psMapTiles != nullptr, "Out of memory");
 
 	mapWidth = data.mapWidth;
@@ -1137,8 +1141,11 @@ bool mapShutdown()
 		dangerSemaphore = nullptr;
 		dangerDoneSemaphore = nullptr;
 	}
+	threatMapShutdown();
 
 	free(psMapTiles);
+	++mapTilesGeneration;
+	visClearTerrainCache();
 	delete[] mapDecals;
 	free(psGroundTypes);
 	free(map);
@@ -1970,92 +1977,6 @@ static int dangerThreadFunc(WZ_DECL_UNUSED void *data)
 	return 0;
 }
 
-static inline void threatUpdateTarget(int player, BASE_OBJECT *psObj, bool ground, bool air)
-{
-	if (psObj->visible[player] || psObj->born == 2)
-	{
-		for (TILEPOS pos : psObj->watchedTiles)
-		{
-			if (ground)
-			{
-				auxSet(pos.x, pos.y, MAX_PLAYERS + AUX_DANGERMAP, AUXBITS_THREAT);	// set ground threat for this tile
-			}
-			if (air)
-			{
-				auxSet(pos.x, pos.y, MAX_PLAYERS + AUX_DANGERMAP, AUXBITS_AATHREAT);	// set air threat for this tile
-			}
-		}
-	}
-}
-
-static void threatUpdate(int player)
-{
-	int i, weapon, x, y;
-
-	// Step 1: Clear our threat bits
-	for (y = 0; y < mapHeight; y++)
-	{
-		for (x = 0; x < mapWidth; x++)
-		{
-			auxClear(x, y, MAX_PLAYERS + AUX_DANGERMAP, AUXBITS_THREAT | AUXBITS_AATHREAT);
-		}
-	}
-
-	// Step 2: Set threat bits
-	for (i = 0; i < MAX_PLAYERS; i++)
-	{
-		DROID *psDroid;
-		STRUCTURE *psStruct;
-
-		if (aiCheckAlliances(player, i))
-		{
-			// No need to iterate friendly objects
-			continue;
-		}
-
-		for (psDroid = apsDroidLists[i]; psDroid; psDroid = psDroid->psNext)
-		{
-			UBYTE mode = 0;
-
-			if (psDroid->droidType == DROID_CONSTRUCT || psDroid->droidType == DROID_CYBORG_CONSTRUCT
-			    || psDroid->droidType == DROID_REPAIR || psDroid->droidType == DROID_CYBORG_REPAIR)
-			{
-				continue;	// hack that really should not be needed, but is -- trucks can SHOOT_ON_GROUND...!
-			}
-			for (weapon = 0; weapon < psDroid->numWeaps; weapon++)
-			{
-				mode |= asWeaponStats[psDroid->asWeaps[weapon].nStat].surfaceToAir;
-			}
-			if (psDroid->droidType == DROID_SENSOR)	// special treatment for sensor turrets, no multiweapon support
-			{
-				mode |= SHOOT_ON_GROUND;		// assume it only shoots at ground targets for now
-			}
-			if (mode > 0)
-			{
-				threatUpdateTarget(player, (BASE_OBJECT *)psDroid, mode & SHOOT_ON_GROUND, mode & SHOOT_IN_AIR);
-			}
-		}
-
-		for (psStruct = apsStructLists[i]; psStruct; psStruct = psStruct->psNext)
-		{
-			UBYTE mode = 0;
-
-			for (weapon = 0; weapon < psStruct->numWeaps; weapon++)
-			{
-				mode |= asWeaponStats[psStruct->asWeaps[weapon].nStat].surfaceToAir;
-			}
-			if (psStruct->pStructureType->pSensor && psStruct->pStructureType->pSensor->location == LOC_TURRET)	// special treatment for sensor turrets
-			{
-				mode |= SHOOT_ON_GROUND;		// assume it only shoots at ground targets for now
-			}
-			if (mode > 0)
-			{
-				threatUpdateTarget(player, (BASE_OBJECT *)psStruct, mode & SHOOT_ON_GROUND, mode & SHOOT_IN_AIR);
-			}
-		}
-	}
-}
-
 void mapInit()
 {
 	int player;
@@ -2070,12 +1991,12 @@ void mapInit()
 	ASSERT(dangerSemaphore == nullptr && dangerThread == nullptr, "Map data not cleaned up before starting!");
 	if (game.type == LEVEL_TYPE::SKIRMISH)
 	{
+		threatMapInit();
 		for (player = 0; player < MAX_PLAYERS; player++)
 		{
 			auxMapStore(player, AUX_DANGERMAP);
-			threatUpdate(player);
 			dangerFloodFill(player);
-			auxMapRestore(player, AUX_DANGERMAP, AUXBITS_DANGER | AUXBITS_THREAT | AUXBITS_AATHREAT);
+			auxMapRestore(player, AUX_DANGERMAP, AUXBITS_DANGER);
 		}
 		lastDangerPlayer = 0;
 		dangerSemaphore = wzSemaphoreCreate(0);
@@ -2104,6 +2025,8 @@ void mapUpdate()
 			}
 		}
 
+	threatMapUpdate();
+
 	if (gameTime > lastDangerUpdate + GAME_TICKS_FOR_DANGER && game.type == LEVEL_TYPE::SKIRMISH)
 	{
 		syncDebug("Do danger maps.");
@@ -2112,10 +2035,9 @@ void mapUpdate()
 		// Lock if previous job not done yet
 		wzSemaphoreWait(dangerDoneSemaphore);
 
-		auxMapRestore(lastDangerPlayer, AUX_DANGERMAP, AUXBITS_THREAT | AUXBITS_AATHREAT | AUXBITS_DANGER);
+		auxMapRestore(lastDangerPlayer, AUX_DANGERMAP, AUXBITS_DANGER);
 		lastDangerPlayer = (lastDangerPlayer + 1) % game.maxPlayers;
 		auxMapStore(lastDangerPlayer, AUX_DANGERMAP);
-		threatUpdate(lastDangerPlayer);
 		wzSemaphorePost(dangerSemaphore);
 	}
 }
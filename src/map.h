@@ -31,6 +31,7 @@
 #include "multiplay.h"
 #include "display.h"
 #include "ai.h"
+#include "visibility.h"
 
 #define ARIZONA 1
 #define URBAN 2
@@ -121,6 +122,7 @@ struct MAPTILE
 /* The size and contents of the map */
 extern SDWORD	mapWidth, mapHeight;
 extern MAPTILE *psMapTiles;
+extern uint32_t mapTilesGeneration;  ///< Incremented whenever psMapTiles is freed, allocated or swapped with the mission map.
 extern float waterLevel;
 extern GROUND_TYPE *psGroundTypes;
 extern int numGroundTypes;
@@ -509,6 +511,7 @@ static inline void setTileHeight(int32_t x, int32_t y, int32_t height)
 
 	psMapTiles[x + (y * mapWidth)].height = height;
 	markTileDirty(x, y);
+	visTerrainHeightChanged(x, y);
 }
 
 /* Return whether a tile coordinate is on the map */
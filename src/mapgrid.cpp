@@ -32,64 +32,143 @@
 #include "pointtree.h"
 
 
-static PointTree *gridPointTree = nullptr;  // A quad-tree-like object.
-static PointTree::Filter *gridFiltersUnseen;
-static PointTree::Filter *gridFiltersDroidsByPlayer;
+/// The grid is split into layers, so that objects which never move don't need to be sorted again every tick.
+enum GridLayerIndex
+{
+	GRID_STATIC,   ///< Structures and features. Updated only when they are added or removed.
+	GRID_DYNAMIC,  ///< Droids. Rebuilt every tick.
+	GRID_LAYERS
+};
+
+struct GridLayer
+{
+	PointTree pointTree;  // A quad-tree-like object.
+};
+
+struct GridStaticChange
+{
+	BASE_OBJECT *psObj;
+	Vector2i    pos;  ///< Position to remove the object from, since it may have been freed by the time the change is applied.
+	bool        add;
+};
+
+static GridLayer *gridLayers = nullptr;
+static std::vector<GridStaticChange> gridStaticChanges;  ///< Changes to apply to the static layer at the next gridReset.
+static bool gridStaticInvalid = true;                    ///< Static layer must be rebuilt from the object lists at the next gridReset.
 
 // initialise the grid system
 bool gridInitialise()
 {
-	ASSERT(gridPointTree == nullptr, "gridInitialise already called, without calling gridShutDown.");
-	gridPointTree = new PointTree;
-	gridFiltersUnseen = new PointTree::Filter[MAX_PLAYERS];
-	gridFiltersDroidsByPlayer = new PointTree::Filter[MAX_PLAYERS];
+	ASSERT(gridLayers == nullptr, "gridInitialise already called, without calling gridShutDown.");
+	gridLayers = new GridLayer[GRID_LAYERS];
+	gridInvalidateStaticObjects();
 
 	return true;  // Yay, nothing failed!
 }
 
-// reset the grid system
-void gridReset()
+void gridAddStaticObject(BASE_OBJECT *psObj)
 {
-	gridPointTree->clear();
+	ASSERT_OR_RETURN(, psObj->type == OBJ_STRUCTURE || psObj->type == OBJ_FEATURE, "Only structures and features belong in the static grid layer.");
+	if (gridStaticInvalid)
+	{
+		return;  // Everything gets rebuilt anyway.
+	}
+	gridStaticChanges.push_back({psObj, Vector2i(0, 0), true});  // Position is read when applying, since features get their position after being added.
+}
 
-	// Put all existing objects into the point tree.
-	for (unsigned player = 0; player < MAX_PLAYERS; player++)
+void gridRemoveStaticObject(BASE_OBJECT *psObj)
+{
+	ASSERT_OR_RETURN(, psObj->type == OBJ_STRUCTURE || psObj->type == OBJ_FEATURE, "Only structures and features belong in the static grid layer.");
+	if (gridStaticInvalid)
 	{
-		BASE_OBJECT *start[3] = {(BASE_OBJECT *)apsDroidLists[player], (BASE_OBJECT *)apsStructLists[player], (BASE_OBJECT *)apsFeatureLists[player]};
-		for (unsigned type = 0; type != sizeof(start) / sizeof(*start); ++type)
+		return;  // Everything gets rebuilt anyway.
+	}
+	for (auto i = gridStaticChanges.begin(); i != gridStaticChanges.end(); ++i)
+	{
+		if (i->psObj == psObj && i->add)
 		{
-			for (BASE_OBJECT *psObj = start[type]; psObj != nullptr; psObj = psObj->psNext)
+			gridStaticChanges.erase(i);  // Never made it into the grid, and may be freed before the next gridReset.
+			return;
+		}
+	}
+	gridStaticChanges.push_back({psObj, psObj->pos.xy(), false});
+}
+
+void gridInvalidateStaticObjects()
+{
+	gridStaticInvalid = true;
+	gridStaticChanges.clear();
+}
+
+static void gridUpdateStaticLayer(PointTree &pointTree)
+{
+	if (gridStaticInvalid)
+	{
+		pointTree.clear();
+		for (unsigned player = 0; player < MAX_PLAYERS; player++)
+		{
+			BASE_OBJECT *start[2] = {(BASE_OBJECT *)apsStructLists[player], (BASE_OBJECT *)apsFeatureLists[player]};
+			for (unsigned type = 0; type != sizeof(start) / sizeof(*start); ++type)
 			{
-				if (!psObj->died)
+				for (BASE_OBJECT *psObj = start[type]; psObj != nullptr; psObj = psObj->psNext)
 				{
-					gridPointTree->insert(psObj, psObj->pos.x, psObj->pos.y);
-					for (unsigned char &viewer : psObj->seenThisTick)
+					if (!psObj->died)
 					{
-						viewer = 0;
+						pointTree.insert(psObj, psObj->pos.x, psObj->pos.y, psObj->id);
 					}
 				}
 			}
 		}
+		pointTree.sort();
+		gridStaticInvalid = false;
 	}
+	else
+	{
+		for (GridStaticChange const &change : gridStaticChanges)
+		{
+			if (change.add)
+			{
+				pointTree.insertSorted(change.psObj, change.psObj->pos.x, change.psObj->pos.y, change.psObj->id);
+			}
+			else if (!pointTree.erase(change.psObj, change.pos.x, change.pos.y))
+			{
+				ASSERT(false, "Removed object %p was not in the grid at (%d, %d), the static layer is out of sync with the object lists.", (void *)change.psObj, change.pos.x, change.pos.y);
+			}
+		}
+	}
+	gridStaticChanges.clear();
+}
 
-	gridPointTree->sort();
-
-	for (unsigned player = 0; player < MAX_PLAYERS; ++player)
+static void gridUpdateDynamicLayer(PointTree &pointTree)
+{
+	pointTree.clear();
+	for (unsigned player = 0; player < MAX_PLAYERS; player++)
 	{
-		gridFiltersUnseen[player].reset(*gridPointTree);
-		gridFiltersDroidsByPlayer[player].reset(*gridPointTree);
+		for (DROID *psDroid = apsDroidLists[player]; psDroid != nullptr; psDroid = psDroid->psNext)
+		{
+			if (!psDroid->died)
+			{
+				pointTree.insert(psDroid, psDroid->pos.x, psDroid->pos.y, psDroid->id);
+			}
+		}
 	}
+	pointTree.sort();
+}
+
+// reset the grid system
+void gridReset()
+{
+	// Put all existing objects into the point trees.
+	gridUpdateStaticLayer(gridLayers[GRID_STATIC].pointTree);
+	gridUpdateDynamicLayer(gridLayers[GRID_DYNAMIC].pointTree);
 }
 
 // shutdown the grid system
 void gridShutDown()
 {
-	delete gridPointTree;
-	gridPointTree = nullptr;
-	delete[] gridFiltersUnseen;
-	gridFiltersUnseen = nullptr;
-	delete[] gridFiltersDroidsByPlayer;
-	gridFiltersDroidsByPlayer = nullptr;
+	delete[] gridLayers;
+	gridLayers = nullptr;
+	gridStaticChanges.clear();
 }
 
 static bool isInRadius(int32_t x, int32_t y, uint32_t radius)
@@ -98,59 +177,30 @@ static bool isInRadius(int32_t x, int32_t y, uint32_t radius)
 	return ((int64_t)x * (int64_t)x + (int64_t)y * (int64_t)y) <= ((int64_t)radius * (int64_t)radius);
 }
 
-// initialise the grid system to start iterating through units that
-// could affect a location (x,y in world coords)
+// find all units that could affect a location (x,y in world coords)
+// Only reads from the grid, so is safe to call from several threads at once.
 template<class Condition>
-static GridList const &gridStartIterateFiltered(int32_t x, int32_t y, uint32_t radius, PointTree::Filter *filter, Condition const &condition)
+static void gridQueryFiltered(GridList &results, int32_t x, int32_t y, uint32_t radius, bool includeStatic, Condition const &condition)
 {
-	if (filter == nullptr)
-	{
-		gridPointTree->query(x, y, radius);
-	}
-	else
+	results.clear();
+	PointTree const *trees[GRID_LAYERS];
+	unsigned numTrees = 0;
+	for (unsigned layer = includeStatic ? 0 : GRID_DYNAMIC; layer < GRID_LAYERS; ++layer)
 	{
-		gridPointTree->query(*filter, x, y, radius);
+		trees[numTrees++] = &gridLayers[layer].pointTree;
 	}
-	PointTree::ResultVector::iterator w = gridPointTree->lastQueryResults.begin(), i;
-	for (i = w; i != gridPointTree->lastQueryResults.end(); ++i)
-	{
-		BASE_OBJECT *obj = static_cast<BASE_OBJECT *>(*i);
-		if (!condition.test(obj))  // Check if we should skip this object.
-		{
-			filter->erase(gridPointTree->lastFilteredQueryIndices[i - gridPointTree->lastQueryResults.begin()]);  // Stop the object from appearing in future searches.
-		}
-		else if (isInRadius(obj->pos.x - x, obj->pos.y - y, radius))  // Check that search result is less than radius (since they can be up to a factor of sqrt(2) more).
+	PointTree::forEachMerged(trees, numTrees, x, y, radius, [&](void *point) {
+		BASE_OBJECT *obj = static_cast<BASE_OBJECT *>(point);
+		if (condition.test(obj)  // Check if we should skip this object.
+		    && isInRadius(obj->pos.x - x, obj->pos.y - y, radius))  // Check that search result is less than radius (since they can be up to a factor of sqrt(2) more).
 		{
-			*w = *i;
-			++w;
+			results.push_back(obj);
 		}
-	}
-	gridPointTree->lastQueryResults.erase(w, i);  // Erase all points that were a bit too far.
+	});
 	/*
 	// In case you are curious.
-	debug(LOG_WARNING, "gridStartIterateFiltered(%d, %d, %u) found %u objects", x, y, radius, (unsigned)gridPointTree->lastQueryResults.size());
+	debug(LOG_WARNING, "gridQueryFiltered(%d, %d, %u) found %u objects", x, y, radius, (unsigned)results.size());
 	*/
-	static GridList gridList;
-	gridList.resize(gridPointTree->lastQueryResults.size());
-	for (unsigned n = 0; n < gridList.size(); ++n)
-	{
-		gridList[n] = (BASE_OBJECT *)gridPointTree->lastQueryResults[n];
-	}
-	return gridList;
-}
-
-template<class Condition>
-static GridList const &gridStartIterateFilteredArea(int32_t x, int32_t y, int32_t x2, int32_t y2, Condition const &condition)
-{
-	gridPointTree->query(x, y, x2, y2);
-
-	static GridList gridList;
-	gridList.resize(gridPointTree->lastQueryResults.size());
-	for (unsigned n = 0; n < gridList.size(); ++n)
-	{
-		gridList[n] = (BASE_OBJECT *)gridPointTree->lastQueryResults[n];
-	}
-	return gridList;
 }
 
 struct ConditionTrue
@@ -161,14 +211,18 @@ struct ConditionTrue
 	}
 };
 
-GridList const &gridStartIterate(int32_t x, int32_t y, uint32_t radius)
+void gridQuery(GridList &results, int32_t x, int32_t y, uint32_t radius)
 {
-	return gridStartIterateFiltered(x, y, radius, nullptr, ConditionTrue());
+	gridQueryFiltered(results, x, y, radius, true, ConditionTrue());
 }
 
-GridList const &gridStartIterateArea(int32_t x, int32_t y, uint32_t x2, uint32_t y2)
+void gridQueryArea(GridList &results, int32_t x, int32_t y, int32_t x2, int32_t y2)
 {
-	return gridStartIterateFilteredArea(x, y, x2, y2, ConditionTrue());
+	results.clear();
+	PointTree const *trees[GRID_LAYERS] = {&gridLayers[GRID_STATIC].pointTree, &gridLayers[GRID_DYNAMIC].pointTree};
+	PointTree::forEachMerged(trees, GRID_LAYERS, x, y, x2, y2, [&](void *point) {
+		results.push_back(static_cast<BASE_OBJECT *>(point));
+	});
 }
 
 struct ConditionDroidsByPlayer
@@ -181,9 +235,9 @@ struct ConditionDroidsByPlayer
 	int player;
 };
 
-GridList const &gridStartIterateDroidsByPlayer(int32_t x, int32_t y, uint32_t radius, int player)
+void gridQueryDroidsByPlayer(GridList &results, int32_t x, int32_t y, uint32_t radius, int player)
 {
-	return gridStartIterateFiltered(x, y, radius, &gridFiltersDroidsByPlayer[player], ConditionDroidsByPlayer(player));
+	gridQueryFiltered(results, x, y, radius, false, ConditionDroidsByPlayer(player));  // Only droids, so no need to look at the static layer.
 }
 
 struct ConditionUnseen
@@ -196,15 +250,21 @@ struct ConditionUnseen
 	int player;
 };
 
-GridList const &gridStartIterateUnseen(int32_t x, int32_t y, uint32_t radius, int player)
+void gridQueryUnseen(GridList &results, int32_t x, int32_t y, uint32_t radius, int player)
+{
+	gridQueryFiltered(results, x, y, radius, true, ConditionUnseen(player));
+}
+
+GridList const &gridStartIterate(int32_t x, int32_t y, uint32_t radius)
 {
-	return gridStartIterateFiltered(x, y, radius, &gridFiltersUnseen[player], ConditionUnseen(player));
+	static GridList gridList;
+	gridQuery(gridList, x, y, radius);
+	return gridList;
 }
 
-BASE_OBJECT **gridIterateDup()
+GridList const &gridStartIterateArea(int32_t x, int32_t y, uint32_t x2, uint32_t y2)
 {
-	size_t bytes = gridPointTree->lastQueryResults.size() * sizeof(void *);
-	BASE_OBJECT **ret = (BASE_OBJECT **)malloc(bytes);
-	memcpy(ret, &gridPointTree->lastQueryResults[0], bytes);
-	return ret;
+	static GridList gridList;
+	gridQueryArea(gridList, x, y, x2, y2);
+	return gridList;
 }
@@ -34,20 +34,40 @@ bool gridInitialise();
 void gridShutDown();
 
 // Reset the grid system. Called once per update.
-// Resets seenThisTick[] to false.
+// Droids are re-sorted every time, structures and features only when added or removed.
 void gridReset();
 
-/// Find all objects within radius.
-GridList const &gridStartIterate(int32_t x, int32_t y, uint32_t radius);
+/// Queue a structure or feature to be added to the grid at the next gridReset(). Call when it is added to apsStructLists or apsFeatureLists.
+void gridAddStaticObject(BASE_OBJECT *psObj);
+
+/// Queue a structure or feature to be removed from the grid at the next gridReset(). Call when it is killed or removed from its list.
+void gridRemoveStaticObject(BASE_OBJECT *psObj);
+
+/// Rebuild all structures and features at the next gridReset(). Call when the object lists are swapped or cleared wholesale.
+void gridInvalidateStaticObjects();
+
+// The gridQuery functions write to a list owned by the caller, and only read from the grid, so they may be
+// called from several threads at once, as long as gridReset() isn't called at the same time.
+// Results are sorted by position in Z-order, and objects at the same position by id, whatever their layer, so the
+// order never depends on when objects were added.
 
 /// Find all objects within radius.
-GridList const &gridStartIterateArea(int32_t x, int32_t y, uint32_t x2, uint32_t y2);
+void gridQuery(GridList &results, int32_t x, int32_t y, uint32_t radius);
+
+/// Find all objects within the rectangle from (x, y) to (x2, y2).
+void gridQueryArea(GridList &results, int32_t x, int32_t y, int32_t x2, int32_t y2);
 
 /// Find all objects within radius where object->type == OBJ_DROID && object->player == player.
-GridList const &gridStartIterateDroidsByPlayer(int32_t x, int32_t y, uint32_t radius, int player);
+void gridQueryDroidsByPlayer(GridList &results, int32_t x, int32_t y, uint32_t radius, int player);
 
 // Used for visibility.
 /// Find all objects within radius where object->seenThisTick[player] != 255.
-GridList const &gridStartIterateUnseen(int32_t x, int32_t y, uint32_t radius, int player);
+void gridQueryUnseen(GridList &results, int32_t x, int32_t y, uint32_t radius, int player);
+
+/// Find all objects within radius. Not thread safe, and the list is overwritten by the next call.
+GridList const &gridStartIterate(int32_t x, int32_t y, uint32_t radius);
+
+/// Find all objects within the rectangle from (x, y) to (x2, y2). Not thread safe, and the list is overwritten by the next call.
+GridList const &gridStartIterateArea(int32_t x, int32_t y, uint32_t x2, uint32_t y2);
 
 #endif // __INCLUDED_SRC_MAPGRID_H__
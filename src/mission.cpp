@@ -71,6 +71,7 @@
 #include "loop.h"
 #include "visibility.h"
 #include "mapgrid.h"
+#include "threatmap.h"
 #include "selection.h"
 #include "scores.h"
 #include "keymap.h"
@@ -317,8 +318,11 @@ bool missionShutDown()
 		apsOilList[0] = mission.apsOilList[0];
 		mission.apsSensorList[0] = nullptr;
 		mission.apsOilList[0] = nullptr;
+		gridInvalidateStaticObjects();
+		threatMapInvalidate();
 
 		psMapTiles = mission.psMapTiles;
+		++mapTilesGeneration;
 		mapWidth = mission.mapWidth;
 		mapHeight = mission.mapHeight;
 		for (int i = 0; i < ARRAY_SIZE(mission.psBlockMap); ++i)
@@ -754,6 +758,8 @@ static void saveMissionData()
 	}
 	mission.apsSensorList[0] = apsSensorList[0];
 	mission.apsOilList[0] = apsOilList[0];
+	gridInvalidateStaticObjects();
+	threatMapInvalidate();
 
 	mission.playerX = player.p.x;
 	mission.playerY = player.p.z;
@@ -823,9 +829,12 @@ void restoreMissionData()
 	apsSensorList[0] = mission.apsSensorList[0];
 	apsOilList[0] = mission.apsOilList[0];
 	mission.apsSensorList[0] = nullptr;
+	gridInvalidateStaticObjects();
+	threatMapInvalidate();
 	//swap mission data over
 
 	psMapTiles = mission.psMapTiles;
+	++mapTilesGeneration;
 
 	mapWidth = mission.mapWidth;
 	mapHeight = mission.mapHeight;
@@ -1325,6 +1334,7 @@ void swapMissionPointers()
 	debug(LOG_SAVE, "called");
 
 	std::swap(psMapTiles, mission.psMapTiles);
+	++mapTilesGeneration;
 	std::swap(mapWidth,   mission.mapWidth);
 	std::swap(mapHeight,  mission.mapHeight);
 	for (int i = 0; i < ARRAY_SIZE(mission.psBlockMap); ++i)
@@ -1351,6 +1361,8 @@ void swapMissionPointers()
 	}
 	std::swap(apsSensorList[0], mission.apsSensorList[0]);
 	std::swap(apsOilList[0],    mission.apsOilList[0]);
+	gridInvalidateStaticObjects();
+	threatMapInvalidate();
 }
 
 void endMission()
@@ -436,7 +436,7 @@ bool recvDroid(NETQUEUE queue)
 	// If we were able to build the droid set it up
 	if (psDroid)
 	{
-		psDroid->id = id;
+		objSetId(psDroid, id);
 		addDroid(psDroid, apsDroidLists);
 
 		if (haveInitialOrders)
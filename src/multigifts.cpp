@@ -681,7 +681,7 @@ void recvMultiPlayerFeature(NETQUEUE queue)
 		{
 			// Create a feature of the specified type at the given location
 			FEATURE *result = buildFeature(&asFeatureStats[i], x, y, false);
-			result->id = id;
+			objSetId(result, id);
 			break;
 		}
 	}
@@ -88,6 +88,8 @@
 #include "modding.h"
 #include "qtscript.h"
 #include "random.h"
+#include "replay.h"
+#include "simbench.h"
 #include "notifications.h"
 #include "lib/framework/wztime.h"
 
@@ -365,20 +367,8 @@ const char *getAIName(int player)
 	}
 }
 
-void loadMultiScripts()
+bool getMultiScriptsIni(WzString &ininame, WzString &path)
 {
-	bool defaultRules = true;
-	char aFileName[256];
-	char aPathName[256];
-	LEVEL_DATASET *psLevel = levFindDataSet(game.map, &game.hash);
-	ASSERT_OR_RETURN(, psLevel, "No level found for %s", game.map);
-	sstrcpy(aFileName, psLevel->apDataFiles[psLevel->game]);
-	aFileName[strlen(aFileName) - 4] = '\0';
-	sstrcpy(aPathName, aFileName);
-	sstrcat(aFileName, ".json");
-	sstrcat(aPathName, "/");
-	WzString ininame;
-	WzString path;
 	bool loadExtra = false;
 
 	if (challengeFileName.length() > 0)
@@ -402,6 +392,23 @@ void loadMultiScripts()
 		loadExtra = true;
 	}
 
+	if (getHostLaunch() == HostLaunch::Replay)
+	{
+		loadExtra = replayScriptsIni(ininame, path);
+	}
+
+	return loadExtra;
+}
+
+void loadMultiScripts()
+{
+	bool defaultRules = true;
+	LEVEL_DATASET *psLevel = levFindDataSet(game.map, &game.hash);
+	ASSERT_OR_RETURN(, psLevel, "No level found for %s", game.map);
+	WzString ininame;
+	WzString path;
+	bool loadExtra = getMultiScriptsIni(ininame, path);
+
 	// Reset assigned counter
 	for (auto it = aidata.begin(); it < aidata.end(); ++it)
 	{
@@ -441,9 +448,12 @@ void loadMultiScripts()
 	uint32_t oldHash1 = DataHash[DATA_SCRIPT];
 	uint32_t oldHash2 = DataHash[DATA_SCRIPTVAL];
 
+	// Replays have the orders the AIs and scavengers gave, so don't run them again.
+	const bool runAIs = getHostLaunch() != HostLaunch::Replay;
+
 	// Load AI players for skirmish games
 	resForceBaseDir("multiplay/skirmish/");
-	if (bMultiPlayer && game.type == LEVEL_TYPE::SKIRMISH)
+	if (bMultiPlayer && game.type == LEVEL_TYPE::SKIRMISH && runAIs)
 	{
 		for (unsigned i = 0; i < game.maxPlayers; i++)
 		{
@@ -476,7 +486,7 @@ void loadMultiScripts()
 	}
 
 	// Load scavengers
-	if (game.scavengers && myResponsibility(scavengerPlayer()))
+	if (game.scavengers && myResponsibility(scavengerPlayer()) && runAIs)
 	{
 		debug(LOG_SAVE, "Loading scavenger AI for player %d", scavengerPlayer());
 		loadPlayerScript("multiplay/script/scavfact.js", scavengerPlayer(), AIDifficulty::EASY);
@@ -2723,12 +2733,21 @@ void WzMultiplayerOptionsTitleUI::addPlayerBox(bool players)
 static void SendFireUp()
 {
 	uint32_t randomSeed = rand();  // Pick a random random seed for the synchronised random number generator.
+	if (!simbench_enabled().empty())
+	{
+		randomSeed = simBenchSeed();  // Same seed for every benchmark run.
+	}
+	if (getHostLaunch() == HostLaunch::Replay)
+	{
+		randomSeed = replaySeed();  // Same seed as the recorded game.
+	}
 
 	NETbeginEncode(NETbroadcastQueue(), NET_FIREUP);
 	NETuint32_t(&randomSeed);
 	NETend();
 	printSearchPath();
 	gameSRand(randomSeed);  // Set the seed for the synchronised random number generator. The clients will use the same seed.
+	replayStartRecording(randomSeed);
 }
 
 // host kicks a player from a game.
@@ -4003,6 +4022,10 @@ void startMultiplayerGame()
 
 		resetDataHash();	// need to reset it, since host's data has changed.
 		createLimitSet();
+		if (getHostLaunch() == HostLaunch::Replay)
+		{
+			replayLoadStructureLimits();
+		}
 		debug(LOG_NET, "sending our options to all clients");
 		sendOptions();
 		NEThaltJoining();							// stop new players entering.
@@ -4179,6 +4202,7 @@ void WzMultiplayerOptionsTitleUI::frontendMultiMessages(bool running)
 				NETend();
 
 				gameSRand(randomSeed);  // Set the seed for the synchronised random number generator, using the seed given by the host.
+				replayStartRecording(randomSeed);
 
 				debug(LOG_NET, "& local Options Received (MP game)");
 				ingame.TimeEveryoneIsInGame = 0;			// reset time
@@ -4676,14 +4700,19 @@ void WzMultiplayerOptionsTitleUI::start()
 		updateLimitIcons();
 	}
 
-	if (autogame_enabled() || getHostLaunch() == HostLaunch::Autohost)
+	if (autogame_enabled() || getHostLaunch() == HostLaunch::Autohost || getHostLaunch() == HostLaunch::Replay)
 	{
 		if (!ingame.localJoiningInProgress)
 		{
 			processMultiopWidgets(MULTIOP_HOST);
 		}
+		if (getHostLaunch() == HostLaunch::Replay && !replayLoadSettings())
+		{
+			debug(LOG_FATAL, "Could not play back replay %s", replay_enabled().c_str());
+			exit(1);
+		}
 		SendReadyRequest(selectedPlayer, true);
-		if (getHostLaunch() == HostLaunch::Skirmish)
+		if (getHostLaunch() == HostLaunch::Skirmish || getHostLaunch() == HostLaunch::Replay)
 		{
 			startMultiplayerGame();
 			// reset flag in case people dropped/quit on join screen
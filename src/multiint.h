@@ -44,6 +44,7 @@
 
 void calcBackdropLayoutForMultiplayerOptionsTitleUI(WIDGET *psWidget, unsigned int, unsigned int, unsigned int, unsigned int);
 void readAIs();	///< step 1, load AI definition files
+bool getMultiScriptsIni(WzString &ininame, WzString &path);  ///< Gets the settings file with extra scripts for this game, and their directory. Returns false if there is none.
 void loadMultiScripts();	///< step 2, load the actual AI scripts
 const char *getAIName(int player);	///< only run this -after- readAIs() is called
 const std::vector<WzString> getAINames();
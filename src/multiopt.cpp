@@ -61,6 +61,7 @@
 #include "multigifts.h"
 #include "multiint.h"
 #include "multirecv.h"
+#include "replay.h"
 #include "template.h"
 #include "activity.h"
 
@@ -452,6 +453,8 @@ bool multiGameShutdown()
 
 	debug(LOG_NET, "%s is shutting down.", getPlayerName(selectedPlayer));
 
+	replayStop();
+
 	sendLeavingMsg();							// say goodbye
 
 	st = getMultiStats(selectedPlayer);	// save stats
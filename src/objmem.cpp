@@ -41,6 +41,13 @@
 #include "combat.h"
 #include "visibility.h"
 #include "qtscript.h"
+#include "feature.h"
+#include "projectile.h"
+#include "threatmap.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <unordered_map>
 
 // the initial value for the object ID
 #define OBJ_ID_INIT 20000
@@ -71,6 +78,182 @@ static void objListIntegCheck();
 #endif
 
 
+/// Number of objects in each slab of an object pool.
+#define OBJECTS_PER_SLAB 64
+
+/** Pool of objects of a single type.
+ *
+ *  Objects are carved out of large slabs, so that objects of the same type are close to each other in memory, and
+ *  freed objects are put on a free list and handed out again, most recently freed first. Objects never move, and
+ *  slabs are only released when all their objects are free at shutdown. Not thread-safe, objects must only be
+ *  created and destroyed on the main thread.
+ */
+class ObjectSlabPool
+{
+public:
+	ObjectSlabPool(char const *name, size_t objectSize)
+		: name(name)
+		, blockSize((std::max(objectSize, sizeof(FreeBlock)) + alignof(std::max_align_t) - 1) / alignof(std::max_align_t) * alignof(std::max_align_t))
+	{}
+
+	void *allocate()
+	{
+		if (freeList == nullptr)
+		{
+			addSlab();
+		}
+		FreeBlock *block = freeList;
+		freeList = block->next;
+		++live;
+		peak = std::max(peak, live);
+		++allocations;
+		return block;
+	}
+
+	void release(void *ptr)
+	{
+		FreeBlock *block = static_cast<FreeBlock *>(ptr);
+		block->next = freeList;
+		freeList = block;
+		--live;
+	}
+
+	/// Gives the slabs back to the system, if no objects are left.
+	void trim()
+	{
+		if (live != 0)
+		{
+			return;
+		}
+		for (char *slab : slabs)
+		{
+			::operator delete(slab);
+		}
+		slabs.clear();
+		freeList = nullptr;
+	}
+
+	ObjectPoolStats stats() const
+	{
+		return ObjectPoolStats{name, blockSize, live, peak, slabs.size() * OBJECTS_PER_SLAB, slabs.size(), allocations};
+	}
+
+private:
+	struct FreeBlock
+	{
+		FreeBlock *next;
+	};
+
+	void addSlab()
+	{
+		char *slab = static_cast<char *>(::operator new(blockSize * OBJECTS_PER_SLAB));
+		slabs.push_back(slab);
+		for (size_t i = OBJECTS_PER_SLAB; i-- > 0;)  // Link backwards, so that the slab is handed out from the start.
+		{
+			FreeBlock *block = reinterpret_cast<FreeBlock *>(slab + i * blockSize);
+			block->next = freeList;
+			freeList = block;
+		}
+	}
+
+	char const *name;
+	size_t blockSize;
+	std::vector<char *> slabs;
+	FreeBlock *freeList = nullptr;
+	size_t live = 0;
+	size_t peak = 0;
+	uint64_t allocations = 0;
+};
+
+// The pools are never destroyed, since objects may still be deleted by destructors of other globals at exit.
+static ObjectSlabPool &droidPool()
+{
+	static ObjectSlabPool *pool = new ObjectSlabPool("DROID", sizeof(DROID));
+	return *pool;
+}
+static ObjectSlabPool &structurePool()
+{
+	static ObjectSlabPool *pool = new ObjectSlabPool("STRUCTURE", sizeof(STRUCTURE));
+	return *pool;
+}
+static ObjectSlabPool &featurePool()
+{
+	static ObjectSlabPool *pool = new ObjectSlabPool("FEATURE", sizeof(FEATURE));
+	return *pool;
+}
+static ObjectSlabPool &projectilePool()
+{
+	static ObjectSlabPool *pool = new ObjectSlabPool("PROJECTILE", sizeof(PROJECTILE));
+	return *pool;
+}
+
+#define OBJECT_POOL_OPERATORS(TYPE, POOL) \
+	void *TYPE::operator new(size_t size) \
+	{ \
+		ASSERT(size == sizeof(TYPE), "Allocating %zu bytes from the " #TYPE " pool", size); \
+		return POOL().allocate(); \
+	} \
+	void TYPE::operator delete(void *ptr) \
+	{ \
+		if (ptr != nullptr) \
+		{ \
+			POOL().release(ptr); \
+		} \
+	}
+
+OBJECT_POOL_OPERATORS(DROID, droidPool)
+OBJECT_POOL_OPERATORS(STRUCTURE, structurePool)
+OBJECT_POOL_OPERATORS(FEATURE, featurePool)
+OBJECT_POOL_OPERATORS(PROJECTILE, projectilePool)
+
+std::vector<ObjectPoolStats> objmemPoolStats()
+{
+	return {droidPool().stats(), structurePool().stats(), featurePool().stats(), projectilePool().stats()};
+}
+
+/* Index from object id to object, so that objects can be found without walking every object list.
+ * Objects are added when they are put in an object list, and removed when they are destroyed or freed.
+ * Droids keep their entry while carried in a transporter, or moved between the mission and limbo lists.
+ * Ids must only be changed with objSetId(), so that no entry is left behind under an old id.
+ * The index is only used for lookups, and never iterated, so its ordering can't affect the game state.
+ */
+static std::unordered_map<uint32_t, BASE_OBJECT *> objIdIndex;
+
+static void objIdIndexAdd(BASE_OBJECT *psObj)
+{
+	objIdIndex[psObj->id] = psObj;
+}
+
+void objIdIndexRemove(BASE_OBJECT *psObj)
+{
+	auto it = objIdIndex.find(psObj->id);
+	if (it != objIdIndex.end() && it->second == psObj)
+	{
+		objIdIndex.erase(it);
+	}
+}
+
+static BASE_OBJECT *objIdIndexFind(uint32_t id)
+{
+	auto it = objIdIndex.find(id);
+	return it != objIdIndex.end() ? it->second : nullptr;
+}
+
+void objSetId(BASE_OBJECT *psObj, uint32_t id)
+{
+	auto it = objIdIndex.find(psObj->id);
+	bool indexed = it != objIdIndex.end() && it->second == psObj;
+	if (indexed)
+	{
+		objIdIndex.erase(it);
+	}
+	psObj->id = id;
+	if (indexed)
+	{
+		objIdIndexAdd(psObj);
+	}
+}
+
 /* Initialise the object heaps */
 bool objmemInitialise()
 {
@@ -84,6 +267,16 @@ bool objmemInitialise()
 /* Release the object heaps */
 void objmemShutdown()
 {
+	for (ObjectPoolStats const &stats : objmemPoolStats())
+	{
+		debug(LOG_MEMORY, "%s pool: %zu live, %zu peak, %zu slabs of %u objects of %zu bytes, %llu allocations", stats.name,
+		      stats.live, stats.peak, stats.slabs, OBJECTS_PER_SLAB, stats.objectSize, (unsigned long long)stats.allocations);
+	}
+	droidPool().trim();
+	structurePool().trim();
+	featurePool().trim();
+	projectilePool().trim();
+	objIdIndex.clear();
 }
 
 // Check that psVictim is not referred to by any other object in the game. We can dump out some extra data in debug builds that help track down sources of dangling pointer errors.
@@ -261,6 +454,8 @@ static inline void destroyObject(OBJECT *list[], OBJECT *object)
 		object->psNext = psDestroyedObj;
 		psDestroyedObj = (BASE_OBJECT *)object;
 		object->died = gameTime;
+		objIdIndexRemove(object);
+		threatMapObjectRemoved(object);  // Dead objects are no threat, even before they are freed.
 		scriptRemoveObject(object);
 		return;
 	}
@@ -286,6 +481,8 @@ static inline void destroyObject(OBJECT *list[], OBJECT *object)
 
 		// Set destruction time
 		object->died = gameTime;
+		objIdIndexRemove(object);
+		threatMapObjectRemoved(object);
 	}
 	scriptRemoveObject(object);
 }
@@ -389,6 +586,7 @@ void addDroid(DROID *psDroidToAdd, DROID *pList[MAX_PLAYERS])
 	DROID_GROUP	*psGroup;
 
 	addObjectToList(pList, psDroidToAdd, psDroidToAdd->player);
+	objIdIndexAdd(psDroidToAdd);
 
 	/* Whenever a droid gets added to a list other than the current list
 	 * its died flag is set to NOT_CURRENT_LIST so that anything targetting
@@ -492,6 +690,8 @@ void freeAllLimboDroids()
 void addStructure(STRUCTURE *psStructToAdd)
 {
 	addObjectToList(apsStructLists, psStructToAdd, psStructToAdd->player);
+	objIdIndexAdd(psStructToAdd);
+	gridAddStaticObject(psStructToAdd);
 	if (psStructToAdd->pStructureType->pSensor
 	    && psStructToAdd->pStructureType->pSensor->location == LOC_TURRET)
 	{
@@ -560,6 +760,7 @@ void killStruct(STRUCTURE *psBuilding)
 		}
 	}
 
+	gridRemoveStaticObject(psBuilding);
 	destroyObject(apsStructLists, psBuilding);
 }
 
@@ -567,6 +768,7 @@ void killStruct(STRUCTURE *psBuilding)
 void freeAllStructs()
 {
 	releaseAllObjectsInList(apsStructLists);
+	gridInvalidateStaticObjects();
 }
 
 /*Remove a single Structure from a list*/
@@ -577,6 +779,10 @@ void removeStructureFromList(STRUCTURE *psStructToRemove, STRUCTURE *pList[MAX_P
 	ASSERT(psStructToRemove->player < MAX_PLAYERS,
 	       "removeStructureFromList: invalid player for structure");
 	removeObjectFromList(pList, psStructToRemove, psStructToRemove->player);
+	if (pList == apsStructLists)
+	{
+		gridRemoveStaticObject(psStructToRemove);
+	}
 	if (psStructToRemove->pStructureType->pSensor
 	    && psStructToRemove->pStructureType->pSensor->location == LOC_TURRET)
 	{
@@ -594,6 +800,8 @@ void removeStructureFromList(STRUCTURE *psStructToRemove, STRUCTURE *pList[MAX_P
 void addFeature(FEATURE *psFeatureToAdd)
 {
 	addObjectToList(apsFeatureLists, psFeatureToAdd, 0);
+	objIdIndexAdd(psFeatureToAdd);
+	gridAddStaticObject(psFeatureToAdd);
 	if (psFeatureToAdd->psStats->subType == FEAT_OIL_RESOURCE)
 	{
 		addObjectToFuncList(apsOilList, psFeatureToAdd, 0);
@@ -608,6 +816,7 @@ void killFeature(FEATURE *psDel)
 	ASSERT(psDel->type == OBJ_FEATURE,
 	       "killFeature: pointer is not a feature");
 	psDel->player = 0;
+	gridRemoveStaticObject(psDel);
 	destroyObject(apsFeatureLists, psDel);
 
 	if (psDel->psStats->subType == FEAT_OIL_RESOURCE)
@@ -620,6 +829,7 @@ void killFeature(FEATURE *psDel)
 void freeAllFeatures()
 {
 	releaseAllObjectsInList(apsFeatureLists);
+	gridInvalidateStaticObjects();
 }
 
 /**************************  FLAG_POSITION ********************************/
@@ -740,8 +950,8 @@ void checkFactoryFlags()
 
 /**************************  OBJECT ACCESS FUNCTIONALITY ********************************/
 
-// Find a base object from it's id
-BASE_OBJECT *getBaseObjFromData(unsigned id, unsigned player, OBJECT_TYPE type)
+// Find a base object from it's id, by searching the object lists
+static BASE_OBJECT *findBaseObjFromData(unsigned id, unsigned player, OBJECT_TYPE type)
 {
 	BASE_OBJECT		*psObj;
 	DROID			*psTrans;
@@ -797,13 +1007,12 @@ BASE_OBJECT *getBaseObjFromData(unsigned id, unsigned player, OBJECT_TYPE type)
 			psObj = psObj->psNext;
 		}
 	}
-	ASSERT(false, "failed to find id %d for player %d", id, player);
 
 	return nullptr;
 }
 
-// Find a base object from it's id
-BASE_OBJECT *getBaseObjFromId(UDWORD id)
+// Find a base object from it's id, by searching the object lists
+static BASE_OBJECT *findBaseObjFromId(UDWORD id)
 {
 	unsigned int i;
 	UDWORD			player;
@@ -884,11 +1093,48 @@ BASE_OBJECT *getBaseObjFromId(UDWORD id)
 			}
 		}
 	}
-	ASSERT(!"couldn't find a BASE_OBJ with ID", "getBaseObjFromId() failed for id %d", id);
 
 	return nullptr;
 }
 
+// Find a base object from it's id
+BASE_OBJECT *getBaseObjFromData(unsigned id, unsigned player, OBJECT_TYPE type)
+{
+	BASE_OBJECT *psObj = objIdIndexFind(id);
+	if (psObj != nullptr && psObj->type == type && (type == OBJ_FEATURE || psObj->player == player))
+	{
+		return psObj;
+	}
+
+	psObj = findBaseObjFromData(id, player, type);
+	if (psObj != nullptr)
+	{
+		objIdIndexAdd(psObj);
+	}
+	ASSERT(psObj != nullptr, "failed to find id %d for player %d", id, player);
+
+	return psObj;
+}
+
+// Find a base object from it's id
+BASE_OBJECT *getBaseObjFromId(UDWORD id)
+{
+	BASE_OBJECT *psObj = objIdIndexFind(id);
+	if (psObj != nullptr)
+	{
+		return psObj;
+	}
+
+	psObj = findBaseObjFromId(id);
+	if (psObj != nullptr)
+	{
+		objIdIndexAdd(psObj);
+	}
+	ASSERT(psObj != nullptr, "getBaseObjFromId() failed for id %d", id);
+
+	return psObj;
+}
+
 UDWORD getRepairIdFromFlag(FLAG_POSITION *psFlag)
 {
 	unsigned int i;
@@ -26,6 +26,8 @@
 
 #include "objectdef.h"
 
+#include <vector>
+
 /* The lists of objects allocated */
 extern DROID			*apsDroidLists[MAX_PLAYERS];
 extern STRUCTURE		*apsStructLists[MAX_PLAYERS];
@@ -44,6 +46,21 @@ bool objmemInitialise();
 /* Release the object heaps */
 void objmemShutdown();
 
+/// Allocation statistics of the slab pool of one object type.
+struct ObjectPoolStats
+{
+	char const *name;
+	size_t objectSize;      ///< Bytes per object, including padding.
+	size_t live;            ///< Objects currently allocated.
+	size_t peak;            ///< Most objects allocated at once.
+	size_t capacity;        ///< Objects which fit in the slabs allocated so far.
+	size_t slabs;
+	uint64_t allocations;   ///< Total number of objects allocated.
+};
+
+/// Returns the statistics of the DROID, STRUCTURE, FEATURE and PROJECTILE pools.
+std::vector<ObjectPoolStats> objmemPoolStats();
+
 /* General housekeeping for the object system */
 void objmemUpdate();
 
@@ -103,6 +120,10 @@ void freeAllFlagPositions();
 // Find a base object from it's id
 BASE_OBJECT *getBaseObjFromData(unsigned id, unsigned player, OBJECT_TYPE type);
 BASE_OBJECT *getBaseObjFromId(UDWORD id);
+/// Forget a freed object, so that it can no longer be found by its id.
+void objIdIndexRemove(BASE_OBJECT *psObj);
+/// Gives an object a new id, such as the one it was saved with. Don't assign BASE_OBJECT::id directly, or the object can't be found by its new id.
+void objSetId(BASE_OBJECT *psObj, uint32_t id);
 
 UDWORD getRepairIdFromFlag(FLAG_POSITION *psFlag);
 
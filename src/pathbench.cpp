@@ -0,0 +1,224 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/**
+ * @file pathbench.cpp
+ *
+ * Recording and replaying of path jobs, for benchmarking.
+ */
+
+#include "lib/framework/frame.h"
+
+#include "pathbench.h"
+
+#include "astar.h"
+#include "baseobject.h"
+#include "clparse.h"
+#include "fpath.h"
+#include "map.h"
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <set>
+#include <vector>
+
+static FILE *pathRecordFile = nullptr;
+
+void pathBenchRecordJob(PATHJOB const &job)
+{
+	std::string const &filename = recordpathjobs_enabled();
+	if (filename.empty())
+	{
+		return;
+	}
+	if (pathRecordFile == nullptr)
+	{
+		pathRecordFile = fopen(filename.c_str(), "w");
+		ASSERT_OR_RETURN(, pathRecordFile != nullptr, "Could not open \"%s\" for recording path jobs", filename.c_str());
+		fprintf(pathRecordFile, "# propulsion droidType owner moveType origX origY destX destY structX structY structW structH acceptNearest\n");
+	}
+	fprintf(pathRecordFile, "%d %d %d %d %d %d %d %d %d %d %d %d %d\n", (int)job.propulsion, (int)job.droidType, job.owner, (int)job.moveType,
+	        job.origX, job.origY, job.destX, job.destY,
+	        job.dstStructure.map.x, job.dstStructure.map.y, job.dstStructure.size.x, job.dstStructure.size.y, (int)job.acceptNearest);
+}
+
+void pathBenchRecordShutdown()
+{
+	if (pathRecordFile != nullptr)
+	{
+		fclose(pathRecordFile);
+		pathRecordFile = nullptr;
+	}
+}
+
+static bool pathBenchLoadJobs(char const *filename, std::vector<PATHJOB> &jobs)
+{
+	FILE *file = fopen(filename, "r");
+	ASSERT_OR_RETURN(false, file != nullptr, "Could not open path jobs \"%s\"", filename);
+
+	char line[256];
+	int lineNumber = 0;
+	while (fgets(line, sizeof(line), file) != nullptr)
+	{
+		++lineNumber;
+		if (line[0] == '#' || line[0] == '\n')
+		{
+			continue;
+		}
+		int propulsion, droidType, owner, moveType, structX, structY, structW, structH, acceptNearest;
+		PATHJOB job;
+		if (sscanf(line, "%d %d %d %d %d %d %d %d %d %d %d %d %d", &propulsion, &droidType, &owner, &moveType,
+		           &job.origX, &job.origY, &job.destX, &job.destY, &structX, &structY, &structW, &structH, &acceptNearest) != 13
+		    || owner < 0 || owner >= MAX_PLAYERS || !worldOnMap(job.origX, job.origY) || !worldOnMap(job.destX, job.destY))
+		{
+			debug(LOG_ERROR, "%s:%d: Bad path job", filename, lineNumber);
+			fclose(file);
+			return false;
+		}
+		job.propulsion = (PROPULSION_TYPE)propulsion;
+		job.droidType = (DROID_TYPE)droidType;
+		job.owner = owner;
+		job.moveType = (FPATH_MOVETYPE)moveType;
+		job.dstStructure = StructureBounds(Vector2i(structX, structY), Vector2i(structW, structH));
+		job.droidID = jobs.size();
+		job.acceptNearest = acceptNearest != 0;
+		job.deleted = false;
+		jobs.push_back(job);
+	}
+	fclose(file);
+	return true;
+}
+
+/// Wheeled routes for player 0 between random passable tiles. Destinations are drawn from a small pool, like groups of droids sent to the same place.
+static void pathBenchRandomJobs(unsigned count, unsigned seed, std::vector<PATHJOB> &jobs)
+{
+	std::vector<Vector2i> passable;
+	for (int y = 0; y < mapHeight; ++y)
+	{
+		for (int x = 0; x < mapWidth; ++x)
+		{
+			if (!fpathBlockingTile(x, y, PROPULSION_TYPE_WHEELED))
+			{
+				passable.push_back(Vector2i(x, y));
+			}
+		}
+	}
+	ASSERT_OR_RETURN(, !passable.empty(), "No passable tiles on map");
+
+	std::mt19937 rng(seed);
+	std::uniform_int_distribution<size_t> anyTile(0, passable.size() - 1);
+	std::vector<Vector2i> destinations(16);
+	for (Vector2i &dest : destinations)
+	{
+		dest = passable[anyTile(rng)];
+	}
+	std::uniform_int_distribution<size_t> anyDestination(0, destinations.size() - 1);
+
+	for (unsigned i = 0; i < count; ++i)
+	{
+		Vector2i orig = passable[anyTile(rng)];
+		Vector2i dest = destinations[anyDestination(rng)];
+		PATHJOB job;
+		job.propulsion = PROPULSION_TYPE_WHEELED;
+		job.droidType = DROID_WEAPON;
+		job.owner = 0;
+		job.moveType = FMT_MOVE;
+		job.origX = world_coord(orig.x) + TILE_UNITS / 2;
+		job.origY = world_coord(orig.y) + TILE_UNITS / 2;
+		job.destX = world_coord(dest.x) + TILE_UNITS / 2;
+		job.destY = world_coord(dest.y) + TILE_UNITS / 2;
+		job.dstStructure = getStructureBounds((BASE_OBJECT *)nullptr);
+		job.droidID = i;
+		job.acceptNearest = true;
+		job.deleted = false;
+		jobs.push_back(job);
+	}
+}
+
+bool pathBenchRun(std::string const &jobsSource)
+{
+	std::vector<PATHJOB> jobs;
+	unsigned count = 0, seed = 1;
+	if (sscanf(jobsSource.c_str(), "random:%u:%u", &count, &seed) >= 1)
+	{
+		pathBenchRandomJobs(count, seed, jobs);
+	}
+	else if (!pathBenchLoadJobs(jobsSource.c_str(), jobs))
+	{
+		return false;
+	}
+	ASSERT_OR_RETURN(false, !jobs.empty(), "No path jobs to run");
+
+	PathfindContextList contexts;
+	PathfindStats stats;
+	std::vector<double> latencies;  // In microseconds.
+	std::set<PathBlockingMap const *> blockingMaps;
+	unsigned routesOk = 0, routesNearest = 0, routesFailed = 0;
+	latencies.reserve(jobs.size());
+
+	for (PATHJOB &job : jobs)
+	{
+		fpathSetBlockingMap(&job);
+		blockingMaps.insert(job.blockingMap.get());
+
+		MOVE_CONTROL move;
+		auto start = std::chrono::steady_clock::now();
+		ASR_RETVAL retval = fpathAStarRoute(contexts, &move, &job, &stats);
+		auto end = std::chrono::steady_clock::now();
+		latencies.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+
+		switch (retval)
+		{
+		case ASR_OK:      ++routesOk;      break;
+		case ASR_NEAREST: ++routesNearest; break;
+		case ASR_FAILED:  ++routesFailed;  break;
+		}
+	}
+
+	size_t contextBytes = 0;
+	for (PathfindContext const &context : contexts)
+	{
+		contextBytes += context.map.capacity() * sizeof(PathExploredTile) + context.nodes.capacity() * sizeof(PathNode) + context.corridor.capacity() / 8;
+	}
+	size_t blockingBytes = 0;
+	for (PathBlockingMap const *blockingMap : blockingMaps)
+	{
+		blockingBytes += blockingMap->map.capacity() / 8;
+	}
+
+	double total = 0;
+	for (double latency : latencies)
+	{
+		total += latency;
+	}
+	std::sort(latencies.begin(), latencies.end());
+	const size_t n = latencies.size();
+
+	fprintf(stdout, "Path benchmark: %u jobs on %dx%d map\n", (unsigned)n, mapWidth, mapHeight);
+	fprintf(stdout, "  routes:         %u ok, %u nearest, %u failed\n", routesOk, routesNearest, routesFailed);
+	fprintf(stdout, "  nodes expanded: %llu (%.1f per job)\n", (unsigned long long)stats.nodesExpanded, (double)stats.nodesExpanded / n);
+	fprintf(stdout, "  latency:        total %.3f ms, mean %.1f us, p50 %.1f us, p99 %.1f us, max %.1f us\n",
+	        total / 1000, total / n, latencies[n * 50 / 100], latencies[std::min(n - 1, n * 99 / 100)], latencies[n - 1]);
+	fprintf(stdout, "  context cache:  %llu hits, %llu misses, %.1f%% hit rate\n", (unsigned long long)stats.contextHits, (unsigned long long)stats.contextMisses,
+	        100.0 * stats.contextHits / std::max<uint64_t>(stats.contextHits + stats.contextMisses, 1));
+	fprintf(stdout, "  memory:         %u contexts, %u KiB, %u blocking maps, %u KiB\n", (unsigned)contexts.size(), (unsigned)(contextBytes / 1024),
+	        (unsigned)blockingMaps.size(), (unsigned)(blockingBytes / 1024));
+	fflush(stdout);
+	return true;
+}
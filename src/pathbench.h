@@ -0,0 +1,48 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/** @file
+ *  Pathfinding benchmark.
+ *
+ *  Path jobs can be recorded while playing (--recordpathjobs=<file>), and replayed on the same map afterwards
+ *  (--pathbench=<file>), or a random workload can be generated for the map (--pathbench=random:<count>[:<seed>]).
+ *  The replay runs the A* of every job in order on the main thread, and reports the nodes expanded, the latency
+ *  percentiles, how often a cached PathfindContext could be continued, and the memory used by the contexts.
+ *
+ *  The benchmark starts once the level is loaded, so a map is chosen as for any other game, for example with
+ *  --skirmish=<settings> --headless.
+ *
+ *  @ingroup pathfinding
+ */
+
+#ifndef __INCLUDED_SRC_PATHBENCH_H__
+#define __INCLUDED_SRC_PATHBENCH_H__
+
+#include <string>
+
+struct PATHJOB;
+
+/// Append the job to the file given by --recordpathjobs, if any. Call from main thread.
+void pathBenchRecordJob(PATHJOB const &job);
+/// Close the file given by --recordpathjobs, if open.
+void pathBenchRecordShutdown();
+
+/// Replay or generate the jobs given by jobs on the current map, and print the results to stdout. Returns false on bad input.
+bool pathBenchRun(std::string const &jobs);
+
+#endif // __INCLUDED_SRC_PATHBENCH_H__
@@ -0,0 +1,146 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/**
+ * @file pathcache.cpp
+ *
+ * Route cache for droids going to the same destination.
+ */
+
+#include "pathcache.h"
+
+#include "astar.h"
+#include "fpath.h"
+#include "map.h"
+#include "movedef.h"
+
+/// Maximum number of cached routes.
+#define PATH_CACHE_SIZE 64
+/// Number of points at the start of a cached route, which a droid may go straight to, to join the route.
+#define PATH_CACHE_SPLICE_POINTS 4
+
+struct PathCacheEntry
+{
+	PathCacheKey key;
+	std::vector<Vector2i> path;
+	uint32_t lastUsed;            ///< For evicting the least recently used route.
+};
+
+static std::vector<PathCacheEntry> pathCache;
+static uint32_t pathCacheCounter = 0;
+
+PathCacheKey pathCacheKey(PATHJOB const &job)
+{
+	PathCacheKey key;
+	key.generation = job.blockingMap->generation;
+	key.region = map_coord(job.origX) / PATH_CLUSTER_SIZE + map_coord(job.origY) / PATH_CLUSTER_SIZE * ((mapWidth + PATH_CLUSTER_SIZE - 1) / PATH_CLUSTER_SIZE);
+	key.dest = Vector2i(job.destX, job.destY);
+	key.dstMap = job.dstStructure.map;
+	key.dstSize = job.dstStructure.size;
+	key.acceptNearest = job.acceptNearest;
+	return key;
+}
+
+/// Checks that a droid could go in a straight line from a to b (in world coordinates), by the same rules as the A* search:
+/// no blocking tile, no cutting corners past a blocking tile, and no dangerous tile, except for the one it starts on.
+/// Unlike the A* search, the structure at the destination blocks too, which only means that fewer routes are reused.
+static bool pathCacheLineClear(PathBlockingMap const &blockingMap, Vector2i a, Vector2i b)
+{
+	auto isBlocked = [&](Vector2i tile) {
+		return tile.x < 0 || tile.y < 0 || tile.x >= mapWidth || tile.y >= mapHeight || blockingMap.map[tile.x + tile.y * mapWidth];
+	};
+
+	const Vector2i delta = b - a;
+	const int steps = std::max(abs(delta.x), abs(delta.y)) / (TILE_UNITS / 4) + 1;  // Steps are short enough to never skip a tile in x or y.
+	const Vector2i start = map_coord(a);
+	Vector2i prev = start;
+	for (int i = 0; i <= steps; ++i)
+	{
+		const Vector2i tile = map_coord(a + delta * i / steps);
+		if (isBlocked(tile))
+		{
+			return false;
+		}
+		if (tile.x != prev.x && tile.y != prev.y && (isBlocked(Vector2i(tile.x, prev.y)) || isBlocked(Vector2i(prev.x, tile.y))))
+		{
+			return false;  // We cannot cut corners.
+		}
+		if (tile != start && blockingMap.dangerMap && blockingMap.dangerMap->ground[tile.x + tile.y * mapWidth])
+		{
+			return false;  // The A* search would rather go around, and the cached route already does.
+		}
+		prev = tile;
+	}
+	return true;
+}
+
+bool pathCacheLookup(PathCacheKey const &key, PATHJOB const &job, MOVE_CONTROL *psMove)
+{
+	auto entry = std::find_if(pathCache.begin(), pathCache.end(), [&](PathCacheEntry const &entry) {
+		return entry.key == key;
+	});
+	if (entry == pathCache.end())
+	{
+		return false;
+	}
+
+	const Vector2i orig(job.origX, job.origY);
+	for (size_t i = std::min<size_t>(entry->path.size(), PATH_CACHE_SPLICE_POINTS); i-- > 0;)
+	{
+		if (pathCacheLineClear(*job.blockingMap, orig, entry->path[i]))
+		{
+			psMove->asPath.assign(entry->path.begin() + i, entry->path.end());
+			psMove->destination = psMove->asPath.back();
+			entry->lastUsed = ++pathCacheCounter;
+			return true;
+		}
+	}
+	return false;
+}
+
+void pathCacheInsert(PathCacheKey const &key, std::vector<Vector2i> const &path)
+{
+	ASSERT_OR_RETURN(, !path.empty(), "Caching empty path");
+
+	auto entry = std::find_if(pathCache.begin(), pathCache.end(), [&](PathCacheEntry const &entry) {
+		return entry.key == key;
+	});
+	if (entry == pathCache.end())
+	{
+		if (pathCache.size() < PATH_CACHE_SIZE)
+		{
+			pathCache.emplace_back();
+			entry = pathCache.end() - 1;
+		}
+		else
+		{
+			entry = std::min_element(pathCache.begin(), pathCache.end(), [](PathCacheEntry const &a, PathCacheEntry const &b) {
+				return a.lastUsed < b.lastUsed;
+			});
+		}
+	}
+	entry->key = key;
+	entry->path = path;
+	entry->lastUsed = ++pathCacheCounter;
+}
+
+void pathCacheClear()
+{
+	pathCache.clear();
+	pathCacheCounter = 0;
+}
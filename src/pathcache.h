@@ -0,0 +1,66 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/** @file
+ *  Cache of recently found routes, shared between droids going to the same place.
+ *
+ *  Routes are keyed on the generation of the blocking map they were found on, the cluster (see pathcluster.h)
+ *  containing the start of the route, and the destination. A droid starting in the same cluster as a cached
+ *  route reuses it, if it can go in a straight line from its position to one of the first few points on the
+ *  route. Since the generation changes whenever the blocking map (or danger map) changes, stale routes are
+ *  never used. All functions must be called from the main thread, so that the cache is the same on all clients.
+ *
+ *  @ingroup pathfinding
+ */
+
+#ifndef __INCLUDED_SRC_PATHCACHE_H__
+#define __INCLUDED_SRC_PATHCACHE_H__
+
+#include "lib/framework/frame.h"
+#include "lib/framework/vector.h"
+
+#include <vector>
+
+struct MOVE_CONTROL;
+struct PATHJOB;
+
+struct PathCacheKey
+{
+	bool operator ==(PathCacheKey const &z) const
+	{
+		return generation == z.generation && region == z.region && dest == z.dest && dstMap == z.dstMap && dstSize == z.dstSize && acceptNearest == z.acceptNearest;
+	}
+
+	uint32_t generation;  ///< Generation of the blocking map.
+	int region;           ///< Cluster containing the start of the route.
+	Vector2i dest;        ///< Destination, in world coordinates.
+	Vector2i dstMap;      ///< Structure at the destination, see PATHJOB::dstStructure.
+	Vector2i dstSize;
+	bool acceptNearest;
+};
+
+/// Returns the key for routes which could be used for the job. psJob->blockingMap must be set.
+PathCacheKey pathCacheKey(PATHJOB const &job);
+/// If a cached route can be used for the job, copies it to psMove and returns true.
+bool pathCacheLookup(PathCacheKey const &key, PATHJOB const &job, MOVE_CONTROL *psMove);
+/// Remembers the route found for a job with the given key.
+void pathCacheInsert(PathCacheKey const &key, std::vector<Vector2i> const &path);
+/// Forgets all routes.
+void pathCacheClear();
+
+#endif // __INCLUDED_SRC_PATHCACHE_H__
@@ -0,0 +1,429 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/** @file
+ *  Hierarchical pathfinding abstraction, see pathcluster.h.
+ */
+
+#include "pathcluster.h"
+
+#include <algorithm>
+#include <mutex>
+#include <unordered_map>
+
+#define PATH_CLUSTER_NO_ROUTE 0xFFFFFFFFu
+
+/// Runs of passable border tiles at least this long get an entrance at each end, shorter runs get one in the middle.
+#define PATH_CLUSTER_LONG_ENTRANCE 8
+
+struct PathCluster
+{
+	std::vector<int>      entrances;  ///< Sorted tile indices (x + y*width) of the entrances inside this cluster.
+	std::vector<unsigned> costs;      ///< entrances.size()² matrix of costs between entrances, or PATH_CLUSTER_NO_ROUTE.
+};
+
+/// Same costs as used by the tile level A*, 140 for orthogonal moves and 198 for diagonal moves.
+static inline unsigned pathClusterEstimate(int x1, int y1, int x2, int y2)
+{
+	unsigned xDelta = abs(x1 - x2), yDelta = abs(y1 - y2);
+	return std::min(xDelta, yDelta) * (198 - 140) + std::max(xDelta, yDelta) * 140;
+}
+
+PathClusterGraph::PathClusterGraph(std::vector<bool> const &blocking_, int width_, int height_)
+	: blocking(blocking_)
+	, width(width_)
+	, height(height_)
+	, clustersX((width_ + PATH_CLUSTER_SIZE - 1) / PATH_CLUSTER_SIZE)
+	, clustersY((height_ + PATH_CLUSTER_SIZE - 1) / PATH_CLUSTER_SIZE)
+	, built(false)
+{}
+
+PathClusterGraph::~PathClusterGraph()
+{}
+
+std::shared_ptr<PathClusterGraph> pathClusterGraphCreate(std::vector<bool> const &blocking, int width, int height, std::shared_ptr<PathClusterGraph> const &previous)
+{
+	std::shared_ptr<PathClusterGraph> graph = std::make_shared<PathClusterGraph>(blocking, width, height);
+	if (previous != nullptr && previous->width == width && previous->height == height)
+	{
+		// If nobody has needed the previous graph yet, it was never built, so use the graph it would have been built from instead.
+		// This way, there is never a chain of more than two graphs, no matter how many ticks pass between long routes.
+		std::lock_guard<wz::mutex> lock(previous->buildMutex);
+		graph->base = previous->built ? previous : previous->base;
+	}
+	return graph;
+}
+
+/// Computes the distance from (x, y) to every tile in the cluster, without leaving the cluster.
+void PathClusterGraph::clusterDistances(int cluster, int x, int y, std::vector<unsigned> &dist) const
+{
+	int x0 = cluster % clustersX * PATH_CLUSTER_SIZE;
+	int y0 = cluster / clustersX * PATH_CLUSTER_SIZE;
+	int x1 = std::min(x0 + PATH_CLUSTER_SIZE, width);
+	int y1 = std::min(y0 + PATH_CLUSTER_SIZE, height);
+	auto isOpen = [&](int tx, int ty) {
+		return tx >= x0 && ty >= y0 && tx < x1 && ty < y1 && !isBlocked(tx, ty);
+	};
+	auto local = [&](int tx, int ty) {
+		return tx - x0 + (ty - y0) * PATH_CLUSTER_SIZE;
+	};
+
+	dist.assign(PATH_CLUSTER_SIZE * PATH_CLUSTER_SIZE, PATH_CLUSTER_NO_ROUTE);
+	if (!isOpen(x, y))
+	{
+		return;
+	}
+
+	typedef std::pair<unsigned, int> Node;  // Distance and local tile index, smallest distance first.
+	std::vector<Node> heap;
+	dist[local(x, y)] = 0;
+	heap.push_back(Node(0, local(x, y)));
+	while (!heap.empty())
+	{
+		std::pop_heap(heap.begin(), heap.end(), std::greater<Node>());
+		Node node = heap.back();
+		heap.pop_back();
+		if (node.first != dist[node.second])
+		{
+			continue;  // Already found a shorter way here.
+		}
+		int nx = x0 + node.second % PATH_CLUSTER_SIZE;
+		int ny = y0 + node.second / PATH_CLUSTER_SIZE;
+		for (int dy = -1; dy <= 1; ++dy)
+			for (int dx = -1; dx <= 1; ++dx)
+			{
+				if ((dx == 0 && dy == 0) || !isOpen(nx + dx, ny + dy))
+				{
+					continue;
+				}
+				if (dx != 0 && dy != 0 && (!isOpen(nx + dx, ny) || !isOpen(nx, ny + dy)))
+				{
+					continue;  // We cannot cut corners.
+				}
+				unsigned newDist = node.first + (dx != 0 && dy != 0 ? 198 : 140);
+				unsigned &oldDist = dist[local(nx + dx, ny + dy)];
+				if (newDist < oldDist)
+				{
+					oldDist = newDist;
+					heap.push_back(Node(newDist, local(nx + dx, ny + dy)));
+					std::push_heap(heap.begin(), heap.end(), std::greater<Node>());
+				}
+			}
+	}
+}
+
+std::shared_ptr<PathCluster const> PathClusterGraph::buildCluster(int cluster) const
+{
+	std::shared_ptr<PathCluster> psCluster = std::make_shared<PathCluster>();
+
+	int x0 = cluster % clustersX * PATH_CLUSTER_SIZE;
+	int y0 = cluster / clustersX * PATH_CLUSTER_SIZE;
+	int x1 = std::min(x0 + PATH_CLUSTER_SIZE, width);
+	int y1 = std::min(y0 + PATH_CLUSTER_SIZE, height);
+
+	// Scan each side of the cluster for runs of tiles which are passable on both sides of the border. The neighbouring
+	// cluster scans the same pairs of tiles in the same order, so it places its entrances directly opposite ours.
+	auto scanSide = [&](int sx, int sy, int stepX, int stepY, int acrossX, int acrossY, int length) {
+		int runStart = -1;
+		for (int i = 0; i <= length; ++i)
+		{
+			int x = sx + stepX * i, y = sy + stepY * i;
+			bool open = i < length && !isBlocked(x, y) && !isBlocked(x + acrossX, y + acrossY);
+			if (open && runStart < 0)
+			{
+				runStart = i;
+			}
+			else if (!open && runStart >= 0)
+			{
+				int runEnd = i - 1;
+				if (runEnd - runStart + 1 >= PATH_CLUSTER_LONG_ENTRANCE)
+				{
+					psCluster->entrances.push_back(sx + stepX * runStart + (sy + stepY * runStart) * width);
+					psCluster->entrances.push_back(sx + stepX * runEnd + (sy + stepY * runEnd) * width);
+				}
+				else
+				{
+					int mid = (runStart + runEnd) / 2;
+					psCluster->entrances.push_back(sx + stepX * mid + (sy + stepY * mid) * width);
+				}
+				runStart = -1;
+			}
+		}
+	};
+	if (x0 > 0)
+	{
+		scanSide(x0, y0, 0, 1, -1, 0, y1 - y0);          // Left.
+	}
+	if (x1 < width)
+	{
+		scanSide(x1 - 1, y0, 0, 1, 1, 0, y1 - y0);      // Right.
+	}
+	if (y0 > 0)
+	{
+		scanSide(x0, y0, 1, 0, 0, -1, x1 - x0);          // Top.
+	}
+	if (y1 < height)
+	{
+		scanSide(x0, y1 - 1, 1, 0, 0, 1, x1 - x0);      // Bottom.
+	}
+	std::sort(psCluster->entrances.begin(), psCluster->entrances.end());
+	psCluster->entrances.erase(std::unique(psCluster->entrances.begin(), psCluster->entrances.end()), psCluster->entrances.end());
+
+	// Find the costs between each pair of entrances.
+	size_t numEntrances = psCluster->entrances.size();
+	psCluster->costs.resize(numEntrances * numEntrances);
+	std::vector<unsigned> dist;
+	for (size_t a = 0; a < numEntrances; ++a)
+	{
+		int tile = psCluster->entrances[a];
+		clusterDistances(cluster, tile % width, tile / width, dist);
+		for (size_t b = 0; b < numEntrances; ++b)
+		{
+			int other = psCluster->entrances[b];
+			psCluster->costs[a * numEntrances + b] = dist[other % width - x0 + (other / width - y0) * PATH_CLUSTER_SIZE];
+		}
+	}
+
+	return psCluster;
+}
+
+void PathClusterGraph::build()
+{
+	int numClusters = clustersX * clustersY;
+	std::vector<bool> dirty(numClusters, true);
+
+	if (base != nullptr)
+	{
+		// Only recompute clusters containing changed tiles, and their neighbours, since they share entrances.
+		clusters = base->clusters;
+		std::fill(dirty.begin(), dirty.end(), false);
+		if (blocking != base->blocking)
+		{
+			for (int y = 0; y < height; ++y)
+				for (int x = 0; x < width; ++x)
+				{
+					if (blocking[x + y * width] == base->blocking[x + y * width])
+					{
+						continue;
+					}
+					int cx = x / PATH_CLUSTER_SIZE, cy = y / PATH_CLUSTER_SIZE;
+					dirty[cx + cy * clustersX] = true;
+					if (cx > 0)
+					{
+						dirty[cx - 1 + cy * clustersX] = true;
+					}
+					if (cx < clustersX - 1)
+					{
+						dirty[cx + 1 + cy * clustersX] = true;
+					}
+					if (cy > 0)
+					{
+						dirty[cx + (cy - 1) * clustersX] = true;
+					}
+					if (cy < clustersY - 1)
+					{
+						dirty[cx + (cy + 1) * clustersX] = true;
+					}
+				}
+		}
+	}
+	else
+	{
+		clusters.resize(numClusters);
+	}
+
+	for (int cluster = 0; cluster < numClusters; ++cluster)
+	{
+		if (dirty[cluster])
+		{
+			clusters[cluster] = buildCluster(cluster);
+		}
+	}
+	base.reset();
+}
+
+void PathClusterGraph::ensureBuilt()
+{
+	if (built)
+	{
+		return;
+	}
+	std::lock_guard<wz::mutex> lock(buildMutex);
+	if (!built)
+	{
+		if (base != nullptr)
+		{
+			base->ensureBuilt();  // Should already be built, see pathClusterGraphCreate.
+		}
+		build();
+		built = true;
+	}
+}
+
+int PathClusterGraph::entranceIndex(int cluster, int tile) const
+{
+	std::vector<int> const &entrances = clusters[cluster]->entrances;
+	auto i = std::lower_bound(entrances.begin(), entrances.end(), tile);
+	return i != entrances.end() && *i == tile ? i - entrances.begin() : -1;
+}
+
+bool PathClusterGraph::findCorridor(int origX, int origY, int destX, int destY, std::vector<bool> &corridor)
+{
+	if (isBlocked(origX, origY) || isBlocked(destX, destY))
+	{
+		return false;
+	}
+	ensureBuilt();
+
+	const int startCluster = clusterIndex(origX, origY);
+	const int goalCluster = clusterIndex(destX, destY);
+	const int goalTile = -1;  // Entrances are identified by tile index, so the destination gets an index which can't be a tile.
+	const int startTile = -2;
+
+	std::vector<unsigned> startDist, goalDist;
+	clusterDistances(startCluster, origX, origY, startDist);
+	clusterDistances(goalCluster, destX, destY, goalDist);
+	auto localIndex = [&](int cluster, int tile) {
+		return tile % width - cluster % clustersX * PATH_CLUSTER_SIZE + (tile / width - cluster / clustersX * PATH_CLUSTER_SIZE) * PATH_CLUSTER_SIZE;
+	};
+
+	struct Node
+	{
+		bool operator <(Node const &z) const
+		{
+			// Sort descending est, fallback to ascending dist, fallback to sorting by tile, same as the tile level PathNode.
+			if (est != z.est)
+			{
+				return est > z.est;
+			}
+			if (dist != z.dist)
+			{
+				return dist < z.dist;
+			}
+			return tile < z.tile;
+		}
+
+		unsigned est, dist;
+		int tile;
+	};
+	struct Explored
+	{
+		unsigned dist;
+		int parent;
+		bool visited;
+	};
+	std::vector<Node> heap;
+	std::unordered_map<int, Explored> explored;
+
+	auto addNode = [&](int tile, unsigned dist, int parent) {
+		auto i = explored.find(tile);
+		if (i != explored.end() && (i->second.visited || i->second.dist <= dist))
+		{
+			return;
+		}
+		explored[tile] = Explored{dist, parent, false};
+		unsigned est = dist;
+		if (tile >= 0)
+		{
+			est += pathClusterEstimate(tile % width, tile / width, destX, destY);
+		}
+		heap.push_back(Node{est, dist, tile});
+		std::push_heap(heap.begin(), heap.end());
+	};
+
+	PathCluster const &start = *clusters[startCluster];
+	for (int tile : start.entrances)
+	{
+		unsigned dist = startDist[localIndex(startCluster, tile)];
+		if (dist != PATH_CLUSTER_NO_ROUTE)
+		{
+			addNode(tile, dist, startTile);
+		}
+	}
+
+	bool found = false;
+	while (!heap.empty())
+	{
+		std::pop_heap(heap.begin(), heap.end());
+		Node node = heap.back();
+		heap.pop_back();
+		Explored &expl = explored[node.tile];
+		if (expl.visited)
+		{
+			continue;
+		}
+		expl.visited = true;
+		if (node.tile == goalTile)
+		{
+			found = true;
+			break;
+		}
+
+		int x = node.tile % width, y = node.tile / width;
+		int cluster = clusterIndex(x, y);
+		PathCluster const &psCluster = *clusters[cluster];
+		int index = entranceIndex(cluster, node.tile);
+		ASSERT_OR_RETURN(false, index >= 0, "Explored a tile which is not an entrance");
+
+		if (cluster == goalCluster)
+		{
+			unsigned dist = goalDist[localIndex(goalCluster, node.tile)];
+			if (dist != PATH_CLUSTER_NO_ROUTE)
+			{
+				addNode(goalTile, node.dist + dist, node.tile);
+			}
+		}
+
+		// Move to other entrances of the same cluster.
+		size_t numEntrances = psCluster.entrances.size();
+		for (size_t other = 0; other < numEntrances; ++other)
+		{
+			unsigned cost = psCluster.costs[index * numEntrances + other];
+			if ((int)other != index && cost != PATH_CLUSTER_NO_ROUTE)
+			{
+				addNode(psCluster.entrances[other], node.dist + cost, node.tile);
+			}
+		}
+
+		// Cross the border to the entrance opposite this one.
+		static const int dirs[4][2] = {{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
+		for (auto const &dir : dirs)
+		{
+			int nx = x + dir[0], ny = y + dir[1];
+			if (isBlocked(nx, ny) || clusterIndex(nx, ny) == cluster || entranceIndex(clusterIndex(nx, ny), nx + ny * width) < 0)
+			{
+				continue;
+			}
+			addNode(nx + ny * width, node.dist + 140, node.tile);
+		}
+	}
+
+	if (!found)
+	{
+		return false;
+	}
+
+	corridor.assign(numClusters(), false);
+	corridor[startCluster] = true;
+	corridor[goalCluster] = true;
+	for (int tile = explored[goalTile].parent; tile != startTile; tile = explored[tile].parent)
+	{
+		corridor[clusterIndex(tile % width, tile / width)] = true;
+	}
+	return true;
+}
@@ -0,0 +1,106 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/** @file
+ *  Hierarchical pathfinding abstraction.
+ *
+ *  The map is divided into square clusters of PATH_CLUSTER_SIZE tiles. Where two neighbouring clusters share
+ *  a passable border, entrances are placed on both sides of it, and the cost of moving between any two
+ *  entrances of the same cluster (without leaving the cluster) is precomputed. Long routes are first planned
+ *  on this small graph, and the tile level A* is then only allowed to explore the clusters which the abstract
+ *  route passes through, so the resulting path keeps the usual tile level format.
+ *
+ *  A graph is built lazily, by the first pathfinding thread which needs it, and is immutable afterwards. When
+ *  the blocking map changes (structures built or destroyed, gates, scroll limits), only the clusters with
+ *  changed tiles and their neighbours are recomputed, everything else is shared with the previous graph.
+ *
+ *  @ingroup pathfinding
+ */
+
+#ifndef __INCLUDED_SRC_PATHCLUSTER_H__
+#define __INCLUDED_SRC_PATHCLUSTER_H__
+
+#include "lib/framework/frame.h"
+#include "lib/framework/wzapp.h"
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#define PATH_CLUSTER_SIZE 16
+
+struct PathCluster;
+
+class PathClusterGraph
+{
+public:
+	PathClusterGraph(std::vector<bool> const &blocking, int width, int height);
+	~PathClusterGraph();
+
+	PathClusterGraph(PathClusterGraph const &) = delete;
+	PathClusterGraph &operator =(PathClusterGraph const &) = delete;
+
+	/// Returns the index of the cluster containing the given tile.
+	int clusterIndex(int x, int y) const
+	{
+		return x / PATH_CLUSTER_SIZE + y / PATH_CLUSTER_SIZE * clustersX;
+	}
+	int numClusters() const
+	{
+		return clustersX * clustersY;
+	}
+
+	/** Plans an abstract route from orig to dest, and marks each cluster it passes through in corridor.
+	 *
+	 *  Returns false if the abstract route could not be found, in which case the caller should fall back to
+	 *  searching the whole map (the destination may be unreachable, and the nearest reachable tile is needed).
+	 *  Function is thread-safe.
+	 */
+	bool findCorridor(int origX, int origY, int destX, int destY, std::vector<bool> &corridor);
+
+private:
+	bool isBlocked(int x, int y) const
+	{
+		return x < 0 || y < 0 || x >= width || y >= height || blocking[x + y * width];
+	}
+	void ensureBuilt();
+	void build();
+	std::shared_ptr<PathCluster const> buildCluster(int cluster) const;
+	void clusterDistances(int cluster, int x, int y, std::vector<unsigned> &dist) const;
+	int entranceIndex(int cluster, int tile) const;
+
+	std::vector<bool> blocking;  ///< Copy of the blocking map this graph was made from.
+	int width, height;           ///< Size of the map, in tiles.
+	int clustersX, clustersY;    ///< Size of the map, in clusters.
+	std::vector<std::shared_ptr<PathCluster const>> clusters;
+
+	wz::mutex buildMutex;
+	std::atomic<bool> built;
+	std::shared_ptr<PathClusterGraph> base;  ///< Previous graph for the same propulsion, to copy unchanged clusters from. Reset once built.
+
+	friend std::shared_ptr<PathClusterGraph> pathClusterGraphCreate(std::vector<bool> const &blocking, int width, int height, std::shared_ptr<PathClusterGraph> const &previous);
+};
+
+/** Creates the graph for a new blocking map. Call from main thread.
+ *
+ *  previous should be the most recently created graph for an equivalent blocking map (or nullptr), so that
+ *  clusters whose tiles did not change can be reused instead of being recomputed.
+ */
+std::shared_ptr<PathClusterGraph> pathClusterGraphCreate(std::vector<bool> const &blocking, int width, int height, std::shared_ptr<PathClusterGraph> const &previous);
+
+#endif // __INCLUDED_SRC_PATHCLUSTER_H__
@@ -77,9 +77,9 @@ static uint64_t interleave(int32_t x, int32_t y)
 	return expandX(x) | expandY(y);
 }
 
-void PointTree::insert(void *pointData, int32_t x, int32_t y)
+void PointTree::insert(void *pointData, int32_t x, int32_t y, uint32_t order)
 {
-	points.push_back(Point(interleave(x, y), pointData));
+	points.push_back({interleave(x, y), order, pointData});
 }
 
 void PointTree::clear()
@@ -87,14 +87,30 @@ void PointTree::clear()
 	points.clear();
 }
 
-static bool pointTreeSortFunction(std::pair<uint64_t, void *> const &a, std::pair<uint64_t, void *> const &b)
+void PointTree::insertSorted(void *pointData, int32_t x, int32_t y, uint32_t order)
 {
-	return a.first < b.first;  // Sort only by position, not by pointer address, even if two units are in the same place.
+	Point point = {interleave(x, y), order, pointData};
+	points.insert(std::upper_bound(points.begin(), points.end(), point), point);  // Sort by order, not by pointer address, even if two units are in the same place.
+}
+
+bool PointTree::erase(void *pointData, int32_t x, int32_t y)
+{
+	const uint64_t key = interleave(x, y);
+	auto keyLess = [](Point const &p, uint64_t k) { return p.key < k; };
+	for (Vector::iterator i = std::lower_bound(points.begin(), points.end(), key, keyLess); i != points.end() && i->key == key; ++i)
+	{
+		if (i->data == pointData)
+		{
+			points.erase(i);
+			return true;
+		}
+	}
+	return false;  // Not where it was inserted, so the caller has lost track of it.
 }
 
 void PointTree::sort()
 {
-	std::stable_sort(points.begin(), points.end(), pointTreeSortFunction);  // Stable sort to avoid unspecified behaviour when two objects are in exactly the same place.
+	std::sort(points.begin(), points.end());  // Sort by order, not by pointer address, even if two units are in the same place.
 }
 
 //#define DUMP_IMAGE  // All x and y coordinates must be in range -500 to 499, if dumping an image.
@@ -128,8 +144,7 @@ static unsigned current(std::vector<unsigned> &filterData, unsigned i)
 	return ret;
 }
 
-template<bool IsFiltered>
-PointTree::ResultVector &PointTree::queryMaybeFilter(Filter &filter, int32_t minXo, int32_t minYo, int32_t maxXo, int32_t maxYo)
+PointTree::Ranges PointTree::findRanges(int32_t minXo, int32_t minYo, int32_t maxXo, int32_t maxYo) const
 {
 	uint64_t minX = expandX(minXo);
 	uint64_t maxX = expandX(maxXo);
@@ -225,24 +240,38 @@ PointTree::ResultVector &PointTree::queryMaybeFilter(Filter &filter, int32_t min
 		--numRanges;
 	}
 
+	Ranges ret;
+	ret.minX = minX;
+	ret.maxX = maxX;
+	ret.minY = minY;
+	ret.maxY = maxY;
+	ret.numRanges = numRanges;
+	for (int r = 0; r != numRanges; ++r)
+	{
+		// Find range of points which may be close enough. Range is [i1 ... i2 - 1]. The pointers are ignored when searching.
+		ret.begin[r] = std::lower_bound(points.begin(),                points.end(), ranges[r].a, [](Point const &p, uint64_t k) { return p.key < k; }) - points.begin();
+		ret.end[r]   = std::upper_bound(points.begin() + ret.begin[r], points.end(), ranges[r].z, [](uint64_t k, Point const &p) { return k < p.key; }) - points.begin();
+	}
+	return ret;
+}
+
+template<bool IsFiltered>
+PointTree::ResultVector &PointTree::queryMaybeFilter(Filter &filter, int32_t minXo, int32_t minYo, int32_t maxXo, int32_t maxYo)
+{
+	Ranges ranges = findRanges(minXo, minYo, maxXo, maxYo);
+
 	lastQueryResults.clear();
 	if (IsFiltered)
 	{
 		lastFilteredQueryIndices.clear();
 	}
-	for (int r = 0; r != numRanges; ++r)
+	for (int r = 0; r != ranges.numRanges; ++r)
 	{
-		// Find range of points which may be close enough. Range is [i1 ... i2 - 1]. The pointers are ignored when searching.
-		unsigned i1 = std::lower_bound(points.begin(),      points.end(), Point(ranges[r].a, (void *)nullptr), pointTreeSortFunction) - points.begin();
-		unsigned i2 = std::upper_bound(points.begin() + i1, points.end(), Point(ranges[r].z, (void *)nullptr), pointTreeSortFunction) - points.begin();
-
-		for (unsigned i = current<IsFiltered>(filter.data, i1); i < i2; i = current<IsFiltered>(filter.data, i + 1))
+		for (unsigned i = current<IsFiltered>(filter.data, ranges.begin[r]); i < ranges.end[r]; i = current<IsFiltered>(filter.data, i + 1))
 		{
-			uint64_t px = points[i].first & 0xAAAAAAAAAAAAAAAAULL;
-			uint64_t py = points[i].first & 0x5555555555555555ULL;
-			if (px >= minX && px <= maxX && py >= minY && py <= maxY)  // Only add point if it's at least in the desired square.
+			if (ranges.contains(points[i].key))  // Only add point if it's at least in the desired square.
 			{
-				lastQueryResults.push_back(points[i].second);
+				lastQueryResults.push_back(points[i].data);
 				if (IsFiltered)
 				{
 					lastFilteredQueryIndices.push_back(i);
@@ -250,9 +279,9 @@ PointTree::ResultVector &PointTree::queryMaybeFilter(Filter &filter, int32_t min
 #ifdef DUMP_IMAGE
 				if (doDump)
 				{
-					ppm[((int32_t *)points[i].second)[1] + 500][((int32_t *)points[i].second)[0] + 500][0] = 192;
-					ppm[((int32_t *)points[i].second)[1] + 500][((int32_t *)points[i].second)[0] + 500][1] = 128;
-					ppm[((int32_t *)points[i].second)[1] + 500][((int32_t *)points[i].second)[0] + 500][2] = 0;
+					ppm[((int32_t *)points[i].data)[1] + 500][((int32_t *)points[i].data)[0] + 500][0] = 192;
+					ppm[((int32_t *)points[i].data)[1] + 500][((int32_t *)points[i].data)[0] + 500][1] = 128;
+					ppm[((int32_t *)points[i].data)[1] + 500][((int32_t *)points[i].data)[0] + 500][2] = 0;
 				}
 #endif //DUMP_IMAGE
 			}
@@ -52,9 +52,17 @@ public:
 		Data data;
 	};
 
-	void insert(void *pointData, int32_t x, int32_t y);                       ///< Inserts a point into the point tree.
+	// Points are sorted by position in Z-order, and points at the same position by order, so that query results don't
+	// depend on the order in which the points were inserted.
+	void insert(void *pointData, int32_t x, int32_t y, uint32_t order);       ///< Inserts a point into the point tree.
+	void insertSorted(void *pointData, int32_t x, int32_t y, uint32_t order); ///< Inserts a point into an already sorted point tree.
+	bool erase(void *pointData, int32_t x, int32_t y);                        ///< Removes a point from a sorted point tree. Returns false if the point wasn't found at (x, y).
 	void clear();                                                             ///< Clears the PointTree.
 	void sort();                                                              ///< Must be done between inserting and querying, to get meaningful results.
+	size_t size() const                                                       ///< Number of points in the tree.
+	{
+		return points.size();
+	}
 	/// Returns all points less than or equal to radius from (x, y), possibly plus some extra nearby points.
 	/// (More specifically, returns all objects in a square with edge length 2*radius.)
 	/// Note: Not thread safe, because it modifies lastQueryResults.
@@ -66,15 +74,166 @@ public:
 	/// Returns all points which have not been filtered away within given rectangle. See function above on thread safety.
 	ResultVector &query(int32_t x, int32_t y, uint32_t x2, uint32_t y2);
 
+	/// Calls func(pointData) for all points less than or equal to radius from (x, y), possibly plus some extra nearby points, in the same order as query() would return them.
+	/// Thread safe, as long as the PointTree isn't modified at the same time.
+	template<class Function>
+	void forEach(int32_t x, int32_t y, uint32_t radius, Function &&func) const
+	{
+		forEachInRanges(findRanges(x - radius, y - radius, x + radius, y + radius), func);
+	}
+	/// Calls func(pointData) for all points within given rectangle. Thread safe, as long as the PointTree isn't modified at the same time.
+	template<class Function>
+	void forEach(int32_t x, int32_t y, int32_t x2, int32_t y2, Function &&func) const
+	{
+		forEachInRanges(findRanges(x, y, x2, y2), func);
+	}
+	/// Same as forEach, but for the points of several trees together, in the order they would have been in a single tree.
+	template<class Function>
+	static void forEachMerged(PointTree const *const *trees, unsigned numTrees, int32_t x, int32_t y, uint32_t radius, Function &&func)
+	{
+		forEachMergedInRanges(trees, numTrees, x - radius, y - radius, x + radius, y + radius, func);
+	}
+	template<class Function>
+	static void forEachMerged(PointTree const *const *trees, unsigned numTrees, int32_t x, int32_t y, int32_t x2, int32_t y2, Function &&func)
+	{
+		forEachMergedInRanges(trees, numTrees, x, y, x2, y2, func);
+	}
+	static const unsigned MAX_MERGED_TREES = 4;
+
 	ResultVector lastQueryResults;
 	IndexVector lastFilteredQueryIndices;
 
 private:
-	typedef std::pair<uint64_t, void *> Point;
+	struct Point
+	{
+		bool operator <(Point const &z) const
+		{
+			return key < z.key || (key == z.key && order < z.order);
+		}
+
+		uint64_t key;    ///< Interleaved coordinates.
+		uint32_t order;  ///< Tie-breaker for points at the same position.
+		void *data;
+	};
 	typedef std::vector<Point> Vector;
 
+	/// Ranges of sorted points which may be in a square, and the bounds of that square in interleaved coordinates.
+	struct Ranges
+	{
+		bool contains(uint64_t n) const
+		{
+			uint64_t px = n & 0xAAAAAAAAAAAAAAAAULL;
+			uint64_t py = n & 0x5555555555555555ULL;
+			return px >= minX && px <= maxX && py >= minY && py <= maxY;
+		}
+
+		uint64_t minX, maxX, minY, maxY;
+		unsigned begin[4], end[4];  ///< Range r is [begin[r] ... end[r] - 1].
+		int numRanges;
+	};
+
+	Ranges findRanges(int32_t minXo, int32_t minYo, int32_t maxXo, int32_t maxYo) const;
+
+	template<class Function>
+	void forEachInRanges(Ranges const &ranges, Function &func) const
+	{
+		for (int r = 0; r != ranges.numRanges; ++r)
+		{
+			for (unsigned i = ranges.begin[r]; i < ranges.end[r]; ++i)
+			{
+				if (ranges.contains(points[i].key))  // Only visit point if it's at least in the desired square.
+				{
+					func(points[i].data);
+				}
+			}
+		}
+	}
+
+	/// Walks through the points of a tree in a square, in sorted order, see forEachMerged.
+	struct Cursor
+	{
+		void start(PointTree const *tree_, Ranges const &ranges_)
+		{
+			tree = tree_;
+			ranges = ranges_;
+			r = 0;
+			i = ranges.numRanges > 0 ? ranges.begin[0] : 0;
+			skip();
+		}
+		bool done() const
+		{
+			return r >= ranges.numRanges;
+		}
+		Point const &point() const
+		{
+			return tree->points[i];
+		}
+		void next()
+		{
+			++i;
+			skip();
+		}
+		void skip()  ///< Moves to the first point in the square, starting at the current one.
+		{
+			while (r < ranges.numRanges)
+			{
+				if (i >= ranges.end[r])
+				{
+					if (++r < ranges.numRanges)
+					{
+						i = ranges.begin[r];
+					}
+				}
+				else if (ranges.contains(tree->points[i].key))
+				{
+					return;
+				}
+				else
+				{
+					++i;
+				}
+			}
+		}
+
+		PointTree const *tree;
+		Ranges ranges;
+		int r;
+		unsigned i;
+	};
+
+	template<class Function>
+	static void forEachMergedInRanges(PointTree const *const *trees, unsigned numTrees, int32_t minX, int32_t minY, int32_t maxX, int32_t maxY, Function &func)
+	{
+		Cursor cursors[MAX_MERGED_TREES];
+		if (numTrees > MAX_MERGED_TREES)
+		{
+			numTrees = MAX_MERGED_TREES;
+		}
+		for (unsigned t = 0; t < numTrees; ++t)
+		{
+			cursors[t].start(trees[t], trees[t]->findRanges(minX, minY, maxX, maxY));
+		}
+		while (true)
+		{
+			Cursor *best = nullptr;
+			for (unsigned t = 0; t < numTrees; ++t)
+			{
+				if (!cursors[t].done() && (best == nullptr || cursors[t].point() < best->point()))
+				{
+					best = &cursors[t];
+				}
+			}
+			if (best == nullptr)
+			{
+				return;
+			}
+			func(best->point().data);
+			best->next();
+		}
+	}
+
 	template<bool IsFiltered>
-	ResultVector &queryMaybeFilter(Filter &filter, int32_t minXo, int32_t maxXo, int32_t minYo, int32_t maxYo);
+	ResultVector &queryMaybeFilter(Filter &filter, int32_t minXo, int32_t minYo, int32_t maxXo, int32_t maxYo);
 
 	Vector points;
 };
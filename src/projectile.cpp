@@ -29,6 +29,7 @@
 #include "lib/framework/trig.h"
 #include "lib/framework/fixedpoint.h"
 #include "lib/framework/math_ext.h"
+#include "lib/framework/wzprofile.h"
 #include "lib/gamelib/gtime.h"
 #include "lib/sound/audio_id.h"
 #include "lib/sound/audio.h"
@@ -60,6 +61,7 @@
 
 #include <algorithm>
 #include <functional>
+#include <unordered_map>
 #ifndef GLM_ENABLE_EXPERIMENTAL
 	#define GLM_ENABLE_EXPERIMENTAL
 #endif
@@ -92,6 +94,8 @@ struct DAMAGE
 // Watermelon:they are from droid.c
 /* The range for neighbouring objects */
 #define PROJ_NEIGHBOUR_RANGE (TILE_UNITS*4)
+/* Size of the cells projectile paths are grouped by, when looking for objects they might hit */
+#define PROJ_BROADPHASE_CELL (TILE_UNITS*8)
 // used to create a specific ID for projectile objects to facilitate tracking them.
 static const uint32_t ProjectileTrackerID = 0xdead0000;
 static uint32_t projectileTrackerIDIncrement = 0;
@@ -109,9 +113,9 @@ BASE_OBJECT		*g_pProjLastAttacker;
 
 /***************************************************************************/
 
-static void	proj_ImpactFunc(PROJECTILE *psObj);
-static void	proj_PostImpactFunc(PROJECTILE *psObj);
-static void proj_checkPeriodicalDamage(PROJECTILE *psProj);
+static void	proj_ImpactFunc(PROJECTILE *psObj, GridList &gridList);
+static void	proj_PostImpactFunc(PROJECTILE *psObj, GridList &gridList);
+static void proj_checkPeriodicalDamage(PROJECTILE *psProj, GridList &gridList);
 
 static int32_t objectDamage(DAMAGE *psDamage);
 
@@ -679,13 +683,33 @@ static int32_t collisionXYZ(Vector3i v1, Vector3i v2, ObjectShape shape, int32_t
 	return -1;
 }
 
-static void proj_InFlightFunc(PROJECTILE *psProj)
+/// Collision data of an object which projectiles may hit, computed once per tick by proj_Broadphase().
+struct ProjectileTarget
+{
+	BASE_OBJECT *psObj;
+	Vector3i     pos, prevPos;
+	ObjectShape  shape;
+	int32_t      height;
+	Vector2i     min, max;          ///< Bounding box of the object, over its movement this tick.
+};
+
+/// Movement of a projectile this tick, filled in by proj_UpdateStart().
+struct ProjectileSweep
+{
+	PROJECTILE *psProj;
+	int32_t     currentDistance;    ///< Distance travelled since being fired.
+	bool        inFlight;           ///< True if moved this tick, so needs checking for collisions.
+	Vector2i    min, max;           ///< Bounding box of the path from prevSpacetime.pos to pos.
+	unsigned    firstCandidate;     ///< Index into the candidate list of the first object near the path.
+	unsigned    numCandidates;
+};
+
+/// Moves an in-flight projectile. Returns false if it's not moving yet, or is invalid.
+static bool proj_InFlightMove(PROJECTILE *psProj, int32_t &currentDistance)
 {
 	/* we want a delay between Las-Sats firing and actually hitting in multiPlayer
 	magic number but that's how long the audio countdown message lasts! */
 	const unsigned int LAS_SAT_DELAY = 4;
-	BASE_OBJECT *closestCollisionObject = nullptr;
-	Spacetime closestCollisionSpacetime;
 
 	CHECK_PROJECTILE(psProj);
 
@@ -695,18 +719,18 @@ static void proj_InFlightFunc(PROJECTILE *psProj)
 	int deltaProjectileTime = psProj->time - psProj->prevSpacetime.time;
 
 	WEAPON_STATS *psStats = psProj->psWStats;
-	ASSERT_OR_RETURN(, psStats != nullptr, "Invalid weapon stats pointer");
+	ASSERT_OR_RETURN(false, psStats != nullptr, "Invalid weapon stats pointer");
 
 	/* we want a delay between Las-Sats firing and actually hitting in multiPlayer
 	magic number but that's how long the audio countdown message lasts! */
 	if (bMultiPlayer && psStats->weaponSubClass == WSC_LAS_SAT &&
 	    (unsigned)timeSoFar < LAS_SAT_DELAY * GAME_TICKS_PER_SEC)
 	{
-		return;
+		return false;
 	}
 
 	/* Calculate movement vector: */
-	int32_t currentDistance = 0;
+	currentDistance = 0;
 	switch (psStats->movementModel)
 	{
 	case MM_DIRECT:           // Go in a straight line.
@@ -798,14 +822,24 @@ static void proj_InFlightFunc(PROJECTILE *psProj)
 		}
 	}
 
+	return true;
+}
+
+/// Checks a moved projectile for collisions with the objects found near its path, and with the terrain.
+static void proj_InFlightCollide(PROJECTILE *psProj, int32_t currentDistance, std::vector<ProjectileTarget> const &targets, unsigned const *candidates, unsigned numCandidates)
+{
+	BASE_OBJECT *closestCollisionObject = nullptr;
+	Spacetime closestCollisionSpacetime;
+
+	WEAPON_STATS *psStats = psProj->psWStats;
+
 	closestCollisionSpacetime.time = 0xFFFFFFFF;
 
-	/* Check nearby objects for possible collisions */
-	static GridList gridList;  // static to avoid allocations.
-	gridList = gridStartIterate(psProj->pos.x, psProj->pos.y, PROJ_NEIGHBOUR_RANGE);
-	for (GridIterator gi = gridList.begin(); gi != gridList.end(); ++gi)
+	/* Check nearby objects for possible collisions, in the order found, so that ties are broken the same way everywhere */
+	for (unsigned n = 0; n < numCandidates; ++n)
 	{
-		BASE_OBJECT *psTempObj = *gi;
+		ProjectileTarget const &target = targets[candidates[n]];
+		BASE_OBJECT *psTempObj = target.psObj;
 		CHECK_OBJECT(psTempObj);
 
 		if (std::find(psProj->psDamaged.begin(), psProj->psDamaged.end(), psTempObj) != psProj->psDamaged.end())
@@ -839,13 +873,9 @@ static void proj_InFlightFunc(PROJECTILE *psProj)
 			continue;
 		}
 
-		Vector3i psTempObjPrevPos = isDroid(psTempObj) ? castDroid(psTempObj)->prevSpacetime.pos : psTempObj->pos;
-
-		const Vector3i diff = psProj->pos - psTempObj->pos;
-		const Vector3i prevDiff = psProj->prevSpacetime.pos - psTempObjPrevPos;
-		const unsigned int targetHeight = establishTargetHeight(psTempObj);
-		const ObjectShape targetShape = establishTargetShape(psTempObj);
-		const int32_t collision = collisionXYZ(prevDiff, diff, targetShape, targetHeight);
+		const Vector3i diff = psProj->pos - target.pos;
+		const Vector3i prevDiff = psProj->prevSpacetime.pos - target.prevPos;
+		const int32_t collision = collisionXYZ(prevDiff, diff, target.shape, target.height);
 		const uint32_t collisionTime = psProj->prevSpacetime.time + (psProj->time - psProj->prevSpacetime.time) * collision / 1024;
 
 		if (collision >= 0 && collisionTime < closestCollisionSpacetime.time)
@@ -951,7 +981,7 @@ static void proj_InFlightFunc(PROJECTILE *psProj)
 
 /***************************************************************************/
 
-static void proj_ImpactFunc(PROJECTILE *psObj)
+static void proj_ImpactFunc(PROJECTILE *psObj, GridList &gridList)
 {
 	WEAPON_STATS    *psStats;
 	SDWORD          iAudioImpactID;
@@ -1175,8 +1205,7 @@ static void proj_ImpactFunc(PROJECTILE *psObj)
 		/* Note when it exploded for the explosion effect */
 		psObj->born = gameTime;
 
-		static GridList gridList;  // static to avoid allocations.
-		gridList = gridStartIterate(psObj->pos.x, psObj->pos.y, psStats->upgrade[psObj->player].radius);
+		gridQuery(gridList, psObj->pos.x, psObj->pos.y, psStats->upgrade[psObj->player].radius);
 		for (GridIterator gi = gridList.begin(); gi != gridList.end(); ++gi)
 		{
 			BASE_OBJECT *psCurr = *gi;
@@ -1262,7 +1291,7 @@ static void proj_ImpactFunc(PROJECTILE *psObj)
 
 /***************************************************************************/
 
-static void proj_PostImpactFunc(PROJECTILE *psObj)
+static void proj_PostImpactFunc(PROJECTILE *psObj, GridList &gridList)
 {
 	ASSERT_OR_RETURN(, psObj != nullptr, "Invalid pointer");
 	CHECK_PROJECTILE(psObj);
@@ -1283,15 +1312,16 @@ static void proj_PostImpactFunc(PROJECTILE *psObj)
 	if (psStats->upgrade[psObj->player].periodicalDamageTime > 0)
 	{
 		/* See if anything is in the fire and damage it periodically */
-		proj_checkPeriodicalDamage(psObj);
+		proj_checkPeriodicalDamage(psObj, gridList);
 	}
 }
 
 /***************************************************************************/
 
-void PROJECTILE::update()
+/// Starts updating a projectile, and moves it if in flight. Returns false if the projectile left the map.
+static bool proj_UpdateStart(ProjectileSweep &sweep)
 {
-	PROJECTILE *psObj = this;
+	PROJECTILE *psObj = sweep.psProj;
 
 	CHECK_PROJECTILE(psObj);
 
@@ -1313,33 +1343,50 @@ void PROJECTILE::update()
 		setProjectileDestination(psObj, nullptr);
 	}
 	// Remove dead objects from psDamaged.
-	psDamaged.erase(std::remove_if(psDamaged.begin(), psDamaged.end(), [](const BASE_OBJECT *psObj) { return ::isDead(psObj); }), psDamaged.end());
+	psObj->psDamaged.erase(std::remove_if(psObj->psDamaged.begin(), psObj->psDamaged.end(), [](const BASE_OBJECT *psDamaged) { return ::isDead(psDamaged); }), psObj->psDamaged.end());
 
 	// This extra check fixes a crash in cam2, mission1
 	if (worldOnMap(psObj->pos.x, psObj->pos.y) == false)
 	{
 		psObj->died = true;
-		return;
+		return false;
 	}
 
+	sweep.inFlight = psObj->state == PROJ_INFLIGHT && proj_InFlightMove(psObj, sweep.currentDistance);
+	if (sweep.inFlight)
+	{
+		sweep.min = min(psObj->prevSpacetime.pos.xy(), psObj->pos.xy());
+		sweep.max = max(psObj->prevSpacetime.pos.xy(), psObj->pos.xy());
+	}
+	return true;
+}
+
+/// Finishes updating a projectile, after proj_UpdateStart() and proj_Broadphase(). gridList is only used as a buffer.
+static void proj_UpdateFinish(ProjectileSweep const &sweep, std::vector<ProjectileTarget> const &targets, std::vector<unsigned> const &candidates, GridList &gridList)
+{
+	PROJECTILE *psObj = sweep.psProj;
+
 	switch (psObj->state)
 	{
 	case PROJ_INFLIGHT:
-		proj_InFlightFunc(psObj);
+		if (sweep.inFlight)
+		{
+			proj_InFlightCollide(psObj, sweep.currentDistance, targets, candidates.data() + sweep.firstCandidate, sweep.numCandidates);
+		}
 		if (psObj->state != PROJ_IMPACT)
 		{
 			break;
 		}
 		// fallthrough
 	case PROJ_IMPACT:
-		proj_ImpactFunc(psObj);
+		proj_ImpactFunc(psObj, gridList);
 		if (psObj->state != PROJ_POSTIMPACT)
 		{
 			break;
 		}
 		// fallthrough
 	case PROJ_POSTIMPACT:
-		proj_PostImpactFunc(psObj);
+		proj_PostImpactFunc(psObj, gridList);
 		break;
 
 	case PROJ_INACTIVE:
@@ -1350,15 +1397,132 @@ void PROJECTILE::update()
 	syncDebugProjectile(psObj, '>');
 }
 
+/// Finds the objects near the path of each moving projectile, looking up each area of the map only once.
+static void proj_Broadphase(std::vector<ProjectileSweep> &sweeps, std::vector<ProjectileTarget> &targets, std::vector<unsigned> &candidates, GridList &gridList)
+{
+	static std::vector<std::pair<unsigned, unsigned>> cellSweeps;     // (cell, sweep), static to avoid allocations.
+	static std::vector<std::pair<unsigned, unsigned>> sweepTargets;   // (sweep, target)
+	static std::unordered_map<BASE_OBJECT *, unsigned> targetIndex;   // Only used for lookups, so the order doesn't matter.
+
+	const int cellsX = (world_coord(mapWidth) + PROJ_BROADPHASE_CELL - 1) / PROJ_BROADPHASE_CELL;
+	const int cellsY = (world_coord(mapHeight) + PROJ_BROADPHASE_CELL - 1) / PROJ_BROADPHASE_CELL;
+
+	// Put each path in every cell it passes through.
+	cellSweeps.clear();
+	for (unsigned i = 0; i < sweeps.size(); ++i)
+	{
+		ProjectileSweep const &sweep = sweeps[i];
+		if (!sweep.inFlight)
+		{
+			continue;
+		}
+		int x0 = clip(sweep.min.x / PROJ_BROADPHASE_CELL, 0, cellsX - 1), x1 = clip(sweep.max.x / PROJ_BROADPHASE_CELL, 0, cellsX - 1);
+		int y0 = clip(sweep.min.y / PROJ_BROADPHASE_CELL, 0, cellsY - 1), y1 = clip(sweep.max.y / PROJ_BROADPHASE_CELL, 0, cellsY - 1);
+		for (int y = y0; y <= y1; ++y)
+		{
+			for (int x = x0; x <= x1; ++x)
+			{
+				cellSweeps.emplace_back(x + y * cellsX, i);
+			}
+		}
+	}
+	std::sort(cellSweeps.begin(), cellSweeps.end());
+
+	// Look up the objects around each cell once, and pair them with the paths whose bounding box they overlap.
+	targets.clear();
+	targetIndex.clear();
+	sweepTargets.clear();
+	for (auto cellBegin = cellSweeps.begin(); cellBegin != cellSweeps.end();)
+	{
+		auto cellEnd = std::find_if(cellBegin, cellSweeps.end(), [&](std::pair<unsigned, unsigned> const &cs) { return cs.first != cellBegin->first; });
+		int cellX = cellBegin->first % cellsX * PROJ_BROADPHASE_CELL, cellY = cellBegin->first / cellsX * PROJ_BROADPHASE_CELL;
+		gridQueryArea(gridList, cellX - PROJ_NEIGHBOUR_RANGE, cellY - PROJ_NEIGHBOUR_RANGE, cellX + PROJ_BROADPHASE_CELL + PROJ_NEIGHBOUR_RANGE, cellY + PROJ_BROADPHASE_CELL + PROJ_NEIGHBOUR_RANGE);
+		for (BASE_OBJECT *psObj : gridList)
+		{
+			if (psObj->died)
+			{
+				continue;
+			}
+			auto inserted = targetIndex.emplace(psObj, targets.size());
+			if (inserted.second)
+			{
+				ProjectileTarget target;
+				target.psObj = psObj;
+				target.pos = psObj->pos;
+				target.prevPos = isDroid(psObj) ? castDroid(psObj)->prevSpacetime.pos : psObj->pos;
+				target.shape = establishTargetShape(psObj);
+				target.height = establishTargetHeight(psObj);
+				target.min = min(target.pos.xy(), target.prevPos.xy()) - target.shape.size;
+				target.max = max(target.pos.xy(), target.prevPos.xy()) + target.shape.size;
+				targets.push_back(target);
+			}
+			ProjectileTarget const &target = targets[inserted.first->second];
+			for (auto cs = cellBegin; cs != cellEnd; ++cs)
+			{
+				ProjectileSweep const &sweep = sweeps[cs->second];
+				if (sweep.min.x <= target.max.x && sweep.max.x >= target.min.x && sweep.min.y <= target.max.y && sweep.max.y >= target.min.y)
+				{
+					sweepTargets.emplace_back(cs->second, inserted.first->second);
+				}
+			}
+		}
+		cellBegin = cellEnd;
+	}
+
+	// Paths crossing several cells may have found the same object more than once.
+	std::sort(sweepTargets.begin(), sweepTargets.end());
+	sweepTargets.erase(std::unique(sweepTargets.begin(), sweepTargets.end()), sweepTargets.end());
+
+	candidates.clear();
+	for (ProjectileSweep &sweep : sweeps)
+	{
+		sweep.numCandidates = 0;
+	}
+	for (auto const &st : sweepTargets)
+	{
+		ProjectileSweep &sweep = sweeps[st.first];
+		if (sweep.numCandidates == 0)
+		{
+			sweep.firstCandidate = candidates.size();
+		}
+		++sweep.numCandidates;
+		candidates.push_back(st.second);
+	}
+}
+
 /***************************************************************************/
 
 // iterate through all projectiles and update their status
 void proj_UpdateAll()
 {
-	std::vector<PROJECTILE *> psProjectileListOld = psProjectileList;
+	static std::vector<ProjectileSweep> sweeps;        // static to avoid allocations.
+	static std::vector<ProjectileTarget> targets;
+	static std::vector<unsigned> candidates;
+	static GridList gridList;                          // For the grid queries of all projectiles, one at a time.
+
+	WZ_PROFILE_SCOPE("proj_UpdateAll");
+	WZ_PROFILE_COUNT("projectiles", psProjectileList.size());
+
+	// Move all projectiles first, then check all their paths for collisions together. Impacts are then
+	// applied in list order, so objects destroyed by one projectile can't be hit by the next ones.
+	sweeps.clear();
+	for (PROJECTILE *psProj : psProjectileList)
+	{
+		ProjectileSweep sweep;
+		sweep.psProj = psProj;
+		if (proj_UpdateStart(sweep))
+		{
+			sweeps.push_back(sweep);
+		}
+	}
+
+	proj_Broadphase(sweeps, targets, candidates, gridList);
 
-	// Update all projectiles. Penetrating projectiles may add to psProjectileList.
-	std::for_each(psProjectileListOld.begin(), psProjectileListOld.end(), std::mem_fn(&PROJECTILE::update));
+	// Penetrating projectiles may add to psProjectileList, these are only updated next tick.
+	for (ProjectileSweep const &sweep : sweeps)
+	{
+		proj_UpdateFinish(sweep, targets, candidates, gridList);
+	}
 
 	// Remove and free dead projectiles.
 	psProjectileList.erase(std::remove_if(psProjectileList.begin(), psProjectileList.end(), std::mem_fn(&PROJECTILE::deleteIfDead)), psProjectileList.end());
@@ -1366,7 +1530,7 @@ void proj_UpdateAll()
 
 /***************************************************************************/
 
-static void proj_checkPeriodicalDamage(PROJECTILE *psProj)
+static void proj_checkPeriodicalDamage(PROJECTILE *psProj, GridList &gridList)
 {
 	CHECK_PROJECTILE(psProj);
 
@@ -1375,8 +1539,7 @@ static void proj_checkPeriodicalDamage(PROJECTILE *psProj)
 
 	WEAPON_STATS *psStats = psProj->psWStats;
 
-	static GridList gridList;  // static to avoid allocations.
-	gridList = gridStartIterate(psProj->pos.x, psProj->pos.y, psStats->upgrade[psProj->player].periodicalDamageRadius);
+	gridQuery(gridList, psProj->pos.x, psProj->pos.y, psStats->upgrade[psProj->player].periodicalDamageRadius);
 	for (GridIterator gi = gridList.begin(); gi != gridList.end(); ++gi)
 	{
 		BASE_OBJECT *psCurr = *gi;
@@ -42,7 +42,9 @@ struct PROJECTILE : public SIMPLE_OBJECT
 {
 	PROJECTILE(uint32_t id, unsigned player) : SIMPLE_OBJECT(OBJ_PROJECTILE, id, player) {}
 
-	void            update();
+	static void *operator new(size_t size);  ///< Allocated from a slab pool, see objmemPoolStats().
+	static void operator delete(void *ptr);
+
 	bool            deleteIfDead()
 	{
 		if (died == 0 || died >= gameTime - deltaGameTime)
@@ -46,6 +46,7 @@
 #include "qtscript.h"
 
 #include "lib/framework/file.h"
+#include "lib/framework/wzprofile.h"
 #include "lib/gamelib/gtime.h"
 #include "lib/netplay/netplay.h"
 #include "multiplay.h"
@@ -54,9 +55,13 @@
 #include "difficulty.h"
 #include "console.h"
 #include "clparse.h"
+#include "pathbench.h"
+#include "replay.h"
+#include "simbench.h"
 #include "mission.h"
 #include "modding.h"
 #include "version.h"
+#include "wrappers.h"
 #include "game.h"
 #include "warzoneconfig.h"
 
@@ -432,6 +437,7 @@ bool scripting_engine::shutdownScripts()
 
 bool updateScripts()
 {
+	WZ_PROFILE_SCOPE("updateScripts");
 	return scripting_engine::instance().updateScripts();
 }
 
@@ -1160,6 +1166,18 @@ bool triggerEvent(SCRIPT_TRIGGER_TYPE trigger, BASE_OBJECT *psObj)
 		saveGame(saveandquit_enabled().c_str(), GTYPE_SAVE_START);
 		exit(0);
 	}
+	if ((trigger == TRIGGER_START_LEVEL || trigger == TRIGGER_GAME_LOADED) && !pathbench_enabled().empty())
+	{
+		exit(pathBenchRun(pathbench_enabled()) ? 0 : 1);
+	}
+	if ((trigger == TRIGGER_START_LEVEL || trigger == TRIGGER_GAME_LOADED) && !simbench_enabled().empty() && !simBenchStart())
+	{
+		exit(1);
+	}
+	if (trigger == TRIGGER_START_LEVEL && getHostLaunch() == HostLaunch::Replay)
+	{
+		replayPlaybackStart();
+	}
 
 	return true;
 }
@@ -0,0 +1,398 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/**
+ * @file replay.cpp
+ *
+ * Recording the settings of a game to a replay, and setting up a game from a replay.
+ */
+
+#include "lib/framework/frame.h"
+#include "lib/framework/physfs_ext.h"
+#include "lib/gamelib/gtime.h"
+#include "lib/netplay/netplay.h"
+#include "lib/netplay/netreplay.h"
+#include <3rdparty/json/json.hpp>
+
+#include "replay.h"
+
+#include "ai.h"
+#include "clparse.h"
+#include "console.h"
+#include "levels.h"
+#include "loop.h"
+#include "modding.h"
+#include "multiint.h"
+#include "multiplay.h"
+#include "simjobs.h"
+#include "visibility.h"
+#include "warzoneconfig.h"
+#include "wrappers.h"
+
+#include <algorithm>
+#include <chrono>
+
+// Settings of the replay being played back, which are only needed after replayLoadSettings.
+/// Maximum number of replays kept in each of replay/skirmish/ and replay/multiplay/.
+#define REPLAY_MAX_FILES 20
+
+static uint32_t replayRandomSeed = 0;
+static std::vector<MULTISTRUCTLIMITS> replayStructureLimits;
+static bool replayHasScripts = false;
+static WzString replayScriptsIniName, replayScriptsPath;
+
+static bool replayPlaybackRunning = false;
+static bool replayPlaybackDone = false;
+static uint32_t replayStartTime = 0;     ///< gameTime when the level was loaded.
+static std::chrono::steady_clock::time_point replayStartClock;
+
+static nlohmann::json replayGameSettings()
+{
+	nlohmann::json mods = nlohmann::json::array();
+	for (auto const &hash : game.modHashes)
+	{
+		mods.push_back(hash.toString());
+	}
+
+	nlohmann::json settings = nlohmann::json::object();
+	settings["type"] = static_cast<int>(game.type);
+	settings["scavengers"] = game.scavengers;
+	settings["map"] = game.map;
+	settings["maxPlayers"] = game.maxPlayers;
+	settings["name"] = game.name;
+	settings["hash"] = game.hash.toString();
+	settings["modHashes"] = mods;
+	settings["power"] = game.power;
+	settings["base"] = game.base;
+	settings["alliance"] = game.alliance;
+	settings["mapHasScavengers"] = game.mapHasScavengers;
+	settings["isMapMod"] = game.isMapMod;
+	settings["isRandom"] = game.isRandom;
+	settings["techLevel"] = game.techLevel;
+	return settings;
+}
+
+static nlohmann::json replayPlayerSettings(unsigned player)
+{
+	nlohmann::json settings = nlohmann::json::object();
+	settings["name"] = NetPlay.players[player].name;
+	settings["position"] = NetPlay.players[player].position;
+	settings["colour"] = NetPlay.players[player].colour;
+	settings["allocated"] = NetPlay.players[player].allocated;
+	settings["team"] = NetPlay.players[player].team;
+	settings["ai"] = NetPlay.players[player].ai;
+	settings["difficulty"] = static_cast<int>(NetPlay.players[player].difficulty);
+	settings["faction"] = static_cast<int>(NetPlay.players[player].faction);
+	return settings;
+}
+
+/// Deletes the oldest replays in the directory, so that there is room for one more.
+static void replayFreeSlot(const char *path)
+{
+	char **files = PHYSFS_enumerateFiles(path);
+	ASSERT_OR_RETURN(, files, "PHYSFS_enumerateFiles(\"%s\") failed: %s", path, WZ_PHYSFS_getLastError());
+	std::vector<std::pair<PHYSFS_sint64, std::string>> replays;
+	for (char **i = files; *i != nullptr; ++i)
+	{
+		std::string name = *i;
+		if (name.size() > 5 && name.compare(name.size() - 5, 5, ".wzrp") == 0)
+		{
+			std::string replayPath = std::string(path) + "/" + name;
+			replays.emplace_back(WZ_PHYSFS_getLastModTime(replayPath.c_str()), replayPath);
+		}
+	}
+	PHYSFS_freeList(files);
+
+	// too many replays, let's delete the oldest
+	std::sort(replays.begin(), replays.end());
+	for (size_t i = 0; i + REPLAY_MAX_FILES <= replays.size(); ++i)
+	{
+		if (PHYSFS_delete(replays[i].second.c_str()) == 0)
+		{
+			debug(LOG_ERROR, "Could not delete replay %s: %s", replays[i].second.c_str(), WZ_PHYSFS_getLastError());
+		}
+	}
+}
+
+void replayStartRecording(uint32_t randomSeed)
+{
+	if (!war_GetRecordReplays())
+	{
+		return;
+	}
+
+	nlohmann::json settings = nlohmann::json::object();
+	settings["randomSeed"] = randomSeed;
+	settings["selectedPlayer"] = selectedPlayer;
+	settings["game"] = replayGameSettings();
+
+	nlohmann::json players = nlohmann::json::array();
+	for (unsigned player = 0; player < MAX_PLAYERS; ++player)
+	{
+		players.push_back(replayPlayerSettings(player));
+	}
+	settings["players"] = players;
+
+	nlohmann::json allianceRows = nlohmann::json::array();
+	for (unsigned i = 0; i < MAX_PLAYER_SLOTS; ++i)
+	{
+		allianceRows.push_back(std::vector<uint8_t>(alliances[i], alliances[i] + MAX_PLAYER_SLOTS));
+	}
+	settings["alliances"] = allianceRows;
+
+	nlohmann::json limits = nlohmann::json::array();
+	for (auto const &structLimit : ingame.structureLimits)
+	{
+		limits.push_back({structLimit.id, structLimit.limit});
+	}
+	settings["structureLimits"] = limits;
+	settings["flags"] = ingame.flags;
+
+	WzString ininame, path;
+	if (getMultiScriptsIni(ininame, path))
+	{
+		settings["scripts"] = {ininame.toUtf8(), path.toUtf8()};
+	}
+
+	const char *subdir = NetPlay.bComms ? "multiplay" : "skirmish";
+	replayFreeSlot((std::string("replay/") + subdir).c_str());
+	NETreplaySaveStart(subdir, settings.dump());
+}
+
+void replayStop()
+{
+	NETreplaySaveStop();
+	NETreplayLoadStop();
+	replayPlaybackRunning = false;
+}
+
+static void replayLoadGameSettings(nlohmann::json const &settings)
+{
+	game.type = static_cast<LEVEL_TYPE>(settings.at("type").get<int>());
+	game.scavengers = settings.at("scavengers").get<bool>();
+	sstrcpy(game.map, settings.at("map").get<std::string>().c_str());
+	game.maxPlayers = settings.at("maxPlayers").get<uint8_t>();
+	sstrcpy(game.name, settings.at("name").get<std::string>().c_str());
+	game.hash.fromString(settings.at("hash").get<std::string>());
+	game.power = settings.at("power").get<uint32_t>();
+	game.base = settings.at("base").get<uint8_t>();
+	game.alliance = settings.at("alliance").get<uint8_t>();
+	game.mapHasScavengers = settings.at("mapHasScavengers").get<bool>();
+	game.isMapMod = settings.at("isMapMod").get<bool>();
+	game.isRandom = settings.at("isRandom").get<bool>();
+	game.techLevel = settings.at("techLevel").get<uint32_t>();
+
+	std::vector<std::string> mods;
+	for (auto const &hash : getModHashList())
+	{
+		mods.push_back(hash.toString());
+	}
+	if (settings.at("modHashes").get<std::vector<std::string>>() != mods)
+	{
+		debug(LOG_WARNING, "The replay was recorded with different mods, so it will probably desync.");
+	}
+}
+
+static void replayLoadPlayerSettings(nlohmann::json const &settings, unsigned player)
+{
+	sstrcpy(NetPlay.players[player].name, settings.at("name").get<std::string>().c_str());
+	NetPlay.players[player].position = settings.at("position").get<int32_t>();
+	NetPlay.players[player].colour = settings.at("colour").get<int32_t>();
+	NetPlay.players[player].allocated = settings.at("allocated").get<bool>();
+	NetPlay.players[player].team = settings.at("team").get<int32_t>();
+	NetPlay.players[player].ai = settings.at("ai").get<int8_t>();
+	NetPlay.players[player].difficulty = static_cast<AIDifficulty>(settings.at("difficulty").get<int>());
+	NetPlay.players[player].faction = static_cast<FactionID>(settings.at("faction").get<int>());
+}
+
+/// Sets up the game from the settings of a replay. Returns false on bad settings.
+static bool replayLoadAllSettings(nlohmann::json const &settings)
+{
+	replayLoadGameSettings(settings.at("game"));
+	if (levFindDataSet(game.map, &game.hash) == nullptr)
+	{
+		debug(LOG_ERROR, "The map %s of the replay was not found.", game.map);
+		return false;
+	}
+
+	nlohmann::json const &players = settings.at("players");
+	if (players.size() != MAX_PLAYERS)
+	{
+		debug(LOG_ERROR, "The replay has %zu players, not %d.", players.size(), MAX_PLAYERS);
+		return false;
+	}
+	for (unsigned player = 0; player < MAX_PLAYERS; ++player)
+	{
+		replayLoadPlayerSettings(players[player], player);
+	}
+	uint32_t player = settings.at("selectedPlayer").get<uint32_t>();
+	if (player >= MAX_PLAYERS)
+	{
+		debug(LOG_ERROR, "The replay has a bad selected player %u.", player);
+		return false;
+	}
+	selectedPlayer = realSelectedPlayer = player;
+
+	nlohmann::json const &allianceRows = settings.at("alliances");
+	if (allianceRows.size() != MAX_PLAYER_SLOTS)
+	{
+		debug(LOG_ERROR, "The replay has %zu rows of alliances, not %d.", allianceRows.size(), MAX_PLAYER_SLOTS);
+		return false;
+	}
+	for (unsigned i = 0; i < MAX_PLAYER_SLOTS; ++i)
+	{
+		std::vector<uint8_t> row = allianceRows[i].get<std::vector<uint8_t>>();
+		if (row.size() != MAX_PLAYER_SLOTS)
+		{
+			debug(LOG_ERROR, "The replay has %zu alliances for player %u, not %d.", row.size(), i, MAX_PLAYER_SLOTS);
+			return false;
+		}
+		std::copy(row.begin(), row.end(), alliances[i]);
+	}
+
+	replayStructureLimits.clear();
+	for (auto const &structLimit : settings.at("structureLimits"))
+	{
+		replayStructureLimits.push_back(MULTISTRUCTLIMITS {structLimit.at(0).get<uint32_t>(), structLimit.at(1).get<uint32_t>()});
+	}
+	ingame.flags = settings.at("flags").get<uint8_t>();
+
+	auto scripts = settings.find("scripts");
+	replayHasScripts = scripts != settings.end();
+	if (replayHasScripts)
+	{
+		replayScriptsIniName = WzString::fromUtf8(scripts->at(0).get<std::string>());
+		replayScriptsPath = WzString::fromUtf8(scripts->at(1).get<std::string>());
+	}
+
+	replayRandomSeed = settings.at("randomSeed").get<uint32_t>();
+	return true;
+}
+
+bool replayLoadSettings()
+{
+	std::string settingsString;
+	if (!NETreplayLoadStart(replay_enabled(), settingsString))
+	{
+		return false;
+	}
+
+	bool ok = false;
+	try
+	{
+		ok = replayLoadAllSettings(nlohmann::json::parse(settingsString));
+	}
+	catch (const std::exception &e)
+	{
+		debug(LOG_ERROR, "Bad replay settings: %s", e.what());
+	}
+	if (!ok)
+	{
+		NETreplayLoadStop();
+	}
+	return ok;
+}
+
+void replayLoadStructureLimits()
+{
+	ingame.structureLimits = replayStructureLimits;
+}
+
+uint32_t replaySeed()
+{
+	return replayRandomSeed;
+}
+
+bool replayScriptsIni(WzString &ininame, WzString &path)
+{
+	if (!replayHasScripts)
+	{
+		return false;
+	}
+	ininame = replayScriptsIniName;
+	path = replayScriptsPath;
+	return true;
+}
+
+void replayPlaybackStart()
+{
+	replayStartTime = gameTime;
+	replayPlaybackRunning = true;
+	replayPlaybackDone = false;
+
+	// Nobody is watching, so do a tick whenever the previous one is finished, unless already fast forwarding with --fastforward.
+	if (headlessGameMode() && !gameTimeFastForward())
+	{
+		loopSetFastForward(true, 0);
+	}
+	loopSetPhaseTiming(true);
+
+	replayStartClock = std::chrono::steady_clock::now();
+}
+
+static double replayMilliseconds(uint64_t nanoseconds)
+{
+	return nanoseconds / 1e6;
+}
+
+static void replayPrint()
+{
+	uint64_t wallTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - replayStartClock).count();
+	unsigned ticks = (gameTime - replayStartTime) / GAME_TICKS_PER_UPDATE;
+
+	printf("{\n");
+	printf("\t\"replay\": \"%s\",\n", replay_enabled().c_str());
+	printf("\t\"map\": \"%s\",\n", game.map);
+	printf("\t\"messages\": %u,\n", NETreplayMessageCount());
+	printf("\t\"ticks\": %u,\n", ticks);
+	printf("\t\"gameTime\": [%u, %u],\n", replayStartTime, gameTime);
+	printf("\t\"threads\": %u,\n", simJobsNumWorkers());
+	printf("\t\"wallMs\": %.3f,\n", replayMilliseconds(wallTime));
+	printf("\t\"ticksPerSecond\": %.2f,\n", wallTime != 0 ? ticks * 1e9 / wallTime : 0.);
+	printf("\t\"phasesMs\": {\n");
+	for (int phase = 0; phase < SIM_PHASE_COUNT; ++phase)
+	{
+		printf("\t\t\"%s\": %.3f%s\n", loopPhaseName((SIM_PHASE)phase), replayMilliseconds(loopPhaseTime((SIM_PHASE)phase)), phase + 1 < SIM_PHASE_COUNT ? "," : "");
+	}
+	printf("\t}%s\n", visGetCheckParallel() ? "," : "");
+	if (visGetCheckParallel())
+	{
+		printf("\t\"visCheckMismatches\": %u\n", visCheckParallelMismatches());
+	}
+	printf("}\n");
+	fflush(stdout);
+}
+
+void replayPlaybackUpdate()
+{
+	// Done once every message has been read, and the game is waiting for more.
+	if (!replayPlaybackRunning || replayPlaybackDone || !NETreplayLoadFinished() || checkPlayerGameTime(NET_ALL_PLAYERS))
+	{
+		return;
+	}
+
+	replayPlaybackDone = true;
+	loopSetPhaseTiming(false);
+	debug(LOG_INFO, "Finished playing back %u replay messages, at gameTime %u.", NETreplayMessageCount(), gameTime);
+	if (headlessGameMode())
+	{
+		replayPrint();
+		exit(visCheckParallelMismatches() == 0 ? 0 : 1);
+	}
+	addConsoleMessage(_("The replay has finished."), DEFAULT_JUSTIFY, SYSTEM_MESSAGE);
+}
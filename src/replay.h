@@ -0,0 +1,57 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/** @file
+ *  Game replays.
+ *
+ *  If recordReplays is set in the config, every skirmish and multiplayer game is recorded to replay/skirmish/ or
+ *  replay/multiplay/, as the settings and random seed the game was started with, followed by the game queue messages of
+ *  all players (see lib/netplay/netreplay.h). Only the newest few replays in each directory are kept.
+ *
+ *  With --replay=<file>, the game is set up from the replay instead, and the recorded messages are processed instead of
+ *  running the AIs and taking input. The GAME_GAME_TIME messages carry the CRCs of the recording, so any desync is
+ *  reported as in a multiplayer game. With --headless, the replay runs as fast as possible, and the timings are printed
+ *  to stdout as JSON at the end.
+ */
+
+#ifndef __INCLUDED_SRC_REPLAY_H__
+#define __INCLUDED_SRC_REPLAY_H__
+
+#include "lib/framework/wzstring.h"
+
+#include <stdint.h>
+
+/// Starts recording the game, if enabled, deleting the oldest replays if there are too many. Call when the game is fired up, after seeding the synchronised random number generator.
+void replayStartRecording(uint32_t randomSeed);
+/// Stops recording or playing back. Call at the end of the game.
+void replayStop();
+
+/// Opens the replay given by --replay, and sets up the game as it was recorded. Call after hosting. Returns false on bad input.
+bool replayLoadSettings();
+/// Replaces the structure limits with the ones the replay was recorded with. Call after createLimitSet.
+void replayLoadStructureLimits();
+/// Returns the seed the replay was recorded with.
+uint32_t replaySeed();
+/// Gets the settings file with extra scripts the replay was recorded with, and their directory. Returns false if there was none.
+bool replayScriptsIni(WzString &ininame, WzString &path);
+/// Starts timing the playback. Call once the level is loaded.
+void replayPlaybackStart();
+/// Checks whether the whole replay has been processed, and if so reports it, and quits if headless. Call each frame.
+void replayPlaybackUpdate();
+
+#endif // __INCLUDED_SRC_REPLAY_H__
@@ -46,6 +46,7 @@
 #include "template.h"
 #include "qtscript.h"
 #include "stats.h"
+#include "threatmap.h"
 
 // The stores for the research stats
 std::vector<RESEARCH> asResearch;
@@ -1065,6 +1066,11 @@ static void replaceComponent(COMPONENT_STATS *pNewComponent, COMPONENT_STATS *pO
 
 	replaceStructureComponent(apsStructLists[player], oldType, oldCompInc, newCompInc, player);
 	replaceStructureComponent(mission.apsStructLists[player], oldType, oldCompInc, newCompInc, player);
+
+	if (oldType == COMP_WEAPON)
+	{
+		threatMapPlayerChanged(player);  // The new weapons may shoot at air instead of ground, or the other way around.
+	}
 }
 
 /*Looks through all the currently allocated stats to check the name is not
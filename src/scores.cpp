@@ -49,6 +49,7 @@
 #include "lib/ivis_opengl/piematrix.h"
 #include "display3d.h"
 #include "mission.h"
+#include "loop.h"
 #include "game.h"
 #include "lib/sound/audio.h"
 #include "lib/sound/audio_id.h"
@@ -566,6 +567,10 @@ void stdOutGameSummary(UDWORD realTimeThrottleSeconds)
 		return;
 	}
 	fprintf(stdout, "Game State [gameTime: %" PRIu32 "]\n", gameTime);
+	if (gameTimeFastForward())
+	{
+		fprintf(stdout, "Fast forwarding at %.1f ticks per second\n", loopFastForwardTicksPerSecond());
+	}
 	fprintf(stdout, "--------------------------------------------------------------------------------------\n");
 	if (ActivityManager::instance().getCurrentGameMode() != ActivitySink::GameMode::CAMPAIGN)
 	{
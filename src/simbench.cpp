@@ -0,0 +1,153 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/**
+ * @file simbench.cpp
+ *
+ * Running game ticks as fast as possible, for benchmarking.
+ */
+
+#include "lib/framework/frame.h"
+#include "lib/framework/crc.h"
+#include "lib/gamelib/gtime.h"
+#include "lib/netplay/netplay.h"
+
+#include "simbench.h"
+
+#include "clparse.h"
+#include "loop.h"
+#include "multiplay.h"
+#include "objmem.h"
+#include "simjobs.h"
+#include "visibility.h"
+
+#include <chrono>
+
+static bool simBenchRunning = false;
+static unsigned simBenchTicks = 0;       ///< Ticks left to run.
+static unsigned simBenchTotalTicks = 0;
+static uint32_t simBenchStartTime = 0;   ///< gameTime of the first tick.
+static uint32_t simBenchCrc = 0;         ///< CRC of the synch debug CRCs of all ticks so far.
+static std::chrono::steady_clock::time_point simBenchStartClock;
+
+/// Parses "<ticks>[:<seed>]".
+static bool simBenchParse(unsigned &ticks, uint32_t &seed)
+{
+	std::string const &arg = simbench_enabled();
+	seed = 1;
+	int n = 0;
+	if (sscanf(arg.c_str(), "%u%n:%u%n", &ticks, &n, &seed, &n) < 1 || (size_t)n != arg.size() || ticks == 0)
+	{
+		debug(LOG_ERROR, "Bad simulation benchmark \"%s\", expected <ticks>[:<seed>]", arg.c_str());
+		return false;
+	}
+	return true;
+}
+
+uint32_t simBenchSeed()
+{
+	unsigned ticks;
+	uint32_t seed;
+	simBenchParse(ticks, seed);
+	return seed;
+}
+
+bool simBenchStart()
+{
+	uint32_t seed;
+	if (!simBenchParse(simBenchTicks, seed))
+	{
+		return false;
+	}
+	simBenchTotalTicks = simBenchTicks;
+	simBenchStartTime = gameTime;
+	simBenchCrc = 0;
+	simBenchRunning = true;
+
+	// Do a tick whenever the previous one is finished, unless already fast forwarding with --fastforward.
+	if (!gameTimeFastForward())
+	{
+		loopSetFastForward(true, 0);
+	}
+	loopSetPhaseTiming(true);
+
+	debug(LOG_INFO, "Running %u game ticks with seed %u", simBenchTicks, seed);
+	simBenchStartClock = std::chrono::steady_clock::now();
+	return true;
+}
+
+static double simBenchMilliseconds(uint64_t nanoseconds)
+{
+	return nanoseconds / 1e6;
+}
+
+static void simBenchPrint()
+{
+	uint64_t wallTime = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - simBenchStartClock).count();
+	unsigned ticks;
+	uint32_t seed;
+	simBenchParse(ticks, seed);
+
+	printf("{\n");
+	printf("\t\"map\": \"%s\",\n", game.map);
+	printf("\t\"seed\": %u,\n", seed);
+	printf("\t\"ticks\": %u,\n", simBenchTotalTicks);
+	printf("\t\"gameTime\": [%u, %u],\n", simBenchStartTime, gameTime);
+	printf("\t\"threads\": %u,\n", simJobsNumWorkers());
+	printf("\t\"wallMs\": %.3f,\n", simBenchMilliseconds(wallTime));
+	printf("\t\"ticksPerSecond\": %.2f,\n", wallTime != 0 ? simBenchTotalTicks * 1e9 / wallTime : 0.);
+	printf("\t\"phasesMs\": {\n");
+	for (int phase = 0; phase < SIM_PHASE_COUNT; ++phase)
+	{
+		printf("\t\t\"%s\": %.3f%s\n", loopPhaseName((SIM_PHASE)phase), simBenchMilliseconds(loopPhaseTime((SIM_PHASE)phase)), phase + 1 < SIM_PHASE_COUNT ? "," : "");
+	}
+	printf("\t},\n");
+	printf("\t\"pools\": {\n");
+	std::vector<ObjectPoolStats> pools = objmemPoolStats();
+	for (size_t i = 0; i < pools.size(); ++i)
+	{
+		printf("\t\t\"%s\": {\"live\": %zu, \"peak\": %zu, \"allocations\": %llu}%s\n", pools[i].name, pools[i].live, pools[i].peak,
+		       (unsigned long long)pools[i].allocations, i + 1 < pools.size() ? "," : "");
+	}
+	printf("\t},\n");
+	if (visGetCheckParallel())
+	{
+		printf("\t\"visCheckMismatches\": %u,\n", visCheckParallelMismatches());
+	}
+	printf("\t\"syncCrc\": \"0x%08X\"\n", simBenchCrc);
+	printf("}\n");
+	fflush(stdout);
+}
+
+void simBenchTick()
+{
+	if (!simBenchRunning)
+	{
+		return;  // Level not loaded yet.
+	}
+
+	uint32_t crc = syncDebugGetCrc();
+	simBenchCrc = crcSum(simBenchCrc, &crc, sizeof(crc));
+
+	if (--simBenchTicks == 0)
+	{
+		loopSetPhaseTiming(false);
+		simBenchPrint();
+		exit(visCheckParallelMismatches() == 0 ? 0 : 1);
+	}
+}
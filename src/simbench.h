@@ -0,0 +1,45 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/** @file
+ *  Simulation benchmark.
+ *
+ *  With --simbench=<ticks>[:<seed>], the synchronised random number generator is seeded with the given seed
+ *  (1 by default) instead of a random one, and once the level is loaded, the game runs the given number of ticks
+ *  as fast as it can. The wall clock time spent in each part of gameStateUpdate is then printed to stdout as JSON,
+ *  together with a CRC of the synch debug state of every tick, which should not change between runs of the same
+ *  build, map and AIs.
+ *
+ *  The map and AIs are chosen as for any other game, for example with --skirmish=<settings> --headless --autogame.
+ *  With --vischeck, the number of ticks where the parallel vision pass differed from a serial one is printed too,
+ *  and the exit status is 1 if there were any.
+ */
+
+#ifndef __INCLUDED_SRC_SIMBENCH_H__
+#define __INCLUDED_SRC_SIMBENCH_H__
+
+#include <stdint.h>
+
+/// Returns the seed given by --simbench, to use for the synchronised random number generator.
+uint32_t simBenchSeed();
+/// Start timing the game ticks. Call once the level is loaded. Returns false on bad input.
+bool simBenchStart();
+/// Count a game tick, and print the results and quit after the last one. Call after each gameStateUpdate.
+void simBenchTick();
+
+#endif // __INCLUDED_SRC_SIMBENCH_H__
@@ -0,0 +1,155 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/** @file
+ *  Worker threads for running independent parts of a game tick in parallel, see simjobs.h.
+ */
+
+#include "lib/framework/frame.h"
+#include "lib/framework/math_ext.h"
+#include "lib/framework/wzapp.h"
+
+#include "simjobs.h"
+#include "warzoneconfig.h"
+
+#include <atomic>
+#include <vector>
+
+/// Number of items taken at once by a thread, to keep the overhead of the shared counter low.
+#define SIM_JOBS_BATCH 16
+
+static std::vector<WZ_THREAD *> simJobsThreads;
+static WZ_SEMAPHORE *simJobsStartSemaphore = nullptr;  ///< Posted once per helper thread, when there is work or when quitting.
+static WZ_SEMAPHORE *simJobsDoneSemaphore = nullptr;   ///< Posted by each helper thread, when it has run out of items.
+static bool simJobsQuit = false;
+
+static std::function<void (size_t, unsigned)> const *simJobsFunc = nullptr;
+static size_t simJobsCount = 0;
+static std::atomic<size_t> simJobsNextItem(0);
+
+static void simJobsRun(unsigned worker)
+{
+	size_t begin;
+	while ((begin = simJobsNextItem.fetch_add(SIM_JOBS_BATCH)) < simJobsCount)
+	{
+		size_t end = std::min<size_t>(begin + SIM_JOBS_BATCH, simJobsCount);
+		for (size_t item = begin; item != end; ++item)
+		{
+			(*simJobsFunc)(item, worker);
+		}
+	}
+}
+
+static int simJobsThreadFunc(void *data)
+{
+	unsigned worker = (unsigned)(uintptr_t)data;
+	while (true)
+	{
+		wzSemaphoreWait(simJobsStartSemaphore);
+		if (simJobsQuit)
+		{
+			return 0;
+		}
+		simJobsRun(worker);
+		wzSemaphorePost(simJobsDoneSemaphore);
+	}
+}
+
+bool simJobsInitialise()
+{
+	if (!simJobsThreads.empty())
+	{
+		return true;
+	}
+
+	int numWorkers = war_GetSimulationThreads();
+	if (numWorkers <= 0)
+	{
+		// Pathfinding threads are running at the same time, so don't try to take every core.
+		numWorkers = clip<int>((int)wzGetLogicalCPUCount() - 1, 1, 8);
+	}
+
+	simJobsQuit = false;
+	simJobsStartSemaphore = wzSemaphoreCreate(0);
+	simJobsDoneSemaphore = wzSemaphoreCreate(0);
+	for (int n = 1; n < numWorkers; ++n)  // Worker 0 is the main thread.
+	{
+		WZ_THREAD *thread = wzThreadCreate(simJobsThreadFunc, (void *)(uintptr_t)n);
+		wzThreadStart(thread);
+		simJobsThreads.push_back(thread);
+	}
+	debug(LOG_INFO, "Using %d simulation thread(s)", numWorkers);
+
+	return true;
+}
+
+void simJobsShutdown()
+{
+	if (simJobsStartSemaphore == nullptr)
+	{
+		return;
+	}
+
+	simJobsQuit = true;
+	for (size_t n = 0; n < simJobsThreads.size(); ++n)
+	{
+		wzSemaphorePost(simJobsStartSemaphore);  // Wake up threads.
+	}
+	for (WZ_THREAD *thread : simJobsThreads)
+	{
+		wzThreadJoin(thread);
+	}
+	simJobsThreads.clear();
+	wzSemaphoreDestroy(simJobsStartSemaphore);
+	simJobsStartSemaphore = nullptr;
+	wzSemaphoreDestroy(simJobsDoneSemaphore);
+	simJobsDoneSemaphore = nullptr;
+}
+
+unsigned simJobsNumWorkers()
+{
+	return simJobsThreads.size() + 1;
+}
+
+void simJobsParallelFor(size_t count, std::function<void (size_t item, unsigned worker)> const &func)
+{
+	// Not worth waking up the other threads, if they would get one batch at most.
+	size_t numHelpers = std::min<size_t>(simJobsThreads.size(), count / SIM_JOBS_BATCH);
+	if (numHelpers == 0)
+	{
+		for (size_t item = 0; item != count; ++item)
+		{
+			func(item, 0);
+		}
+		return;
+	}
+
+	simJobsFunc = &func;
+	simJobsCount = count;
+	simJobsNextItem = 0;
+	for (size_t n = 0; n < numHelpers; ++n)
+	{
+		wzSemaphorePost(simJobsStartSemaphore);
+	}
+	simJobsRun(0);
+	for (size_t n = 0; n < numHelpers; ++n)
+	{
+		wzSemaphoreWait(simJobsDoneSemaphore);
+	}
+	simJobsFunc = nullptr;
+}
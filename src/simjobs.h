@@ -0,0 +1,43 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/** @file
+ *  Worker threads for running independent parts of a game tick in parallel.
+ *
+ *  Work is split into items which must not depend on each other. Each item may run on any thread, so it may only
+ *  read the game state, and write to storage belonging to that item or to the worker running it. The caller then
+ *  applies the results serially, in item order, so the outcome never depends on the number of threads.
+ */
+
+#ifndef __INCLUDED_SRC_SIMJOBS_H__
+#define __INCLUDED_SRC_SIMJOBS_H__
+
+#include <cstddef>
+#include <functional>
+
+bool simJobsInitialise();
+void simJobsShutdown();
+
+/// Number of threads running items, including the calling thread. Always at least 1.
+unsigned simJobsNumWorkers();
+
+/// Calls func(item, worker) for each item in [0, count), and returns once all items are done.
+/// worker is less than simJobsNumWorkers(), and is unique among the threads running at the same time. Must only be called from the main thread.
+void simJobsParallelFor(size_t count, std::function<void (size_t item, unsigned worker)> const &func);
+
+#endif // __INCLUDED_SRC_SIMJOBS_H__
@@ -3573,8 +3573,8 @@ void structureUpdate(STRUCTURE *psBuilding, bool mission)
 		{
 			bool		found = false;
 
-			static GridList gridList;  // static to avoid allocations.
-			gridList = gridStartIterate(psBuilding->pos.x, psBuilding->pos.y, TILE_UNITS);
+			GridList gridList;  // Only looked at while a gate waits to close, so not worth keeping around.
+			gridQuery(gridList, psBuilding->pos.x, psBuilding->pos.y, TILE_UNITS);
 			for (GridIterator gi = gridList.begin(); !found && gi != gridList.end(); ++gi)
 			{
 				found = isDroid(*gi);
@@ -0,0 +1,348 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/**
+ * @file threatmap.cpp
+ *
+ * Incrementally updated threat map.
+ */
+
+#include "threatmap.h"
+
+#include "objects.h"
+#include "ai.h"
+#include "map.h"
+#include "objmem.h"
+#include "stats.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+struct ThreatSource
+{
+	std::vector<TILEPOS> tiles;  ///< Watched tiles, as of when the source was last applied.
+	PlayerMask players = 0;      ///< Players that the source is a threat to.
+	UBYTE mode = 0;              ///< SHOOT_ON_GROUND and/or SHOOT_IN_AIR.
+};
+
+struct ThreatPlayerMap
+{
+	std::vector<uint16_t> ground;                     ///< Number of sources threatening each tile on the ground.
+	std::vector<uint16_t> air;                        ///< Number of sources threatening each tile in the air.
+	std::shared_ptr<ThreatSnapshot const> snapshot;  ///< Reset whenever ground changes between zero and non-zero.
+};
+
+static std::unordered_map<BASE_OBJECT const *, ThreatSource> threatSources;
+static std::vector<BASE_OBJECT const *> threatQueue;  ///< Objects to look at again at the next threatMapUpdate, may contain duplicates.
+static ThreatPlayerMap threatMaps[MAX_PLAYERS];
+static bool threatMapActive = false;
+static bool threatMapInvalid = false;  ///< Rebuild everything from the object lists at the next threatMapUpdate.
+
+static UBYTE droidThreatMode(DROID const *psDroid)
+{
+	if (psDroid->droidType == DROID_CONSTRUCT || psDroid->droidType == DROID_CYBORG_CONSTRUCT
+	    || psDroid->droidType == DROID_REPAIR || psDroid->droidType == DROID_CYBORG_REPAIR)
+	{
+		return 0;	// hack that really should not be needed, but is -- trucks can SHOOT_ON_GROUND...!
+	}
+	UBYTE mode = 0;
+	for (int weapon = 0; weapon < psDroid->numWeaps; weapon++)
+	{
+		mode |= asWeaponStats[psDroid->asWeaps[weapon].nStat].surfaceToAir;
+	}
+	if (psDroid->droidType == DROID_SENSOR)	// special treatment for sensor turrets, no multiweapon support
+	{
+		mode |= SHOOT_ON_GROUND;		// assume it only shoots at ground targets for now
+	}
+	return mode;
+}
+
+static UBYTE structThreatMode(STRUCTURE const *psStruct)
+{
+	UBYTE mode = 0;
+	for (int weapon = 0; weapon < psStruct->numWeaps; weapon++)
+	{
+		mode |= asWeaponStats[psStruct->asWeaps[weapon].nStat].surfaceToAir;
+	}
+	if (psStruct->pStructureType->pSensor && psStruct->pStructureType->pSensor->location == LOC_TURRET)	// special treatment for sensor turrets
+	{
+		mode |= SHOOT_ON_GROUND;		// assume it only shoots at ground targets for now
+	}
+	return mode;
+}
+
+/// Players who know about the object and aren't allied to its owner, whether or not it is armed.
+static PlayerMask threatPlayers(BASE_OBJECT const *psObj)
+{
+	PlayerMask players = 0;
+	for (int player = 0; player < MAX_PLAYERS; ++player)
+	{
+		if (!aiCheckAlliances(player, psObj->player) && (psObj->visible[player] || psObj->born == 2))
+		{
+			players |= 1 << player;
+		}
+	}
+	return players;
+}
+
+static inline void threatCountAdd(std::vector<uint16_t> &counts, ThreatPlayerMap &map, int player, TILEPOS pos, int bit)
+{
+	uint16_t &count = counts[pos.x + pos.y * mapWidth];
+	if (count++ == 0)
+	{
+		auxSet(pos.x, pos.y, player, bit);
+		if (bit == AUXBITS_THREAT)
+		{
+			map.snapshot.reset();
+		}
+	}
+}
+
+static inline void threatCountRemove(std::vector<uint16_t> &counts, ThreatPlayerMap &map, int player, TILEPOS pos, int bit)
+{
+	uint16_t &count = counts[pos.x + pos.y * mapWidth];
+	ASSERT_OR_RETURN(, count > 0, "Threat count underflow at (%d, %d)", pos.x, pos.y);
+	if (--count == 0)
+	{
+		auxClear(pos.x, pos.y, player, bit);
+		if (bit == AUXBITS_THREAT)
+		{
+			map.snapshot.reset();
+		}
+	}
+}
+
+/// Adds (or removes, if !add) the contribution of the source to the threat maps.
+static void threatApply(ThreatSource const &source, bool add)
+{
+	for (int player = 0; player < MAX_PLAYERS; ++player)
+	{
+		if ((source.players & (1 << player)) == 0)
+		{
+			continue;
+		}
+		ThreatPlayerMap &map = threatMaps[player];
+		for (TILEPOS pos : source.tiles)
+		{
+			if (source.mode & SHOOT_ON_GROUND)
+			{
+				add ? threatCountAdd(map.ground, map, player, pos, AUXBITS_THREAT) : threatCountRemove(map.ground, map, player, pos, AUXBITS_THREAT);
+			}
+			if (source.mode & SHOOT_IN_AIR)
+			{
+				add ? threatCountAdd(map.air, map, player, pos, AUXBITS_AATHREAT) : threatCountRemove(map.air, map, player, pos, AUXBITS_AATHREAT);
+			}
+		}
+	}
+}
+
+static bool sameTiles(std::vector<TILEPOS> const &a, std::vector<TILEPOS> const &b)
+{
+	return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(), [](TILEPOS const &p, TILEPOS const &q) {
+		return p.x == q.x && p.y == q.y;
+	});
+}
+
+static void threatUpdateSource(BASE_OBJECT const *psObj)
+{
+	UBYTE mode = 0;
+	if (psObj->type == OBJ_DROID)
+	{
+		mode = droidThreatMode((DROID const *)psObj);
+	}
+	else if (psObj->type == OBJ_STRUCTURE)
+	{
+		mode = structThreatMode((STRUCTURE const *)psObj);
+	}
+	PlayerMask players = mode != 0 && !psObj->watchedTiles.empty() ? psObj->threatPlayers : 0;
+
+	auto i = threatSources.find(psObj);
+	if (players == 0)
+	{
+		if (i != threatSources.end())
+		{
+			threatApply(i->second, false);
+			threatSources.erase(i);
+		}
+		return;
+	}
+	if (i == threatSources.end())
+	{
+		i = threatSources.emplace(psObj, ThreatSource()).first;
+	}
+
+	ThreatSource &source = i->second;
+	if (source.players != players || source.mode != mode || !sameTiles(source.tiles, psObj->watchedTiles))
+	{
+		threatApply(source, false);
+		source.tiles = psObj->watchedTiles;
+		source.players = players;
+		source.mode = mode;
+		threatApply(source, true);
+	}
+}
+
+/// Clears the maps, and queues every droid and structure.
+static void threatRebuild()
+{
+	threatSources.clear();
+	threatQueue.clear();
+
+	const size_t size = static_cast<size_t>(mapWidth) * static_cast<size_t>(mapHeight);
+	for (int player = 0; player < MAX_PLAYERS; ++player)
+	{
+		threatMaps[player].ground.assign(size, 0);
+		threatMaps[player].air.assign(size, 0);
+		threatMaps[player].snapshot.reset();
+		for (int y = 0; y < mapHeight; ++y)
+		{
+			for (int x = 0; x < mapWidth; ++x)
+			{
+				auxClear(x, y, player, AUXBITS_THREAT | AUXBITS_AATHREAT);
+			}
+		}
+	}
+
+	for (int owner = 0; owner < MAX_PLAYERS; ++owner)
+	{
+		BASE_OBJECT *lists[] = {apsDroidLists[owner], apsStructLists[owner]};
+		for (BASE_OBJECT *psList : lists)
+		{
+			for (BASE_OBJECT *psObj = psList; psObj != nullptr; psObj = psObj->psNext)
+			{
+				psObj->threatPlayers = threatPlayers(psObj);
+				threatQueue.push_back(psObj);
+			}
+		}
+	}
+	threatMapInvalid = false;
+}
+
+void threatMapInit()
+{
+	threatMapShutdown();
+	threatMapActive = true;
+	threatMapInvalid = true;
+	threatMapUpdate();
+}
+
+void threatMapShutdown()
+{
+	threatSources.clear();
+	threatQueue.clear();
+	for (ThreatPlayerMap &map : threatMaps)
+	{
+		map = ThreatPlayerMap();
+	}
+	threatMapActive = false;
+	threatMapInvalid = false;
+}
+
+void threatMapInvalidate()
+{
+	// The sources may refer to tiles of another map now, so never apply them again.
+	threatSources.clear();
+	threatQueue.clear();
+	threatMapInvalid = true;
+}
+
+void threatMapObjectChanged(BASE_OBJECT const *psObj)
+{
+	if (threatMapActive && (threatQueue.empty() || threatQueue.back() != psObj))
+	{
+		threatQueue.push_back(psObj);
+	}
+}
+
+void threatMapVisibilityUpdated(BASE_OBJECT *psObj)
+{
+	PlayerMask players = threatPlayers(psObj);
+	if (players != psObj->threatPlayers)
+	{
+		psObj->threatPlayers = players;
+		threatMapObjectChanged(psObj);
+	}
+}
+
+void threatMapPlayerChanged(int player)
+{
+	ASSERT_OR_RETURN(, player >= 0 && player < MAX_PLAYERS, "Bad player %d", player);
+	for (DROID const *psDroid = apsDroidLists[player]; psDroid != nullptr; psDroid = psDroid->psNext)
+	{
+		threatMapObjectChanged(psDroid);
+	}
+	for (STRUCTURE const *psStruct = apsStructLists[player]; psStruct != nullptr; psStruct = psStruct->psNext)
+	{
+		threatMapObjectChanged(psStruct);
+	}
+}
+
+void threatMapObjectRemoved(BASE_OBJECT const *psObj)
+{
+	threatQueue.erase(std::remove(threatQueue.begin(), threatQueue.end(), psObj), threatQueue.end());
+	auto i = threatSources.find(psObj);
+	if (i != threatSources.end())
+	{
+		threatApply(i->second, false);
+		threatSources.erase(i);
+	}
+}
+
+void threatMapUpdate()
+{
+	if (!threatMapActive)
+	{
+		return;
+	}
+
+	if (threatMapInvalid)
+	{
+		threatRebuild();
+	}
+	// The order doesn't matter, since only counts change.
+	for (BASE_OBJECT const *psObj : threatQueue)
+	{
+		threatUpdateSource(psObj);
+	}
+	threatQueue.clear();
+}
+
+std::shared_ptr<ThreatSnapshot const> threatMapSnapshot(int player)
+{
+	ASSERT_OR_RETURN(nullptr, player >= 0 && player < MAX_PLAYERS, "Bad player %d", player);
+	if (!threatMapActive)
+	{
+		return nullptr;
+	}
+
+	ThreatPlayerMap &map = threatMaps[player];
+	if (!map.snapshot)
+	{
+		ThreatSnapshot *snapshot = new ThreatSnapshot;
+		snapshot->ground.resize(map.ground.size());
+		uint32_t checksum = 0, factor = 0;
+		for (size_t i = 0; i < map.ground.size(); ++i)
+		{
+			snapshot->ground[i] = map.ground[i] != 0;
+			checksum ^= snapshot->ground[i] * (factor = 3 * factor + 1);
+		}
+		snapshot->checksum = checksum;
+		map.snapshot.reset(snapshot);
+	}
+	return map.snapshot;
+}
@@ -0,0 +1,65 @@
+/*
+	This file is part of Warzone 2100.
+	Copyright (C) 2020  Warzone 2100 Project
+
+	Warzone 2100 is free software; you can redistribute it and/or modify
+	it under the terms of the GNU General Public License as published by
+	the Free Software Foundation; either version 2 of the License, or
+	(at your option) any later version.
+
+	Warzone 2100 is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with Warzone 2100; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+*/
+/** @file
+ *  Per-player threat map, telling where hostile armed objects can shoot.
+ *
+ *  Every armed droid and structure which some player knows about contributes the tiles it watches to the threat map
+ *  of that player. The contribution of each object is remembered, and only objects which are reported to have changed
+ *  their watched tiles, visibility, alliances or weapons, or to have died, are looked at again, so the cost of an update
+ *  depends on what changed rather than on the number of objects. AUXBITS_THREAT and AUXBITS_AATHREAT in the aux maps
+ *  are kept up to date with the counts.
+ */
+
+#ifndef __INCLUDED_SRC_THREATMAP_H__
+#define __INCLUDED_SRC_THREATMAP_H__
+
+#include "lib/framework/frame.h"
+
+#include <memory>
+#include <vector>
+
+struct BASE_OBJECT;
+
+/// Immutable copy of the ground threat of a player, safe to read from any thread.
+struct ThreatSnapshot
+{
+	std::vector<bool> ground;  ///< Indexed by x + y * mapWidth.
+	uint32_t checksum;         ///< For syncDebug.
+};
+
+/// Start tracking threats on the current map.
+void threatMapInit();
+/// Forget all threats.
+void threatMapShutdown();
+/// Apply the changes in threats since the last call. Call once per game tick.
+void threatMapUpdate();
+/// Rebuild everything at the next update. Call when the object lists or the map are swapped or replaced wholesale.
+void threatMapInvalidate();
+/// Look at the object again at the next update. Call when its watched tiles or weapons changed.
+void threatMapObjectChanged(BASE_OBJECT const *psObj);
+/// Queues the object if the set of players it can be a threat to changed, due to visibility or alliances. Call after updating its visibility.
+void threatMapVisibilityUpdated(BASE_OBJECT *psObj);
+/// Look at all droids and structures of the player again at the next update.
+void threatMapPlayerChanged(int player);
+/// Forget the object at once. Call when it is destroyed.
+void threatMapObjectRemoved(BASE_OBJECT const *psObj);
+/// Returns the current ground threat of the player, or nullptr if threats are not tracked. The snapshot is only rebuilt after the threat changed.
+std::shared_ptr<ThreatSnapshot const> threatMapSnapshot(int player);
+
+#endif // __INCLUDED_SRC_THREATMAP_H__
@@ -24,6 +24,7 @@
  */
 #include "lib/framework/frame.h"
 #include "lib/framework/fixedpoint.h"
+#include "lib/framework/wzprofile.h"
 
 #include "lib/gamelib/gtime.h"
 #include "lib/sound/audio.h"
@@ -46,6 +47,10 @@
 #include "multiplay.h"
 #include "qtscript.h"
 #include "wavecast.h"
+#include "simjobs.h"
+#include "threatmap.h"
+
+#include <unordered_map>
 
 // accuracy for the height gradient
 #define GRAD_MUL 10000
@@ -92,9 +97,6 @@ struct VisibleObjectHelp_t
 	Vector2i wall; // The position of a wall if it is on the LOS
 };
 
-static int *gNumWalls = nullptr;
-static Vector2i *gWall = nullptr;
-
 // forward declarations
 static void setSeenBy(BASE_OBJECT *psObj, unsigned viewer, int val);
 
@@ -197,7 +199,7 @@ static void updateSpotters()
 			continue;
 		}
 		// else, ie if not expired, show objects around it
-		gridList = gridStartIterateUnseen(world_coord(psSpot->pos.x), world_coord(psSpot->pos.y), psSpot->sensorRadius, psSpot->player);
+		gridQueryUnseen(gridList, world_coord(psSpot->pos.x), world_coord(psSpot->pos.y), psSpot->sensorRadius, psSpot->player);
 		for (GridIterator gi = gridList.begin(); gi != gridList.end(); ++gi)
 		{
 			BASE_OBJECT *psObj = *gi;
@@ -249,14 +251,77 @@ static inline void visMarkTile(const BASE_OBJECT *psObj, int mapX, int mapY, MAP
 	}
 }
 
-/* The terrain revealing ray callback */
-static void doWaveTerrain(BASE_OBJECT *psObj)
+/// Identifies the terrain visible from a point. Everything else in doWaveTerrain only depends on the terrain heights.
+struct WaveTerrainKey
+{
+	bool operator ==(WaveTerrainKey const &b) const
+	{
+		return mapGeneration == b.mapGeneration && x == b.x && y == b.y && z == b.z && radius == b.radius;
+	}
+
+	uint32_t mapGeneration;  ///< mapTilesGeneration, so results never outlive their map, even if another is allocated at the same address.
+	int x, y;                ///< Tile coordinates of the viewer.
+	int z;                   ///< Height of the viewer's eyes.
+	unsigned radius;
+};
+
+struct WaveTerrainKeyHash
+{
+	size_t operator ()(WaveTerrainKey const &k) const
+	{
+		return (size_t)k.mapGeneration * 2654435761u ^ ((size_t)k.x * 7919 + (size_t)k.y * 104729 + (size_t)k.z * 31 + k.radius);
+	}
+};
+
+/// Maximum number of results kept in the cache, before throwing them all away.
+#define WAVE_TERRAIN_CACHE_SIZE 1024
+
+/// Width and height, in tiles, of the map areas by which the cache is indexed.
+#define WAVE_TERRAIN_BUCKET 8
+
+/// Tiles visible from a given point, for viewers which rarely move. Cleared when the terrain changes.
+static std::unordered_map<WaveTerrainKey, std::vector<TILEPOS>, WaveTerrainKeyHash> waveTerrainCache;
+/// Keys of the cached results depending on the heights in each map area, so that a height change only looks at results nearby.
+static std::vector<std::vector<WaveTerrainKey>> waveTerrainBuckets;
+static int waveTerrainBucketsX = 0;
+/// mapTilesGeneration when waveTerrainBuckets was sized, since other maps may have other dimensions.
+static uint32_t waveTerrainBucketsGeneration = 0;
+
+/// Calls func on the bucket of each map area the result for key depends on.
+template<class Function>
+static void waveTerrainForEachBucket(WaveTerrainKey const &key, Function &&func)
+{
+	const int tileRadius = map_coord(key.radius) + 1;
+	const int bx0 = std::max(key.x - tileRadius, 0) / WAVE_TERRAIN_BUCKET, bx1 = std::min(key.x + tileRadius, mapWidth - 1) / WAVE_TERRAIN_BUCKET;
+	const int by0 = std::max(key.y - tileRadius, 0) / WAVE_TERRAIN_BUCKET, by1 = std::min(key.y + tileRadius, mapHeight - 1) / WAVE_TERRAIN_BUCKET;
+	for (int by = by0; by <= by1; ++by)
+	{
+		for (int bx = bx0; bx <= bx1; ++bx)
+		{
+			func(waveTerrainBuckets[bx + by * waveTerrainBucketsX]);
+		}
+	}
+}
+
+/// Empties the cache, and sizes its index for the current map.
+static void waveTerrainCacheReset()
+{
+	waveTerrainCache.clear();
+	waveTerrainBucketsX = (mapWidth + WAVE_TERRAIN_BUCKET - 1) / WAVE_TERRAIN_BUCKET;
+	const int bucketsY = (mapHeight + WAVE_TERRAIN_BUCKET - 1) / WAVE_TERRAIN_BUCKET;
+	waveTerrainBuckets.clear();
+	waveTerrainBuckets.resize(waveTerrainBucketsX * bucketsY);
+	waveTerrainBucketsGeneration = mapTilesGeneration;
+}
+
+static bool waveTerrainCacheIsForCurrentMap()
+{
+	return waveTerrainBucketsGeneration == mapTilesGeneration && !waveTerrainBuckets.empty();
+}
+
+/* Find all the tiles that can be seen from (sx, sy, sz) in the given radius, in the order they are scanned. */
+static void calcWaveTerrain(int sx, int sy, int sz, unsigned radius, std::vector<TILEPOS> &seenTiles)
 {
-	const int sx = psObj->pos.x;
-	const int sy = psObj->pos.y;
-	const int sz = psObj->pos.z + MAX(MIN_VIS_HEIGHT, psObj->sDisplay.imd->max.y);
-	const unsigned radius = objSensorRange(psObj);
-	const int rayPlayer = psObj->player;
 	size_t size;
 	const WavecastTile *tiles = getWavecastTable(radius, &size);
 #define MAX_WAVECAST_LIST_SIZE 1360  // Trivial upper bound to what a fully upgraded WSS can use (its number of angles). Should probably be some factor times the maximum possible radius. Is probably a lot more than needed. Tested to need at least 180.
@@ -272,7 +337,7 @@ static void doWaveTerrain(BASE_OBJECT *psObj)
 	angles[!readList][writeListPos] = 0;               // Smallest angle.
 	++writeListPos;
 
-	psObj->watchedTiles.clear();
+	seenTiles.clear();
 	for (size_t i = 0; i < size; ++i)
 	{
 		const int mapX = map_coord(sx) + tiles[i].dx;
@@ -327,12 +392,92 @@ static void doWaveTerrain(BASE_OBJECT *psObj)
 		if (seen)
 		{
 			// Can see this tile.
-			psTile->tileExploredBits |= alliancebits[rayPlayer];                        // Share exploration with allies too
-			visMarkTile(psObj, mapX, mapY, psTile, psObj->watchedTiles);   // Mark this tile as seen by our sensor
+			seenTiles.push_back({uint8_t(mapX), uint8_t(mapY), 0});
 		}
 	}
 }
 
+/* The terrain revealing ray callback */
+static void doWaveTerrain(BASE_OBJECT *psObj)
+{
+	const int sx = psObj->pos.x;
+	const int sy = psObj->pos.y;
+	const int sz = psObj->pos.z + MAX(MIN_VIS_HEIGHT, psObj->sDisplay.imd->max.y);
+	const unsigned radius = objSensorRange(psObj);
+	const int rayPlayer = psObj->player;
+
+	std::vector<TILEPOS> const *seenTiles;
+	static std::vector<TILEPOS> uncachedTiles;  // static to avoid allocations.
+	if (psObj->type == OBJ_STRUCTURE)
+	{
+		// Structures don't move, but get here again whenever they are upgraded, so keep their results.
+		if (!waveTerrainCacheIsForCurrentMap())
+		{
+			waveTerrainCacheReset();
+		}
+		WaveTerrainKey key = {mapTilesGeneration, map_coord(sx), map_coord(sy), sz, radius};
+		auto cached = waveTerrainCache.find(key);
+		if (cached == waveTerrainCache.end())
+		{
+			if (waveTerrainCache.size() >= WAVE_TERRAIN_CACHE_SIZE)
+			{
+				waveTerrainCacheReset();
+			}
+			cached = waveTerrainCache.emplace(key, std::vector<TILEPOS>()).first;
+			calcWaveTerrain(sx, sy, sz, radius, cached->second);
+			waveTerrainForEachBucket(key, [&](std::vector<WaveTerrainKey> &bucket) {
+				bucket.push_back(key);
+			});
+		}
+		seenTiles = &cached->second;
+	}
+	else
+	{
+		// Droids are usually here because they moved to a different tile, so caching wouldn't help.
+		calcWaveTerrain(sx, sy, sz, radius, uncachedTiles);
+		seenTiles = &uncachedTiles;
+	}
+
+	psObj->watchedTiles.clear();
+	for (TILEPOS const &tile : *seenTiles)
+	{
+		MAPTILE *psTile = mapTile(tile.x, tile.y);
+		psTile->tileExploredBits |= alliancebits[rayPlayer];                        // Share exploration with allies too
+		visMarkTile(psObj, tile.x, tile.y, psTile, psObj->watchedTiles);   // Mark this tile as seen by our sensor
+	}
+}
+
+void visTerrainHeightChanged(int x, int y)
+{
+	if (!waveTerrainCacheIsForCurrentMap() || x < 0 || y < 0 || x >= mapWidth || y >= mapHeight)
+	{
+		return;  // Nothing cached for this map, or not a tile of it.
+	}
+
+	std::vector<WaveTerrainKey> &tileBucket = waveTerrainBuckets[x / WAVE_TERRAIN_BUCKET + y / WAVE_TERRAIN_BUCKET * waveTerrainBucketsX];
+	for (size_t i = 0; i < tileBucket.size();)
+	{
+		const WaveTerrainKey key = tileBucket[i];
+		const int tileRadius = map_coord(key.radius) + 1;
+		if (abs(key.x - x) > tileRadius || abs(key.y - y) > tileRadius)
+		{
+			++i;
+			continue;
+		}
+		waveTerrainCache.erase(key);
+		// This also removes tileBucket[i], moving the next key there.
+		waveTerrainForEachBucket(key, [&](std::vector<WaveTerrainKey> &bucket) {
+			bucket.erase(std::find(bucket.begin(), bucket.end(), key));
+		});
+	}
+}
+
+void visClearTerrainCache()
+{
+	waveTerrainCache.clear();
+	waveTerrainBuckets.clear();
+}
+
 /* The los ray callback */
 static bool rayLOSCallback(Vector2i pos, int32_t dist, void *data)
 {
@@ -411,11 +556,13 @@ void visRemoveVisibility(BASE_OBJECT *psObj)
 	}
 	psObj->watchedTiles.clear();
 	psObj->flags.set(OBJECT_FLAG_JAMMED_TILES, false);
+	threatMapObjectChanged(psObj);  // Also covers visTilesUpdate, since the threat map only looks at the tiles at the next update.
 }
 
 void visRemoveVisibilityOffWorld(BASE_OBJECT *psObj)
 {
 	psObj->watchedTiles.clear();
+	threatMapObjectChanged(psObj);
 }
 
 /* Check which tiles can be seen by an object */
@@ -461,75 +608,53 @@ void revealAll(UBYTE player)
 	//the objects gets revealed in processVisibility()
 }
 
-/* Check whether psViewer can see psTarget.
- * psViewer should be an object that has some form of sensor,
- * currently droids and structures.
- * psTarget can be any type of BASE_OBJECT (e.g. a tree).
- * struckBlock controls whether structures block LOS
- */
-int visibleObject(const BASE_OBJECT *psViewer, const BASE_OBJECT *psTarget, bool wallsBlock)
+/// The parts of visibleObject which only depend on the viewer, so they can be shared when checking several targets.
+struct VisibleObjectViewer
+{
+	const BASE_OBJECT *psViewer;
+	const DROID *psDroid;       ///< psViewer, if it is a droid.
+	const STRUCTURE *psStruct;  ///< psViewer, if it is a structure.
+	int range;                  ///< Sensor range.
+	int startHeight;            ///< Height of the viewer, for the line of sight.
+	bool isVtol;
+	bool isRadarDetector;
+	bool aaVsVtol;              ///< Structure with anti-air weapons, which sees further when looking at VTOLs.
+	int *numWalls;              ///< If not nullptr, set to whether the line of sight hit a wall, see visGetBlockingWall.
+	Vector2i *wall;             ///< If not nullptr, set to the position of that wall.
+};
+
+static int visibleObjectFrom(VisibleObjectViewer const &viewer, const BASE_OBJECT *psTarget, bool wallsBlock)
 {
-	ASSERT_OR_RETURN(0, psViewer != nullptr, "Invalid viewer pointer!");
 	ASSERT_OR_RETURN(0, psTarget != nullptr, "Invalid viewed pointer!");
 
-	int range = objSensorRange(psViewer);
+	const BASE_OBJECT *psViewer = viewer.psViewer;
+	int range = viewer.range;
 
-	if (!worldOnMap(psViewer->pos.x, psViewer->pos.y) || !worldOnMap(psTarget->pos.x, psTarget->pos.y))
+	if (!worldOnMap(psTarget->pos.x, psTarget->pos.y))
 	{
 		//Most likely a VTOL or transporter
 		debug(LOG_WARNING, "Trying to view something off map!");
 		return 0;
 	}
 
-	/* Get the sensor range */
-	switch (psViewer->type)
+	if (viewer.psDroid != nullptr && viewer.psDroid->order.psObj == psTarget && cbSensorDroid(viewer.psDroid))
 	{
-	case OBJ_DROID:
+		// if it is targetted by a counter battery sensor, it is seen
+		return UBYTE_MAX;
+	}
+	if (viewer.psStruct != nullptr)
+	{
+		if (viewer.aaVsVtol && psTarget->type == OBJ_DROID && isVtolDroid((const DROID *)psTarget))
 		{
-			const DROID *psDroid = (const DROID *)psViewer;
-
-			if (psDroid->order.psObj == psTarget && cbSensorDroid(psDroid))
-			{
-				// if it is targetted by a counter battery sensor, it is seen
-				return UBYTE_MAX;
-			}
-			break;
+			range = 3 * range / 2;	// increase vision range of AA vs VTOL
 		}
-	case OBJ_STRUCTURE:
-		{
-			const STRUCTURE *psStruct = (const STRUCTURE *)psViewer;
-
-			// a structure that is being built cannot see anything
-			if (psStruct->status != SS_BUILT)
-			{
-				return 0;
-			}
-
-			if (psStruct->pStructureType->type == REF_WALL
-			    || psStruct->pStructureType->type == REF_GATE
-			    || psStruct->pStructureType->type == REF_WALLCORNER)
-			{
-				return 0;
-			}
 
-			if (psTarget->type == OBJ_DROID && isVtolDroid((const DROID *)psTarget)
-			    && asWeaponStats[psStruct->asWeaps[0].nStat].surfaceToAir == SHOOT_IN_AIR)
-			{
-				range = 3 * range / 2;	// increase vision range of AA vs VTOL
-			}
-
-			if (psStruct->psTarget[0] == psTarget && (structCBSensor(psStruct) || structVTOLCBSensor(psStruct)))
-			{
-				// if a unit is targetted by a counter battery sensor
-				// it is automatically seen
-				return UBYTE_MAX;
-			}
-			break;
+		if (viewer.psStruct->psTarget[0] == psTarget && (structCBSensor(viewer.psStruct) || structVTOLCBSensor(viewer.psStruct)))
+		{
+			// if a unit is targetted by a counter battery sensor
+			// it is automatically seen
+			return UBYTE_MAX;
 		}
-	default:
-		ASSERT(false, "Visibility checking is only implemented for units and structures");
-		return 0;
-		break;
 	}
 
 	/* First see if the target is in sensor range */
@@ -543,8 +668,7 @@ int visibleObject(const BASE_OBJECT *psViewer, const BASE_OBJECT *psTarget, bool
 	const bool jammed = psTile->jammerBits & ~alliancebits[psViewer->player];
 
 	// Special rule for VTOLs, as they are not affected by ECM
-	if (((psTarget->type == OBJ_DROID && isVtolDroid((const DROID *)psTarget))
-	     || (psViewer->type == OBJ_DROID && isVtolDroid((const DROID *)psViewer)))
+	if (((psTarget->type == OBJ_DROID && isVtolDroid((const DROID *)psTarget)) || viewer.isVtol)
 	    && dist < range)
 	{
 		return UBYTE_MAX;
@@ -554,7 +678,7 @@ int visibleObject(const BASE_OBJECT *psViewer, const BASE_OBJECT *psTarget, bool
 	VisibleObjectHelp_t help = {
 		true,
 		wallsBlock,
-		psViewer->pos.z + map_Height(psViewer->pos.x, psViewer->pos.y),
+		viewer.startHeight,
 		map_coord(psTarget->pos.xy()),
 		0,
 		0,
@@ -566,10 +690,10 @@ int visibleObject(const BASE_OBJECT *psViewer, const BASE_OBJECT *psTarget, bool
 	// Cast a ray from the viewer to the target
 	rayCast(psViewer->pos.xy(), psTarget->pos.xy(), rayLOSCallback, &help);
 
-	if (gWall != nullptr && gNumWalls != nullptr) // Out globals are set
+	if (viewer.wall != nullptr && viewer.numWalls != nullptr)
 	{
-		*gWall = help.wall;
-		*gNumWalls = help.numWalls;
+		*viewer.wall = help.wall;
+		*viewer.numWalls = help.numWalls;
 	}
 
 	bool tileWatched = psTile->watchers[psViewer->player] > 0;
@@ -589,7 +713,7 @@ int visibleObject(const BASE_OBJECT *psViewer, const BASE_OBJECT *psTarget, bool
 		return UBYTE_MAX;
 	}
 	// Show detected sensors as radar blips
-	if (objRadarDetector(psViewer) && objActiveRadar(psTarget) && dist < range * 10)
+	if (viewer.isRadarDetector && objActiveRadar(psTarget) && dist < range * 10)
 	{
 		return UBYTE_MAX / 2;
 	}
@@ -597,20 +721,109 @@ int visibleObject(const BASE_OBJECT *psViewer, const BASE_OBJECT *psTarget, bool
 	return 0;
 }
 
+/// Fills in viewer for psViewer. Returns false if psViewer can't see anything at all.
+static bool visibleObjectViewer(VisibleObjectViewer &viewer, const BASE_OBJECT *psViewer)
+{
+	ASSERT_OR_RETURN(false, psViewer != nullptr, "Invalid viewer pointer!");
+
+	if (!worldOnMap(psViewer->pos.x, psViewer->pos.y))
+	{
+		//Most likely a VTOL or transporter
+		debug(LOG_WARNING, "Trying to view something off map!");
+		return false;
+	}
+
+	viewer.psViewer = psViewer;
+	viewer.psDroid = nullptr;
+	viewer.psStruct = nullptr;
+	viewer.aaVsVtol = false;
+	viewer.numWalls = nullptr;
+	viewer.wall = nullptr;
+
+	/* Get the sensor range */
+	switch (psViewer->type)
+	{
+	case OBJ_DROID:
+		viewer.psDroid = (const DROID *)psViewer;
+		break;
+	case OBJ_STRUCTURE:
+		{
+			const STRUCTURE *psStruct = (const STRUCTURE *)psViewer;
+
+			// a structure that is being built cannot see anything
+			if (psStruct->status != SS_BUILT)
+			{
+				return false;
+			}
+
+			if (psStruct->pStructureType->type == REF_WALL
+			    || psStruct->pStructureType->type == REF_GATE
+			    || psStruct->pStructureType->type == REF_WALLCORNER)
+			{
+				return false;
+			}
+
+			viewer.psStruct = psStruct;
+			viewer.aaVsVtol = asWeaponStats[psStruct->asWeaps[0].nStat].surfaceToAir == SHOOT_IN_AIR;
+			break;
+		}
+	default:
+		ASSERT(false, "Visibility checking is only implemented for units and structures");
+		return false;
+	}
+
+	viewer.range = objSensorRange(psViewer);
+	viewer.startHeight = psViewer->pos.z + map_Height(psViewer->pos.x, psViewer->pos.y);
+	viewer.isVtol = viewer.psDroid != nullptr && isVtolDroid(viewer.psDroid);
+	viewer.isRadarDetector = objRadarDetector(psViewer);
+	return true;
+}
+
+/* Check whether psViewer can see each of the targets, see visibleObject. */
+void visibleObjectBatch(const BASE_OBJECT *psViewer, const BASE_OBJECT *const *targets, size_t numTargets, bool wallsBlock, int *results)
+{
+	std::fill(results, results + numTargets, 0);
+
+	VisibleObjectViewer viewer;
+	if (!visibleObjectViewer(viewer, psViewer))
+	{
+		return;
+	}
+
+	for (size_t i = 0; i != numTargets; ++i)
+	{
+		results[i] = visibleObjectFrom(viewer, targets[i], wallsBlock);
+	}
+}
+
+/* Check whether psViewer can see psTarget.
+ * psViewer should be an object that has some form of sensor,
+ * currently droids and structures.
+ * psTarget can be any type of BASE_OBJECT (e.g. a tree).
+ * struckBlock controls whether structures block LOS
+ */
+int visibleObject(const BASE_OBJECT *psViewer, const BASE_OBJECT *psTarget, bool wallsBlock)
+{
+	ASSERT_OR_RETURN(0, psTarget != nullptr, "Invalid viewed pointer!");
+
+	int result;
+	visibleObjectBatch(psViewer, &psTarget, 1, wallsBlock, &result);
+	return result;
+}
+
 // Find the wall that is blocking LOS to a target (if any)
 STRUCTURE *visGetBlockingWall(const BASE_OBJECT *psViewer, const BASE_OBJECT *psTarget)
 {
 	int numWalls = 0;
 	Vector2i wall;
 
-	// HACK Using globals to not clutter visibleObject() interface too much
-	gNumWalls = &numWalls;
-	gWall = &wall;
-
-	visibleObject(psViewer, psTarget, true);
-
-	gNumWalls = nullptr;
-	gWall = nullptr;
+	VisibleObjectViewer viewer;
+	if (visibleObjectViewer(viewer, psViewer))
+	{
+		viewer.numWalls = &numWalls;
+		viewer.wall = &wall;
+		visibleObjectFrom(viewer, psTarget, true);
+	}
 
 	// see if there was a wall in the way
 	if (numWalls > 0)
@@ -705,19 +918,67 @@ static void processVisibilitySelf(BASE_OBJECT *psObj)
 	}
 }
 
-// Calculate which objects we can see. Better to call after processVisibilitySelf, since that check is cheaper.
-static void processVisibilityVision(BASE_OBJECT *psViewer)
+struct VisibilitySeen
+{
+	BASE_OBJECT *psObj;
+	int         val;
+};
+
+/// Buffers for processVisibilityVision, one per simulation thread.
+struct VisibilityWorker
 {
-	if (psViewer->type == OBJ_FEATURE)
+	GridList gridList;
+	std::vector<VisibilitySeen> seen;
+};
+
+/// Which part of VisibilityWorker::seen holds the results of a viewer.
+struct VisibilityViewer
+{
+	BASE_OBJECT *psViewer;
+	unsigned    worker;
+	size_t      begin, end;
+};
+
+static std::vector<VisibilityWorker> visWorkers;
+static std::vector<VisibilityViewer> visViewers;
+
+/// A call to triggerEventSeen, recorded for visSetCheckParallel.
+struct VisibilityEvent
+{
+	BASE_OBJECT *psViewer;
+	BASE_OBJECT *psObj;
+	int         val;
+
+	bool operator !=(VisibilityEvent const &o) const
 	{
-		return;
+		return psViewer != o.psViewer || psObj != o.psObj || val != o.val;
 	}
+};
+
+/// seenThisTick of an object, recorded for visSetCheckParallel.
+struct VisibilitySeenThisTick
+{
+	BASE_OBJECT *psObj;
+	UBYTE       seenThisTick[MAX_PLAYERS];
+};
+
+static bool visCheckParallel = false;             ///< Also run the vision pass serially each tick, and compare the results.
+static std::vector<VisibilityEvent> visCheckEvents;  ///< Events of the parallel vision pass, if visCheckParallel.
+static unsigned visCheckMismatches = 0;           ///< Number of ticks where the parallel and serial vision passes differed.
+
+// Calculate which objects we can see. Better to call after processVisibilitySelf, since that check is cheaper.
+// Only reads the game state, so it can run on any thread. The results are applied by processVisibilityVisionApply.
+static void processVisibilityVision(VisibilityViewer &viewer, unsigned worker)
+{
+	BASE_OBJECT *psViewer = viewer.psViewer;
+	VisibilityWorker &buffers = visWorkers[worker];
+
+	viewer.worker = worker;
+	viewer.begin = buffers.seen.size();
 
 	// get all the objects from the grid the droid is in
-	// Will give inconsistent results if hasSharedVision is not an equivalence relation.
-	static GridList gridList;  // static to avoid allocations.
-	gridList = gridStartIterateUnseen(psViewer->pos.x, psViewer->pos.y, objSensorRange(psViewer), psViewer->player);
-	for (GridIterator gi = gridList.begin(); gi != gridList.end(); ++gi)
+	gridQueryUnseen(buffers.gridList, psViewer->pos.x, psViewer->pos.y, objSensorRange(psViewer), psViewer->player);
+	for (GridIterator gi = buffers.gridList.begin(); gi != buffers.gridList.end(); ++gi)
 	{
 		BASE_OBJECT *psObj = *gi;
 
@@ -726,13 +987,148 @@ static void processVisibilityVision(BASE_OBJECT *psViewer)
 		// If we've got ranged line of sight...
 		if (val > 0)
 		{
-			// Tell system that this side can see this object
-			setSeenBy(psObj, psViewer->player, val);
+			buffers.seen.push_back({psObj, val});
+		}
+	}
+
+	viewer.end = buffers.seen.size();
+}
+
+// Must be called for each viewer in order, so that the result is the same as if each viewer had been processed completely before the next.
+static void processVisibilityVisionApply(VisibilityViewer const &viewer)
+{
+	BASE_OBJECT *psViewer = viewer.psViewer;
+	std::vector<VisibilitySeen> const &seen = visWorkers[viewer.worker].seen;
+
+	// Will give inconsistent results if hasSharedVision is not an equivalence relation.
+	for (size_t i = viewer.begin; i != viewer.end; ++i)
+	{
+		BASE_OBJECT *psObj = seen[i].psObj;
+		if (psObj->seenThisTick[psViewer->player] == UINT8_MAX)
+		{
+			continue;  // Fully seen by an earlier viewer, so gridQueryUnseen wouldn't have returned it, if the viewers were processed one at a time.
+		}
+
+		// Tell system that this side can see this object
+		setSeenBy(psObj, psViewer->player, seen[i].val);
 
-			// Check if scripting system wants to trigger an event for this
-			triggerEventSeen(psViewer, psObj);
+		if (visCheckParallel)
+		{
+			visCheckEvents.push_back({psViewer, psObj, seen[i].val});
+		}
+
+		// Check if scripting system wants to trigger an event for this
+		triggerEventSeen(psViewer, psObj);
+	}
+}
+
+static void visRecordSeenThisTick(std::vector<VisibilitySeenThisTick> &record)
+{
+	record.clear();
+	for (int player = 0; player < MAX_PLAYERS; ++player)
+	{
+		BASE_OBJECT *lists[] = {apsDroidLists[player], apsStructLists[player], apsFeatureLists[player]};
+		for (BASE_OBJECT *psList : lists)
+		{
+			for (BASE_OBJECT *psObj = psList; psObj != nullptr; psObj = psObj->psNext)
+			{
+				record.emplace_back();
+				record.back().psObj = psObj;
+				memcpy(record.back().seenThisTick, psObj->seenThisTick, sizeof(psObj->seenThisTick));
+			}
+		}
+	}
+}
+
+/// The vision pass as it was before it was split up for simJobsParallelFor, processing each viewer completely before the next.
+/// Records the results in seenThisTick and events, then restores seenThisTick as it was, without triggering any script events.
+static void processVisibilityVisionSerial(std::vector<VisibilitySeenThisTick> &seenThisTick, std::vector<VisibilityEvent> &events)
+{
+	std::vector<VisibilitySeenThisTick> before;
+	visRecordSeenThisTick(before);
+
+	events.clear();
+	GridList gridList;
+	for (VisibilityViewer const &viewer : visViewers)
+	{
+		BASE_OBJECT *psViewer = viewer.psViewer;
+		gridQueryUnseen(gridList, psViewer->pos.x, psViewer->pos.y, objSensorRange(psViewer), psViewer->player);
+		for (GridIterator gi = gridList.begin(); gi != gridList.end(); ++gi)
+		{
+			BASE_OBJECT *psObj = *gi;
+			int val = visibleObject(psViewer, psObj, false);
+			if (val > 0)
+			{
+				setSeenBy(psObj, psViewer->player, val);
+				events.push_back({psViewer, psObj, val});
+			}
+		}
+	}
+
+	visRecordSeenThisTick(seenThisTick);
+	for (VisibilitySeenThisTick const &record : before)
+	{
+		memcpy(record.psObj->seenThisTick, record.seenThisTick, sizeof(record.seenThisTick));
+	}
+}
+
+/// Compares the results of the parallel vision pass to those of processVisibilityVisionSerial. Returns false if they differ.
+static bool visCheckParallelResults(std::vector<VisibilitySeenThisTick> const &expectedSeen, std::vector<VisibilityEvent> const &expectedEvents)
+{
+	std::vector<VisibilitySeenThisTick> seen;
+	visRecordSeenThisTick(seen);
+	if (seen.size() != expectedSeen.size())
+	{
+		debug(LOG_WARNING, "Objects were added or removed by seen events, not comparing the vision passes");
+		return true;
+	}
+	bool same = true;
+	for (size_t i = 0; i < seen.size(); ++i)
+	{
+		BASE_OBJECT *psObj = seen[i].psObj;
+		for (int player = 0; player < MAX_PLAYERS; ++player)
+		{
+			if (seen[i].seenThisTick[player] != expectedSeen[i].seenThisTick[player])
+			{
+				ASSERT(false, "Parallel vision pass gives %s(%u) seenThisTick[%d] = %d, the serial pass gives %d",
+				       objInfo(psObj), psObj->id, player, seen[i].seenThisTick[player], expectedSeen[i].seenThisTick[player]);
+				same = false;
+			}
+		}
+	}
+	if (visCheckEvents.size() != expectedEvents.size())
+	{
+		ASSERT(false, "Parallel vision pass triggers %zu seen events, the serial pass %zu", visCheckEvents.size(), expectedEvents.size());
+		same = false;
+	}
+	for (size_t i = 0; i < std::min(visCheckEvents.size(), expectedEvents.size()); ++i)
+	{
+		if (visCheckEvents[i] != expectedEvents[i])
+		{
+			same = false;
+			ASSERT(false, "Seen event %zu differs: parallel pass %s(%u) sees %s(%u) at %d, the serial pass %s(%u) sees %s(%u) at %d", i,
+			       objInfo(visCheckEvents[i].psViewer), visCheckEvents[i].psViewer->id, objInfo(visCheckEvents[i].psObj), visCheckEvents[i].psObj->id, visCheckEvents[i].val,
+			       objInfo(expectedEvents[i].psViewer), expectedEvents[i].psViewer->id, objInfo(expectedEvents[i].psObj), expectedEvents[i].psObj->id, expectedEvents[i].val);
+			break;
 		}
 	}
+	return same;
+}
+
+void visSetCheckParallel(bool check)
+{
+	visCheckParallel = check;
+	visCheckEvents.clear();
+}
+
+bool visGetCheckParallel()
+{
+	return visCheckParallel;
+}
+
+unsigned visCheckParallelMismatches()
+{
+	return visCheckMismatches;
 }
 
 /* Find out what can see this object */
@@ -812,10 +1208,30 @@ static void processVisibilityLevel(BASE_OBJECT *psObj, bool& addedMessage)
 			}
 		}
 	}
+
+	if (psObj->type != OBJ_FEATURE)
+	{
+		threatMapVisibilityUpdated(psObj);
+	}
 }
 
 void processVisibility()
 {
+	WZ_PROFILE_SCOPE("processVisibility");
+
+	// Clear what was seen last tick before the spotters reveal anything, or what they reveal would be forgotten at once.
+	for (int player = 0; player < MAX_PLAYERS; ++player)
+	{
+		BASE_OBJECT *lists[] = {apsDroidLists[player], apsStructLists[player], apsFeatureLists[player]};
+		unsigned list;
+		for (list = 0; list < sizeof(lists) / sizeof(*lists); ++list)
+		{
+			for (BASE_OBJECT *psObj = lists[list]; psObj != nullptr; psObj = psObj->psNext)
+			{
+				memset(psObj->seenThisTick, 0, sizeof(psObj->seenThisTick));
+			}
+		}
+	}
 	updateSpotters();
 	for (int player = 0; player < MAX_PLAYERS; ++player)
 	{
@@ -829,6 +1245,7 @@ void processVisibility()
 			}
 		}
 	}
+	visViewers.clear();
 	for (int player = 0; player < MAX_PLAYERS; ++player)
 	{
 		BASE_OBJECT *lists[] = {apsDroidLists[player], apsStructLists[player]};
@@ -837,10 +1254,36 @@ void processVisibility()
 		{
 			for (BASE_OBJECT *psObj = lists[list]; psObj != nullptr; psObj = psObj->psNext)
 			{
-				processVisibilityVision(psObj);
+				visViewers.push_back({psObj, 0, 0, 0});
 			}
 		}
 	}
+	std::vector<VisibilitySeenThisTick> expectedSeen;
+	std::vector<VisibilityEvent> expectedEvents;
+	if (visCheckParallel)
+	{
+		processVisibilityVisionSerial(expectedSeen, expectedEvents);
+		visCheckEvents.clear();
+	}
+	visWorkers.resize(simJobsNumWorkers());
+	for (VisibilityWorker &worker : visWorkers)
+	{
+		worker.seen.clear();
+	}
+	simJobsParallelFor(visViewers.size(), [](size_t item, unsigned worker) {
+		processVisibilityVision(visViewers[item], worker);
+	});
+	for (VisibilityViewer const &viewer : visViewers)
+	{
+		processVisibilityVisionApply(viewer);
+	}
+	if (visCheckParallel)
+	{
+		if (!visCheckParallelResults(expectedSeen, expectedEvents))
+		{
+			++visCheckMismatches;
+		}
+	}
 	for (BASE_OBJECT *psObj = apsSensorList[0]; psObj != nullptr; psObj = psObj->psNextFunc)
 	{
 		if (objRadarDetector(psObj))
@@ -918,34 +1361,22 @@ void	setUnderTilesVis(BASE_OBJECT *psObj, UDWORD player)
 
 //forward declaration
 static int checkFireLine(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *psTarget, int weapon_slot, bool wallsBlock, bool direct);
+static Vector3i fireLineMuzzle(const SIMPLE_OBJECT *psViewer, int weapon_slot);
+static int checkFireLineFrom(Vector3i muzzle, const BASE_OBJECT *psTarget, bool wallsBlock, bool direct);
 
 /**
  * Check whether psViewer can fire directly at psTarget.
  * psTarget can be any type of BASE_OBJECT (e.g. a tree).
  */
-bool lineOfFire(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *psTarget, int weapon_slot, bool wallsBlock)
+/* Check whether a shot from muzzle can hit psTarget, with the given weapon range and trajectory */
+static bool lineOfFireFrom(const SIMPLE_OBJECT *psViewer, Vector3i muzzle, int range, bool direct, const BASE_OBJECT *psTarget, bool wallsBlock)
 {
-	WEAPON_STATS *psStats = nullptr;
-
-	ASSERT_OR_RETURN(false, psViewer != nullptr, "Invalid shooter pointer!");
-	ASSERT_OR_RETURN(false, psTarget != nullptr, "Invalid target pointer!");
-	ASSERT_OR_RETURN(false, psViewer->type == OBJ_DROID || psViewer->type == OBJ_STRUCTURE, "Bad viewer type");
-
-	if (psViewer->type == OBJ_DROID)
-	{
-		psStats = asWeaponStats + ((const DROID *)psViewer)->asWeaps[weapon_slot].nStat;
-	}
-	else if (psViewer->type == OBJ_STRUCTURE)
-	{
-		psStats = asWeaponStats + ((const STRUCTURE *)psViewer)->asWeaps[weapon_slot].nStat;
-	}
 	// 2d distance
 	int distance = iHypot((psTarget->pos - psViewer->pos).xy());
-	int range = proj_GetLongRange(psStats, psViewer->player);
-	if (proj_Direct(psStats))
+	if (direct)
 	{
 		/** direct shots could collide with ground **/
-		return range >= distance && LINE_OF_FIRE_MINIMUM <= checkFireLine(psViewer, psTarget, weapon_slot, wallsBlock, true);
+		return range >= distance && LINE_OF_FIRE_MINIMUM <= checkFireLineFrom(muzzle, psTarget, wallsBlock, true);
 	}
 	else
 	{
@@ -953,7 +1384,7 @@ bool lineOfFire(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *psTarget, int
 		 * indirect shots always have a line of fire, IF the forced
 		 * minimum angle doesn't move it out of range
 		 **/
-		int min_angle = checkFireLine(psViewer, psTarget, weapon_slot, wallsBlock, false);
+		int min_angle = checkFireLineFrom(muzzle, psTarget, wallsBlock, false);
 		// NOTE This code seems similar to the code in combFire in combat.cpp.
 		if (min_angle > DEG(PROJ_MAX_PITCH))
 		{
@@ -966,6 +1397,44 @@ bool lineOfFire(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *psTarget, int
 	}
 }
 
+static WEAPON_STATS *lineOfFireWeapon(const SIMPLE_OBJECT *psViewer, int weapon_slot)
+{
+	if (psViewer->type == OBJ_DROID)
+	{
+		return asWeaponStats + ((const DROID *)psViewer)->asWeaps[weapon_slot].nStat;
+	}
+	return asWeaponStats + ((const STRUCTURE *)psViewer)->asWeaps[weapon_slot].nStat;
+}
+
+bool lineOfFire(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *psTarget, int weapon_slot, bool wallsBlock)
+{
+	ASSERT_OR_RETURN(false, psViewer != nullptr, "Invalid shooter pointer!");
+	ASSERT_OR_RETURN(false, psTarget != nullptr, "Invalid target pointer!");
+	ASSERT_OR_RETURN(false, psViewer->type == OBJ_DROID || psViewer->type == OBJ_STRUCTURE, "Bad viewer type");
+
+	WEAPON_STATS *psStats = lineOfFireWeapon(psViewer, weapon_slot);
+	return lineOfFireFrom(psViewer, fireLineMuzzle(psViewer, weapon_slot), proj_GetLongRange(psStats, psViewer->player), proj_Direct(psStats), psTarget, wallsBlock);
+}
+
+/* Check whether psViewer can hit each of the targets, see lineOfFire. */
+void lineOfFireBatch(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *const *targets, size_t numTargets, int weapon_slot, bool wallsBlock, std::vector<bool> &results)
+{
+	results.assign(numTargets, false);
+	ASSERT_OR_RETURN(, psViewer != nullptr, "Invalid shooter pointer!");
+	ASSERT_OR_RETURN(, psViewer->type == OBJ_DROID || psViewer->type == OBJ_STRUCTURE, "Bad viewer type");
+
+	WEAPON_STATS *psStats = lineOfFireWeapon(psViewer, weapon_slot);
+	const int range = proj_GetLongRange(psStats, psViewer->player);
+	const bool direct = proj_Direct(psStats);
+	const Vector3i muzzle = fireLineMuzzle(psViewer, weapon_slot);
+
+	for (size_t i = 0; i != numTargets; ++i)
+	{
+		ASSERT_OR_RETURN(, targets[i] != nullptr, "Invalid target pointer!");
+		results[i] = lineOfFireFrom(psViewer, muzzle, range, direct, targets[i], wallsBlock);
+	}
+}
+
 /* Check how much of psTarget is hitable from psViewer's gun position */
 int areaOfFire(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *psTarget, int weapon_slot, bool wallsBlock)
 {
@@ -1021,12 +1490,6 @@ static inline void angle_check(int64_t *angletan, int positionSq, int height, in
  */
 static int checkFireLine(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *psTarget, int weapon_slot, bool wallsBlock, bool direct)
 {
-	Vector3i pos(0, 0, 0), dest(0, 0, 0);
-	Vector2i start(0, 0), diff(0, 0), current(0, 0), halfway(0, 0), next(0, 0), part(0, 0);
-	Vector3i muzzle(0, 0, 0);
-	int distSq, partSq, oldPartSq;
-	int64_t angletan;
-
 	ASSERT(psViewer != nullptr, "Invalid shooter pointer!");
 	ASSERT(psTarget != nullptr, "Invalid target pointer!");
 	if (!psViewer || !psTarget)
@@ -1034,6 +1497,14 @@ static int checkFireLine(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *psTar
 		return -1;
 	}
 
+	return checkFireLineFrom(fireLineMuzzle(psViewer, weapon_slot), psTarget, wallsBlock, direct);
+}
+
+/* Where shots from psViewer start */
+static Vector3i fireLineMuzzle(const SIMPLE_OBJECT *psViewer, int weapon_slot)
+{
+	Vector3i muzzle(0, 0, 0);
+
 	/* CorvusCorax: get muzzle offset (code from projectile.c)*/
 	if (psViewer->type == OBJ_DROID && weapon_slot >= 0)
 	{
@@ -1047,6 +1518,18 @@ static int checkFireLine(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *psTar
 	{
 		muzzle = psViewer->pos;
 	}
+	return muzzle;
+}
+
+/**
+ * Check fire line from muzzle to psTarget
+ */
+static int checkFireLineFrom(Vector3i muzzle, const BASE_OBJECT *psTarget, bool wallsBlock, bool direct)
+{
+	Vector3i pos(0, 0, 0), dest(0, 0, 0);
+	Vector2i start(0, 0), diff(0, 0), current(0, 0), halfway(0, 0), next(0, 0), part(0, 0);
+	int distSq, partSq, oldPartSq;
+	int64_t angletan;
 
 	pos = muzzle;
 	dest = psTarget->pos;
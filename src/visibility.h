@@ -25,6 +25,8 @@
 #include "raycast.h"
 #include "stats.h"
 
+#include <vector>
+
 #define LINE_OF_FIRE_MINIMUM 5
 
 // initialise the visibility stuff
@@ -33,6 +35,12 @@ bool visInitialise();
 /* Check which tiles can be seen by an object */
 void visTilesUpdate(BASE_OBJECT *psObj);
 
+/// Must be called when the height of a tile changes, so that cached terrain visibility around it is recalculated.
+void visTerrainHeightChanged(int x, int y);
+
+/// Forget all cached terrain visibility. Must be called when the map is freed, or when many tiles change height at once.
+void visClearTerrainCache();
+
 void revealAll(UBYTE player);
 
 /* Check whether psViewer can see psTarget
@@ -42,9 +50,19 @@ void revealAll(UBYTE player);
  */
 int visibleObject(const BASE_OBJECT *psViewer, const BASE_OBJECT *psTarget, bool wallsBlock);
 
+/** Same as calling visibleObject(psViewer, targets[i], wallsBlock) for each target, storing the results in results[i].
+ *  Everything which only depends on the viewer is only done once.
+ */
+void visibleObjectBatch(const BASE_OBJECT *psViewer, const BASE_OBJECT *const *targets, size_t numTargets, bool wallsBlock, int *results);
+
 /** Can shooter hit target with direct fire weapon? */
 bool lineOfFire(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *psTarget, int weapon_slot, bool wallsBlock);
 
+/** Same as calling lineOfFire(psViewer, targets[i], weapon_slot, wallsBlock) for each target, storing the results in results[i].
+ *  The muzzle position and weapon stats of the shooter are only looked up once.
+ */
+void lineOfFireBatch(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *const *targets, size_t numTargets, int weapon_slot, bool wallsBlock, std::vector<bool> &results);
+
 /** How much of target can the player hit with direct fire weapon? */
 int areaOfFire(const SIMPLE_OBJECT *psViewer, const BASE_OBJECT *psTarget, int weapon_slot, bool wallsBlock);
 
@@ -58,6 +76,13 @@ bool hasSharedVision(unsigned viewer, unsigned ally);
 
 void processVisibility();  ///< Calls processVisibilitySelf and processVisibilityVision on all objects.
 
+/// Debug switch: if set, processVisibility also runs the vision pass serially each tick, and asserts that the parallel pass gives the same seenThisTick and seen events.
+/// Enabled by --vischeck, which then fails --simbench and headless --replay runs if visCheckParallelMismatches() is not 0.
+void visSetCheckParallel(bool check);
+bool visGetCheckParallel();
+/// Number of ticks where the parallel and serial vision passes differed, while visGetCheckParallel().
+unsigned visCheckParallelMismatches();
+
 // update the visibility reduction
 void visUpdateLevel();
 
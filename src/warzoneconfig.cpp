@@ -65,6 +65,9 @@ struct WARZONE_GLOBALS
 	video_backend gfxBackend = video_backend::opengl; // the actual default value is determined in loadConfig()
 	JS_BACKEND jsBackend = (JS_BACKEND)0;
 	bool autoAdjustDisplayScale = true;
+	int pathfindingThreads = 0; // 0 = choose based on the number of CPU cores
+	int simulationThreads = 0; // 0 = choose based on the number of CPU cores
+	bool recordReplays = false;
 };
 
 static WARZONE_GLOBALS warGlobs;
@@ -412,3 +415,33 @@ void war_setAutoAdjustDisplayScale(bool autoAdjustDisplayScale)
 {
 	warGlobs.autoAdjustDisplayScale = autoAdjustDisplayScale;
 }
+
+int war_GetPathfindingThreads()
+{
+	return warGlobs.pathfindingThreads;
+}
+
+void war_SetPathfindingThreads(int threads)
+{
+	warGlobs.pathfindingThreads = std::max(threads, 0);
+}
+
+int war_GetSimulationThreads()
+{
+	return warGlobs.simulationThreads;
+}
+
+void war_SetSimulationThreads(int threads)
+{
+	warGlobs.simulationThreads = std::max(threads, 0);
+}
+
+bool war_GetRecordReplays()
+{
+	return warGlobs.recordReplays;
+}
+
+void war_SetRecordReplays(bool record)
+{
+	warGlobs.recordReplays = record;
+}
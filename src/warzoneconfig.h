@@ -116,6 +116,12 @@ JS_BACKEND war_getJSBackend();
 void war_setJSBackend(JS_BACKEND backend);
 bool war_getAutoAdjustDisplayScale();
 void war_setAutoAdjustDisplayScale(bool autoAdjustDisplayScale);
+int war_GetPathfindingThreads();
+void war_SetPathfindingThreads(int threads);
+int war_GetSimulationThreads();
+void war_SetSimulationThreads(int threads);
+bool war_GetRecordReplays();
+void war_SetRecordReplays(bool record);
 
 /**
  * Enable or disable sound initialization
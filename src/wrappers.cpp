@@ -108,9 +108,9 @@ static void setupLoadingScreen()
 
 bool recalculateEffectiveHeadlessValue()
 {
-	if (hostlaunch == HostLaunch::Skirmish || hostlaunch == HostLaunch::Autohost || autogame_enabled())
+	if (hostlaunch == HostLaunch::Skirmish || hostlaunch == HostLaunch::Autohost || hostlaunch == HostLaunch::Replay || autogame_enabled())
 	{
-		// only support headless mode if hostlaunch is --skirmish or --autogame
+		// only support headless mode if hostlaunch is --skirmish, --replay or --autogame
 		return bHeadlessAutoGameModeCLIOption;
 	}
 	return false;
@@ -167,7 +167,7 @@ TITLECODE titleLoop()
 		// then check --join and if neither, run the normal game menu.
 		if (hostlaunch != HostLaunch::Normal)
 		{
-			if (hostlaunch == HostLaunch::Skirmish)
+			if (hostlaunch == HostLaunch::Skirmish || hostlaunch == HostLaunch::Replay)
 			{
 				SPinit(LEVEL_TYPE::SKIRMISH);
 			}
@@ -41,6 +41,7 @@ enum class HostLaunch
 	Host,
 	Skirmish,
 	Autohost,
+	Replay,
 };
 
 void setHostLaunch(HostLaunch value);
@@ -37,6 +37,17 @@ function skirmish
 	#run "--autogame --loadskirmish=$1" "$1 : Loading and running"
 }
 
+function vischeck
+{
+	echo
+	echo " ==== $1 : $2 ===="
+	# Fails if the parallel vision pass ever gives different results than a serial one.
+	if ! src/warzone2100 --configdir=tmp --skirmish=$1.json --headless --autogame --simbench=$3 --vischeck; then
+		echo " * Vision pass check failed!"
+		exit 1
+	fi
+}
+
 echo
 echo "Running Warzone2100 automated tests"
 echo -n "Time is: "
@@ -51,3 +62,6 @@ cam FASTPLAY "Fastplay"
 skirmish highground "Basic skirmish"
 skirmish miza "All AIs"
 skirmish miza_challenge "Best AI vs 7 old timers"
+
+vischeck highground "Parallel vision pass" 6000
+vischeck miza "Parallel vision pass, all AIs" 6000